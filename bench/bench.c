@@ -0,0 +1,325 @@
+/**
+ * Host benchmark for the DC solve.
+ * Generates parameterized circuits, times `circuit_calc_voltages` on them with each solver
+ * and prints one CSV row per run so results can be diffed against a baseline.
+ * The phase split comes from the solver's own CIRCUIT_STATS laps and the bistack peak
+ * from MEM_STATS, both compiled in here, so the path timed is the one callers get.
+ * The `dense` rows time the dense LU kernels on their own next to `gaussian_rref`, the reference they replaced.
+ *
+ *   bench [generator-filter] [max-scale] [arena-MiB]
+ *
+ * Not part of the calculator build: `make bench` compiles it with the host compiler.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#define CIRCUIT_STATS
+#define MEM_STATS
+#include "node.h"
+
+
+enum {
+	BENCH_REPEATS          = 3,    /// each run reports its fastest solve out of these.
+	BENCH_DENSE_MAX        = 1500, /// largest system also timed on the dense path.
+	BENCH_DENSE_KERNEL_MAX = 512,  /// the dense kernel rows double up to this size.
+};
+
+static uint64_t bench_ns(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return ( uint64_t )(t.tv_sec) * 1000000000u + ( uint64_t )(t.tv_nsec);
+}
+
+/// xorshift so every generator is reproducible without touching libc's rand state.
+static uint32_t bench_rand(uint64_t *const state) {
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return ( uint32_t )(x >> 32);
+}
+
+static rat_t bench_ohms(uint64_t *const state) {
+	return rat_from_int(100 + ( int )(bench_rand(state) % 9900));
+}
+
+
+/// series chain of `n` resistors with a shunt to ground at every node, driven from one end.
+static void gen_ladder(struct Circuit *const c, uint32_t const n, uint64_t *const rng) {
+	circuit_add_component(c, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_from_int(5));
+	for( uint32_t i=1; i < n; i++ ) {
+		circuit_add_component(c, i, i + 1, COMP_RESISTOR, bench_ohms(rng));
+		circuit_add_component(c, i + 1, GND_IDX, COMP_RESISTOR, rat_from_int(100000));
+	}
+}
+
+/// `w x w` resistor mesh with a source in one corner and a load in the other.
+static void gen_mesh2d(struct Circuit *const c, uint32_t const w, uint64_t *const rng) {
+	for( uint32_t y=0; y < w; y++ ) {
+		for( uint32_t x=0; x < w; x++ ) {
+			uint32_t const id = 1 + y*w + x;
+			if( x + 1 < w ) {
+				circuit_add_component(c, id, id + 1, COMP_RESISTOR, bench_ohms(rng));
+			}
+			if( y + 1 < w ) {
+				circuit_add_component(c, id, id + w, COMP_RESISTOR, bench_ohms(rng));
+			}
+		}
+	}
+	circuit_add_component(c, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_from_int(5));
+	circuit_add_component(c, w*w, GND_IDX, COMP_RESISTOR, rat_from_int(1000));
+}
+
+static void gen_mesh3d(struct Circuit *const c, uint32_t const w, uint64_t *const rng) {
+	for( uint32_t z=0; z < w; z++ ) {
+		for( uint32_t y=0; y < w; y++ ) {
+			for( uint32_t x=0; x < w; x++ ) {
+				uint32_t const id = 1 + (z*w + y)*w + x;
+				if( x + 1 < w ) {
+					circuit_add_component(c, id, id + 1, COMP_RESISTOR, bench_ohms(rng));
+				}
+				if( y + 1 < w ) {
+					circuit_add_component(c, id, id + w, COMP_RESISTOR, bench_ohms(rng));
+				}
+				if( z + 1 < w ) {
+					circuit_add_component(c, id, id + w*w, COMP_RESISTOR, bench_ohms(rng));
+				}
+			}
+		}
+	}
+	circuit_add_component(c, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_from_int(5));
+	circuit_add_component(c, w*w*w, GND_IDX, COMP_RESISTOR, rat_from_int(1000));
+}
+
+/// random spanning tree plus `n/2` random chords, roughly average degree 3.
+/// No locality at all, so this is the worst case for fill.
+static void gen_random(struct Circuit *const c, uint32_t const n, uint64_t *const rng) {
+	for( uint32_t i=2; i <= n; i++ ) {
+		circuit_add_component(c, 1 + bench_rand(rng) % (i - 1), i, COMP_RESISTOR, bench_ohms(rng));
+	}
+	for( uint32_t k=0; k < n/2; k++ ) {
+		uint32_t const a = 1 + bench_rand(rng) % n, b = 1 + bench_rand(rng) % n;
+		if( a != b ) {
+			circuit_add_component(c, a, b, COMP_RESISTOR, bench_ohms(rng));
+		}
+	}
+	circuit_add_component(c, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_from_int(5));
+	circuit_add_component(c, n, GND_IDX, COMP_RESISTOR, rat_from_int(1000));
+}
+
+/// random tree of resistors with a capacitor from every node to ground (open at DC, but stamped).
+static void gen_rctree(struct Circuit *const c, uint32_t const n, uint64_t *const rng) {
+	circuit_add_component(c, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_from_int(5));
+	for( uint32_t i=2; i <= n; i++ ) {
+		uint32_t const parent = ( i > 8 )? i - 1 - bench_rand(rng) % 8 : 1;
+		circuit_add_component(c, parent, i, COMP_RESISTOR, bench_ohms(rng));
+		circuit_add_component(c, i, GND_IDX, COMP_CAPACITOR, rat_div(rat_pos1(), rat_from_int(1000000)));
+	}
+	circuit_add_component(c, n, GND_IDX, COMP_RESISTOR, rat_from_int(1000));
+}
+
+/// ladder where every node has a current source and every 4th a voltage source through a resistor,
+/// so about a fifth of the unknowns are branch currents.
+static void gen_sources(struct Circuit *const c, uint32_t const n, uint64_t *const rng) {
+	for( uint32_t i=1; i < n; i++ ) {
+		circuit_add_component(c, i, i + 1, COMP_RESISTOR, bench_ohms(rng));
+	}
+	for( uint32_t i=1; i <= n; i++ ) {
+		circuit_add_component(c, GND_IDX, i, COMP_DC_CURRENT_SRC, rat_div(rat_from_int(1 + ( int )(i % 7)), rat_from_int(1000)));
+		circuit_add_component(c, i, GND_IDX, COMP_RESISTOR, rat_from_int(10000));
+		if( i % 4==0 ) {
+			uint32_t const tap = n + i/4;
+			circuit_add_component(c, GND_IDX, tap, COMP_VOLTAGE_SRC, rat_from_int(( int )(i % 5)));
+			circuit_add_component(c, tap, i, COMP_RESISTOR, bench_ohms(rng));
+		}
+	}
+}
+
+struct BenchGen {
+	char const *name;
+	void      (*build)(struct Circuit *c, uint32_t size, uint64_t *rng);
+	uint32_t    first, last; /// sizes double from `first` while at most `last * scale` (`last` alone for meshes).
+	bool        cube_root, square_root; /// size is an edge length, node counts grow as its cube/square.
+};
+
+static struct BenchGen const bench_gens[] = {
+	{ "ladder",  gen_ladder,  1000, 256000, false, false },
+	{ "mesh2d",  gen_mesh2d,  16,   192,    false, true  },
+	{ "mesh3d",  gen_mesh3d,  6,    22,     true,  false },
+	{ "random",  gen_random,  1000, 16000,  false, false },
+	{ "rctree",  gen_rctree,  1000, 256000, false, false },
+	{ "sources", gen_sources, 1000, 128000, false, false },
+};
+
+static uint64_t bench_min(uint64_t const a, uint64_t const b) {
+	return ( a < b )? a : b;
+}
+
+/// One DC solve, best of BENCH_REPEATS: the wall time of `circuit_calc_voltages` and
+/// the per-phase split its CIRCUIT_STATS instrumentation recorded in that same call.
+struct BenchRun {
+	uint64_t total;
+	uint64_t phase[MAX_CIRCUIT_PHASES];
+	size_t   front_peak, back_used; /// bistack high-water mark over the whole solve, from MEM_STATS.
+	uint32_t unknowns, nnz, lu_nnz;
+	int      res;
+};
+
+/// times the public entry point with `solver` picked, everything it allocates is scratch.
+static struct BenchRun bench_solve(struct Circuit *const c, uint8_t const solver) {
+	struct BenchRun run = { .total = UINT64_MAX, .res = ERR_OK };
+	struct TIBiStack *const s = &c->bistack;
+	struct CircuitStats st;
+	struct TIMemStats mst;
+	c->solver = solver;
+	for( int rep=0; rep < BENCH_REPEATS && run.res==ERR_OK; rep++ ) {
+		circuit_attach_stats(c, &st);
+		bistack_attach_stats(s, &mst);
+		uint64_t const t = bench_ns();
+		run.res = circuit_calc_voltages(c);
+		uint64_t const total = bench_ns() - t;
+		bistack_attach_stats(s, NULL);
+		circuit_attach_stats(c, NULL);
+		if( total < run.total ) {
+			run.total = total;
+			memcpy(run.phase, st.phase_ns, sizeof run.phase);
+		}
+		run.front_peak = ( mst.front_peak > run.front_peak )? mst.front_peak : run.front_peak;
+		run.unknowns = st.n;
+		run.nnz      = st.a_nnz;
+		run.lu_nnz   = st.lu_nnz;
+	}
+	run.back_used = s->len - s->back;
+	return run;
+}
+
+static void bench_report(char const *const gen, uint32_t const size, struct Circuit const *const c, char const *const solver, struct BenchRun const *const r) {
+	uint32_t const nodes = c->active_count;
+	if( r->res != ERR_OK ) {
+		printf("%s,%" PRIu32 ",%" PRIu32 ",%s,%s,,,,,,,,,,,,\n", gen, size, nodes, solver, ( r->res==ERR_OOM )? "oom" : "singular");
+		return;
+	}
+	printf("%s,%" PRIu32 ",%" PRIu32 ",%s,ok,%" PRIu32 ",%" PRIu32 ",%" PRIu32, gen, size, nodes, solver, r->unknowns, r->nnz, r->lu_nnz);
+	for( int p=0; p < MAX_CIRCUIT_PHASES; p++ ) {
+		printf(",%" PRIu64, r->phase[p]);
+	}
+	printf(",%" PRIu64 ",%.1f,%zu,%zu\n", r->total, ( double )(r->total) / ( double )(nodes ? nodes : 1), r->front_peak, r->back_used);
+	fflush(stdout);
+}
+
+/// conductance-like `n x n` system, diagonally dominant with random couplings, row-major.
+static void bench_dense_system(size_t const n, uint64_t *const rng, rat_t A[const], rat_t b[const]) {
+	for( size_t i=0; i < n; i++ ) {
+		rat_t diag = rat_pos1();
+		for( size_t j=0; j < n; j++ ) {
+			if( i != j ) {
+				A[idx1D(i, j, n)] = rat_neg(rat_recip(bench_ohms(rng)));
+				diag = rat_sub(diag, A[idx1D(i, j, n)]);
+			}
+		}
+		A[idx1D(i, i, n)] = diag;
+		b[i] = rat_from_int(( int )(bench_rand(rng) % 11) - 5);
+	}
+}
+
+/// The dense kernels on their own, against `gaussian_rref` as the reference:
+/// one row per size and routine, factor and solve times being the best of BENCH_REPEATS.
+static void bench_dense_kernels(uint8_t mem[const], size_t const bytes) {
+	struct DenseKernels const kinds[] = { dense_kernels_for(DENSE_KERNEL_SCALAR), dense_kernels() };
+	char const *const names[] = { "lu_scalar", "lu_dispatch" };
+	for( size_t n = 8; n <= BENCH_DENSE_KERNEL_MAX; n *= 2 ) {
+		struct TIBiStack s = bistack_make(mem, bytes);
+		rat_t    *A0  = bistack_alloc_front_vec(&s, n*n, sizeof *A0);
+		rat_t    *b0  = bistack_alloc_front_vec(&s, n, sizeof *b0);
+		rat_t    *A   = bistack_alloc_front_vec(&s, n*n, sizeof *A);
+		rat_t    *x   = bistack_alloc_front_vec(&s, n, sizeof *x);
+		uint32_t *piv = bistack_alloc_front_vec(&s, n, sizeof *piv);
+		if( A0==NULL || b0==NULL || A==NULL || x==NULL || piv==NULL ) {
+			printf("dense,%zu,%zu,rref,oom,,,,,,,,,,,,\n", n, n);
+			return;
+		}
+		uint64_t rng = UINT64_C(0x2545F4914F6CDD1D) ^ n;
+		bench_dense_system(n, &rng, A0, b0);
+		for( int k=-1; k < ( int )(sizeof kinds / sizeof *kinds); k++ ) {
+			uint64_t factor = UINT64_MAX, solve = UINT64_MAX;
+			bool ok = true;
+			for( int rep=0; rep < BENCH_REPEATS && ok; rep++ ) {
+				memcpy(x, b0, n * sizeof *x);
+				if( k < 0 ) {
+					memcpy(A, A0, n*n * sizeof *A);
+					uint64_t const t = bench_ns();
+					gaussian_rref(n, A, x);
+					factor = bench_min(factor, bench_ns() - t);
+					solve = 0;
+					continue;
+				}
+				/// the LU works column-major.
+				for( size_t i=0; i < n; i++ ) {
+					for( size_t j=0; j < n; j++ ) {
+						A[i + j*n] = A0[idx1D(i, j, n)];
+					}
+				}
+				uint64_t t = bench_ns();
+				ok = dense_lu_factor(&kinds[k], n, A, piv);
+				factor = bench_min(factor, bench_ns() - t);
+				t = bench_ns();
+				dense_lu_solve(&kinds[k], n, A, piv, x);
+				solve = bench_min(solve, bench_ns() - t);
+			}
+			char const *const name = ( k < 0 )? "rref" : names[k];
+			if( !ok ) {
+				printf("dense,%zu,%zu,%s,singular,,,,,,,,,,,,\n", n, n, name);
+				continue;
+			}
+			printf("dense,%zu,%zu,%s,ok,%zu,%zu,%zu,0,0,0,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.1f,%zu,0\n",
+				n, n, name, n, n*n, n*n, factor, solve, factor + solve, ( double )(factor + solve) / ( double )(n), s.front);
+		}
+		fflush(stdout);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	char const *const filter = ( argc > 1 )? argv[1] : "";
+	uint32_t const scale = ( argc > 2 )? ( uint32_t )(strtoul(argv[2], NULL, 10)) : 1;
+	size_t const mib = ( argc > 3 )? ( size_t )(strtoul(argv[3], NULL, 10)) : 1024;
+	uint8_t *const mem = malloc(mib << 20);
+	if( mem==NULL ) {
+		fprintf(stderr, "can't allocate a %zu MiB arena\n", mib);
+		return 1;
+	}
+	puts("generator,size,nodes,solver,status,unknowns,nnz,lu_nnz,compile_ns,assemble_ns,order_ns,factor_ns,solve_ns,total_ns,ns_per_node,front_peak_bytes,back_used_bytes");
+	if( strstr("dense", filter) != NULL ) {
+		bench_dense_kernels(mem, mib << 20);
+	}
+	for( size_t g=0; g < sizeof bench_gens / sizeof bench_gens[0]; g++ ) {
+		struct BenchGen const *const gen = &bench_gens[g];
+		if( strstr(gen->name, filter)==NULL ) {
+			continue;
+		}
+		/// edge lengths grow by ~sqrt(2) / cbrt(2) so node counts still double per step.
+		for( uint32_t size = gen->first; size <= gen->last * (( gen->cube_root || gen->square_root )? 1 : scale); ) {
+			uint64_t rng = UINT64_C(0x2545F4914F6CDD1D) ^ size;
+			struct Circuit c = circuit_make(mem, mib << 20);
+			c.storage = STORE_EDGES;
+			gen->build(&c, size, &rng);
+			struct BenchRun const automatic = bench_solve(&c, SOLVER_AUTO);
+			bench_report(gen->name, size, &c, "auto", &automatic);
+			struct BenchRun const sparse = bench_solve(&c, SOLVER_SPARSE);
+			bench_report(gen->name, size, &c, "sparse", &sparse);
+			if( sparse.unknowns <= BENCH_DENSE_MAX ) {
+				struct BenchRun const dense = bench_solve(&c, SOLVER_DENSE);
+				bench_report(gen->name, size, &c, "dense", &dense);
+			}
+			if( gen->cube_root ) {
+				size = ( size * 5 + 3 ) / 4;
+			} else if( gen->square_root ) {
+				size = ( size * 17 + 11 ) / 12;
+			} else {
+				size *= 2;
+			}
+		}
+	}
+	free(mem);
+}
@@ -0,0 +1,430 @@
+#ifndef AC_H_INCLUDED
+#	define AC_H_INCLUDED
+
+#include "domain.h"
+#include "newton.h"
+#include "crat.h"
+
+#define AC_EXPORT    static inline
+
+enum {
+	AC_LIN = 0, /// `points` total, evenly spaced.
+	AC_DEC,     /// `points` per decade.
+	AC_OCT,     /// `points` per octave.
+};
+
+enum {
+	AC_MAX_CHUNKS = 256,
+};
+
+/// A `.ac` small-signal sweep.
+/// Only the source of `in_kind` running from `in_n1` to `in_n2` is driven, at `in_mag`, and every
+/// other source is zeroed as in SPICE, DC levels don't reach the small-signal response.
+/// `in_n1 == NODE_NONE` drives nothing and every phasor comes out 0.
+struct AcOptions {
+	rat_t    fstart, fstop, in_mag;
+	struct NewtonOptions const *newton; /// operating point of circuits with diodes, NULL for the defaults.
+	uint32_t points;
+	uint32_t workers;  /// 0 uses every online core.
+	uint32_t in_n1, in_n2;
+	uint8_t  sweep;    /// AC_*
+	uint8_t  in_kind;  /// COMP_VOLTAGE_SRC or COMP_DC_CURRENT_SRC
+};
+
+struct AcResult {
+	uint32_t points, failed; /// failed points hit a singular matrix and are left at 0 V.
+	uint32_t workers;
+};
+
+AC_EXPORT struct AcOptions ac_options(uint8_t const sweep, uint32_t const points, rat_t const fstart, rat_t const fstop) {
+	return (struct AcOptions){
+		.fstart  = fstart,
+		.fstop   = fstop,
+		.in_mag  = rat_pos1(),
+		.newton  = NULL,
+		.points  = points,
+		.workers = 0,
+		.in_n1   = NODE_NONE,
+		.in_n2   = NODE_NONE,
+		.sweep   = sweep,
+		.in_kind = COMP_VOLTAGE_SRC,
+	};
+}
+
+/// frequency of point `i`.
+AC_EXPORT NO_NULLS rat_t ac_frequency(struct AcOptions const *const opt, uint32_t const i) {
+	if( opt->sweep==AC_LIN ) {
+		if( opt->points < 2 ) {
+			return opt->fstart;
+		}
+		rat_t const step = rat_div(rat_sub(opt->fstop, opt->fstart), rat_from_int(opt->points - 1));
+		return rat_add(opt->fstart, rat_mul(step, rat_from_int(i)));
+	}
+	rat_t const base = rat_from_int(( opt->sweep==AC_DEC )? 10 : 2);
+	return rat_mul(opt->fstart, rat_pow(base, rat_div(rat_from_int(i), rat_from_int(opt->points))));
+}
+
+/// Number of frequencies the sweep visits, 0 when the range makes no sense.
+/// Log sweeps step until they pass `fstop` (with a little slack for rounding),
+/// counted rather than computed since there's no portable `rat_t` to int.
+AC_EXPORT NO_NULLS uint32_t ac_point_count(struct AcOptions const *const opt) {
+	if( opt->points==0 || rat_lt(opt->fstop, opt->fstart) || rat_lt(opt->fstart, rat_zero()) ) {
+		return 0;
+	} else if( opt->sweep==AC_LIN ) {
+		return opt->points;
+	} else if( !rat_lt(rat_zero(), opt->fstart) ) {
+		return 0;
+	}
+	rat_t const limit = rat_mul(opt->fstop, rat_add(rat_pos1(), rat_recip(rat_from_int(1000000))));
+	uint32_t count = 1;
+	while( count < UINT32_MAX && !rat_lt(limit, ac_frequency(opt, count)) ) {
+		count++;
+	}
+	return count;
+}
+
+/// Complex assembly at angular frequency `omega`, the AC twin of `stamp_program_assemble`:
+/// resistors publish `1/R`, capacitors `jwC`, inductors `jwL`, sources their value in `raw`.
+AC_EXPORT NO_NULLS void _ac_assemble(
+	struct StampProgram const *const          prog,
+	rat_t               const                 raw[const restrict],
+	rat_t               const                 omega,
+	crat_t                                    vals[const restrict],
+	crat_t                                    Y[const restrict],
+	crat_t                                    rhs[const restrict]
+) {
+	for( uint32_t e=0; e < prog->r_end; e++ ) {
+		rat_t const g = rat_recip(raw[e]);
+		vals[2*e]     = crat_from_rat(g);
+		vals[2*e + 1] = crat_from_rat(rat_neg(g));
+	}
+	for( uint32_t e = prog->r_end; e < prog->c_end; e++ ) {
+		rat_t const b = rat_mul(omega, raw[e]);
+		vals[2*e]     = crat_imag(b);
+		vals[2*e + 1] = crat_imag(rat_neg(b));
+	}
+	for( uint32_t e = prog->c_end; e < prog->v_end; e++ ) {
+		vals[2*e]     = crat_from_rat(raw[e]);
+		vals[2*e + 1] = crat_from_rat(rat_neg(raw[e]));
+	}
+	for( uint32_t e = prog->v_end; e < prog->l_end; e++ ) {
+		rat_t const x = rat_mul(omega, raw[e]);
+		vals[2*e]     = crat_imag(x);
+		vals[2*e + 1] = crat_imag(rat_neg(x));
+	}
+	for( uint32_t k=0; k < prog->G.nnz; k++ ) {
+		Y[k] = crat_from_rat(prog->base[k]);
+	}
+	for( uint32_t k=0; k < prog->g_count; k++ ) {
+		Y[prog->g_ops[k].offs] = crat_add(Y[prog->g_ops[k].offs], vals[prog->g_ops[k].val]);
+	}
+	for( uint32_t i=0; i < prog->n; i++ ) {
+		rhs[i] = crat_zero();
+	}
+	for( uint32_t k=0; k < prog->rhs_count; k++ ) {
+		rhs[prog->rhs_ops[k].offs] = crat_add(rhs[prog->rhs_ops[k].offs], vals[prog->rhs_ops[k].val]);
+	}
+}
+
+/// Real stand-in for `Y` used to pick pivots: `re + im` entrywise, which is the
+/// transient matrix with `alpha = omega` and so keeps the MNA sign structure intact.
+AC_EXPORT NO_NULLS void _ac_surrogate(uint32_t const nnz, crat_t const Y[const restrict], rat_t G[const restrict]) {
+	for( uint32_t k=0; k < nnz; k++ ) {
+		G[k] = rat_add(Y[k].re, Y[k].im);
+	}
+}
+
+/// `splu_refactor` over complex values: the pattern, pivots and column order come from `lu`,
+/// the values go to `Lv` and `Uv` (laid out like `lu->L.vals` and `lu->U.vals`).
+/// Pivots are compared by `|re| + |im|`. `x` must hold `n` values.
+AC_EXPORT NO_NULLS int _ac_refactor(
+	struct SpLU   const *const lu,
+	struct SpMat  const *const A,
+	crat_t        const        Av[const restrict],
+	rat_t         const        tol,
+	crat_t                     Lv[const restrict],
+	crat_t                     Uv[const restrict],
+	crat_t                     x[const restrict]
+) {
+	uint32_t const n = lu->n;
+	for( uint32_t k=0; k < n; k++ ) {
+		uint32_t const ustart = lu->U.colptr[k], diag = lu->U.colptr[k + 1] - 1;
+		uint32_t const lstart = lu->L.colptr[k], lend = lu->L.colptr[k + 1];
+		for( uint32_t p = ustart; p <= diag; p++ ) {
+			x[lu->U.rowidx[p]] = crat_zero();
+		}
+		for( uint32_t p = lstart; p < lend; p++ ) {
+			x[lu->L.rowidx[p]] = crat_zero();
+		}
+		uint32_t const col = lu->q[k];
+		for( uint32_t p = A->colptr[col]; p < A->colptr[col + 1]; p++ ) {
+			x[lu->pinv[A->rowidx[p]]] = Av[p];
+		}
+		for( uint32_t p = ustart; p < diag; p++ ) {
+			uint32_t const J = lu->U.rowidx[p];
+			crat_t const xj = x[J];
+			Uv[p] = xj;
+			for( uint32_t pl = lu->L.colptr[J] + 1; pl < lu->L.colptr[J + 1]; pl++ ) {
+				x[lu->L.rowidx[pl]] = crat_sub(x[lu->L.rowidx[pl]], crat_mul(Lv[pl], xj));
+			}
+		}
+		crat_t const pivot = x[k];
+		rat_t big = crat_abs1(pivot);
+		for( uint32_t p = lstart + 1; p < lend; p++ ) {
+			big = rat_max(big, crat_abs1(x[lu->L.rowidx[p]]));
+		}
+		if( !rat_lt(rat_zero(), big) || !rat_lt(rat_zero(), crat_abs1(pivot)) || rat_lt(crat_abs1(pivot), rat_mul(big, tol)) ) {
+			return SPARSE_ERR_SINGULAR;
+		}
+		Uv[diag] = pivot;
+		Lv[lstart] = crat_pos1();
+		crat_t const inv = crat_recip(pivot);
+		for( uint32_t p = lstart + 1; p < lend; p++ ) {
+			Lv[p] = crat_mul(x[lu->L.rowidx[p]], inv);
+		}
+	}
+	return SPARSE_OK;
+}
+
+/// `splu_solve` over complex values, `b` is solved in place and `work` must hold `n` values.
+AC_EXPORT NO_NULLS void _ac_solve(struct SpLU const *const lu, crat_t const Lv[const], crat_t const Uv[const], crat_t b[const restrict], crat_t work[const restrict]) {
+	uint32_t const n = lu->n;
+	for( uint32_t i=0; i < n; i++ ) {
+		work[lu->pinv[i]] = b[i];
+	}
+	for( uint32_t j=0; j < n; j++ ) {
+		crat_t const xj = work[j];
+		for( uint32_t p = lu->L.colptr[j] + 1; p < lu->L.colptr[j + 1]; p++ ) {
+			work[lu->L.rowidx[p]] = crat_sub(work[lu->L.rowidx[p]], crat_mul(Lv[p], xj));
+		}
+	}
+	for( uint32_t j = n-1; j < n; j-- ) {
+		uint32_t const diag = lu->U.colptr[j + 1] - 1;
+		work[j] = crat_div(work[j], Uv[diag]);
+		crat_t const xj = work[j];
+		for( uint32_t p = lu->U.colptr[j]; p < diag; p++ ) {
+			work[lu->U.rowidx[p]] = crat_sub(work[lu->U.rowidx[p]], crat_mul(Uv[p], xj));
+		}
+	}
+	for( uint32_t k=0; k < n; k++ ) {
+		b[lu->q[k]] = work[k];
+	}
+}
+
+/// Read-only state every worker shares, plus the chunk counter.
+struct _AcShared {
+	struct StampProgram const *prog;
+	struct AcOptions    const *opt;
+	struct SpLU                lu;      /// symbolic factors, workers only read the pattern and pivots.
+	rat_t               const *raw;     /// element values with the sources set to their AC drive.
+	crat_t                    *volts;   /// `points * node_count`
+	rat_t                     *freqs;
+	uint32_t                   points, chunk_size, chunk_count;
+#ifdef DOMAIN_THREADS
+	atomic_uint                next_chunk;
+#else
+	uint32_t                   next_chunk;
+#endif
+};
+
+struct _AcWorker {
+	struct DomainPoolWorker base;
+	struct _AcShared       *shared;
+};
+
+AC_EXPORT NO_NULLS uint32_t _ac_claim_chunk(struct _AcShared *const sh) {
+#ifdef DOMAIN_THREADS
+	return atomic_fetch_add_explicit(&sh->next_chunk, 1, memory_order_relaxed);
+#else
+	return sh->next_chunk++;
+#endif
+}
+
+/// Pivots chosen at this frequency, for when the shared ones go bad there:
+/// factors the real surrogate in the front of the worker's arena, then refactors the complex
+/// values through that pattern, accepting any nonzero pivot as a last resort.
+AC_EXPORT NO_NULLS bool _ac_fresh_solve(struct _AcWorker *const w, struct SpMat const *const pattern, crat_t const Y[const], crat_t x[const], crat_t work[const]) {
+	struct TIBiStack *const s = &w->base.arena;
+	struct SpMat G = *pattern;
+	struct SpLU fresh;
+	bool solved = false;
+	G.vals = sparse_alloc_vals(s, G.nnz);
+	if( G.vals==NULL ) {
+		goto done;
+	}
+	_ac_surrogate(G.nnz, Y, G.vals);
+	if( splu_factor(s, &G, w->shared->lu.q, sparse_pivot_tol(), &fresh) != SPARSE_OK ) {
+		goto done;
+	}
+	crat_t *Lv = bistack_alloc_front_vec(s, fresh.L.nnz, sizeof *Lv);
+	crat_t *Uv = bistack_alloc_front_vec(s, fresh.U.nnz, sizeof *Uv);
+	if( Lv==NULL || Uv==NULL ) {
+		goto done;
+	}
+	if( _ac_refactor(&fresh, pattern, Y, sparse_pivot_tol(), Lv, Uv, work) != SPARSE_OK
+	 && _ac_refactor(&fresh, pattern, Y, rat_zero(), Lv, Uv, work) != SPARSE_OK ) {
+		goto done;
+	}
+	_ac_solve(&fresh, Lv, Uv, x, work);
+	solved = true;
+done:
+	bistack_reset_front(s);
+	return solved;
+}
+
+/// Runs claimed chunks until none are left, buffers on the back of the worker's own arena.
+/// Every point refactors from the shared pivots, so its result doesn't depend on
+/// which points this worker happened to run before.
+AC_EXPORT NO_NULLS void *_ac_run_worker(void *const arg) {
+	struct _AcWorker          *const w    = arg;
+	struct _AcShared    const *const sh   = w->shared;
+	struct StampProgram const *const prog = sh->prog;
+	struct TIBiStack          *const s    = &w->base.arena;
+	uint32_t const n = prog->n, rows = prog->node_rows, nodes = prog->node_count;
+
+	crat_t *vals = bistack_alloc_back_vec(s, 2 * prog->elem_count, sizeof *vals);
+	crat_t *Y    = bistack_alloc_back_vec(s, prog->G.nnz, sizeof *Y);
+	crat_t *x    = bistack_alloc_back_vec(s, n, sizeof *x);
+	crat_t *work = bistack_alloc_back_vec(s, n, sizeof *work);
+	crat_t *Lv   = bistack_alloc_back_vec(s, sh->lu.L.nnz, sizeof *Lv);
+	crat_t *Uv   = bistack_alloc_back_vec(s, sh->lu.U.nnz, sizeof *Uv);
+	if( vals==NULL || Y==NULL || x==NULL || work==NULL || Lv==NULL || Uv==NULL ) {
+		return NULL;
+	}
+	w->base.ok = true;
+
+	rat_t const two_pi = rat_mul(rat_from_int(2), rat_pi());
+	for( uint32_t chunk = _ac_claim_chunk(w->shared); chunk < sh->chunk_count; chunk = _ac_claim_chunk(w->shared) ) {
+		uint32_t const first = chunk * sh->chunk_size;
+		uint32_t const last  = ( sh->points - first < sh->chunk_size )? sh->points : first + sh->chunk_size;
+		for( uint32_t pt = first; pt < last; pt++ ) {
+			rat_t const f = ac_frequency(sh->opt, pt);
+			crat_t *const out = &sh->volts[( size_t )(pt) * nodes];
+			if( sh->freqs != NULL ) {
+				sh->freqs[pt] = f;
+			}
+			for( uint32_t i=0; i < nodes; i++ ) {
+				out[i] = crat_zero();
+			}
+			_ac_assemble(prog, sh->raw, rat_mul(two_pi, f), vals, Y, x);
+			if( _ac_refactor(&sh->lu, &prog->G, Y, sparse_pivot_tol(), Lv, Uv, work)==SPARSE_OK ) {
+				_ac_solve(&sh->lu, Lv, Uv, x, work);
+			} else if( !_ac_fresh_solve(w, &prog->G, Y, x, work) ) {
+				w->base.failed++;
+				continue;
+			}
+			for( uint32_t i=0; i < rows; i++ ) {
+				out[prog->matrix_to_node[i]] = x[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+/// AC small-signal sweep.
+/// The stamp pattern is the same at every frequency, so it's compiled, ordered and factored
+/// symbolically once (pivots picked on the real surrogate at the middle of the sweep)
+/// and each point only runs a complex numeric refactor and solve. Points are split into
+/// chunks that workers claim off an atomic counter, each solving out of its own `TIBiStack`
+/// carved from the circuit's free space.
+/// `volts` gets `ac_point_count(opt) * node_count` phasors, point `i`'s node `k` at `idx1D(i, k, node_count)`,
+/// `freqs` (nullable) the frequency of each point.
+/// Diodes are linearized at the DC operating point, which is solved first with `opt->newton`
+/// and left in `c->voltage`: each junction is its small-signal conductance `gd` there.
+AC_EXPORT EXTANT(1, 2, 3) int circuit_ac_sweep(
+	struct Circuit          *const c,
+	struct AcOptions  const *const opt,
+	crat_t                         volts[const],
+	rat_t                          freqs[const],
+	struct AcResult                *const result
+) {
+	struct TIBiStack *const s = &c->bistack;
+	struct _AcShared sh = { .opt = opt, .volts = volts, .freqs = freqs, .points = ac_point_count(opt) };
+	struct NewtonOptions const defaults = newton_options();
+	struct NewtonOptions const *const nopt = ( opt->newton != NULL )? opt->newton : &defaults;
+	struct StampProgram prog;
+	int res = circuit_compile(c, &prog);
+	if( res==ERR_OK && prog.diode_count > 0 ) {
+		bistack_reset_front(s);
+		res = circuit_calc_voltages_newton(c, nopt, NULL);
+		if( res==ERR_OK ) {
+			res = circuit_compile(c, &prog);
+		}
+	}
+	if( res != ERR_OK ) {
+		goto done;
+	}
+	sh.prog = &prog;
+	res = ERR_OOM;
+	uint32_t const n = prog.n;
+
+	rat_t    *raw  = alloc_vec(s, prog.elem_count);
+	crat_t   *cval = bistack_alloc_front_vec(s, 2 * prog.elem_count, sizeof *cval);
+	crat_t   *Y    = bistack_alloc_front_vec(s, prog.G.nnz, sizeof *Y);
+	crat_t   *rhs  = bistack_alloc_front_vec(s, n, sizeof *rhs);
+	uint32_t *q    = sparse_alloc_ids(s, n);
+	rat_t    *base = ( prog.diode_count > 0 )? alloc_vec(s, prog.G.nnz) : prog.base;
+	if( raw==NULL || cval==NULL || Y==NULL || rhs==NULL || q==NULL || base==NULL ) {
+		goto done;
+	}
+	stamp_program_load(&prog, raw);
+	if( prog.diode_count > 0 ) {
+		/// the junctions go into the constant part of Y, which every worker copies in per point.
+		memcpy(base, prog.base, prog.G.nnz * sizeof *base);
+		for( uint32_t d=0; d < prog.diode_count; d++ ) {
+			rat_t const v = rat_sub(c->voltage[prog.diode_a[d]], c->voltage[prog.diode_b[d]]);
+			rat_t id, gd;
+			_newton_diode(v, *prog.diode_src[d], nopt->vt, nopt->gmin, &id, &gd);
+			uint32_t const *const slot = &prog.diode_slots[4*d];
+			for( int k=0; k < 4; k++ ) {
+				if( slot[k] != NODE_NONE ) {
+					base[slot[k]] = rat_add(base[slot[k]], ( k < 2 )? gd : rat_neg(gd));
+				}
+			}
+		}
+		prog.base = base;
+	}
+	for( uint32_t e = prog.c_end; e < prog.v_end; e++ ) {
+		bool const input = opt->in_n1 != NODE_NONE
+			&& prog.kind[e]==opt->in_kind && prog.node_a[e]==opt->in_n1 && prog.node_b[e]==opt->in_n2;
+		raw[e] = input? opt->in_mag : rat_zero();
+	}
+	sh.raw = raw;
+
+	rat_t const f_mid = ( opt->sweep==AC_LIN )?
+		rat_div(rat_add(opt->fstart, opt->fstop), rat_from_int(2)) :
+		rat_root(rat_mul(opt->fstart, opt->fstop), rat_from_int(2));
+	_ac_assemble(&prog, raw, rat_mul(rat_mul(rat_from_int(2), rat_pi()), f_mid), cval, Y, rhs);
+	_ac_surrogate(prog.G.nnz, Y, prog.G.vals);
+	circuit_order(c, &prog, q);
+	switch( splu_factor(s, &prog.G, q, sparse_pivot_tol(), &sh.lu) ) {
+		case SPARSE_ERR_OOM:      res = ERR_OOM;      goto done;
+		case SPARSE_ERR_SINGULAR: res = ERR_SINGULAR; goto done;
+	}
+
+	sh.chunk_size  = ( sh.points + AC_MAX_CHUNKS - 1 ) / AC_MAX_CHUNKS;
+	sh.chunk_size  = ( sh.chunk_size > 0 )? sh.chunk_size : 1;
+	sh.chunk_count = ( sh.points + sh.chunk_size - 1 ) / sh.chunk_size;
+
+	uint32_t const workers = domain_pool_size(opt->workers, sh.chunk_count);
+	struct _AcWorker *pool = bistack_alloc_front_vec(s, workers, sizeof *pool);
+	if( pool==NULL || !domain_pool_carve(s, pool, sizeof *pool, workers) ) {
+		goto done;
+	}
+	for( uint32_t w=0; w < workers; w++ ) {
+		pool[w].shared = &sh;
+	}
+	domain_pool_run(pool, sizeof *pool, workers, _ac_run_worker);
+	uint32_t failed;
+	if( !domain_pool_collect(pool, sizeof *pool, workers, &failed) && sh.chunk_count > 0 ) {
+		goto done;
+	}
+	if( result != NULL ) {
+		*result = (struct AcResult){ .points = sh.points, .failed = failed, .workers = workers };
+	}
+	res = ERR_OK;
+done:
+	bistack_reset_front(s);
+	return res;
+}
+#endif
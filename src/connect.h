@@ -0,0 +1,218 @@
+#ifndef CONNECT_H_INCLUDED
+#	define CONNECT_H_INCLUDED
+
+#include "domain.h"
+
+#define CONNECT_EXPORT    static inline
+
+/// Disjoint sets over `0 .. n-1`, union by rank with path halving.
+struct UnionFind {
+	uint32_t *parent;
+	uint8_t  *rank;
+	uint32_t  n;
+};
+
+CONNECT_EXPORT NO_NULLS bool union_find_make(struct TIBiStack *const s, uint32_t const n, struct UnionFind *const uf) {
+	uf->n      = n;
+	uf->parent = sparse_alloc_ids(s, n);
+	uf->rank   = bistack_alloc_front_vec(s, n, sizeof *uf->rank);
+	if( uf->parent==NULL || uf->rank==NULL ) {
+		return false;
+	}
+	for( uint32_t i=0; i < n; i++ ) {
+		uf->parent[i] = i;
+	}
+	return true;
+}
+
+CONNECT_EXPORT NO_NULLS uint32_t union_find_root(struct UnionFind const *const uf, uint32_t i) {
+	while( uf->parent[i] != i ) {
+		uf->parent[i] = uf->parent[uf->parent[i]];
+		i = uf->parent[i];
+	}
+	return i;
+}
+
+/// joins the sets of `a` and `b`, false when they already were one.
+CONNECT_EXPORT NO_NULLS bool union_find_merge(struct UnionFind *const uf, uint32_t const a, uint32_t const b) {
+	uint32_t ra = union_find_root(uf, a), rb = union_find_root(uf, b);
+	if( ra==rb ) {
+		return false;
+	} else if( uf->rank[ra] < uf->rank[rb] ) {
+		uint32_t const t = ra;
+		ra = rb;
+		rb = t;
+	}
+	uf->parent[rb] = ra;
+	uf->rank[ra] += uf->rank[ra]==uf->rank[rb];
+	return true;
+}
+
+
+enum {
+	CONNECT_MAX_LOOPS = 8, /// source loops whose closing element gets recorded.
+};
+
+/// What stops the DC operating point from being solvable, found before any matrix is built.
+struct ConnectReport {
+	uint32_t floating;     /// active nodes with no DC path to ground.
+	uint32_t source_loops; /// loops made only of voltage sources, inductors and wires.
+	uint32_t loop_n1[CONNECT_MAX_LOOPS], loop_n2[CONNECT_MAX_LOOPS]; /// the element closing each of the first loops.
+	uint32_t subcircuits;  /// groups of nodes whose only DC connection is through ground.
+};
+
+/// whether an element carries DC current, the ones that don't leave their nodes floating.
+/// Diodes count, the Newton solve always has at least `gmin` across them.
+CONNECT_EXPORT bool connect_conducts(uint8_t const kind) {
+	return kind==COMP_RESISTOR || kind==COMP_VOLTAGE_SRC || kind==COMP_INDUCTOR || kind==COMP_WIRE || kind==COMP_DIODE;
+}
+
+/// whether an element pins its nodes' voltage difference at DC, a loop of these over-determines it.
+CONNECT_EXPORT bool connect_shorts(uint8_t const kind) {
+	return kind==COMP_VOLTAGE_SRC || kind==COMP_INDUCTOR || kind==COMP_WIRE;
+}
+
+/// one element's share of the three passes: DC paths, shorts, and DC coupling that doesn't go through ground.
+CONNECT_EXPORT NO_NULLS void _connect_element(struct UnionFind uf[const static 3], struct ConnectReport *const rep, uint8_t const kind, uint32_t const a, uint32_t const b) {
+	if( connect_conducts(kind) ) {
+		union_find_merge(&uf[0], a, b);
+	}
+	if( connect_shorts(kind) && !union_find_merge(&uf[1], a, b) ) {
+		if( rep->source_loops < CONNECT_MAX_LOOPS ) {
+			rep->loop_n1[rep->source_loops] = a;
+			rep->loop_n2[rep->source_loops] = b;
+		}
+		rep->source_loops++;
+	}
+	if( connect_conducts(kind) && a != GND_IDX && b != GND_IDX ) {
+		union_find_merge(&uf[2], a, b);
+	}
+}
+
+/// Union-find over the components: reports floating nodes and voltage source loops, and counts
+/// the independent subcircuits. The first `cap` floating nodes go into `floating` (nullable).
+/// Returns ERR_FLOATING or ERR_SOURCE_LOOP when the DC solve would be singular, ERR_OK otherwise.
+CONNECT_EXPORT EXTANT(1, 2) int circuit_check_connectivity(struct Circuit *const c, struct ConnectReport *const rep, uint32_t floating[const], uint32_t const cap) {
+	struct TIBiStack *const s = &c->bistack;
+	struct TIBiMark const mark = bistack_mark(s);
+	*rep = (struct ConnectReport){0};
+	int res = ERR_OOM;
+	struct UnionFind uf[3];
+	uint32_t const nodes = c->node_count;
+	if( !union_find_make(s, nodes, &uf[0]) || !union_find_make(s, nodes, &uf[1]) || !union_find_make(s, nodes, &uf[2]) ) {
+		goto done;
+	}
+	if( c->storage==STORE_EDGES ) {
+		for( uint32_t e=0; e < c->edges.len; e++ ) {
+			_connect_element(uf, rep, c->edges.kind[e], c->edges.node_a[e], c->edges.node_b[e]);
+		}
+	} else {
+		for( uint32_t node=0; node < nodes && node < c->node_cap; node++ ) {
+			for( struct Comp const *comp = c->comps[node]; comp != NULL; comp = comp->next ) {
+				if( !comp->mirrored ) {
+					_connect_element(uf, rep, comp->kind, comp->owner, comp->node);
+				}
+			}
+		}
+	}
+	uint32_t const ground = union_find_root(&uf[0], GND_IDX);
+	for( uint32_t node = GND_IDX + 1; node < nodes; node++ ) {
+		if( !circuit_node_active(c, node) ) {
+			continue;
+		}
+		if( union_find_root(&uf[0], node) != ground ) {
+			if( floating != NULL && rep->floating < cap ) {
+				floating[rep->floating] = node;
+			}
+			rep->floating++;
+		}
+		rep->subcircuits += union_find_root(&uf[2], node)==node;
+	}
+	res = ( rep->floating > 0 )? ERR_FLOATING : ( rep->source_loops > 0 )? ERR_SOURCE_LOOP : ERR_OK;
+done:
+	bistack_rewind(s, mark);
+	return res;
+}
+
+struct SplitResult {
+	uint32_t subcircuits, workers;
+	bool     direct; /// only one subcircuit, it went through `circuit_calc_voltages`.
+};
+
+/// Solves the DC node voltages one independent subcircuit at a time, side by side on `workers`
+/// threads (0 for every online core). The subcircuits are the connected pieces of the MNA matrix,
+/// found with union-find over its nonzeros so branch rows stay with their nodes, and each gets
+/// its own sparse LU, several small factorizations costing far less than one of their block diagonal.
+/// The connectivity check runs first, a floating node or source loop fails with its own error
+/// instead of a singular matrix, and circuits with diodes fail with ERR_NONLINEAR.
+CONNECT_EXPORT EXTANT(1) int circuit_calc_voltages_split(struct Circuit *const c, uint32_t const workers, struct SplitResult *const result) {
+	struct TIBiStack *const s = &c->bistack;
+	struct SplitResult info = { .subcircuits = 0, .workers = 1, .direct = true };
+	struct ConnectReport rep;
+	int res = circuit_check_connectivity(c, &rep, NULL, 0);
+	if( res != ERR_OK ) {
+		goto done;
+	}
+	info.subcircuits = rep.subcircuits;
+	if( rep.subcircuits < 2 ) {
+		res = circuit_calc_voltages(c);
+		goto done;
+	}
+	circuit_reset_voltages(c);
+	struct StampProgram prog;
+	res = circuit_compile(c, &prog);
+	if( res != ERR_OK ) {
+		goto done;
+	} else if( prog.diode_count > 0 ) {
+		res = ERR_NONLINEAR;
+		goto done;
+	}
+	uint32_t const n = prog.n;
+	struct UnionFind uf;
+	rat_t    *raw   = alloc_vec(s, prog.elem_count);
+	rat_t    *vals  = alloc_vec(s, 2 * prog.elem_count);
+	rat_t    *x     = alloc_vec(s, n);
+	uint32_t *part  = sparse_alloc_ids(s, n);
+	res = ERR_OOM;
+	if( raw==NULL || vals==NULL || x==NULL || part==NULL || !union_find_make(s, n, &uf) ) {
+		goto done;
+	}
+	stamp_program_load(&prog, raw);
+	stamp_program_assemble(&prog, raw, rat_zero(), vals, prog.G.vals, x);
+	/// explicit zeros (capacitors at DC) don't couple anything.
+	for( uint32_t j=0; j < n; j++ ) {
+		for( uint32_t p = prog.G.colptr[j]; p < prog.G.colptr[j + 1]; p++ ) {
+			if( rat_cmp(prog.G.vals[p], rat_zero()) != 0 ) {
+				union_find_merge(&uf, prog.G.rowidx[p], j);
+			}
+		}
+	}
+	uint32_t parts = 0;
+	for( uint32_t i=0; i < n; i++ ) {
+		part[i] = DOMAIN_INTERFACE;
+	}
+	for( uint32_t i=0; i < n; i++ ) {
+		uint32_t const root = union_find_root(&uf, i);
+		if( part[root]==DOMAIN_INTERFACE ) {
+			part[root] = parts++;
+		}
+		part[i] = part[root];
+	}
+	uint32_t const used = domain_workers(workers);
+	res = domain_solve(s, &prog.G, part, parts, 0, used, x);
+	if( res==ERR_OK ) {
+		stamp_program_store(&prog, c, x);
+		info = (struct SplitResult){ .subcircuits = parts, .workers = ( used > parts )? parts : used };
+	} else if( res==ERR_OOM ) {
+		/// the workers' arenas didn't fit, one solve over everything needs less.
+		bistack_reset_front(s);
+		res = circuit_calc_voltages(c);
+	}
+done:
+	bistack_reset_front(s);
+	if( result != NULL ) {
+		*result = info;
+	}
+	return res;
+}
+#endif
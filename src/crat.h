@@ -0,0 +1,93 @@
+#ifndef CRAT_H_INCLUDED
+#	define CRAT_H_INCLUDED
+
+#include "realtype.h"
+
+#define CRAT_EXPORT    static inline
+
+/// Complex numbers over `rat_t`, so they work with TI's reals the same as with `double`.
+typedef struct {
+	rat_t re, im;
+} crat_t;
+
+
+CRAT_EXPORT crat_t crat_make(rat_t const re, rat_t const im) {
+	return (crat_t){ .re = re, .im = im };
+}
+CRAT_EXPORT crat_t crat_from_rat(rat_t const re) {
+	return crat_make(re, rat_zero());
+}
+CRAT_EXPORT crat_t crat_zero(void) {
+	return crat_make(rat_zero(), rat_zero());
+}
+CRAT_EXPORT crat_t crat_pos1(void) {
+	return crat_make(rat_pos1(), rat_zero());
+}
+/// `j*a`
+CRAT_EXPORT crat_t crat_imag(rat_t const a) {
+	return crat_make(rat_zero(), a);
+}
+
+/** Unary Operations */
+CRAT_EXPORT crat_t crat_neg(crat_t const a) {
+	return crat_make(rat_neg(a.re), rat_neg(a.im));
+}
+CRAT_EXPORT crat_t crat_conj(crat_t const a) {
+	return crat_make(a.re, rat_neg(a.im));
+}
+/// `|re| + |im|`, cheap and good enough to compare pivots by.
+CRAT_EXPORT rat_t crat_abs1(crat_t const a) {
+	return rat_add(rat_abs(a.re), rat_abs(a.im));
+}
+/// modulus, scaled so squaring can't overflow.
+CRAT_EXPORT rat_t crat_abs(crat_t const a) {
+	rat_t const x = rat_abs(a.re), y = rat_abs(a.im);
+	rat_t const big = rat_max(x, y), small = rat_min(x, y);
+	if( rat_cmp(big, rat_zero())==0 ) {
+		return rat_zero();
+	}
+	rat_t const r = rat_div(small, big);
+	return rat_mul(big, rat_root(rat_add(rat_pos1(), rat_mul(r, r)), rat_from_int(2)));
+}
+/// argument in radians on (-pi, pi].
+CRAT_EXPORT rat_t crat_arg(crat_t const a) {
+	int const re_sign = rat_cmp(a.re, rat_zero()), im_sign = rat_cmp(a.im, rat_zero());
+	if( re_sign==0 ) {
+		rat_t const half_pi = rat_div(rat_pi(), rat_from_int(2));
+		return ( im_sign > 0 )? half_pi : ( im_sign < 0 )? rat_neg(half_pi) : rat_zero();
+	}
+	rat_t const t = rat_atan(rat_div(a.im, a.re));
+	if( re_sign > 0 ) {
+		return t;
+	}
+	return ( im_sign >= 0 )? rat_add(t, rat_pi()) : rat_sub(t, rat_pi());
+}
+
+/** Binary Operations */
+CRAT_EXPORT crat_t crat_add(crat_t const a, crat_t const b) {
+	return crat_make(rat_add(a.re, b.re), rat_add(a.im, b.im));
+}
+CRAT_EXPORT crat_t crat_sub(crat_t const a, crat_t const b) {
+	return crat_make(rat_sub(a.re, b.re), rat_sub(a.im, b.im));
+}
+CRAT_EXPORT crat_t crat_mul(crat_t const a, crat_t const b) {
+	return crat_make(rat_sub(rat_mul(a.re, b.re), rat_mul(a.im, b.im)), rat_add(rat_mul(a.re, b.im), rat_mul(a.im, b.re)));
+}
+CRAT_EXPORT crat_t crat_scale(crat_t const a, rat_t const k) {
+	return crat_make(rat_mul(a.re, k), rat_mul(a.im, k));
+}
+/// Smith's algorithm, divides by the larger part of `b` so nothing squares out of range.
+CRAT_EXPORT crat_t crat_div(crat_t const a, crat_t const b) {
+	if( rat_ge(rat_abs(b.re), rat_abs(b.im)) ) {
+		rat_t const r = rat_div(b.im, b.re);
+		rat_t const den = rat_add(b.re, rat_mul(b.im, r));
+		return crat_make(rat_div(rat_add(a.re, rat_mul(a.im, r)), den), rat_div(rat_sub(a.im, rat_mul(a.re, r)), den));
+	}
+	rat_t const r = rat_div(b.re, b.im);
+	rat_t const den = rat_add(b.im, rat_mul(b.re, r));
+	return crat_make(rat_div(rat_add(rat_mul(a.re, r), a.im), den), rat_div(rat_sub(rat_mul(a.im, r), a.re), den));
+}
+CRAT_EXPORT crat_t crat_recip(crat_t const a) {
+	return crat_div(crat_pos1(), a);
+}
+#endif
@@ -0,0 +1,577 @@
+#ifndef DENSE_H_INCLUDED
+#	define DENSE_H_INCLUDED
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include "mem.h"
+#include "realtype.h"
+
+#define DENSE_EXPORT    static inline
+
+/// Vector kernels are only built on x86 compilers that can target them per function.
+/// The `rat_t` ones assume `rat_t` is `double`, the float ones back the mixed-precision factorization.
+#if !defined(TICE_H) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#	define DENSE_X86_SIMD_F32
+#	include <immintrin.h>
+#	if !defined(RAT_FLOAT) && !defined(RAT_LONG_DOUBLE)
+#		define DENSE_X86_SIMD
+#	endif
+#endif
+
+/// factoring in float only pays off where `rat_t` is wider.
+#if !defined(TICE_H) && !defined(RAT_FLOAT)
+#	define DENSE_MIXED
+#	include <float.h>
+#endif
+
+enum {
+	DENSE_BLOCK    = 32,  /// panel width, the number of columns each trailing update applies at once.
+	DENSE_ROW_TILE = 256, /// rows of the panel kept hot in cache while sweeping the trailing columns.
+	DENSE_REFINE_MAX = 10, /// refinement steps a mixed-precision solve gets before it's given up on.
+};
+
+enum {
+	DENSE_KERNEL_SCALAR = 0,
+	DENSE_KERNEL_AVX2,
+	DENSE_KERNEL_AVX512,
+};
+
+/// The inner loops of the LU, swappable per CPU.
+/// `update` does `y -= L*c`, `L` being `len x k` column-major with leading dimension `ld`.
+struct DenseKernels {
+	size_t  (*iamax)(size_t len, rat_t const x[]);
+	void    (*update)(size_t len, size_t k, rat_t const L[], size_t ld, rat_t const c[], rat_t y[]);
+	uint8_t   kind;
+};
+
+
+/// index of the first largest `|x[i]|`.
+DENSE_EXPORT size_t _dense_iamax_scalar(size_t const len, rat_t const x[const]) {
+	size_t m = 0;
+	rat_t cur_max = rat_abs(x[0]);
+	for( size_t i=1; i < len; i++ ) {
+		rat_t const potential_max = rat_abs(x[i]);
+		if( rat_lt(cur_max, potential_max) ) {
+			cur_max = potential_max;
+			m = i;
+		}
+	}
+	return m;
+}
+
+DENSE_EXPORT void _dense_update_scalar(size_t const len, size_t const k, rat_t const L[const], size_t const ld, rat_t const c[const], rat_t y[const]) {
+	for( size_t p=0; p < k; p++ ) {
+		rat_t const *const col = &L[p * ld];
+		for( size_t i=0; i < len; i++ ) {
+			y[i] = rat_sub(y[i], rat_mul(col[i], c[p]));
+		}
+	}
+}
+
+#ifdef DENSE_X86_SIMD
+/// two passes: a vector max, then the first element matching it, so ties resolve like the scalar search.
+__attribute__((target("avx2")))
+DENSE_EXPORT size_t _dense_iamax_avx2(size_t const len, rat_t const x[const]) {
+	__m256d const sign = _mm256_set1_pd(-0.0);
+	__m256d vmax = _mm256_setzero_pd();
+	size_t i = 0;
+	for( ; i + 4 <= len; i += 4 ) {
+		vmax = _mm256_max_pd(vmax, _mm256_andnot_pd(sign, _mm256_loadu_pd(&x[i])));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, vmax);
+	double cur_max = lanes[0];
+	for( size_t l=1; l < 4; l++ ) {
+		cur_max = ( cur_max < lanes[l] )? lanes[l] : cur_max;
+	}
+	for( ; i < len; i++ ) {
+		double const a = fabs(x[i]);
+		cur_max = ( cur_max < a )? a : cur_max;
+	}
+	for( i=0; i < len; i++ ) {
+		if( fabs(x[i])==cur_max ) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+__attribute__((target("avx2,fma")))
+DENSE_EXPORT void _dense_update_avx2(size_t const len, size_t const k, rat_t const L[const], size_t const ld, rat_t const c[const], rat_t y[const]) {
+	size_t i = 0;
+	for( ; i + 8 <= len; i += 8 ) {
+		__m256d y0 = _mm256_loadu_pd(&y[i]);
+		__m256d y1 = _mm256_loadu_pd(&y[i + 4]);
+		for( size_t p=0; p < k; p++ ) {
+			__m256d const cp = _mm256_set1_pd(c[p]);
+			y0 = _mm256_fnmadd_pd(_mm256_loadu_pd(&L[p*ld + i]),     cp, y0);
+			y1 = _mm256_fnmadd_pd(_mm256_loadu_pd(&L[p*ld + i + 4]), cp, y1);
+		}
+		_mm256_storeu_pd(&y[i],     y0);
+		_mm256_storeu_pd(&y[i + 4], y1);
+	}
+	for( ; i + 4 <= len; i += 4 ) {
+		__m256d y0 = _mm256_loadu_pd(&y[i]);
+		for( size_t p=0; p < k; p++ ) {
+			y0 = _mm256_fnmadd_pd(_mm256_loadu_pd(&L[p*ld + i]), _mm256_set1_pd(c[p]), y0);
+		}
+		_mm256_storeu_pd(&y[i], y0);
+	}
+	if( i < len ) {
+		_dense_update_scalar(len - i, k, &L[i], ld, c, &y[i]);
+	}
+}
+
+__attribute__((target("avx512f")))
+DENSE_EXPORT size_t _dense_iamax_avx512(size_t const len, rat_t const x[const]) {
+	__m512d vmax = _mm512_setzero_pd();
+	size_t i = 0;
+	for( ; i + 8 <= len; i += 8 ) {
+		vmax = _mm512_max_pd(vmax, _mm512_abs_pd(_mm512_loadu_pd(&x[i])));
+	}
+	double cur_max = _mm512_reduce_max_pd(vmax);
+	for( ; i < len; i++ ) {
+		double const a = fabs(x[i]);
+		cur_max = ( cur_max < a )? a : cur_max;
+	}
+	for( i=0; i < len; i++ ) {
+		if( fabs(x[i])==cur_max ) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+__attribute__((target("avx512f")))
+DENSE_EXPORT void _dense_update_avx512(size_t const len, size_t const k, rat_t const L[const], size_t const ld, rat_t const c[const], rat_t y[const]) {
+	size_t i = 0;
+	for( ; i + 16 <= len; i += 16 ) {
+		__m512d y0 = _mm512_loadu_pd(&y[i]);
+		__m512d y1 = _mm512_loadu_pd(&y[i + 8]);
+		for( size_t p=0; p < k; p++ ) {
+			__m512d const cp = _mm512_set1_pd(c[p]);
+			y0 = _mm512_fnmadd_pd(_mm512_loadu_pd(&L[p*ld + i]),     cp, y0);
+			y1 = _mm512_fnmadd_pd(_mm512_loadu_pd(&L[p*ld + i + 8]), cp, y1);
+		}
+		_mm512_storeu_pd(&y[i],     y0);
+		_mm512_storeu_pd(&y[i + 8], y1);
+	}
+	if( i < len ) {
+		_dense_update_avx2(len - i, k, &L[i], ld, c, &y[i]);
+	}
+}
+#endif
+
+/// kernels of the given `DENSE_KERNEL_*` kind, scalar if this build or CPU can't run them.
+DENSE_EXPORT struct DenseKernels dense_kernels_for(uint8_t const kind) {
+#ifdef DENSE_X86_SIMD
+	__builtin_cpu_init();
+	if( kind >= DENSE_KERNEL_AVX512 && __builtin_cpu_supports("avx512f") ) {
+		return (struct DenseKernels){ _dense_iamax_avx512, _dense_update_avx512, DENSE_KERNEL_AVX512 };
+	} else if( kind >= DENSE_KERNEL_AVX2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ) {
+		return (struct DenseKernels){ _dense_iamax_avx2, _dense_update_avx2, DENSE_KERNEL_AVX2 };
+	}
+#else
+	(void)(kind);
+#endif
+	return (struct DenseKernels){ _dense_iamax_scalar, _dense_update_scalar, DENSE_KERNEL_SCALAR };
+}
+
+/// the widest kernels the running CPU supports.
+DENSE_EXPORT struct DenseKernels dense_kernels(void) {
+	return dense_kernels_for(DENSE_KERNEL_AVX512);
+}
+
+
+#ifdef DENSE_MIXED
+/// `DenseKernels` over float, for factors that only have to be good enough to refine from.
+struct DenseKernelsF32 {
+	size_t  (*iamax)(size_t len, float const x[]);
+	void    (*update)(size_t len, size_t k, float const L[], size_t ld, float const c[], float y[]);
+	uint8_t   kind;
+};
+
+DENSE_EXPORT size_t _dense_iamax_f32_scalar(size_t const len, float const x[const]) {
+	size_t m = 0;
+	float cur_max = fabsf(x[0]);
+	for( size_t i=1; i < len; i++ ) {
+		float const potential_max = fabsf(x[i]);
+		if( cur_max < potential_max ) {
+			cur_max = potential_max;
+			m = i;
+		}
+	}
+	return m;
+}
+
+DENSE_EXPORT void _dense_update_f32_scalar(size_t const len, size_t const k, float const L[const], size_t const ld, float const c[const], float y[const]) {
+	for( size_t p=0; p < k; p++ ) {
+		float const *const col = &L[p * ld];
+		for( size_t i=0; i < len; i++ ) {
+			y[i] -= col[i] * c[p];
+		}
+	}
+}
+
+#	ifdef DENSE_X86_SIMD_F32
+__attribute__((target("avx2")))
+DENSE_EXPORT size_t _dense_iamax_f32_avx2(size_t const len, float const x[const]) {
+	__m256 const sign = _mm256_set1_ps(-0.0f);
+	__m256 vmax = _mm256_setzero_ps();
+	size_t i = 0;
+	for( ; i + 8 <= len; i += 8 ) {
+		vmax = _mm256_max_ps(vmax, _mm256_andnot_ps(sign, _mm256_loadu_ps(&x[i])));
+	}
+	float lanes[8];
+	_mm256_storeu_ps(lanes, vmax);
+	float cur_max = lanes[0];
+	for( size_t l=1; l < 8; l++ ) {
+		cur_max = ( cur_max < lanes[l] )? lanes[l] : cur_max;
+	}
+	for( ; i < len; i++ ) {
+		float const a = fabsf(x[i]);
+		cur_max = ( cur_max < a )? a : cur_max;
+	}
+	for( i=0; i < len; i++ ) {
+		if( fabsf(x[i])==cur_max ) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+__attribute__((target("avx2,fma")))
+DENSE_EXPORT void _dense_update_f32_avx2(size_t const len, size_t const k, float const L[const], size_t const ld, float const c[const], float y[const]) {
+	size_t i = 0;
+	for( ; i + 16 <= len; i += 16 ) {
+		__m256 y0 = _mm256_loadu_ps(&y[i]);
+		__m256 y1 = _mm256_loadu_ps(&y[i + 8]);
+		for( size_t p=0; p < k; p++ ) {
+			__m256 const cp = _mm256_set1_ps(c[p]);
+			y0 = _mm256_fnmadd_ps(_mm256_loadu_ps(&L[p*ld + i]),     cp, y0);
+			y1 = _mm256_fnmadd_ps(_mm256_loadu_ps(&L[p*ld + i + 8]), cp, y1);
+		}
+		_mm256_storeu_ps(&y[i],     y0);
+		_mm256_storeu_ps(&y[i + 8], y1);
+	}
+	for( ; i + 8 <= len; i += 8 ) {
+		__m256 y0 = _mm256_loadu_ps(&y[i]);
+		for( size_t p=0; p < k; p++ ) {
+			y0 = _mm256_fnmadd_ps(_mm256_loadu_ps(&L[p*ld + i]), _mm256_set1_ps(c[p]), y0);
+		}
+		_mm256_storeu_ps(&y[i], y0);
+	}
+	if( i < len ) {
+		_dense_update_f32_scalar(len - i, k, &L[i], ld, c, &y[i]);
+	}
+}
+
+__attribute__((target("avx512f")))
+DENSE_EXPORT size_t _dense_iamax_f32_avx512(size_t const len, float const x[const]) {
+	__m512 vmax = _mm512_setzero_ps();
+	size_t i = 0;
+	for( ; i + 16 <= len; i += 16 ) {
+		vmax = _mm512_max_ps(vmax, _mm512_abs_ps(_mm512_loadu_ps(&x[i])));
+	}
+	float cur_max = _mm512_reduce_max_ps(vmax);
+	for( ; i < len; i++ ) {
+		float const a = fabsf(x[i]);
+		cur_max = ( cur_max < a )? a : cur_max;
+	}
+	for( i=0; i < len; i++ ) {
+		if( fabsf(x[i])==cur_max ) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+__attribute__((target("avx512f")))
+DENSE_EXPORT void _dense_update_f32_avx512(size_t const len, size_t const k, float const L[const], size_t const ld, float const c[const], float y[const]) {
+	size_t i = 0;
+	for( ; i + 32 <= len; i += 32 ) {
+		__m512 y0 = _mm512_loadu_ps(&y[i]);
+		__m512 y1 = _mm512_loadu_ps(&y[i + 16]);
+		for( size_t p=0; p < k; p++ ) {
+			__m512 const cp = _mm512_set1_ps(c[p]);
+			y0 = _mm512_fnmadd_ps(_mm512_loadu_ps(&L[p*ld + i]),      cp, y0);
+			y1 = _mm512_fnmadd_ps(_mm512_loadu_ps(&L[p*ld + i + 16]), cp, y1);
+		}
+		_mm512_storeu_ps(&y[i],      y0);
+		_mm512_storeu_ps(&y[i + 16], y1);
+	}
+	if( i < len ) {
+		_dense_update_f32_avx2(len - i, k, &L[i], ld, c, &y[i]);
+	}
+}
+#	endif
+
+DENSE_EXPORT struct DenseKernelsF32 dense_kernels_f32_for(uint8_t const kind) {
+#	ifdef DENSE_X86_SIMD_F32
+	__builtin_cpu_init();
+	if( kind >= DENSE_KERNEL_AVX512 && __builtin_cpu_supports("avx512f") ) {
+		return (struct DenseKernelsF32){ _dense_iamax_f32_avx512, _dense_update_f32_avx512, DENSE_KERNEL_AVX512 };
+	} else if( kind >= DENSE_KERNEL_AVX2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ) {
+		return (struct DenseKernelsF32){ _dense_iamax_f32_avx2, _dense_update_f32_avx2, DENSE_KERNEL_AVX2 };
+	}
+#	else
+	(void)(kind);
+#	endif
+	return (struct DenseKernelsF32){ _dense_iamax_f32_scalar, _dense_update_f32_scalar, DENSE_KERNEL_SCALAR };
+}
+
+DENSE_EXPORT struct DenseKernelsF32 dense_kernels_f32(void) {
+	return dense_kernels_f32_for(DENSE_KERNEL_AVX512);
+}
+#endif
+
+
+DENSE_EXPORT NO_NULLS void _dense_swap_rows(size_t const n, rat_t A[const], size_t const a, size_t const b) {
+	for( size_t j=0; j < n; j++ ) {
+		rat_t const tmp = A[a + j*n];
+		A[a + j*n] = A[b + j*n];
+		A[b + j*n] = tmp;
+	}
+}
+
+/// Blocked right-looking LU with partial pivoting, in place.
+/// `A` is `n x n` column-major (`A[i + j*n]`) so pivot searches and column updates run over contiguous memory.
+/// Each panel of `DENSE_BLOCK` columns is factored unblocked, then the rest of the matrix
+/// takes the whole panel as one rank-`DENSE_BLOCK` update, `DENSE_ROW_TILE` rows at a time.
+/// `piv[k]` is the row swapped with row `k` at step `k`.
+/// Fails with a pivot below `rat_epsilon()`. The reference `gaussian_rref` (node.h) skips such a column
+/// instead and divides by the tiny pivot later, so the two only agree on systems that are safely nonsingular.
+DENSE_EXPORT NO_NULLS bool dense_lu_factor(struct DenseKernels const *const kern, size_t const n, rat_t A[const restrict], uint32_t piv[const restrict]) {
+	rat_t const eps = rat_epsilon();
+	for( size_t kb=0; kb < n; kb += DENSE_BLOCK ) {
+		size_t const ke = ( n - kb < DENSE_BLOCK )? n : kb + DENSE_BLOCK;
+		for( size_t k = kb; k < ke; k++ ) {
+			rat_t *const col = &A[k*n];
+			size_t const m = k + kern->iamax(n - k, &col[k]);
+			if( rat_lt(rat_abs(col[m]), eps) ) {
+				return false;
+			}
+			piv[k] = m;
+			if( m != k ) {
+				_dense_swap_rows(n, A, k, m);
+			}
+			rat_t const inv = rat_recip(col[k]);
+			for( size_t i = k+1; i < n; i++ ) {
+				col[i] = rat_mul(col[i], inv);
+			}
+			for( size_t j = k+1; j < ke; j++ ) {
+				kern->update(n - k - 1, 1, &col[k + 1], n, &A[k + j*n], &A[k + 1 + j*n]);
+			}
+		}
+		if( ke==n ) {
+			break;
+		}
+		/// U12 = L11^-1 * A12, small unit-triangular solves per trailing column.
+		for( size_t j = ke; j < n; j++ ) {
+			for( size_t p = kb; p + 1 < ke; p++ ) {
+				kern->update(ke - p - 1, 1, &A[p + 1 + p*n], n, &A[p + j*n], &A[p + 1 + j*n]);
+			}
+		}
+		/// A22 -= L21 * U12, the coefficients for column `j` are its contiguous U12 segment.
+		for( size_t r0 = ke; r0 < n; r0 += DENSE_ROW_TILE ) {
+			size_t const rows = ( n - r0 < DENSE_ROW_TILE )? n - r0 : DENSE_ROW_TILE;
+			for( size_t j = ke; j < n; j++ ) {
+				kern->update(rows, ke - kb, &A[r0 + kb*n], n, &A[kb + j*n], &A[r0 + j*n]);
+			}
+		}
+	}
+	return true;
+}
+
+/// solves `A*x = b` in place with the factors from `dense_lu_factor`.
+DENSE_EXPORT NO_NULLS void dense_lu_solve(struct DenseKernels const *const kern, size_t const n, rat_t const A[const restrict], uint32_t const piv[const restrict], rat_t b[const restrict]) {
+	for( size_t k=0; k < n; k++ ) {
+		if( piv[k] != k ) {
+			rat_t const tmp = b[k];
+			b[k] = b[piv[k]];
+			b[piv[k]] = tmp;
+		}
+	}
+	for( size_t j=0; j < n; j++ ) {
+		kern->update(n - j - 1, 1, &A[j + 1 + j*n], n, &b[j], &b[j + 1]);
+	}
+	for( size_t j = n-1; j < n; j-- ) {
+		b[j] = rat_div(b[j], A[j + j*n]);
+		kern->update(j, 1, &A[j*n], n, &b[j], b);
+	}
+}
+
+/// Banded LU with partial pivoting, in place, in LAPACK's `gbtrf` layout: column-major with
+/// `ld = 2*kl + ku + 1` rows per column, entry `(i, j)` of the matrix at `A[kl + ku + i - j + j*ld]`.
+/// The top `kl` rows must start out zero, row swaps spill U up to `kl + ku` over the diagonal.
+/// Work is `O(n*kl*(kl+ku))` and storage `O(n*(2*kl+ku))` against the full LU's `O(n^3)` and `O(n^2)`.
+/// `piv[k]` is the row swapped with row `k` at step `k`. Fails with a pivot below `rat_epsilon()`.
+DENSE_EXPORT NO_NULLS bool dense_band_lu_factor(struct DenseKernels const *const kern, size_t const n, size_t const kl, size_t const ku, rat_t A[const restrict], uint32_t piv[const restrict]) {
+	rat_t const eps = rat_epsilon();
+	size_t const kv = kl + ku, ld = 2*kl + ku + 1;
+	size_t ju = 0; /// last column the pivots so far reach.
+	for( size_t j=0; j < n; j++ ) {
+		rat_t *const col = &A[kv + j*ld];
+		size_t const km = ( n - 1 - j < kl )? n - 1 - j : kl;
+		size_t const m = kern->iamax(km + 1, col);
+		if( rat_lt(rat_abs(col[m]), eps) ) {
+			return false;
+		}
+		piv[j] = j + m;
+		size_t const reach = ( j + ku + m < n - 1 )? j + ku + m : n - 1;
+		ju = ( reach > ju )? reach : ju;
+		if( m != 0 ) {
+			for( size_t c = j; c <= ju; c++ ) {
+				rat_t *const a = &A[kv + j - c + c*ld];
+				rat_t const tmp = a[0];
+				a[0] = a[m];
+				a[m] = tmp;
+			}
+		}
+		if( km==0 ) {
+			continue;
+		}
+		rat_t const inv = rat_recip(col[0]);
+		for( size_t i=1; i <= km; i++ ) {
+			col[i] = rat_mul(col[i], inv);
+		}
+		for( size_t c = j+1; c <= ju; c++ ) {
+			rat_t *const a = &A[kv + j - c + c*ld];
+			kern->update(km, 1, &col[1], ld, a, &a[1]);
+		}
+	}
+	return true;
+}
+
+/// solves `A*x = b` in place with the factors from `dense_band_lu_factor`.
+DENSE_EXPORT NO_NULLS void dense_band_lu_solve(struct DenseKernels const *const kern, size_t const n, size_t const kl, size_t const ku, rat_t const A[const restrict], uint32_t const piv[const restrict], rat_t b[const restrict]) {
+	size_t const kv = kl + ku, ld = 2*kl + ku + 1;
+	for( size_t j=0; j < n; j++ ) {
+		size_t const km = ( n - 1 - j < kl )? n - 1 - j : kl;
+		if( piv[j] != j ) {
+			rat_t const tmp = b[j];
+			b[j] = b[piv[j]];
+			b[piv[j]] = tmp;
+		}
+		kern->update(km, 1, &A[kv + 1 + j*ld], ld, &b[j], &b[j + 1]);
+	}
+	for( size_t j = n-1; j < n; j-- ) {
+		size_t const top = ( j < kv )? 0 : j - kv;
+		b[j] = rat_div(b[j], A[kv + j*ld]);
+		kern->update(j - top, 1, &A[kv + top - j + j*ld], ld, &b[j], &b[top]);
+	}
+}
+
+/// Banded Cholesky `A = L*L^T` of a symmetric positive definite matrix, in place, in LAPACK's
+/// `pbtrf` lower layout: `ld = kd + 1` rows per column, entry `(i, j)` with `i >= j` at `A[i - j + j*ld]`.
+/// Half the storage and work of the banded LU and no pivoting, for matrices without MNA branch rows.
+/// Fails on a pivot that isn't positive, the matrix wasn't positive definite.
+DENSE_EXPORT NO_NULLS bool dense_band_cholesky(struct DenseKernels const *const kern, size_t const n, size_t const kd, rat_t A[const restrict]) {
+	rat_t const eps = rat_epsilon(), two = rat_from_int(2);
+	size_t const ld = kd + 1;
+	for( size_t j=0; j < n; j++ ) {
+		rat_t *const col = &A[j*ld];
+		if( rat_lt(col[0], eps) ) {
+			return false;
+		}
+		col[0] = rat_root(col[0], two);
+		size_t const kn = ( n - 1 - j < kd )? n - 1 - j : kd;
+		rat_t const inv = rat_recip(col[0]);
+		for( size_t i=1; i <= kn; i++ ) {
+			col[i] = rat_mul(col[i], inv);
+		}
+		for( size_t c=1; c <= kn; c++ ) {
+			kern->update(kn - c + 1, 1, &col[c], ld, &col[c], &A[(j + c)*ld]);
+		}
+	}
+	return true;
+}
+
+/// solves `A*x = b` in place with the factor from `dense_band_cholesky`.
+DENSE_EXPORT NO_NULLS void dense_band_cholesky_solve(struct DenseKernels const *const kern, size_t const n, size_t const kd, rat_t const A[const restrict], rat_t b[const restrict]) {
+	size_t const ld = kd + 1;
+	for( size_t j=0; j < n; j++ ) {
+		size_t const kn = ( n - 1 - j < kd )? n - 1 - j : kd;
+		b[j] = rat_div(b[j], A[j*ld]);
+		kern->update(kn, 1, &A[1 + j*ld], ld, &b[j], &b[j + 1]);
+	}
+	for( size_t j = n-1; j < n; j-- ) {
+		size_t const kn = ( n - 1 - j < kd )? n - 1 - j : kd;
+		rat_t dot = rat_zero();
+		for( size_t i=1; i <= kn; i++ ) {
+			dot = rat_add(dot, rat_mul(A[i + j*ld], b[j + i]));
+		}
+		b[j] = rat_div(rat_sub(b[j], dot), A[j*ld]);
+	}
+}
+
+#ifdef DENSE_MIXED
+DENSE_EXPORT NO_NULLS void _dense_swap_rows_f32(size_t const n, float A[const], size_t const a, size_t const b) {
+	for( size_t j=0; j < n; j++ ) {
+		float const tmp = A[a + j*n];
+		A[a + j*n] = A[b + j*n];
+		A[b + j*n] = tmp;
+	}
+}
+
+/// `dense_lu_factor` in float: half the memory and twice the vector width.
+/// Fails on a pivot that underflowed or isn't finite, the caller then factors in `rat_t`.
+DENSE_EXPORT NO_NULLS bool dense_lu_factor_f32(struct DenseKernelsF32 const *const kern, size_t const n, float A[const restrict], uint32_t piv[const restrict]) {
+	for( size_t kb=0; kb < n; kb += DENSE_BLOCK ) {
+		size_t const ke = ( n - kb < DENSE_BLOCK )? n : kb + DENSE_BLOCK;
+		for( size_t k = kb; k < ke; k++ ) {
+			float *const col = &A[k*n];
+			size_t const m = k + kern->iamax(n - k, &col[k]);
+			float const pivot = fabsf(col[m]);
+			if( !(pivot >= FLT_MIN && pivot <= FLT_MAX) ) {
+				return false;
+			}
+			piv[k] = m;
+			if( m != k ) {
+				_dense_swap_rows_f32(n, A, k, m);
+			}
+			float const inv = 1.0f / col[k];
+			for( size_t i = k+1; i < n; i++ ) {
+				col[i] *= inv;
+			}
+			for( size_t j = k+1; j < ke; j++ ) {
+				kern->update(n - k - 1, 1, &col[k + 1], n, &A[k + j*n], &A[k + 1 + j*n]);
+			}
+		}
+		if( ke==n ) {
+			break;
+		}
+		for( size_t j = ke; j < n; j++ ) {
+			for( size_t p = kb; p + 1 < ke; p++ ) {
+				kern->update(ke - p - 1, 1, &A[p + 1 + p*n], n, &A[p + j*n], &A[p + 1 + j*n]);
+			}
+		}
+		for( size_t r0 = ke; r0 < n; r0 += DENSE_ROW_TILE ) {
+			size_t const rows = ( n - r0 < DENSE_ROW_TILE )? n - r0 : DENSE_ROW_TILE;
+			for( size_t j = ke; j < n; j++ ) {
+				kern->update(rows, ke - kb, &A[r0 + kb*n], n, &A[kb + j*n], &A[r0 + j*n]);
+			}
+		}
+	}
+	return true;
+}
+
+DENSE_EXPORT NO_NULLS void dense_lu_solve_f32(struct DenseKernelsF32 const *const kern, size_t const n, float const A[const restrict], uint32_t const piv[const restrict], float b[const restrict]) {
+	for( size_t k=0; k < n; k++ ) {
+		if( piv[k] != k ) {
+			float const tmp = b[k];
+			b[k] = b[piv[k]];
+			b[piv[k]] = tmp;
+		}
+	}
+	for( size_t j=0; j < n; j++ ) {
+		kern->update(n - j - 1, 1, &A[j + 1 + j*n], n, &b[j], &b[j + 1]);
+	}
+	for( size_t j = n-1; j < n; j-- ) {
+		b[j] /= A[j + j*n];
+		kern->update(j, 1, &A[j*n], n, &b[j], b);
+	}
+}
+#endif
+#endif
@@ -0,0 +1,664 @@
+#ifndef DOMAIN_H_INCLUDED
+#	define DOMAIN_H_INCLUDED
+
+#include "node.h"
+
+/// the calculator has no threads, every part there goes through one inline worker.
+#if !defined(TICE_H) && (defined(__unix__) || defined(__APPLE__))
+#	define DOMAIN_THREADS
+#	include <pthread.h>
+#	include <stdatomic.h>
+#	include <unistd.h>
+#endif
+
+#define DOMAIN_EXPORT    static inline
+
+enum {
+	DOMAIN_MAX_WORKERS = 64,
+	DOMAIN_MAX_PARTS   = 256,
+	DOMAIN_MIN_ROWS    = 1024, /// smaller systems aren't worth the threads, they go straight to `circuit_calc_voltages`.
+	DOMAIN_BATCH       = 16,   /// interface columns pushed through a part's factors at once.
+};
+
+#define DOMAIN_INTERFACE    UINT32_MAX
+
+/// Domain-decomposition DC solve.
+/// The unknowns are split into `parts` blocks whose interiors only couple through a set
+/// of interface unknowns. Each interior is factored on its own worker, the interface
+/// Schur complement is solved densely, then the interiors are back-substituted in parallel.
+struct DomainOptions {
+	uint32_t workers; /// 0 uses every online core.
+	uint32_t parts;   /// 0 uses one per worker.
+};
+
+struct DomainResult {
+	uint32_t parts, workers;
+	uint32_t interface; /// unknowns in the Schur complement.
+	bool     direct;    /// too small to split, or the split didn't pay off, it went through `circuit_calc_voltages`.
+};
+
+DOMAIN_EXPORT struct DomainOptions domain_options(void) {
+	return (struct DomainOptions){ .workers = 0, .parts = 0 };
+}
+
+/// how many workers a solve gets, `requested` 0 meaning every online core.
+DOMAIN_EXPORT uint32_t domain_workers(uint32_t const requested) {
+	uint32_t workers = 1;
+#ifdef DOMAIN_THREADS
+	if( requested > 0 ) {
+		workers = requested;
+	} else {
+		long const cores = sysconf(_SC_NPROCESSORS_ONLN);
+		workers = ( cores > 0 )? ( uint32_t )(cores) : 1;
+	}
+#else
+	(void)(requested);
+#endif
+	return ( workers > DOMAIN_MAX_WORKERS )? DOMAIN_MAX_WORKERS : workers;
+}
+
+/// Worker pool of the threaded analyses: the domain solve, the AC sweep and Monte Carlo.
+/// Each one's worker struct starts with this, and the pool hands every worker an arena of its own
+/// and runs them side by side, with the jobs handed out through the analysis' own atomic counter.
+struct DomainPoolWorker {
+	struct TIBiStack arena;
+	uint32_t         failed; /// jobs it gave up on.
+	bool             ok;     /// set up its buffers, one that didn't claimed nothing.
+};
+
+/// workers for `jobs` pieces of work, `requested` 0 meaning every online core.
+DOMAIN_EXPORT uint32_t domain_pool_size(uint32_t const requested, uint32_t const jobs) {
+	uint32_t const workers = domain_workers(requested);
+	return ( jobs > 0 && workers > jobs )? jobs : workers;
+}
+
+/// worker `w` of a pool of `stride`-byte worker structs.
+DOMAIN_EXPORT NO_NULLS struct DomainPoolWorker *domain_pool_at(void *const pool, size_t const stride, uint32_t const w) {
+	return ( struct DomainPoolWorker* )(( uint8_t* )(pool) + ( size_t )(w) * stride);
+}
+
+/// What's left of the front is split evenly into the workers' arenas. They're carved raw:
+/// every arena allocation zeroes its own bytes, clearing the whole margin here would cost more than the work.
+DOMAIN_EXPORT NO_NULLS bool domain_pool_carve(struct TIBiStack *const s, void *const pool, size_t const stride, uint32_t const workers) {
+	size_t arena_len = bistack_get_margins(s) / workers;
+	arena_len -= arena_len % sizeof(size_t);
+	if( arena_len <= sizeof(size_t) ) {
+		return false;
+	}
+	arena_len -= sizeof(size_t);
+	for( uint32_t w=0; w < workers; w++ ) {
+		uint8_t *const buf = bistack_alloc_front_raw(s, arena_len);
+		if( buf==NULL ) {
+			return false;
+		}
+		struct DomainPoolWorker *const base = domain_pool_at(pool, stride, w);
+		base->arena  = bistack_make(buf, arena_len);
+		base->failed = 0;
+		base->ok     = false;
+	}
+	return true;
+}
+
+/// Runs `run` on every worker, worker 0 inline and the rest on threads of their own.
+/// Jobs are claimed, so a thread that doesn't start only leaves its share to the others.
+DOMAIN_EXPORT NO_NULLS void domain_pool_run(void *const pool, size_t const stride, uint32_t const workers, void *run(void *arg)) {
+#ifdef DOMAIN_THREADS
+	pthread_t threads[DOMAIN_MAX_WORKERS];
+	bool started[DOMAIN_MAX_WORKERS] = {false};
+	for( uint32_t w=1; w < workers && w < DOMAIN_MAX_WORKERS; w++ ) {
+		started[w] = pthread_create(&threads[w], NULL, run, domain_pool_at(pool, stride, w))==0;
+	}
+	run(pool);
+	for( uint32_t w=1; w < workers && w < DOMAIN_MAX_WORKERS; w++ ) {
+		if( started[w] ) {
+			pthread_join(threads[w], NULL);
+		}
+	}
+#else
+	(void)(stride);
+	(void)(workers);
+	run(pool);
+#endif
+}
+
+/// the failures summed over the workers into `failed`, false when none of them set up.
+/// Any worker that did keeps claiming until the jobs run out, so then none is left undone.
+DOMAIN_EXPORT NO_NULLS bool domain_pool_collect(void *const pool, size_t const stride, uint32_t const workers, uint32_t *const failed) {
+	bool any_ok = false;
+	*failed = 0;
+	for( uint32_t w=0; w < workers; w++ ) {
+		struct DomainPoolWorker const *const base = domain_pool_at(pool, stride, w);
+		any_ok |= base->ok;
+		*failed += base->failed;
+	}
+	return any_ok;
+}
+
+/// Splits the unknowns of `A` into `parts` blocks and the interface between them.
+/// Blocks are runs of a breadth-first level order, cut on level boundaries where that
+/// doesn't empty a block, so each interface is about one level thick. An unknown joins
+/// the interface when it has a neighbor in a later block, which leaves no edge between
+/// two interiors. Unknowns without a diagonal (MNA branch currents) follow a neighbor
+/// into the interface, so no interior keeps a branch row without its node.
+/// `part` gets each unknown's block or DOMAIN_INTERFACE, the interface size is returned,
+/// UINT32_MAX on OOM. Scratch is released before returning.
+DOMAIN_EXPORT NO_NULLS uint32_t domain_partition(struct TIBiStack *const s, struct SpMat const *const A, uint32_t const parts, uint32_t part[const]) {
+	size_t const scratch = s->front;
+	uint32_t const n = A->n;
+	uint32_t interface = UINT32_MAX;
+	struct SpGraph g;
+	uint32_t *order = sparse_alloc_ids(s, n);
+	uint32_t *level = sparse_alloc_ids(s, n);
+	uint8_t  *cut   = bistack_alloc_front_vec(s, n, sizeof *cut);
+	if( order==NULL || level==NULL || cut==NULL || !spmat_graph(s, A, &g) ) {
+		goto done;
+	}
+	spgraph_level_order(&g, order, level);
+	uint32_t first = 0;
+	for( uint32_t b=0; b < parts; b++ ) {
+		uint32_t last = ( uint32_t )(( uint64_t )(n) * (b + 1) / parts);
+		uint32_t snap = last;
+		while( snap > first && snap < n && level[order[snap]]==level[order[snap - 1]] ) {
+			snap--;
+		}
+		last = ( snap > first )? snap : last;
+		for( uint32_t k = first; k < last; k++ ) {
+			part[order[k]] = b;
+		}
+		first = last;
+	}
+
+	for( uint32_t v=0; v < n; v++ ) {
+		cut[v] = false;
+		for( uint32_t p = g.ptr[v]; p < g.ptr[v + 1]; p++ ) {
+			if( part[g.adj[p]] > part[v] ) {
+				cut[v] = true;
+				break;
+			}
+		}
+	}
+	for( uint32_t j=0; j < n; j++ ) {
+		bool diag = false;
+		for( uint32_t p = A->colptr[j]; p < A->colptr[j + 1]; p++ ) {
+			diag |= A->rowidx[p]==j && rat_cmp(A->vals[p], rat_zero()) != 0;
+		}
+		for( uint32_t p = g.ptr[j]; p < g.ptr[j + 1] && !diag && !cut[j]; p++ ) {
+			cut[j] = cut[g.adj[p]]==true;
+		}
+	}
+	interface = 0;
+	for( uint32_t v=0; v < n; v++ ) {
+		if( cut[v] ) {
+			part[v] = DOMAIN_INTERFACE;
+			interface++;
+		}
+	}
+done:
+	s->front = scratch;
+	return interface;
+}
+
+
+struct _DomainPart {
+	struct SpLU lu;
+	uint32_t   *touch;       /// interface unknowns coupled to the interior, as Schur indices.
+	uint32_t    touch_count;
+	int         res;
+	bool        solved;      /// nothing couples it to the interface, its interior was final after elimination.
+};
+
+struct _DomainShared {
+	struct SpMat const  *G;
+	uint32_t const      *part;      /// block of every unknown, DOMAIN_INTERFACE on the interface.
+	uint32_t const      *local;     /// index inside its block's interior, or inside the interface.
+	uint32_t const      *interior;  /// unknowns of each block's interior, ascending, block `b` at `[start[b], start[b+1])`.
+	uint32_t const      *start;
+	uint32_t const      *iface;     /// interface unknowns.
+	struct _DomainPart  *blocks;
+	rat_t               *S;         /// `s x s` column-major Schur complement.
+	rat_t               *bS;        /// interface right-hand side, reduced by the interiors.
+	rat_t               *x;         /// `b` on the way in, the solution on the way out.
+	uint32_t             parts, s;
+	bool                 back;      /// back substitution, otherwise elimination.
+#ifdef DOMAIN_THREADS
+	atomic_uint          next_part;
+	pthread_mutex_t      lock;      /// guards `S` and `bS`.
+#else
+	uint32_t             next_part;
+#endif
+};
+
+struct _DomainWorker {
+	struct DomainPoolWorker base;   /// arena: factors on the back, per-block scratch on the front.
+	struct _DomainShared   *shared;
+};
+
+DOMAIN_EXPORT NO_NULLS uint32_t _domain_claim(struct _DomainShared *const sh) {
+#ifdef DOMAIN_THREADS
+	return atomic_fetch_add_explicit(&sh->next_part, 1, memory_order_relaxed);
+#else
+	return sh->next_part++;
+#endif
+}
+
+DOMAIN_EXPORT NO_NULLS void _domain_lock(struct _DomainShared *const sh) {
+#ifdef DOMAIN_THREADS
+	pthread_mutex_lock(&sh->lock);
+#else
+	(void)(sh);
+#endif
+}
+
+DOMAIN_EXPORT NO_NULLS void _domain_unlock(struct _DomainShared *const sh) {
+#ifdef DOMAIN_THREADS
+	pthread_mutex_unlock(&sh->lock);
+#else
+	(void)(sh);
+#endif
+}
+
+/// Factors block `b`'s interior and folds it into the Schur complement:
+/// `S -= C * A^-1 * B` and `bS -= C * A^-1 * b`, `C` and `B` being the couplings to the interface.
+/// The factors and the coupled interface columns move to the back of the arena for the back substitution.
+DOMAIN_EXPORT NO_NULLS int _domain_eliminate(struct _DomainWorker *const w, uint32_t const b) {
+	struct _DomainShared *const sh = w->shared;
+	struct _DomainPart *const blk = &sh->blocks[b];
+	struct SpMat const *const G = sh->G;
+	struct TIBiStack *const s = &w->base.arena;
+	uint32_t const *const rows = &sh->interior[sh->start[b]];
+	uint32_t const m = sh->start[b + 1] - sh->start[b], si = sh->s;
+	if( m==0 ) {
+		return ERR_OK;
+	}
+	/// interior block in CSC, ascending interior order keeps its rows sorted.
+	struct SpMat A = { .n = m };
+	A.colptr = sparse_alloc_ids(s, m + 1);
+	if( A.colptr==NULL ) {
+		return ERR_OOM;
+	}
+	for( uint32_t k=0; k < m; k++ ) {
+		for( uint32_t p = G->colptr[rows[k]]; p < G->colptr[rows[k] + 1]; p++ ) {
+			A.nnz += sh->part[G->rowidx[p]]==b;
+		}
+	}
+	A.rowidx = sparse_alloc_ids(s, A.nnz);
+	A.vals   = sparse_alloc_vals(s, A.nnz);
+	uint32_t *q = sparse_alloc_ids(s, m);
+	if( A.rowidx==NULL || A.vals==NULL || q==NULL ) {
+		return ERR_OOM;
+	}
+	uint32_t nz = 0;
+	for( uint32_t k=0; k < m; k++ ) {
+		A.colptr[k] = nz;
+		for( uint32_t p = G->colptr[rows[k]]; p < G->colptr[rows[k] + 1]; p++ ) {
+			if( sh->part[G->rowidx[p]]==b ) {
+				A.rowidx[nz] = sh->local[G->rowidx[p]];
+				A.vals[nz++] = G->vals[p];
+			}
+		}
+	}
+	A.colptr[m] = nz;
+
+	/// the interface unknowns this interior touches through `B` or `C`, and the interior unknowns doing the touching.
+	uint8_t  *seen = bistack_alloc_front_vec(s, si, sizeof *seen);
+	uint8_t  *edge = bistack_alloc_front_vec(s, m, sizeof *edge);
+	uint32_t *near = sparse_alloc_ids(s, m);
+	if( seen==NULL || edge==NULL || near==NULL ) {
+		return ERR_OOM;
+	}
+	for( uint32_t k=0; k < m; k++ ) {
+		for( uint32_t p = G->colptr[rows[k]]; p < G->colptr[rows[k] + 1]; p++ ) {
+			if( sh->part[G->rowidx[p]]==DOMAIN_INTERFACE ) {
+				blk->touch_count += !seen[sh->local[G->rowidx[p]]];
+				seen[sh->local[G->rowidx[p]]] = true;
+				edge[k] = true;
+			}
+		}
+	}
+	for( uint32_t t=0; t < si; t++ ) {
+		for( uint32_t p = G->colptr[sh->iface[t]]; p < G->colptr[sh->iface[t] + 1]; p++ ) {
+			if( sh->part[G->rowidx[p]]==b ) {
+				blk->touch_count += !seen[t];
+				seen[t] = true;
+				edge[sh->local[G->rowidx[p]]] = true;
+			}
+		}
+	}
+	blk->touch = bistack_alloc_back_vec(s, blk->touch_count, sizeof *blk->touch);
+	if( blk->touch==NULL ) {
+		return ERR_OOM;
+	}
+	for( uint32_t t=0, k=0; t < si; t++ ) {
+		if( seen[t] ) {
+			blk->touch[k++] = t;
+		}
+	}
+
+	/// Minimum degree, then the unknowns on the edge moved to the end of the order.
+	/// `B` only has rows there and `C` only reads them, so each interface column
+	/// only needs the trailing corner of the factors.
+	spmat_min_degree(s, &A, q);
+	uint32_t near_count = 0, kept = 0;
+	for( uint32_t k=0; k < m; k++ ) {
+		if( edge[q[k]] ) {
+			near[near_count++] = q[k];
+		} else {
+			q[kept++] = q[k];
+		}
+	}
+	memcpy(&q[kept], near, near_count * sizeof *q);
+	switch( splu_factor(s, &A, q, sparse_pivot_tol(), &blk->lu) ) {
+		case SPARSE_ERR_OOM:      return ERR_OOM;
+		case SPARSE_ERR_SINGULAR: return ERR_SINGULAR;
+	}
+	/// pivoting can still pull an edge row forward, so the corner starts at the earliest one.
+	uint32_t first = m;
+	for( uint32_t c=0; c < near_count; c++ ) {
+		first = ( ( uint32_t )(blk->lu.pinv[near[c]]) < first )? ( uint32_t )(blk->lu.pinv[near[c]]) : first;
+	}
+	blk->lu.q = sparse_persist(s, q, m * sizeof *q);
+	if( blk->lu.q==NULL || !splu_persist(s, &blk->lu) ) {
+		return ERR_OOM;
+	}
+
+	uint32_t const tc = blk->touch_count;
+	rat_t *Y    = alloc_vec(s, ( size_t )(m) * DOMAIN_BATCH);
+	rat_t *work = alloc_vec(s, ( size_t )(m) * DOMAIN_BATCH);
+	rat_t *acc  = alloc_vec(s, ( size_t )(si) * DOMAIN_BATCH);
+	if( Y==NULL || work==NULL || acc==NULL ) {
+		return ERR_OOM;
+	}
+	/// `Y = A^-1 * B` a batch of interface columns at a time, RHS-major.
+	/// `C*Y` gathers into `acc` (rows by Schur index) so the lock is only held to add it in.
+	for( uint32_t t0=0; t0 < tc; t0 += DOMAIN_BATCH ) {
+		uint32_t const k = ( tc - t0 < DOMAIN_BATCH )? tc - t0 : DOMAIN_BATCH;
+		memset(Y, 0, ( size_t )(m) * k * sizeof *Y);
+		for( uint32_t r=0; r < k; r++ ) {
+			uint32_t const j = sh->iface[blk->touch[t0 + r]];
+			for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+				if( sh->part[G->rowidx[p]]==b ) {
+					Y[( size_t )(sh->local[G->rowidx[p]]) * k + r] = G->vals[p];
+				}
+			}
+		}
+		splu_solve_batch_tail(&blk->lu, k, first, kept, Y, work);
+		for( uint32_t e=0; e < near_count; e++ ) {
+			uint32_t const c = near[e];
+			for( uint32_t p = G->colptr[rows[c]]; p < G->colptr[rows[c] + 1]; p++ ) {
+				if( sh->part[G->rowidx[p]]==DOMAIN_INTERFACE ) {
+					rat_t *const dst = &acc[( size_t )(sh->local[G->rowidx[p]]) * k];
+					for( uint32_t r=0; r < k; r++ ) {
+						dst[r] = rat_add(dst[r], rat_mul(G->vals[p], Y[( size_t )(c) * k + r]));
+					}
+				}
+			}
+		}
+		_domain_lock(sh);
+		for( uint32_t i=0; i < tc; i++ ) {
+			rat_t *const src = &acc[( size_t )(blk->touch[i]) * k];
+			for( uint32_t r=0; r < k; r++ ) {
+				rat_t *const dst = &sh->S[blk->touch[i] + ( size_t )(blk->touch[t0 + r]) * si];
+				*dst = rat_sub(*dst, src[r]);
+				src[r] = rat_zero();
+			}
+		}
+		_domain_unlock(sh);
+	}
+
+	/// same again for the right-hand side, `acc` is back to zeros.
+	for( uint32_t c=0; c < m; c++ ) {
+		Y[c] = sh->x[rows[c]];
+	}
+	splu_solve(&blk->lu, Y, work);
+	if( tc==0 ) {
+		for( uint32_t c=0; c < m; c++ ) {
+			sh->x[rows[c]] = Y[c];
+		}
+		blk->solved = true;
+		return ERR_OK;
+	}
+	for( uint32_t e=0; e < near_count; e++ ) {
+		uint32_t const c = near[e];
+		for( uint32_t p = G->colptr[rows[c]]; p < G->colptr[rows[c] + 1]; p++ ) {
+			if( sh->part[G->rowidx[p]]==DOMAIN_INTERFACE ) {
+				acc[sh->local[G->rowidx[p]]] = rat_add(acc[sh->local[G->rowidx[p]]], rat_mul(G->vals[p], Y[c]));
+			}
+		}
+	}
+	_domain_lock(sh);
+	for( uint32_t i=0; i < tc; i++ ) {
+		sh->bS[blk->touch[i]] = rat_sub(sh->bS[blk->touch[i]], acc[blk->touch[i]]);
+	}
+	_domain_unlock(sh);
+	return ERR_OK;
+}
+
+/// `x_I = A^-1 * (b_I - B * x_S)` for block `b`, the interface part of `x` already solved.
+DOMAIN_EXPORT NO_NULLS int _domain_substitute(struct _DomainWorker *const w, uint32_t const b) {
+	struct _DomainShared *const sh = w->shared;
+	struct _DomainPart const *const blk = &sh->blocks[b];
+	struct SpMat const *const G = sh->G;
+	uint32_t const *const rows = &sh->interior[sh->start[b]];
+	uint32_t const m = sh->start[b + 1] - sh->start[b];
+	if( m==0 || blk->solved ) {
+		return ERR_OK;
+	}
+	rat_t *y    = alloc_vec(&w->base.arena, m);
+	rat_t *work = alloc_vec(&w->base.arena, m);
+	if( y==NULL || work==NULL ) {
+		return ERR_OOM;
+	}
+	for( uint32_t c=0; c < m; c++ ) {
+		y[c] = sh->x[rows[c]];
+	}
+	for( uint32_t i=0; i < blk->touch_count; i++ ) {
+		uint32_t const j = sh->iface[blk->touch[i]];
+		for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+			if( sh->part[G->rowidx[p]]==b ) {
+				y[sh->local[G->rowidx[p]]] = rat_sub(y[sh->local[G->rowidx[p]]], rat_mul(G->vals[p], sh->x[j]));
+			}
+		}
+	}
+	splu_solve(&blk->lu, y, work);
+	for( uint32_t c=0; c < m; c++ ) {
+		sh->x[rows[c]] = y[c];
+	}
+	return ERR_OK;
+}
+
+DOMAIN_EXPORT NO_NULLS void *_domain_run_worker(void *const arg) {
+	struct _DomainWorker *const w = arg;
+	struct _DomainShared *const sh = w->shared;
+	w->base.ok = true;
+	for( uint32_t b = _domain_claim(sh); b < sh->parts; b = _domain_claim(sh) ) {
+		size_t const mark = w->base.arena.front;
+		int const res = sh->back? _domain_substitute(w, b) : _domain_eliminate(w, b);
+		if( res != ERR_OK ) {
+			sh->blocks[b].res = res;
+		}
+		w->base.arena.front = mark;
+	}
+	return NULL;
+}
+
+/// one pass over every block, spread over the workers with worker 0 inline.
+DOMAIN_EXPORT NO_NULLS void _domain_run(struct _DomainShared *const sh, struct _DomainWorker pool[const], uint32_t const workers) {
+	sh->next_part = 0;
+	domain_pool_run(pool, sizeof *pool, workers, _domain_run_worker);
+}
+
+/// Solves `G*x = x` (right-hand side in, solution out) over the blocks in `part`:
+/// every block's interior is eliminated into the Schur complement of the `si` interface unknowns,
+/// the complement is solved with the dense LU and the interiors are back-substituted.
+/// With no interface the blocks are simply independent systems solved side by side.
+/// Uses the front of `s` from where it is, the caller resets it. Any failure means
+/// the blocks couldn't be solved this way, not that the system has no solution.
+DOMAIN_EXPORT NO_NULLS int domain_solve(struct TIBiStack *const s, struct SpMat const *const G, uint32_t const part[const], uint32_t const parts, uint32_t const si, uint32_t workers, rat_t x[const]) {
+	uint32_t const n = G->n;
+	workers = ( workers > parts )? parts : workers;
+	workers = ( workers > 0 )? workers : 1;
+	uint32_t *local    = sparse_alloc_ids(s, n);
+	uint32_t *start    = sparse_alloc_ids(s, ( size_t )(parts) + 2);
+	uint32_t *interior = sparse_alloc_ids(s, n);
+	rat_t    *S        = alloc_vec(s, ( size_t )(si) * si);
+	rat_t    *bS       = alloc_vec(s, si);
+	uint32_t *piv      = sparse_alloc_ids(s, si);
+	struct _DomainPart   *blocks = bistack_alloc_front_vec(s, parts, sizeof *blocks);
+	struct _DomainWorker *pool   = bistack_alloc_front_vec(s, workers, sizeof *pool);
+	if( local==NULL || start==NULL || interior==NULL || S==NULL || bS==NULL || piv==NULL || blocks==NULL || pool==NULL ) {
+		return ERR_OOM;
+	}
+	/// interiors grouped by block in ascending order, the interface after them (counting as block `parts`).
+	for( uint32_t i=0; i < n; i++ ) {
+		start[(( part[i]==DOMAIN_INTERFACE )? parts : part[i]) + 1]++;
+	}
+	for( uint32_t b=0; b <= parts; b++ ) {
+		start[b + 1] += start[b];
+	}
+	for( uint32_t i=0; i < n; i++ ) {
+		interior[start[( part[i]==DOMAIN_INTERFACE )? parts : part[i]]++] = i;
+	}
+	/// filling ran every `start[b]` up to the next block's, shift them back.
+	for( uint32_t b = parts + 1; b > 0; b-- ) {
+		start[b] = start[b - 1];
+	}
+	start[0] = 0;
+	for( uint32_t b=0; b <= parts; b++ ) {
+		for( uint32_t k = start[b]; k < start[b + 1]; k++ ) {
+			local[interior[k]] = k - start[b];
+		}
+	}
+	uint32_t const *const iface = &interior[start[parts]];
+	for( uint32_t b=0; b < parts; b++ ) {
+		blocks[b].res = ERR_OK;
+	}
+	for( uint32_t t=0; t < si; t++ ) {
+		bS[t] = x[iface[t]];
+		uint32_t const j = iface[t];
+		for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+			if( part[G->rowidx[p]]==DOMAIN_INTERFACE ) {
+				S[local[G->rowidx[p]] + ( size_t )(t) * si] = G->vals[p];
+			}
+		}
+	}
+
+	struct _DomainShared sh = {
+		.G = G, .part = part, .local = local, .interior = interior, .start = start, .iface = iface,
+		.blocks = blocks, .S = S, .bS = bS, .x = x, .parts = parts, .s = si,
+	};
+	if( !domain_pool_carve(s, pool, sizeof *pool, workers) ) {
+		return ERR_OOM;
+	}
+	for( uint32_t w=0; w < workers; w++ ) {
+		pool[w].shared = &sh;
+	}
+#ifdef DOMAIN_THREADS
+	if( pthread_mutex_init(&sh.lock, NULL) != 0 ) {
+		return ERR_OOM;
+	}
+#endif
+	int res = ERR_OK;
+	_domain_run(&sh, pool, workers);
+	for( uint32_t b=0; b < parts && res==ERR_OK; b++ ) {
+		res = blocks[b].res;
+	}
+	if( res==ERR_OK && si > 0 ) {
+		struct DenseKernels const kern = dense_kernels();
+		if( dense_lu_factor(&kern, si, S, piv) ) {
+			dense_lu_solve(&kern, si, S, piv, bS);
+			for( uint32_t t=0; t < si; t++ ) {
+				x[iface[t]] = bS[t];
+			}
+		} else {
+			res = ERR_SINGULAR;
+		}
+	}
+	if( res==ERR_OK ) {
+		sh.back = true;
+		_domain_run(&sh, pool, workers);
+		for( uint32_t b=0; b < parts && res==ERR_OK; b++ ) {
+			res = blocks[b].res;
+		}
+	}
+#ifdef DOMAIN_THREADS
+	pthread_mutex_destroy(&sh.lock);
+#endif
+	return res;
+}
+
+/// Solves the DC node voltages like `circuit_calc_voltages`, split across cores.
+/// The MNA matrix is partitioned with `domain_partition`, each worker factors the interiors
+/// it claims out of its own `TIBiStack` carved from the circuit's free space and folds them
+/// into the interface Schur complement, the complement is solved with the dense LU, and the
+/// interiors are back-substituted in parallel off their kept factors.
+/// Systems under DOMAIN_MIN_ROWS, single-worker runs and partitions whose interface comes out
+/// larger than a quarter of the unknowns go through `circuit_calc_voltages` instead, as does
+/// any block that can't be factored on its own. Circuits with diodes fail with ERR_NONLINEAR.
+DOMAIN_EXPORT EXTANT(1, 2) int circuit_calc_voltages_domain(struct Circuit *const c, struct DomainOptions const *const opt, struct DomainResult *const result) {
+	struct TIBiStack *const s = &c->bistack;
+	struct DomainResult info = {0};
+	uint32_t const workers = domain_workers(opt->workers);
+	uint32_t parts = ( opt->parts > 0 )? opt->parts : workers;
+	parts = ( parts > DOMAIN_MAX_PARTS )? DOMAIN_MAX_PARTS : parts;
+
+	circuit_reset_voltages(c);
+	int res = ERR_OK;
+	if( c->active_count==0 ) {
+		goto done;
+	}
+	CIRCUIT_STATS_ONLY(uint64_t tick = circuit_stats_clock();)
+	struct StampProgram prog;
+	res = circuit_compile(c, &prog);
+	if( res != ERR_OK ) {
+		goto done;
+	} else if( prog.diode_count > 0 ) {
+		res = ERR_NONLINEAR;
+		goto done;
+	}
+	uint32_t const n = prog.n;
+	if( n < DOMAIN_MIN_ROWS || parts < 2 ) {
+		goto direct;
+	}
+	rat_t    *raw  = alloc_vec(s, prog.elem_count);
+	rat_t    *vals = alloc_vec(s, 2 * prog.elem_count);
+	rat_t    *x    = alloc_vec(s, n);
+	uint32_t *part = sparse_alloc_ids(s, n);
+	if( raw==NULL || vals==NULL || x==NULL || part==NULL ) {
+		goto direct;
+	}
+	stamp_program_load(&prog, raw);
+	stamp_program_assemble(&prog, raw, rat_zero(), vals, prog.G.vals, x);
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_ASSEMBLE, &tick);)
+	uint32_t const si = domain_partition(s, &prog.G, parts, part);
+	if( si > n / 4 ) {
+		goto direct;
+	}
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_ORDER, &tick);)
+	if( domain_solve(s, &prog.G, part, parts, si, workers, x) != ERR_OK ) {
+		goto direct;
+	}
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_FACTOR, &tick);)
+	stamp_program_store(&prog, c, x);
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_SOLVE, &tick);)
+#ifdef CIRCUIT_STATS
+	if( c->stats != NULL ) {
+		c->stats->solves++;
+		c->stats->n = n;
+		c->stats->a_nnz = prog.G.nnz;
+	}
+#endif
+	info = (struct DomainResult){ .parts = parts, .workers = ( workers > parts )? parts : workers, .interface = si };
+	goto done;
+
+direct:
+	bistack_reset_front(s);
+	info = (struct DomainResult){ .parts = 1, .workers = 1, .direct = true };
+	res = circuit_calc_voltages(c);
+done:
+	bistack_reset_front(s);
+	if( result != NULL ) {
+		*result = info;
+	}
+	return res;
+}
+#endif
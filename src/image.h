@@ -0,0 +1,382 @@
+#ifndef IMAGE_H_INCLUDED
+#	define IMAGE_H_INCLUDED
+
+#include "node.h"
+
+#if !defined(TICE_H) && (defined(__unix__) || defined(__APPLE__))
+#	define IMAGE_MMAP
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#define IMAGE_EXPORT    static inline
+
+enum {
+	IMAGE_VERSION = 1,
+	IMAGE_ALIGN   = 16,
+	IMAGE_ENDIAN  = 0x01020304,
+};
+
+enum {
+	IMAGE_ERR_FORMAT = -3, /// not an image, another version, or built for a different rat_t/word size.
+	IMAGE_ERR_IO     = -2,
+	IMAGE_ERR_OOM    = -1,
+	IMAGE_OK         =  1,
+};
+
+/// Image sections, each `IMAGE_ALIGN`ed and addressed by its offset from the start of the file.
+enum {
+	IMAGE_KIND = 0,
+	IMAGE_NODE_A,
+	IMAGE_NODE_B,
+	IMAGE_VAL,
+	IMAGE_ACTIVE,  /// active node bitset, `bitset_words(node_count)` words.
+	IMAGE_NAMES,   /// the name hash table as `struct NodeName`s, `name` holding a file offset.
+	IMAGE_STRINGS,
+	IMAGE_ORDER,   /// optional saved column order, `order_len` ids.
+	MAX_IMAGE_SECTIONS,
+};
+
+/// A circuit image is the edge storage of a circuit written out as-is, so loading is a
+/// mapping plus pointer setup. Components are indices rather than `struct Comp` links,
+/// so the image can sit anywhere in memory. It's a native format: it records the sizes of
+/// rat_t, size_t and the name entries and refuses to load where they differ.
+struct CircuitImageHeader {
+	char     magic[8];
+	uint32_t version, endian;
+	uint16_t rat_size, word_size, name_size, reserved;
+	uint32_t node_count, active_count, edge_count;
+	uint32_t name_cap, name_count, order_len;
+	uint64_t offs[MAX_IMAGE_SECTIONS];
+	uint64_t total_len;
+};
+
+IMAGE_EXPORT void _image_magic(char magic[const static 8]) {
+	memcpy(magic, "LSPCIMG", 8);
+}
+
+IMAGE_EXPORT EXTANT(1, 2) bool _image_write_section(FILE *const file, uint64_t *const at, uint64_t const offs, void const *const data, size_t const bytes) {
+	static uint8_t const zeros[IMAGE_ALIGN] = {0};
+	if( offs > *at && fwrite(zeros, 1, ( size_t )(offs - *at), file) != offs - *at ) {
+		return false;
+	}
+	*at = offs + bytes;
+	return bytes==0 || fwrite(data, 1, bytes, file)==bytes;
+}
+
+/// Writes the circuit as an image. Linked storage is flattened into edges on the way out,
+/// `with_order` also stores the fill-reducing ordering so loads skip that analysis.
+/// Subcircuit instances aren't kept, their components come back as plain ones without the `macro` flag.
+IMAGE_EXPORT NO_NULLS int circuit_save_image(struct Circuit *const c, char const path[const static 1], bool const with_order) {
+	struct TIBiStack *const s = &c->bistack;
+	int res = IMAGE_ERR_OOM;
+	struct CompEdges flat = c->edges;
+	if( c->storage==STORE_LINKED ) {
+		uint32_t count = 0;
+		for( uint32_t n=0; n < c->node_count && n < c->node_cap; n++ ) {
+			for( struct Comp const *comp = c->comps[n]; comp != NULL; comp = comp->next ) {
+				count += !comp->mirrored;
+			}
+		}
+		flat = (struct CompEdges){ .len = count };
+		flat.kind   = bistack_alloc_front_vec(s, count, sizeof *flat.kind);
+		flat.node_a = sparse_alloc_ids(s, count);
+		flat.node_b = sparse_alloc_ids(s, count);
+		flat.val    = sparse_alloc_vals(s, count);
+		if( count > 0 && (flat.kind==NULL || flat.node_a==NULL || flat.node_b==NULL || flat.val==NULL) ) {
+			goto done;
+		}
+		uint32_t e = 0;
+		for( uint32_t n=0; n < c->node_count && n < c->node_cap; n++ ) {
+			for( struct Comp const *comp = c->comps[n]; comp != NULL; comp = comp->next ) {
+				if( !comp->mirrored ) {
+					flat.kind[e]   = comp->kind;
+					flat.node_a[e] = comp->owner;
+					flat.node_b[e] = comp->node;
+					flat.val[e]    = comp->val;
+					e++;
+				}
+			}
+		}
+	}
+
+	struct StampProgram prog = {0};
+	uint32_t *order = NULL;
+	if( with_order && c->active_count > 0 ) {
+		res = circuit_compile(c, &prog);
+		if( res != ERR_OK ) {
+			res = ( res==ERR_OOM )? IMAGE_ERR_OOM : IMAGE_ERR_FORMAT;
+			goto done;
+		}
+		res = IMAGE_ERR_OOM;
+		order = sparse_alloc_ids(s, prog.n);
+		if( order==NULL ) {
+			goto done;
+		}
+		circuit_order(c, &prog, order);
+	}
+
+	/// names go out with their string's file offset in place of the pointer.
+	size_t strings_len = 0;
+	struct NodeName *names = bistack_alloc_front_vec(s, c->name_cap, sizeof *names);
+	if( c->name_cap > 0 && names==NULL ) {
+		goto done;
+	}
+	for( uint32_t i=0; i < c->name_cap; i++ ) {
+		if( c->names[i].name != NULL ) {
+			strings_len += c->names[i].len + 1;
+		}
+	}
+	char *strings = bistack_alloc_front_vec(s, strings_len, sizeof *strings);
+	if( strings_len > 0 && strings==NULL ) {
+		goto done;
+	}
+
+	struct CircuitImageHeader hdr = {
+		.version      = IMAGE_VERSION,
+		.endian       = IMAGE_ENDIAN,
+		.rat_size     = sizeof(rat_t),
+		.word_size    = sizeof(size_t),
+		.name_size    = sizeof(struct NodeName),
+		.node_count   = c->node_count,
+		.active_count = c->active_count,
+		.edge_count   = flat.len,
+		.name_cap     = c->name_cap,
+		.name_count   = c->name_count,
+		.order_len    = ( order != NULL )? prog.n : 0,
+	};
+	_image_magic(hdr.magic);
+	size_t const bytes[MAX_IMAGE_SECTIONS] = {
+		[IMAGE_KIND]    = flat.len * sizeof *flat.kind,
+		[IMAGE_NODE_A]  = flat.len * sizeof *flat.node_a,
+		[IMAGE_NODE_B]  = flat.len * sizeof *flat.node_b,
+		[IMAGE_VAL]     = flat.len * sizeof *flat.val,
+		[IMAGE_ACTIVE]  = bitset_words(c->node_count) * sizeof *c->active_nodes,
+		[IMAGE_NAMES]   = c->name_cap * sizeof *names,
+		[IMAGE_STRINGS] = strings_len,
+		[IMAGE_ORDER]   = hdr.order_len * sizeof *order,
+	};
+	uint64_t at = _align_size(sizeof hdr, IMAGE_ALIGN);
+	for( int k=0; k < MAX_IMAGE_SECTIONS; k++ ) {
+		hdr.offs[k] = at;
+		at = _align_size(at + bytes[k], IMAGE_ALIGN);
+	}
+	hdr.total_len = at;
+
+	size_t str_at = 0;
+	for( uint32_t i=0; i < c->name_cap; i++ ) {
+		names[i] = c->names[i];
+		if( c->names[i].name != NULL ) {
+			memcpy(&strings[str_at], c->names[i].name, c->names[i].len);
+			names[i].name = ( char const* )(( uintptr_t )(hdr.offs[IMAGE_STRINGS] + str_at));
+			str_at += c->names[i].len + 1;
+		}
+	}
+
+	void const *const data[MAX_IMAGE_SECTIONS] = {
+		flat.kind, flat.node_a, flat.node_b, flat.val, c->active_nodes, names, strings, order,
+	};
+	res = IMAGE_ERR_IO;
+	FILE *const file = fopen(path, "wb");
+	if( file==NULL ) {
+		goto done;
+	}
+	uint64_t written = 0;
+	bool ok = _image_write_section(file, &written, 0, &hdr, sizeof hdr);
+	for( int k=0; k < MAX_IMAGE_SECTIONS && ok; k++ ) {
+		ok = _image_write_section(file, &written, hdr.offs[k], data[k], bytes[k]);
+	}
+	ok = ok && _image_write_section(file, &written, hdr.total_len, NULL, 0);
+	ok = (fclose(file)==0) && ok;
+	res = ok? IMAGE_OK : IMAGE_ERR_IO;
+done:
+	bistack_reset_front(s);
+	return res;
+}
+
+/// Everything the header claims, checked against the image before any of it is used:
+/// every section fits before the next one and the end, edges have a known kind and nodes in range,
+/// the name table is a power of two with a free slot and names point inside the strings,
+/// and a saved order is a permutation. Takes scratch from the front of `s`.
+IMAGE_EXPORT NO_NULLS bool _image_check(struct CircuitImageHeader const *const hdr, uint8_t const *const base, struct TIBiStack *const s) {
+	uint64_t const bytes[MAX_IMAGE_SECTIONS] = {
+		[IMAGE_KIND]    = ( uint64_t )(hdr->edge_count) * sizeof(uint8_t),
+		[IMAGE_NODE_A]  = ( uint64_t )(hdr->edge_count) * sizeof(uint32_t),
+		[IMAGE_NODE_B]  = ( uint64_t )(hdr->edge_count) * sizeof(uint32_t),
+		[IMAGE_VAL]     = ( uint64_t )(hdr->edge_count) * sizeof(rat_t),
+		[IMAGE_ACTIVE]  = ( uint64_t )(bitset_words(hdr->node_count)) * sizeof(size_t),
+		[IMAGE_NAMES]   = ( uint64_t )(hdr->name_cap) * sizeof(struct NodeName),
+		[IMAGE_STRINGS] = 0, /// not recorded, bounded by the next section.
+		[IMAGE_ORDER]   = ( uint64_t )(hdr->order_len) * sizeof(uint32_t),
+	};
+	uint64_t at = sizeof *hdr;
+	for( int k=0; k < MAX_IMAGE_SECTIONS; k++ ) {
+		uint64_t const end = ( k + 1 < MAX_IMAGE_SECTIONS )? hdr->offs[k + 1] : hdr->total_len;
+		if( hdr->offs[k] < at || hdr->offs[k] % IMAGE_ALIGN != 0 || end > hdr->total_len || hdr->offs[k] > end || bytes[k] > end - hdr->offs[k] ) {
+			return false;
+		}
+		at = hdr->offs[k] + bytes[k];
+	}
+	if( hdr->active_count > hdr->node_count || (hdr->name_cap & (hdr->name_cap - 1)) != 0 ) {
+		return false;
+	}
+
+	uint8_t  const *const kind   = base + hdr->offs[IMAGE_KIND];
+	uint32_t const *const node_a = ( uint32_t const* )(base + hdr->offs[IMAGE_NODE_A]);
+	uint32_t const *const node_b = ( uint32_t const* )(base + hdr->offs[IMAGE_NODE_B]);
+	for( uint32_t e=0; e < hdr->edge_count; e++ ) {
+		if( kind[e] >= MAX_COMP_TYPES || node_a[e] >= hdr->node_count || node_b[e] >= hdr->node_count ) {
+			return false;
+		}
+	}
+
+	/// the table must keep an empty slot or probing never ends.
+	struct NodeName const *const names = ( struct NodeName const* )(base + hdr->offs[IMAGE_NAMES]);
+	uint64_t const strings = hdr->offs[IMAGE_STRINGS], strings_end = hdr->offs[IMAGE_ORDER];
+	uint32_t used = 0;
+	for( uint32_t i=0; i < hdr->name_cap; i++ ) {
+		if( names[i].name==NULL ) {
+			continue;
+		}
+		uint64_t const offs = ( uintptr_t )(names[i].name);
+		if( offs < strings || offs > strings_end || names[i].len > strings_end - offs || names[i].id >= hdr->node_count ) {
+			return false;
+		}
+		used++;
+	}
+	if( used != hdr->name_count || (hdr->name_cap > 0 && used >= hdr->name_cap) ) {
+		return false;
+	}
+
+	if( hdr->order_len > 0 ) {
+		uint32_t const *const order = ( uint32_t const* )(base + hdr->offs[IMAGE_ORDER]);
+		struct TIBiMark const mark = bistack_mark(s);
+		uint8_t *const seen = bistack_alloc_front_vec(s, hdr->order_len, sizeof *seen);
+		bool ok = seen != NULL;
+		for( uint32_t i=0; i < hdr->order_len && ok; i++ ) {
+			ok = order[i] < hdr->order_len && !seen[order[i]];
+			if( ok ) {
+				seen[order[i]] = 1;
+			}
+		}
+		bistack_rewind_front(s, mark);
+		return ok;
+	}
+	return true;
+}
+
+/// Points a fresh circuit's tables into an image already in memory, with no per-component work.
+/// Only the name table gets its string offsets turned into pointers, and the voltage table is
+/// allocated on the bistack. The image must stay alive and be writable, a private
+/// copy-on-write mapping does, since changing values writes straight into it.
+/// A header whose counts don't fit the image, or contents that would index out of it, fail with IMAGE_ERR_FORMAT.
+IMAGE_EXPORT NO_NULLS int circuit_attach_image(struct Circuit *const c, void *const image, size_t const len) {
+	struct CircuitImageHeader *const hdr = image;
+	char magic[8];
+	_image_magic(magic);
+	if( len < sizeof *hdr || memcmp(hdr->magic, magic, sizeof magic) != 0 || hdr->version != IMAGE_VERSION
+	 || hdr->endian != IMAGE_ENDIAN || hdr->rat_size != sizeof(rat_t) || hdr->word_size != sizeof(size_t)
+	 || hdr->name_size != sizeof(struct NodeName) || hdr->total_len > len || hdr->node_count==0 ) {
+		return IMAGE_ERR_FORMAT;
+	}
+	uint8_t *const base = image;
+	if( !_image_check(hdr, base, &c->bistack) ) {
+		return IMAGE_ERR_FORMAT;
+	}
+	rat_t *voltage = bistack_alloc_back_vec(&c->bistack, hdr->node_count, sizeof *voltage);
+	if( voltage==NULL ) {
+		return IMAGE_ERR_OOM;
+	}
+	c->storage      = STORE_EDGES;
+	c->comps        = NULL;
+	c->voltage      = voltage;
+	c->active_nodes = ( size_t* )(base + hdr->offs[IMAGE_ACTIVE]);
+	c->node_cap     = hdr->node_count;
+	c->node_count   = hdr->node_count;
+	c->active_count = hdr->active_count;
+	c->edges = (struct CompEdges){
+		.kind   = base + hdr->offs[IMAGE_KIND],
+		.node_a = ( uint32_t* )(base + hdr->offs[IMAGE_NODE_A]),
+		.node_b = ( uint32_t* )(base + hdr->offs[IMAGE_NODE_B]),
+		.val    = ( rat_t* )(base + hdr->offs[IMAGE_VAL]),
+		.len    = hdr->edge_count,
+		.cap    = hdr->edge_count,
+	};
+	c->names      = ( hdr->name_cap > 0 )? ( struct NodeName* )(base + hdr->offs[IMAGE_NAMES]) : NULL;
+	c->name_cap   = hdr->name_cap;
+	c->name_count = hdr->name_count;
+	for( uint32_t i=0; i < c->name_cap; i++ ) {
+		if( c->names[i].name != NULL ) {
+			c->names[i].name = ( char const* )(base + ( uintptr_t )(c->names[i].name));
+		}
+	}
+	c->order     = ( hdr->order_len > 0 )? ( uint32_t* )(base + hdr->offs[IMAGE_ORDER]) : NULL;
+	c->order_len = hdr->order_len;
+	c->image     = image;
+	c->image_len = len;
+	return IMAGE_OK;
+}
+
+/// Loads a circuit image into a fresh circuit: a private mapping where there's mmap,
+/// read onto the back of the bistack elsewhere.
+IMAGE_EXPORT NO_NULLS int circuit_load_mapped(struct Circuit *const c, char const path[const static 1]) {
+#ifdef IMAGE_MMAP
+	int const fd = open(path, O_RDONLY);
+	if( fd < 0 ) {
+		return IMAGE_ERR_IO;
+	}
+	struct stat info;
+	if( fstat(fd, &info) < 0 || info.st_size < ( off_t )(sizeof(struct CircuitImageHeader)) ) {
+		close(fd);
+		return IMAGE_ERR_FORMAT;
+	}
+	size_t const len = ( size_t )(info.st_size);
+	void *const image = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if( image==MAP_FAILED ) {
+		return IMAGE_ERR_IO;
+	}
+	int const res = circuit_attach_image(c, image, len);
+	if( res != IMAGE_OK ) {
+		munmap(image, len);
+	}
+	return res;
+#else
+	FILE *const file = fopen(path, "rb");
+	if( file==NULL ) {
+		return IMAGE_ERR_IO;
+	}
+	struct CircuitImageHeader hdr;
+	int res = IMAGE_ERR_FORMAT;
+	if( fread(&hdr, sizeof hdr, 1, file)==1 && hdr.total_len >= sizeof hdr ) {
+		struct TIBiMark const mark = bistack_mark(&c->bistack);
+		uint8_t *const image = bistack_alloc_back(&c->bistack, ( size_t )(hdr.total_len));
+		res = IMAGE_ERR_OOM;
+		if( image != NULL ) {
+			memcpy(image, &hdr, sizeof hdr);
+			size_t const rest = ( size_t )(hdr.total_len) - sizeof hdr;
+			res = ( fread(image + sizeof hdr, 1, rest, file)==rest )? circuit_attach_image(c, image, ( size_t )(hdr.total_len)) : IMAGE_ERR_IO;
+			if( res != IMAGE_OK ) {
+				/// the copy stands in for the mapping, drop it on failure as the mmap path unmaps.
+				bistack_rewind(&c->bistack, mark);
+			}
+		}
+	}
+	fclose(file);
+	return res;
+#endif
+}
+
+/// releases the mapping behind a circuit from `circuit_load_mapped`, the circuit can't be used afterwards.
+IMAGE_EXPORT NO_NULLS void circuit_unmap(struct Circuit *const c) {
+#ifdef IMAGE_MMAP
+	if( c->image != NULL ) {
+		munmap(c->image, c->image_len);
+	}
+#endif
+	c->image     = NULL;
+	c->image_len = 0;
+}
+#endif
@@ -1,6 +1,11 @@
 #include <tice.h>
 #include <stdlib.h>
 #include "node.h"
+#include "netlist.h"
+#include "newton.h"
+#include "connect.h"
+#include "waveform.h"
+#include "sensitivity.h"
 
 /**
 0 -> Ground/Reference node.
@@ -31,12 +36,71 @@ enum {
 #ifdef TICE_H
 	MEM_SIZE = 1 << 14
 #else
-	MEM_SIZE = 1 << 20
+	MEM_SIZE = 1 << 20,
+	WAVE_MEM = 1 << 20, /// the waveform writer's blocks.
+	SENS_ROWS = 20,     /// largest sensitivities listed.
 #endif
 };
 uint8_t backing_mem[MEM_SIZE];
 
+#ifndef TICE_H
+/// prints a node by its netlist name, falling back to its index.
+static void print_node(struct Circuit const *const c, uint32_t const id, FILE *const out) {
+	if( id==GND_IDX ) {
+		fputs("0", out);
+		return;
+	}
+	for( uint32_t i=0; i < c->name_cap; i++ ) {
+		if( c->names[i].name != NULL && c->names[i].id==id ) {
+			fprintf(out, "%.*s", ( int )(c->names[i].len), c->names[i].name);
+			return;
+		}
+	}
+	fprintf(out, "#%" PRIu32, id);
+}
+
+/// waveforms are CSV when the path ends in `.csv` and SPICE raw otherwise, keeping to a `.save` list.
+static struct WaveOptions wave_options_for(char const path[const static 1], struct NetlistStatus const *const status) {
+	size_t const path_len = strlen(path);
+	bool const csv = path_len >= 4 && strcmp(&path[path_len - 4], ".csv")==0;
+	struct WaveOptions opt = wave_options(csv? WAVE_CSV : WAVE_RAW);
+	if( status->save_count > 0 ) {
+		opt.nodes      = status->save;
+		opt.node_count = status->save_count;
+		opt.currents   = false;
+	}
+	return opt;
+}
+
+/// writes the phasors of an AC sweep out as a complex waveform, `volts` and `freqs` as `circuit_ac_sweep` left them.
+static int write_ac_wave(struct Circuit const *const c, char const path[const static 1], struct NetlistStatus const *const status, uint32_t const points, crat_t const volts[const], rat_t const freqs[const]) {
+	struct WaveOptions opt = wave_options_for(path, status);
+	opt.plot    = "AC Analysis";
+	opt.scale   = "frequency";
+	opt.unit    = "frequency";
+	opt.phasors = true;
+	void *const mem = malloc(WAVE_MEM);
+	struct WaveWriter wave;
+	int res = ( mem != NULL )? wave_open(&wave, c, path, &opt, mem, WAVE_MEM) : WAVE_ERR_OOM;
+	if( res==WAVE_OK ) {
+		for( uint32_t p=0; p < points; p++ ) {
+			wave_put_phasors(&wave, freqs[p], &volts[idx1D(p, 0, c->node_count)]);
+		}
+	}
+	if( mem != NULL ) {
+		int const close_res = wave_close(&wave);
+		res = ( res==WAVE_OK )? close_res : res;
+	}
+	free(mem);
+	return res;
+}
+#endif
+
+#ifdef TICE_H
 int main(void) {
+#else
+int main(int argc, char *argv[]) {
+#endif
 #	ifdef TICE_H
 #	warning "compiling for TI Calculator"
 	os_ClrHome();
@@ -61,10 +125,10 @@ int main(void) {
 	puts("Calc'ed Voltages. Press 'enter' to continue.");
 	while( os_GetCSC() != sk_Enter );
 	os_ClrHome();
-	for( size_t i=0; i < MAX_NODES; i++ ) {
-		if( circuit.active_nodes & (1 << i) ) {
+	for( uint32_t i=0; i < circuit.node_count; i++ ) {
+		if( circuit_node_active(&circuit, i) ) {
 			char voltage_str[32] = {0}; rat_to_str(circuit.voltage[i], sizeof voltage_str, voltage_str);
-			printf("Node %zu: %s volts\n", i, voltage_str);
+			printf("Node %" PRIu32 ": %s volts\n", i, voltage_str);
 		}
 	}
 	puts("Press 'clear' to Exit.");
@@ -73,6 +137,137 @@ int main(void) {
 #	warning "compiling for PC/Other"
 	puts("Welcome to LiteSpiCE");
 	struct Circuit circuit = circuit_make(backing_mem, sizeof backing_mem);
+#	ifdef BISTACK_RESERVE
+	/// a netlist can be any size, it gets a bistack that grows with it where there's one to be had.
+	circuit_make_reserved(&circuit, 0);
+#	endif
+	if( argc > 1 ) {
+		struct NetlistStatus status;
+		if( circuit_load_netlist(&circuit, argv[1], &status) != NETLIST_OK ) {
+			fprintf(stderr, "%s:%" PRIu32 ": %s\n", argv[1], status.line, netlist_strerror(status.code));
+			return 1;
+		}
+		printf("Loaded %" PRIu32 " elements, %" PRIu32 " nodes.\n", status.elements, circuit.node_count);
+		struct ConnectReport rep;
+		uint32_t floating[8];
+		int const check = circuit_check_connectivity(&circuit, &rep, floating, sizeof floating / sizeof *floating);
+		if( check != ERR_OK ) {
+			for( uint32_t i=0; i < rep.floating && i < sizeof floating / sizeof *floating; i++ ) {
+				fputs("floating node (no DC path to ground): ", stderr);
+				print_node(&circuit, floating[i], stderr);
+				fputc('\n', stderr);
+			}
+			for( uint32_t i=0; i < rep.source_loops && i < CONNECT_MAX_LOOPS; i++ ) {
+				fputs("loop of voltage sources/inductors closed between ", stderr);
+				print_node(&circuit, rep.loop_n1[i], stderr);
+				fputs(" and ", stderr);
+				print_node(&circuit, rep.loop_n2[i], stderr);
+				fputc('\n', stderr);
+			}
+			fprintf(stderr, "%" PRIu32 " floating nodes, %" PRIu32 " source loops\n", rep.floating, rep.source_loops);
+			return 1;
+		}
+		struct NewtonOptions const newton = newton_options();
+		int const res = circuit_calc_voltages_newton(&circuit, &newton, NULL);
+		if( res != ERR_OK ) {
+			fprintf(stderr, "solve failed (%d)\n", res);
+			return 1;
+		}
+		for( uint32_t i=0; i < circuit.name_cap; i++ ) {
+			struct NodeName const *const n = &circuit.names[i];
+			if( n->name != NULL && circuit_node_active(&circuit, n->id) ) {
+				char voltage_str[32] = {0}; rat_to_str(circuit.voltage[n->id], sizeof voltage_str, voltage_str);
+				printf("%.*s: %s volts\n", ( int )(n->len), n->name, voltage_str);
+			}
+		}
+		if( status.sens_out != NODE_NONE ) {
+			struct SensEntry table[SENS_ROWS];
+			struct SensResult sens;
+			int const sens_res = circuit_sensitivity(&circuit, &newton, status.sens_out, table, SENS_ROWS, &sens);
+			if( sens_res != ERR_OK ) {
+				fprintf(stderr, "sensitivity failed (%d)\n", sens_res);
+				return 1;
+			}
+			fputs("\nDC sensitivity of v(", stdout);
+			print_node(&circuit, status.sens_out, stdout);
+			printf(") = %g V, largest %" PRIu32 " of %" PRIu32 " (dV/dvalue, and V per 100%% change):\n", rat_to_double(sens.vout), sens.entries, sens.elements);
+			for( uint32_t i=0; i < sens.entries; i++ ) {
+				struct SensEntry const *const e = &table[i];
+				char const letter = ( e->kind==COMP_RESISTOR )? 'R' : ( e->kind==COMP_VOLTAGE_SRC )? 'V' : 'I';
+				printf("  %c(", letter);
+				print_node(&circuit, e->n1, stdout);
+				putchar(',');
+				print_node(&circuit, e->n2, stdout);
+				printf(") = %g: %g, %g\n", rat_to_double(e->val), rat_to_double(e->dv), rat_to_double(e->rel));
+			}
+		}
+		if( status.has_ac ) {
+			uint32_t const points = ac_point_count(&status.ac);
+			crat_t *const volts = calloc(( size_t )(points) * circuit.node_count + 1, sizeof *volts);
+			rat_t  *const freqs = calloc(( size_t )(points) + 1, sizeof *freqs);
+			struct AcResult ac;
+			status.ac.newton = &newton;
+			int const ac_res = ( volts != NULL && freqs != NULL )? circuit_ac_sweep(&circuit, &status.ac, volts, freqs, &ac) : ERR_OOM;
+			if( ac_res != ERR_OK ) {
+				fprintf(stderr, "ac sweep failed (%d)\n", ac_res);
+				free(volts);
+				free(freqs);
+				return 1;
+			} else if( status.ac.in_n1==NODE_NONE ) {
+				fputs("no source has an AC field, every phasor is 0\n", stderr);
+			}
+			printf("\nAC sweep, %" PRIu32 " points on %" PRIu32 " workers (magnitude, phase in degrees):\n", ac.points, ac.workers);
+			rat_t const deg = rat_div(rat_from_int(180), rat_pi());
+			for( uint32_t p=0; p < points; p++ ) {
+				printf("%g Hz", ( double )(freqs[p]));
+				for( uint32_t i=0; i < circuit.name_cap; i++ ) {
+					struct NodeName const *const n = &circuit.names[i];
+					if( n->name != NULL && circuit_node_active(&circuit, n->id) ) {
+						crat_t const v = volts[idx1D(p, n->id, circuit.node_count)];
+						printf("  %.*s: %g, %g", ( int )(n->len), n->name, ( double )(crat_abs(v)), ( double )(rat_mul(crat_arg(v), deg)));
+					}
+				}
+				putchar('\n');
+			}
+			/// with no transient to take it, the second argument gets the phasors.
+			int const wave_res = ( argc > 2 && !status.has_tran )? write_ac_wave(&circuit, argv[2], &status, points, volts, freqs) : WAVE_OK;
+			free(volts);
+			free(freqs);
+			if( wave_res != WAVE_OK ) {
+				fprintf(stderr, "%s: waveform write failed (%d)\n", argv[2], wave_res);
+				return 1;
+			}
+		}
+		if( status.has_tran ) {
+			/// waveforms go to the second argument, `litespice.raw` without one.
+			char const *const path = ( argc > 2 )? argv[2] : "litespice.raw";
+			struct WaveOptions const wave_opt = wave_options_for(path, &status);
+			void *const wave_mem = malloc(WAVE_MEM);
+			struct WaveWriter wave;
+			int wave_res = ( wave_mem != NULL )? wave_open(&wave, &circuit, path, &wave_opt, wave_mem, WAVE_MEM) : WAVE_ERR_OOM;
+			if( wave_res != WAVE_OK ) {
+				fprintf(stderr, "%s: can't write waveform (%d)\n", path, wave_res);
+				free(wave_mem);
+				return 1;
+			}
+			struct TranStats tran;
+			int const tran_res = circuit_transient(&circuit, &status.tran, wave_probe, &wave, &tran);
+			wave_res = wave_close(&wave);
+			free(wave_mem);
+			if( tran_res==ERR_NONLINEAR ) {
+				fputs("transient analysis doesn't handle diodes\n", stderr);
+				return 1;
+			} else if( tran_res != ERR_OK ) {
+				fprintf(stderr, "transient failed (%d)\n", tran_res);
+				return 1;
+			} else if( wave_res != WAVE_OK ) {
+				fprintf(stderr, "%s: waveform write failed (%d)\n", path, wave_res);
+				return 1;
+			}
+			printf("\nTransient, %" PRIu32 " points (%" PRIu32 " rejected) written to %s\n", wave.points, tran.rejected, path);
+		}
+		return 0;
+	}
 	if( circuit_add_component(&circuit, 0, 1, COMP_VOLTAGE_SRC, rat_from_int(5))==ERR_OK ) {
 		puts("Volt Src (5 volts) | ground -> node 1.");
 	}
@@ -85,10 +280,10 @@ int main(void) {
 	puts("Calcing voltages...");
 	circuit_calc_voltages(&circuit);
 	puts("Done calculating voltages...\n\nPrinting Voltages::");
-	for( size_t i=0; i < MAX_NODES; i++ ) {
-		if( circuit.active_nodes & (1 << i) ) {
+	for( uint32_t i=0; i < circuit.node_count; i++ ) {
+		if( circuit_node_active(&circuit, i) ) {
 			char voltage_str[32] = {0}; rat_to_str(circuit.voltage[i], sizeof voltage_str, voltage_str);
-			printf("Node %zu: %s volts\n", i, voltage_str);
+			printf("Node %" PRIu32 ": %s volts\n", i, voltage_str);
 		}
 	}
 #	endif
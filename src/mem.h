@@ -7,6 +7,18 @@
 #include <stdio.h>
 #include <string.h>
 
+/// host builds can back a bistack with a reserved address range instead of a fixed buffer.
+#if !defined(TICE_H) && (defined(__unix__) || defined(__APPLE__))
+#	define BISTACK_RESERVE
+#	include <sys/mman.h>
+#	ifndef MAP_NORESERVE
+#		define MAP_NORESERVE    0
+#	endif
+#	ifndef MAP_ANONYMOUS
+#		define MAP_ANONYMOUS    MAP_ANON
+#	endif
+#endif
+
 
 #define TI_MEM_EXPORT    static inline
 
@@ -71,10 +83,54 @@ TI_MEM_EXPORT NO_NULLS int region_size_remaining(struct TIMemRegion const *const
 }
 
 
+/** Allocation statistics, compiled in with `-DMEM_STATS`.
+ * Every bistack allocation is attributed to the `file:line` that made it,
+ * or to the caller of a tracked helper like `alloc_vec`.
+ */
+#ifdef MEM_STATS
+enum {
+	MEM_STATS_SITES = 64,
+};
+
+struct TIMemSite {
+	char const *site;
+	size_t      bytes;
+	uint32_t    allocs, ooms;
+};
+
+struct TIMemStats {
+	size_t           front_peak, back_peak, total_peak; /// bytes in use at the high-water marks, `total_peak` counts both ends.
+	size_t           front_bytes, back_bytes;           /// bytes handed out over the lifetime.
+	uint32_t         front_allocs, back_allocs, ooms;
+	char const      *last_oom_site;
+	size_t           last_oom_bytes, last_oom_margin;   /// request that failed and the room that was left.
+	char const      *pending;                           /// caller site stashed by a tracked helper.
+	struct TIMemSite sites[MEM_STATS_SITES];
+	uint32_t         site_count, sites_dropped;
+};
+
+#	define _MEM_STR(x)    #x
+#	define _MEM_LINE(x)   _MEM_STR(x)
+#	define MEM_SITE       __FILE__ ":" _MEM_LINE(__LINE__)
+#endif
+
+
 /** Bifurcated/Double-Ended Stack */
 struct TIBiStack {
 	uint8_t *mem;
 	size_t   front, back, len;
+#ifdef BISTACK_RESERVE
+	size_t   mapped; /// bytes of `mem` mapped by `bistack_reserve`, 0 for a caller's buffer.
+#endif
+#ifdef MEM_STATS
+	struct TIMemStats *stats; /// NULL when not tracking.
+#endif
+};
+
+/// A save point, `bistack_rewind` frees exactly what was allocated since on both ends.
+/// Save points nest like the scratch phases taking them.
+struct TIBiMark {
+	size_t front, back;
 };
 
 
@@ -82,6 +138,159 @@ TI_MEM_EXPORT NO_NULLS struct TIBiStack bistack_make(uint8_t *const buf, size_t
 	return (struct TIBiStack){ .mem = buf, .len = len, .front = 0, .back = len };
 }
 
+#ifdef BISTACK_RESERVE
+enum {
+	BISTACK_HUGE_PAGE = 1 << 21, /// reservations are aligned and sized in these so the kernel can back them with huge pages.
+};
+
+/// address space asked for when `bistack_reserve` gets 0, halved until the system grants it.
+#	define BISTACK_DEFAULT_RESERVE    (( sizeof(size_t) >= 8 )? ( size_t )(1) << 36 : ( size_t )(1) << 30)
+
+/// A bistack over a reserved stretch of address space rather than a fixed buffer.
+/// The range is mapped without a commit charge (where the system allows it) and a page only
+/// gets memory when it's first touched, so the bistack grows with use up to `reserve` bytes
+/// from either end and everything built on offsets into `mem` works unchanged.
+/// A refused reservation is retried at half the size down to one huge page.
+TI_MEM_EXPORT NO_NULLS bool bistack_reserve(struct TIBiStack *const s, size_t reserve) {
+	if( reserve==0 ) {
+		reserve = BISTACK_DEFAULT_RESERVE;
+	}
+	reserve = _align_size(reserve, BISTACK_HUGE_PAGE);
+	for( ; reserve >= BISTACK_HUGE_PAGE; reserve /= 2 ) {
+		size_t const span = reserve + BISTACK_HUGE_PAGE;
+		uint8_t *const map = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if( map==MAP_FAILED ) {
+			continue;
+		}
+		/// trim the slack so the range starts on a huge page boundary.
+		size_t const head = _align_size(( uintptr_t )(map), BISTACK_HUGE_PAGE) - ( uintptr_t )(map);
+		if( head > 0 ) {
+			munmap(map, head);
+		}
+		if( span - head > reserve ) {
+			munmap(map + head + reserve, span - head - reserve);
+		}
+#	ifdef MADV_HUGEPAGE
+		madvise(map + head, reserve, MADV_HUGEPAGE);
+#	endif
+		*s = bistack_make(map + head, reserve);
+		s->mapped = reserve;
+		return true;
+	}
+	return false;
+}
+
+/// hands the untouched middle back to the system after a big scratch phase, a reserved bistack keeps working.
+TI_MEM_EXPORT NO_NULLS void bistack_trim(struct TIBiStack *const s) {
+	if( s->mapped==0 ) {
+		return;
+	}
+	size_t const page = BISTACK_HUGE_PAGE;
+	size_t const lo = _align_size(s->front, page), hi = s->back - s->back % page;
+	if( lo < hi ) {
+		madvise(s->mem + lo, hi - lo, MADV_DONTNEED);
+	}
+}
+
+/// unmaps a reserved bistack, nothing allocated from it may be used afterwards.
+TI_MEM_EXPORT NO_NULLS void bistack_release(struct TIBiStack *const s) {
+	if( s->mapped > 0 ) {
+		munmap(s->mem, s->mapped);
+	}
+	*s = (struct TIBiStack){0};
+}
+#endif
+
+#ifdef MEM_STATS
+/// starts recording into `stats`, which is cleared. NULL stops recording.
+TI_MEM_EXPORT EXTANT(1) void bistack_attach_stats(struct TIBiStack *const s, struct TIMemStats *const stats) {
+	s->stats = stats;
+	if( stats != NULL ) {
+		*stats = (struct TIMemStats){0};
+		stats->total_peak = s->front + (s->len - s->back);
+		stats->front_peak = s->front;
+		stats->back_peak  = s->len - s->back;
+	}
+}
+
+TI_MEM_EXPORT NO_NULLS struct TIMemSite *_mem_stats_site(struct TIMemStats *const st, char const *const site) {
+	for( uint32_t i=0; i < st->site_count; i++ ) {
+		if( st->sites[i].site==site || strcmp(st->sites[i].site, site)==0 ) {
+			return &st->sites[i];
+		}
+	}
+	if( st->site_count==MEM_STATS_SITES ) {
+		st->sites_dropped++;
+		return NULL;
+	}
+	st->sites[st->site_count].site = site;
+	return &st->sites[st->site_count++];
+}
+
+/// bookkeeping for one allocation that returned `p`, hands `p` back.
+TI_MEM_EXPORT EXTANT(1, 5) void *_bistack_stats_note(struct TIBiStack *const s, void *const p, size_t const bytes, bool const back, char const *site) {
+	struct TIMemStats *const st = s->stats;
+	if( st==NULL ) {
+		return p;
+	}
+	if( st->pending != NULL ) {
+		site = st->pending;
+		st->pending = NULL;
+	}
+	struct TIMemSite *const rec = _mem_stats_site(st, site);
+	if( p==NULL ) {
+		st->ooms++;
+		st->last_oom_site   = site;
+		st->last_oom_bytes  = bytes;
+		st->last_oom_margin = s->back - s->front;
+		if( rec != NULL ) {
+			rec->ooms++;
+		}
+		return NULL;
+	}
+	size_t const aligned = _align_size(bytes, sizeof bytes);
+	if( back ) {
+		st->back_allocs++;
+		st->back_bytes += aligned;
+		st->back_peak = ( s->len - s->back > st->back_peak )? s->len - s->back : st->back_peak;
+	} else {
+		st->front_allocs++;
+		st->front_bytes += aligned;
+		st->front_peak = ( s->front > st->front_peak )? s->front : st->front_peak;
+	}
+	size_t const used = s->front + (s->len - s->back);
+	st->total_peak = ( used > st->total_peak )? used : st->total_peak;
+	if( rec != NULL ) {
+		rec->allocs++;
+		rec->bytes += aligned;
+	}
+	return p;
+}
+
+/// charges the next allocation on `s` to `site`, used by helper wrappers.
+TI_MEM_EXPORT NO_NULLS struct TIBiStack *_bistack_stats_at(struct TIBiStack *const s, char const *const site) {
+	if( s->stats != NULL && s->stats->pending==NULL ) {
+		s->stats->pending = site;
+	}
+	return s;
+}
+
+TI_MEM_EXPORT NO_NULLS void mem_stats_print(struct TIMemStats const *const st, FILE *const out) {
+	fprintf(out, "bistack peak: front %zu, back %zu, total %zu bytes\n", st->front_peak, st->back_peak, st->total_peak);
+	fprintf(out, "allocations: front %" PRIu32 " (%zu bytes), back %" PRIu32 " (%zu bytes), oom %" PRIu32 "\n",
+		st->front_allocs, st->front_bytes, st->back_allocs, st->back_bytes, st->ooms);
+	if( st->ooms > 0 ) {
+		fprintf(out, "last oom: %zu bytes at %s with %zu free\n", st->last_oom_bytes, st->last_oom_site, st->last_oom_margin);
+	}
+	for( uint32_t i=0; i < st->site_count; i++ ) {
+		fprintf(out, "  %-32s %8" PRIu32 " allocs %12zu bytes %4" PRIu32 " oom\n", st->sites[i].site, st->sites[i].allocs, st->sites[i].bytes, st->sites[i].ooms);
+	}
+	if( st->sites_dropped > 0 ) {
+		fprintf(out, "  (%" PRIu32 " allocations from untracked sites)\n", st->sites_dropped);
+	}
+}
+#endif
+
 TI_MEM_EXPORT NO_NULLS void bistack_reset(struct TIBiStack *s) {
 	s->front = 0;
 	s->back = s->len;
@@ -94,48 +303,84 @@ TI_MEM_EXPORT NO_NULLS void bistack_reset_back(struct TIBiStack *const s) {
 	s->back = s->len;
 }
 
-TI_MEM_EXPORT NO_NULLS void *bistack_alloc_front(struct TIBiStack *const s, size_t bytes) {
+/// The `_raw` allocators leave the memory as it was, for buffers that get filled right away.
+/// The others hand out zeroed memory.
+TI_MEM_EXPORT NO_NULLS void *bistack_alloc_front_raw(struct TIBiStack *const s, size_t bytes) {
 	bytes = _align_size(bytes, sizeof bytes);
 	if( s->front + bytes >= s->back ) {
 		return NULL;
 	}
 	size_t const alloc_offs = s->front;
 	s->front += bytes;
-	return memset(s->mem + alloc_offs, 0, bytes);
+	return s->mem + alloc_offs;
 }
 
-TI_MEM_EXPORT NO_NULLS void *bistack_alloc_front_vec(struct TIBiStack *const s, size_t len, size_t elem_size) {
-	size_t const bytes = _align_size(len * elem_size, sizeof len);
-	if( s->front + bytes >= s->back ) {
+TI_MEM_EXPORT NO_NULLS void *bistack_alloc_back_raw(struct TIBiStack *const s, size_t bytes) {
+	bytes = _align_size(bytes, sizeof bytes);
+	if( bytes >= s->back - s->front ) {
 		return NULL;
 	}
-	size_t const alloc_offs = s->front;
-	s->front += bytes;
-	return memset(s->mem + alloc_offs, 0, bytes);
+	s->back -= bytes;
+	return s->mem + s->back;
+}
+
+TI_MEM_EXPORT NO_NULLS void *bistack_alloc_front(struct TIBiStack *const s, size_t bytes) {
+	bytes = _align_size(bytes, sizeof bytes);
+	void *const p = bistack_alloc_front_raw(s, bytes);
+	return ( p==NULL )? NULL : memset(p, 0, bytes);
+}
+
+TI_MEM_EXPORT NO_NULLS void *bistack_alloc_front_vec(struct TIBiStack *const s, size_t len, size_t elem_size) {
+	return bistack_alloc_front(s, len * elem_size);
 }
 
 TI_MEM_EXPORT NO_NULLS void *bistack_alloc_back(struct TIBiStack *const s, size_t bytes) {
 	bytes = _align_size(bytes, sizeof bytes);
-	if( s->back - bytes <= s->front ) {
-		return NULL;
-	}
-	s->back -= bytes;
-	return memset(s->mem + s->back, 0, bytes);
+	void *const p = bistack_alloc_back_raw(s, bytes);
+	return ( p==NULL )? NULL : memset(p, 0, bytes);
 }
 
 TI_MEM_EXPORT NO_NULLS void *bistack_alloc_back_vec(struct TIBiStack *const s, size_t len, size_t elem_size) {
-	size_t const bytes = _align_size(len * elem_size, sizeof len);
-	if( s->back - bytes <= s->front ) {
-		return NULL;
-	}
-	s->back -= bytes;
-	return memset(s->mem + s->back, 0, bytes);
+	return bistack_alloc_back(s, len * elem_size);
+}
+
+TI_MEM_EXPORT NO_NULLS struct TIBiMark bistack_mark(struct TIBiStack const *const s) {
+	return (struct TIBiMark){ .front = s->front, .back = s->back };
+}
+
+TI_MEM_EXPORT NO_NULLS void bistack_rewind(struct TIBiStack *const s, struct TIBiMark const mark) {
+	s->front = mark.front;
+	s->back  = mark.back;
+}
+
+/// frees the scratch taken since `mark`, keeping what was persisted onto the back.
+TI_MEM_EXPORT NO_NULLS void bistack_rewind_front(struct TIBiStack *const s, struct TIBiMark const mark) {
+	s->front = mark.front;
 }
 
-TI_MEM_EXPORT NO_NULLS int bistack_get_margins(struct TIBiStack const *s) {
+TI_MEM_EXPORT NO_NULLS size_t bistack_get_margins(struct TIBiStack const *s) {
 	return s->back - s->front;
 }
 
+#ifdef MEM_STATS
+/// From here on the allocators are wrapped so every call site is recorded.
+/// Function-like macros don't expand inside themselves, so the wrappers still reach the functions above.
+#	define bistack_alloc_front(s, bytes) \
+		({ struct TIBiStack *const _s = (s); size_t const _b = (bytes); _bistack_stats_note(_s, bistack_alloc_front(_s, _b), _b, false, MEM_SITE); })
+#	define bistack_alloc_front_vec(s, len, elem_size) \
+		({ struct TIBiStack *const _s = (s); size_t const _b = (len) * (elem_size); _bistack_stats_note(_s, bistack_alloc_front_vec(_s, _b, 1), _b, false, MEM_SITE); })
+#	define bistack_alloc_back(s, bytes) \
+		({ struct TIBiStack *const _s = (s); size_t const _b = (bytes); _bistack_stats_note(_s, bistack_alloc_back(_s, _b), _b, true, MEM_SITE); })
+#	define bistack_alloc_back_vec(s, len, elem_size) \
+		({ struct TIBiStack *const _s = (s); size_t const _b = (len) * (elem_size); _bistack_stats_note(_s, bistack_alloc_back_vec(_s, _b, 1), _b, true, MEM_SITE); })
+#	define bistack_alloc_front_raw(s, bytes) \
+		({ struct TIBiStack *const _s = (s); size_t const _b = (bytes); _bistack_stats_note(_s, bistack_alloc_front_raw(_s, _b), _b, false, MEM_SITE); })
+#	define bistack_alloc_back_raw(s, bytes) \
+		({ struct TIBiStack *const _s = (s); size_t const _b = (bytes); _bistack_stats_note(_s, bistack_alloc_back_raw(_s, _b), _b, true, MEM_SITE); })
+/// wraps a call to an allocating helper taking the bistack first, so its caller gets the bytes.
+#	define MEM_TRACK_CALL(fn, s, ...)    fn(_bistack_stats_at((s), MEM_SITE), __VA_ARGS__)
+#endif
+
 
 struct TIBuffer {
 	uint8_t *data;
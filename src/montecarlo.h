@@ -0,0 +1,363 @@
+#ifndef MONTECARLO_H_INCLUDED
+#	define MONTECARLO_H_INCLUDED
+
+#include "domain.h"
+
+#define MC_EXPORT    static inline
+
+enum {
+	MC_UNIFORM = 0, /// `tol` is the half-width of the spread.
+	MC_GAUSSIAN,    /// `tol` is three standard deviations.
+};
+
+enum {
+	MC_MAX_CHUNKS = 256, /// statistics are kept per chunk so the merge order never depends on scheduling.
+	MC_MIN_CHUNK  = 16,
+};
+
+/// Spread of one component's value relative to its nominal, `val * (1 + tol*draw)`.
+/// `n1 == NODE_NONE` applies it to every component of `kind`, each drawn independently.
+struct McVary {
+	uint32_t n1, n2;
+	uint8_t  kind, dist; /// COMP_*, MC_*
+	rat_t    tol;
+};
+
+struct McOptions {
+	uint64_t seed;
+	uint32_t trials;
+	uint32_t workers;   /// 0 uses every online core.
+	uint32_t bins;      /// histogram bins per node, 0 for none.
+	rat_t    hist_span; /// histograms cover nominal +- span*|nominal| (+- span volts around 0 V).
+};
+
+struct McNodeStats {
+	rat_t mean, stddev, min, max;
+};
+
+struct McResult {
+	uint32_t trials, failed; /// failed trials hit a singular matrix and are left out of the statistics.
+	uint32_t workers;
+};
+
+
+/// splitmix64, cheap to seed per trial so any worker can pick up any trial.
+MC_EXPORT NO_NULLS uint64_t mc_next(uint64_t *const state) {
+	uint64_t z = (*state += UINT64_C(0x9E3779B97F4A7C15));
+	z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return z ^ (z >> 31);
+}
+
+/// uniform on [0, 1) from two 22-bit halves, small enough for `rat_from_int` on a 24-bit int.
+MC_EXPORT NO_NULLS rat_t mc_uniform(uint64_t *const state) {
+	uint64_t const r = mc_next(state);
+	rat_t const scale = rat_recip(rat_from_int(1 << 22));
+	rat_t const hi = rat_from_int(( int )(r >> 42));
+	rat_t const lo = rat_from_int(( int )((r >> 20) & 0x3FFFFF));
+	return rat_mul(rat_add(hi, rat_mul(lo, scale)), scale);
+}
+
+/// standard normal draw, Box-Muller.
+MC_EXPORT NO_NULLS rat_t mc_gaussian(uint64_t *const state) {
+	rat_t const u1 = rat_sub(rat_pos1(), mc_uniform(state));
+	rat_t const u2 = mc_uniform(state);
+	rat_t const two = rat_from_int(2);
+	rat_t const radius = rat_pow(rat_mul(rat_neg(two), rat_ln(u1)), rat_recip(two));
+	return rat_mul(radius, rat_cos(rat_mul(rat_mul(two, rat_pi()), u2)));
+}
+
+
+/// running moments, merged pairwise (Chan et al.) so chunks can be combined in any grouping.
+struct _McMoments {
+	rat_t    mean, m2, min, max;
+	uint32_t count;
+};
+
+MC_EXPORT NO_NULLS void _mc_moments_push(struct _McMoments *const m, rat_t const v) {
+	m->count++;
+	if( m->count==1 ) {
+		m->mean = m->min = m->max = v;
+		m->m2 = rat_zero();
+		return;
+	}
+	rat_t const delta = rat_sub(v, m->mean);
+	m->mean = rat_add(m->mean, rat_div(delta, rat_from_int(m->count)));
+	m->m2   = rat_add(m->m2, rat_mul(delta, rat_sub(v, m->mean)));
+	m->min  = rat_min(m->min, v);
+	m->max  = rat_max(m->max, v);
+}
+
+MC_EXPORT NO_NULLS void _mc_moments_merge(struct _McMoments *const a, struct _McMoments const *const b) {
+	if( b->count==0 ) {
+		return;
+	} else if( a->count==0 ) {
+		*a = *b;
+		return;
+	}
+	rat_t const na = rat_from_int(a->count), nb = rat_from_int(b->count);
+	rat_t const n  = rat_add(na, nb);
+	rat_t const delta = rat_sub(b->mean, a->mean);
+	a->mean  = rat_add(a->mean, rat_div(rat_mul(delta, nb), n));
+	a->m2    = rat_add(rat_add(a->m2, b->m2), rat_div(rat_mul(rat_mul(delta, delta), rat_mul(na, nb)), n));
+	a->min   = rat_min(a->min, b->min);
+	a->max   = rat_max(a->max, b->max);
+	a->count += b->count;
+}
+
+/// Read-only state every worker shares, plus the chunk counter and per-chunk results.
+struct _McShared {
+	struct StampProgram const *prog;
+	struct McOptions    const *opt;
+	struct SpLU                lu;         /// nominal factors, workers copy the values and keep the pivots.
+	uint32_t            const *vary_elem;
+	uint8_t             const *vary_dist;
+	rat_t               const *vary_tol;
+	rat_t               const *nominal;    /// raw element values.
+	rat_t               const *hist_lo, *hist_step;
+	struct _McMoments         *chunks;     /// `chunk_count * node_rows`
+	uint32_t                   vary_count, chunk_size, chunk_count;
+#ifdef DOMAIN_THREADS
+	atomic_uint                next_chunk;
+#else
+	uint32_t                   next_chunk;
+#endif
+};
+
+struct _McWorker {
+	struct DomainPoolWorker base;
+	struct _McShared       *shared;
+	uint32_t               *hist;   /// `node_rows * bins`, summed after the run.
+};
+
+MC_EXPORT NO_NULLS uint32_t _mc_claim_chunk(struct _McShared *const sh) {
+#ifdef DOMAIN_THREADS
+	return atomic_fetch_add_explicit(&sh->next_chunk, 1, memory_order_relaxed);
+#else
+	return sh->next_chunk++;
+#endif
+}
+
+/// bin of `v`, clamped into the end bins, found by bisection since there's no portable `rat_t` to int.
+MC_EXPORT uint32_t _mc_bin(rat_t const v, rat_t const lo, rat_t const step, uint32_t const bins) {
+	uint32_t a = 0, b = bins;
+	while( b - a > 1 ) {
+		uint32_t const mid = a + (b - a) / 2;
+		if( rat_lt(v, rat_add(lo, rat_mul(step, rat_from_int(mid)))) ) {
+			b = mid;
+		} else {
+			a = mid;
+		}
+	}
+	return a;
+}
+
+/// Runs claimed chunks until none are left. Everything mutable lives in the worker's own arena:
+/// persistent buffers on the back, a fallback factorization on the front.
+/// Every trial refactors from the nominal pivots so its result doesn't depend on which trials
+/// this worker happened to run before, that's what keeps runs identical across worker counts.
+MC_EXPORT NO_NULLS void *_mc_run_worker(void *const arg) {
+	struct _McWorker          *const w    = arg;
+	struct _McShared    const *const sh   = w->shared;
+	struct StampProgram const *const prog = sh->prog;
+	struct TIBiStack          *const s    = &w->base.arena;
+	uint32_t const n = prog->n, rows = prog->node_rows, bins = sh->opt->bins;
+
+	struct SpMat G = prog->G;
+	struct SpLU lu = sh->lu;
+	rat_t *raw  = bistack_alloc_back_vec(s, prog->elem_count, sizeof *raw);
+	rat_t *vals = bistack_alloc_back_vec(s, 2 * prog->elem_count, sizeof *vals);
+	rat_t *x    = bistack_alloc_back_vec(s, n, sizeof *x);
+	rat_t *work = bistack_alloc_back_vec(s, n, sizeof *work);
+	G.vals      = bistack_alloc_back_vec(s, G.nnz, sizeof *G.vals);
+	lu.L.vals   = bistack_alloc_back_vec(s, lu.L.nnz, sizeof *lu.L.vals);
+	lu.U.vals   = bistack_alloc_back_vec(s, lu.U.nnz, sizeof *lu.U.vals);
+	if( raw==NULL || vals==NULL || x==NULL || work==NULL || G.vals==NULL || lu.L.vals==NULL || lu.U.vals==NULL ) {
+		return NULL;
+	}
+	w->base.ok = true;
+
+	for( uint32_t chunk = _mc_claim_chunk(w->shared); chunk < sh->chunk_count; chunk = _mc_claim_chunk(w->shared) ) {
+		struct _McMoments *const slot = &sh->chunks[( size_t )(chunk) * rows];
+		uint32_t const first = chunk * sh->chunk_size;
+		uint32_t const last  = ( sh->opt->trials - first < sh->chunk_size )? sh->opt->trials : first + sh->chunk_size;
+		for( uint32_t trial = first; trial < last; trial++ ) {
+			uint64_t rng = sh->opt->seed ^ (( uint64_t )(trial) * UINT64_C(0xD1B54A32D192ED03));
+			memcpy(raw, sh->nominal, prog->elem_count * sizeof *raw);
+			for( uint32_t v=0; v < sh->vary_count; v++ ) {
+				rat_t const draw = ( sh->vary_dist[v]==MC_GAUSSIAN )?
+					rat_div(mc_gaussian(&rng), rat_from_int(3)) :
+					rat_sub(rat_mul(rat_from_int(2), mc_uniform(&rng)), rat_pos1());
+				uint32_t const e = sh->vary_elem[v];
+				raw[e] = rat_mul(raw[e], rat_add(rat_pos1(), rat_mul(sh->vary_tol[v], draw)));
+			}
+			memset(x, 0, n * sizeof *x);
+			stamp_program_assemble(prog, raw, rat_zero(), vals, G.vals, x);
+			if( splu_refactor(&lu, &G, sparse_pivot_tol(), work)==SPARSE_OK ) {
+				splu_solve(&lu, x, work);
+			} else {
+				struct SpLU fresh;
+				bool const solved = splu_factor(s, &G, sh->lu.q, sparse_pivot_tol(), &fresh)==SPARSE_OK;
+				if( solved ) {
+					splu_solve(&fresh, x, work);
+				}
+				bistack_reset_front(s);
+				if( !solved ) {
+					w->base.failed++;
+					continue;
+				}
+			}
+			for( uint32_t i=0; i < rows; i++ ) {
+				_mc_moments_push(&slot[i], x[i]);
+				if( bins > 0 ) {
+					w->hist[( size_t )(i) * bins + _mc_bin(x[i], sh->hist_lo[i], sh->hist_step[i], bins)]++;
+				}
+			}
+		}
+	}
+	return NULL;
+}
+
+/// Monte Carlo tolerance analysis of the DC operating point.
+/// Each trial redraws the components matched by `vary` and solves; trials are split into
+/// fixed chunks that workers claim off an atomic counter, each worker solving out of its own
+/// `TIBiStack` carved from the circuit's free space, so the hot path takes no locks and no shared allocator.
+/// Trial `t`'s draws come from `seed` and `t` alone and chunk statistics merge in chunk order,
+/// so a given seed reproduces the same numbers with any number of workers.
+/// `stats` gets one entry per node id, `hist` (nullable) `node_count * bins` counts.
+/// Every trial is a linear solve, circuits with diodes fail with ERR_NONLINEAR.
+MC_EXPORT EXTANT(1, 2, 3, 5) int circuit_monte_carlo(
+	struct Circuit          *const c,
+	struct McOptions  const *const opt,
+	struct McVary     const        vary[const],
+	uint32_t          const        vary_len,
+	struct McNodeStats             stats[const],
+	uint32_t                       hist[const],
+	struct McResult                *const result
+) {
+	struct TIBiStack *const s = &c->bistack;
+	struct _McShared sh = { .opt = opt };
+	struct StampProgram prog;
+	int res = circuit_compile(c, &prog);
+	if( res != ERR_OK ) {
+		goto done;
+	} else if( prog.diode_count > 0 ) {
+		res = ERR_NONLINEAR;
+		goto done;
+	}
+	sh.prog = &prog;
+	res = ERR_OOM;
+	uint32_t const n = prog.n, rows = prog.node_rows, bins = opt->bins;
+
+	/// nominal solve: its ordering and pivots are shared, its voltages center the histograms.
+	rat_t    *raw   = alloc_vec(s, prog.elem_count);
+	rat_t    *vals  = alloc_vec(s, 2 * prog.elem_count);
+	rat_t    *x     = alloc_vec(s, n);
+	rat_t    *work  = alloc_vec(s, n);
+	uint32_t *q     = sparse_alloc_ids(s, n);
+	uint32_t *elems = sparse_alloc_ids(s, prog.elem_count);
+	uint8_t  *dists = bistack_alloc_front_vec(s, prog.elem_count, sizeof *dists);
+	rat_t    *tols  = alloc_vec(s, prog.elem_count);
+	rat_t    *lo    = alloc_vec(s, rows);
+	rat_t    *step  = alloc_vec(s, rows);
+	if( raw==NULL || vals==NULL || x==NULL || work==NULL || q==NULL || elems==NULL || dists==NULL || tols==NULL || lo==NULL || step==NULL ) {
+		goto done;
+	}
+	stamp_program_load(&prog, raw);
+	stamp_program_assemble(&prog, raw, rat_zero(), vals, prog.G.vals, x);
+	circuit_order(c, &prog, q);
+	switch( splu_factor(s, &prog.G, q, sparse_pivot_tol(), &sh.lu) ) {
+		case SPARSE_ERR_OOM:      res = ERR_OOM;      goto done;
+		case SPARSE_ERR_SINGULAR: res = ERR_SINGULAR; goto done;
+	}
+	splu_solve(&sh.lu, x, work);
+	for( uint32_t i=0; i < rows; i++ ) {
+		rat_t const half = rat_max(rat_mul(opt->hist_span, rat_abs(x[i])), opt->hist_span);
+		lo[i] = rat_sub(x[i], half);
+		step[i] = ( bins > 0 )? rat_div(rat_add(half, half), rat_from_int(bins)) : rat_zero();
+	}
+
+	for( uint32_t e=0; e < prog.elem_count; e++ ) {
+		for( uint32_t v=0; v < vary_len; v++ ) {
+			bool const match = prog.kind[e]==vary[v].kind
+				&& (vary[v].n1==NODE_NONE || (prog.node_a[e]==vary[v].n1 && prog.node_b[e]==vary[v].n2));
+			if( match ) {
+				elems[sh.vary_count] = e;
+				dists[sh.vary_count] = vary[v].dist;
+				tols[sh.vary_count]  = vary[v].tol;
+				sh.vary_count++;
+				break;
+			}
+		}
+	}
+	sh.vary_elem = elems;
+	sh.vary_dist = dists;
+	sh.vary_tol  = tols;
+	sh.nominal   = raw;
+	sh.hist_lo   = lo;
+	sh.hist_step = step;
+
+	sh.chunk_size = ( opt->trials + MC_MAX_CHUNKS - 1 ) / MC_MAX_CHUNKS;
+	if( sh.chunk_size < MC_MIN_CHUNK ) {
+		sh.chunk_size = MC_MIN_CHUNK;
+	}
+	sh.chunk_count = ( opt->trials + sh.chunk_size - 1 ) / sh.chunk_size;
+	sh.chunks = bistack_alloc_front_vec(s, ( size_t )(sh.chunk_count) * rows, sizeof *sh.chunks);
+
+	uint32_t const workers = domain_pool_size(opt->workers, sh.chunk_count);
+	struct _McWorker *pool = bistack_alloc_front_vec(s, workers, sizeof *pool);
+	if( (sh.chunks==NULL && sh.chunk_count > 0) || pool==NULL ) {
+		goto done;
+	}
+	for( uint32_t w=0; w < workers; w++ ) {
+		pool[w].shared = &sh;
+		if( bins > 0 ) {
+			pool[w].hist = bistack_alloc_front_vec(s, ( size_t )(rows) * bins, sizeof *pool[w].hist);
+			if( pool[w].hist==NULL ) {
+				goto done;
+			}
+		}
+	}
+	if( !domain_pool_carve(s, pool, sizeof *pool, workers) ) {
+		goto done;
+	}
+	domain_pool_run(pool, sizeof *pool, workers, _mc_run_worker);
+	uint32_t failed;
+	if( !domain_pool_collect(pool, sizeof *pool, workers, &failed) ) {
+		goto done;
+	}
+	for( uint32_t i=0; i < c->node_count; i++ ) {
+		stats[i] = (struct McNodeStats){ rat_zero(), rat_zero(), rat_zero(), rat_zero() };
+	}
+	if( hist != NULL ) {
+		memset(hist, 0, ( size_t )(c->node_count) * bins * sizeof *hist);
+	}
+	for( uint32_t i=0; i < rows; i++ ) {
+		struct _McMoments total = {0};
+		for( uint32_t k=0; k < sh.chunk_count; k++ ) {
+			_mc_moments_merge(&total, &sh.chunks[( size_t )(k) * rows + i]);
+		}
+		uint32_t const node = prog.matrix_to_node[i];
+		stats[node].mean = total.mean;
+		stats[node].min  = total.min;
+		stats[node].max  = total.max;
+		if( total.count > 1 ) {
+			stats[node].stddev = rat_pow(rat_div(total.m2, rat_from_int(total.count - 1)), rat_recip(rat_from_int(2)));
+		}
+		if( hist != NULL ) {
+			for( uint32_t w=0; w < workers; w++ ) {
+				for( uint32_t b=0; b < bins; b++ ) {
+					hist[( size_t )(node) * bins + b] += pool[w].hist[( size_t )(i) * bins + b];
+				}
+			}
+		}
+	}
+	if( result != NULL ) {
+		*result = (struct McResult){ .trials = opt->trials - failed, .failed = failed, .workers = workers };
+	}
+	res = ERR_OK;
+done:
+	bistack_reset_front(s);
+	return res;
+}
+#endif
@@ -0,0 +1,693 @@
+#ifndef NETLIST_H_INCLUDED
+#	define NETLIST_H_INCLUDED
+
+#include "node.h"
+#include "ac.h"
+#include "transient.h"
+#include "subckt.h"
+
+#if !defined(TICE_H) && (defined(__unix__) || defined(__APPLE__))
+#	define NETLIST_MMAP
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#define NETLIST_EXPORT    static inline
+
+enum {
+	NETLIST_MAX_FIELDS  = 16, /// fields kept per logical line, the rest are ignored.
+	NETLIST_NUM_MAX     = 64, /// longest number handed to `str_to_rat`.
+	NETLIST_FAST_DIGITS = 14, /// mantissa digits both `double` and TI's BCD reals hold exactly.
+	NETLIST_FAST_EXP    = 22, /// largest power of ten `double` holds exactly.
+	NETLIST_MAX_SAVE    = 64, /// nodes `.save` cards can pick.
+};
+
+enum {
+	NETLIST_ERR_SUBCKT  = -6, /// unknown subcircuit, wrong port count or an element a `.subckt` body can't hold.
+	NETLIST_ERR_IO      = -5,
+	NETLIST_ERR_ELEMENT = -4, /// unknown element letter.
+	NETLIST_ERR_FIELDS  = -3, /// element line missing nodes or value.
+	NETLIST_ERR_VALUE   = -2, /// malformed or invalid number.
+	NETLIST_ERR_CIRCUIT = -1, /// the circuit refused the element, see `circuit_err`.
+	NETLIST_OK          =  1,
+};
+
+/// A field of a netlist line, pointing straight into the source text.
+struct NetToken {
+	char const *str;
+	uint32_t    len;
+};
+
+struct NetlistStatus {
+	uint32_t line;        /// physical line the error is on, or the line count when it went fine.
+	uint32_t elements;
+	int      code;        /// NETLIST_*
+	int      circuit_err; /// ERR_* when code is NETLIST_ERR_CIRCUIT.
+	bool     has_ac;      /// a `.ac` card was met, its sweep is in `ac`.
+	bool     has_tran;    /// a `.tran` card was met, its options are in `tran`.
+	uint32_t save_count;  /// nodes `.save` cards asked for, in `save`. 0 saves everything.
+	uint32_t sens_out;    /// output node of a `.sens` card, NODE_NONE without one.
+	struct AcOptions   ac;
+	struct TranOptions tran;
+	uint32_t save[NETLIST_MAX_SAVE];
+};
+
+/// Walks an in-memory netlist logical line by logical line.
+struct NetScanner {
+	char const *cur, *end;
+	uint32_t    line;
+};
+
+NETLIST_EXPORT char const *netlist_strerror(int const code) {
+	switch( code ) {
+		case NETLIST_ERR_SUBCKT:  return "bad subcircuit";
+		case NETLIST_ERR_IO:      return "can't read netlist";
+		case NETLIST_ERR_ELEMENT: return "unknown element";
+		case NETLIST_ERR_FIELDS:  return "missing nodes or value";
+		case NETLIST_ERR_VALUE:   return "bad value";
+		case NETLIST_ERR_CIRCUIT: return "circuit rejected element";
+		case NETLIST_OK:          return "ok";
+	}
+	return "unknown error";
+}
+
+NETLIST_EXPORT bool _netlist_is_space(char const ch) {
+	return ch==' ' || ch=='\t' || ch=='\r' || ch=='\f' || ch=='\v';
+}
+
+NETLIST_EXPORT bool _netlist_is_sep(char const ch) {
+	return _netlist_is_space(ch) || ch==',' || ch=='(' || ch==')';
+}
+
+NETLIST_EXPORT NO_NULLS bool netlist_token_is(struct NetToken const tok, char const word[const static 1]) {
+	size_t const len = strlen(word);
+	if( tok.len != len ) {
+		return false;
+	}
+	for( size_t i=0; i < len; i++ ) {
+		if( (tok.str[i] | 0x20) != word[i] ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+NETLIST_EXPORT NO_NULLS struct NetScanner netlist_scanner(char const text[const], size_t const len) {
+	return (struct NetScanner){ .cur = text, .end = text + len, .line = 1 };
+}
+
+/// skips one physical line, returning false at the end of the text.
+NETLIST_EXPORT NO_NULLS bool netlist_skip_line(struct NetScanner *const sc) {
+	if( sc->cur >= sc->end ) {
+		return false;
+	}
+	char const *const eol = memchr(sc->cur, '\n', ( size_t )(sc->end - sc->cur));
+	sc->cur = ( eol != NULL )? eol + 1 : sc->end;
+	sc->line++;
+	return true;
+}
+
+/// Splits the next logical line into `fields`, folding in any `+` continuation lines.
+/// Skips blank lines and `*` comments, `;` comments out the rest of a line.
+/// Returns the number of fields or -1 once the text runs out, `*first_line` gets the physical line it started on.
+NETLIST_EXPORT NO_NULLS int netlist_next_line(struct NetScanner *const sc, struct NetToken fields[const static NETLIST_MAX_FIELDS], uint32_t *const first_line) {
+	int count = 0;
+	bool started = false;
+	while( sc->cur < sc->end ) {
+		char const *p = sc->cur;
+		char const *eol = memchr(p, '\n', ( size_t )(sc->end - p));
+		if( eol==NULL ) {
+			eol = sc->end;
+		}
+		while( p < eol && _netlist_is_space(*p) ) {
+			p++;
+		}
+		if( started ) {
+			if( p==eol || *p != '+' ) {
+				break;
+			}
+			p++;
+		} else if( p==eol || *p=='*' || *p==';' ) {
+			netlist_skip_line(sc);
+			continue;
+		} else {
+			started = true;
+			*first_line = sc->line;
+		}
+		while( p < eol ) {
+			while( p < eol && _netlist_is_sep(*p) ) {
+				p++;
+			}
+			if( p==eol || *p==';' ) {
+				break;
+			}
+			char const *const start = p;
+			while( p < eol && !_netlist_is_sep(*p) && *p != ';' ) {
+				p++;
+			}
+			if( count < NETLIST_MAX_FIELDS ) {
+				fields[count++] = (struct NetToken){ start, ( uint32_t )(p - start) };
+			}
+		}
+		netlist_skip_line(sc);
+	}
+	return started? count : -1;
+}
+
+
+/// exact for any `m` below 10^18, built from base-10^6 digits so each fits a 24-bit int.
+NETLIST_EXPORT rat_t _netlist_rat_from_u64(uint64_t const m) {
+	uint64_t chunks[4] = {0};
+	size_t n = 0;
+	uint64_t rest = m;
+	do {
+		chunks[n++] = rest % 1000000;
+		rest /= 1000000;
+	} while( rest > 0 && n < 4 );
+	rat_t const base = rat_from_int(1000000);
+	rat_t r = rat_zero();
+	while( n > 0 ) {
+		r = rat_add(rat_mul(r, base), rat_from_int(( int )(chunks[--n])));
+	}
+	return r;
+}
+
+NETLIST_EXPORT rat_t _netlist_pow10(uint32_t k) {
+	rat_t r = rat_pos1(), base = rat_from_int(10);
+	while( k > 0 ) {
+		if( k & 1 ) {
+			r = rat_mul(r, base);
+		}
+		base = rat_mul(base, base);
+		k >>= 1;
+	}
+	return r;
+}
+
+NETLIST_EXPORT rat_t _netlist_scale10(rat_t const v, int32_t const exp) {
+	return ( exp >= 0 )? rat_mul(v, _netlist_pow10(( uint32_t )(exp))) : rat_div(v, _netlist_pow10(( uint32_t )(-exp)));
+}
+
+/// Engineering suffix at `s`, as `mul * 10^exp`. Case-insensitive, `meg` and `mil` (a thousandth
+/// of an inch, 25.4u) before `m`, trailing letters are units and ignored (`10uF`, `1kohm`).
+/// Returns false on other junk.
+NETLIST_EXPORT NO_NULLS bool _netlist_suffix(char const *s, char const *const end, int32_t *const exp, uint32_t *const mul) {
+	*exp = 0;
+	*mul = 1;
+	if( s==end ) {
+		return true;
+	}
+	switch( *s | 0x20 ) {
+		case 't': *exp =  12; break;
+		case 'g': *exp =   9; break;
+		case 'k': *exp =   3; break;
+		case 'u': *exp =  -6; break;
+		case 'n': *exp =  -9; break;
+		case 'p': *exp = -12; break;
+		case 'f': *exp = -15; break;
+		case 'm':
+			if( end - s >= 3 && (s[1] | 0x20)=='e' && (s[2] | 0x20)=='g' ) {
+				*exp = 6;
+			} else if( end - s >= 3 && (s[1] | 0x20)=='i' && (s[2] | 0x20)=='l' ) {
+				*exp = -7;
+				*mul = 254;
+			} else {
+				*exp = -3;
+			}
+			break;
+	}
+	for( ; s < end; s++ ) {
+		char const ch = *s | 0x20;
+		if( ch < 'a' || ch > 'z' ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Parses a SPICE number like `4.7u`, `2meg`, `3mil`, `-1.5e-3` or `10kohm`; an exponent
+/// marker without digits (`1e`) is malformed.
+/// Numbers whose mantissa and net power of ten are small enough to be exact go straight
+/// through rat_ ops (correctly rounded, no copy); anything else is copied out for `str_to_rat`.
+NETLIST_EXPORT NO_NULLS bool netlist_parse_value(struct NetToken const tok, rat_t *const out) {
+	char const *p = tok.str, *const end = tok.str + tok.len;
+	bool neg = false;
+	if( p < end && (*p=='-' || *p=='+') ) {
+		neg = *p=='-';
+		p++;
+	}
+	uint64_t mant = 0;
+	uint32_t digits = 0, seen = 0;
+	int32_t  exp = 0;
+	for( ; p < end && *p >= '0' && *p <= '9'; p++, seen++ ) {
+		if( mant > 0 || *p != '0' ) {
+			if( digits < 18 ) {
+				mant = mant * 10 + ( uint64_t )(*p - '0');
+			} else {
+				exp++;
+			}
+			digits++;
+		}
+	}
+	if( p < end && *p=='.' ) {
+		for( p++; p < end && *p >= '0' && *p <= '9'; p++, seen++ ) {
+			if( mant > 0 || *p != '0' ) {
+				if( digits < 18 ) {
+					mant = mant * 10 + ( uint64_t )(*p - '0');
+					exp--;
+				}
+				digits++;
+			} else {
+				exp--;
+			}
+		}
+	}
+	if( seen==0 ) {
+		return false;
+	}
+	/// no scale suffix starts with `e`, so one that isn't followed by exponent digits (`1e`, `1e-`) is malformed.
+	int32_t e10 = 0;
+	if( p < end && (*p | 0x20)=='e' ) {
+		char const *q = p + 1;
+		bool eneg = false;
+		if( q < end && (*q=='-' || *q=='+') ) {
+			eneg = *q=='-';
+			q++;
+		}
+		if( q==end || *q < '0' || *q > '9' ) {
+			return false;
+		}
+		for( ; q < end && *q >= '0' && *q <= '9'; q++ ) {
+			if( e10 < 10000 ) {
+				e10 = e10 * 10 + (*q - '0');
+			}
+		}
+		e10 = eneg? -e10 : e10;
+		p = q;
+	}
+	int32_t suffix;
+	uint32_t mul;
+	if( !_netlist_suffix(p, end, &suffix, &mul) ) {
+		return false;
+	}
+	int32_t const total = exp + e10 + suffix;
+	rat_t v;
+	if( mant==0 ) {
+		v = rat_zero();
+	} else if( digits <= NETLIST_FAST_DIGITS && total >= -NETLIST_FAST_EXP && total <= NETLIST_FAST_EXP ) {
+		v = _netlist_scale10(_netlist_rat_from_u64(mant), total);
+	} else {
+		char buf[NETLIST_NUM_MAX];
+		size_t const len = ( size_t )(p - tok.str);
+		if( len >= sizeof buf ) {
+			return false;
+		}
+		memcpy(buf, tok.str, len);
+		buf[len] = 0;
+		v = _netlist_scale10(rat_abs(str_to_rat(buf)), suffix);
+	}
+	if( mul != 1 ) {
+		v = rat_mul(v, rat_from_int(( int )(mul)));
+	}
+	*out = neg? rat_neg(v) : v;
+	return true;
+}
+
+/// saturation current of a diode line without one, SPICE's default 1e-14 A.
+NETLIST_EXPORT rat_t netlist_diode_is(void) {
+	return _netlist_scale10(rat_pos1(), -14);
+}
+
+/// `.ac dec|oct|lin points fstart fstop`
+NETLIST_EXPORT NO_NULLS int _netlist_parse_ac(struct NetToken const f[const], int const count, struct AcOptions *const ac) {
+	if( count < 5 ) {
+		return NETLIST_ERR_FIELDS;
+	}
+	uint8_t sweep;
+	if( netlist_token_is(f[1], "dec") ) {
+		sweep = AC_DEC;
+	} else if( netlist_token_is(f[1], "oct") ) {
+		sweep = AC_OCT;
+	} else if( netlist_token_is(f[1], "lin") ) {
+		sweep = AC_LIN;
+	} else {
+		return NETLIST_ERR_VALUE;
+	}
+	uint32_t points = 0;
+	for( uint32_t i=0; i < f[2].len; i++ ) {
+		if( f[2].str[i] < '0' || f[2].str[i] > '9' || points > 100000 ) {
+			return NETLIST_ERR_VALUE;
+		}
+		points = points * 10 + ( uint32_t )(f[2].str[i] - '0');
+	}
+	rat_t fstart, fstop;
+	if( points==0 || !netlist_parse_value(f[3], &fstart) || !netlist_parse_value(f[4], &fstop) ) {
+		return NETLIST_ERR_VALUE;
+	}
+	/// keep any AC source already met.
+	uint32_t const in_n1 = ac->in_n1, in_n2 = ac->in_n2;
+	uint8_t const in_kind = ac->in_kind;
+	rat_t const in_mag = ac->in_mag;
+	*ac = ac_options(sweep, points, fstart, fstop);
+	ac->in_n1 = in_n1;
+	ac->in_n2 = in_n2;
+	ac->in_kind = in_kind;
+	ac->in_mag = in_mag;
+	return NETLIST_OK;
+}
+
+/// `.tran tstep tstop [tstart [tmax]] [uic]`, the start time is accepted and ignored.
+NETLIST_EXPORT NO_NULLS int _netlist_parse_tran(struct NetToken const f[const], int const count, struct TranOptions *const tran) {
+	int args = count;
+	bool const uic = netlist_token_is(f[count - 1], "uic");
+	args -= uic;
+	if( args < 3 ) {
+		return NETLIST_ERR_FIELDS;
+	}
+	rat_t tstep, tstop, tstart = rat_zero(), tmax = rat_zero();
+	if( !netlist_parse_value(f[1], &tstep) || !netlist_parse_value(f[2], &tstop) || !rat_lt(rat_zero(), tstop)
+	 || (args > 3 && !netlist_parse_value(f[3], &tstart)) || (args > 4 && !netlist_parse_value(f[4], &tmax)) ) {
+		return NETLIST_ERR_VALUE;
+	}
+	*tran = tran_options(tstop, tstep);
+	tran->tmax = tmax;
+	tran->uic  = uic;
+	return NETLIST_OK;
+}
+
+/// `.save v(n1) n2 ..`, nodes by name with or without `v()` around them.
+NETLIST_EXPORT NO_NULLS int _netlist_parse_save(struct Circuit *const c, struct NetToken const f[const], int const count, struct NetlistStatus *const st) {
+	for( int i=1; i < count; i++ ) {
+		/// the tokenizer splits on parentheses, `v(out)` arrives as `v` and `out`.
+		if( netlist_token_is(f[i], "v") && i + 1 < count ) {
+			continue;
+		} else if( st->save_count==NETLIST_MAX_SAVE ) {
+			return NETLIST_ERR_FIELDS;
+		}
+		uint32_t const node = circuit_intern_node(c, f[i].len, f[i].str);
+		if( node==NODE_NONE ) {
+			st->circuit_err = ERR_OOM;
+			return NETLIST_ERR_CIRCUIT;
+		}
+		st->save[st->save_count++] = node;
+	}
+	return NETLIST_OK;
+}
+
+/// `.sens v(out)`, the node whose DC sensitivities get ranked.
+NETLIST_EXPORT NO_NULLS int _netlist_parse_sens(struct Circuit *const c, struct NetToken const f[const], int const count, struct NetlistStatus *const st) {
+	int const at = ( count > 2 && netlist_token_is(f[1], "v") )? 2 : 1;
+	if( count <= at ) {
+		return NETLIST_ERR_FIELDS;
+	}
+	st->sens_out = circuit_intern_node(c, f[at].len, f[at].str);
+	if( st->sens_out==NODE_NONE ) {
+		st->circuit_err = ERR_OOM;
+		return NETLIST_ERR_CIRCUIT;
+	}
+	return NETLIST_OK;
+}
+
+/// `Xname n1 .. np subname`, a placement of a `.subckt` already defined in `lib`.
+NETLIST_EXPORT NO_NULLS int _netlist_parse_instance(struct Circuit *const c, struct Circuit const *const lib, struct NetToken const f[const], int const count, struct NetlistStatus *const st) {
+	if( count < 3 ) {
+		return NETLIST_ERR_FIELDS;
+	}
+	struct Macromodel const *const model = circuit_find_macromodel(lib, f[count - 1].len, f[count - 1].str);
+	if( model==NULL || model->ports != ( uint32_t )(count - 2) ) {
+		return NETLIST_ERR_SUBCKT;
+	}
+	uint32_t nodes[NETLIST_MAX_FIELDS];
+	for( int i=1; i < count - 1; i++ ) {
+		nodes[i - 1] = circuit_intern_node(c, f[i].len, f[i].str);
+		if( nodes[i - 1]==NODE_NONE ) {
+			st->circuit_err = ERR_OOM;
+			return NETLIST_ERR_CIRCUIT;
+		}
+	}
+	st->circuit_err = circuit_add_subckt(c, model, nodes, f[0].len, f[0].str, NULL);
+	return ( st->circuit_err==ERR_OK )? NETLIST_OK : NETLIST_ERR_CIRCUIT;
+}
+
+/// One element line into `c`, subcircuits are looked up in `lib`.
+/// A `.subckt` body (`body`) only holds what reduces to a DC port model:
+/// resistors, sources without an `AC` field and other subcircuits.
+NETLIST_EXPORT NO_NULLS int _netlist_parse_element(struct Circuit *const c, struct Circuit const *const lib, struct NetToken const f[const], int const count, struct NetlistStatus *const st, bool const body) {
+	uint8_t kind;
+	switch( f[0].str[0] | 0x20 ) {
+		case 'r': kind = COMP_RESISTOR;       break;
+		case 'c': kind = COMP_CAPACITOR;      break;
+		case 'l': kind = COMP_INDUCTOR;       break;
+		case 'v': kind = COMP_VOLTAGE_SRC;    break;
+		case 'i': kind = COMP_DC_CURRENT_SRC; break;
+		case 'd': kind = COMP_DIODE;          break;
+		case 'x': return _netlist_parse_instance(c, lib, f, count, st);
+		default:
+			return NETLIST_ERR_ELEMENT;
+	}
+	if( body && (kind==COMP_CAPACITOR || kind==COMP_INDUCTOR || kind==COMP_DIODE) ) {
+		return NETLIST_ERR_SUBCKT;
+	}
+	bool const source = kind==COMP_VOLTAGE_SRC || kind==COMP_DC_CURRENT_SRC;
+	rat_t value = rat_zero(), ac_mag = rat_zero();
+	bool has_value = false, has_ac = false;
+	if( count < 3 ) {
+		return NETLIST_ERR_FIELDS;
+	}
+	/// sources default to 0 V DC when they only carry an AC field, everything else needs its value.
+	for( int i=3; i < count; i++ ) {
+		bool ok;
+		if( source && netlist_token_is(f[i], "dc") && i + 1 < count ) {
+			ok = netlist_parse_value(f[++i], &value);
+			has_value = true;
+		} else if( source && netlist_token_is(f[i], "ac") ) {
+			has_ac = true;
+			ac_mag = rat_pos1();
+			ok = true;
+			if( i + 1 < count ) {
+				ok = netlist_parse_value(f[++i], &ac_mag);
+				if( i + 1 < count && !netlist_token_is(f[i + 1], "dc") ) {
+					i++; /// phase, a single driven source only rotates every phasor by it.
+				}
+			}
+		} else if( !has_value ) {
+			ok = netlist_parse_value(f[i], &value);
+			has_value = ok;
+			if( !ok && kind==COMP_DIODE ) {
+				ok = true; /// a model name, the default junction stands in for it.
+			}
+		} else {
+			break;
+		}
+		if( !ok ) {
+			return NETLIST_ERR_VALUE;
+		}
+	}
+	if( body && has_ac ) {
+		return NETLIST_ERR_SUBCKT;
+	} else if( kind==COMP_DIODE && !has_value ) {
+		value = netlist_diode_is();
+	} else if( !has_value && !(source && has_ac) ) {
+		return NETLIST_ERR_FIELDS;
+	}
+	if( (kind==COMP_RESISTOR && rat_cmp(value, rat_zero())==0) || (kind==COMP_DIODE && !rat_lt(rat_zero(), value)) ) {
+		return NETLIST_ERR_VALUE;
+	}
+	uint32_t const np = circuit_intern_node(c, f[1].len, f[1].str);
+	uint32_t const nm = circuit_intern_node(c, f[2].len, f[2].str);
+	if( np==NODE_NONE || nm==NODE_NONE ) {
+		st->circuit_err = ERR_OOM;
+		return NETLIST_ERR_CIRCUIT;
+	}
+	/// SPICE's `V n+ n- v` holds V(n+) - V(n-) = v, ours holds V(n2) - V(n1).
+	/// `I n+ n- i` draws i out of n+ and into n-, same as ours.
+	int const res = ( kind==COMP_VOLTAGE_SRC )?
+		circuit_add_component(c, nm, np, kind, value) :
+		circuit_add_component(c, np, nm, kind, value);
+	if( res != ERR_OK ) {
+		st->circuit_err = res;
+		return NETLIST_ERR_CIRCUIT;
+	}
+	if( has_ac && st->ac.in_n1==NODE_NONE ) {
+		st->ac.in_kind = kind;
+		st->ac.in_n1   = ( kind==COMP_VOLTAGE_SRC )? nm : np;
+		st->ac.in_n2   = ( kind==COMP_VOLTAGE_SRC )? np : nm;
+		st->ac.in_mag  = ac_mag;
+	}
+	return NETLIST_OK;
+}
+
+/// `.subckt name p1 .. pn` up to its `.ends`, built into a scratch circuit carved out of the free
+/// middle of `c`'s bistack and reduced to a macromodel of `c` (see subckt.h).
+NETLIST_EXPORT NO_NULLS int _netlist_parse_subckt(struct Circuit *const c, struct NetScanner *const sc, struct NetToken const def[const], int const count, struct NetlistStatus *const st) {
+	if( count < 3 ) {
+		return NETLIST_ERR_FIELDS;
+	}
+	struct NetToken const name = def[1];
+	uint32_t const ports = ( uint32_t )(count - 2);
+	struct TIBiStack *const s = &c->bistack;
+	struct TIBiMark const mark = bistack_mark(s);
+	/// carved raw, the body's own allocations zero what they use.
+	size_t len = bistack_get_margins(s) / 2;
+	len -= len % sizeof(size_t);
+	uint8_t *const mem = ( len > 0 )? bistack_alloc_front_raw(s, len) : NULL;
+	if( mem==NULL ) {
+		st->circuit_err = ERR_OOM;
+		return NETLIST_ERR_CIRCUIT;
+	}
+	struct Circuit body = circuit_make(mem, len);
+	int code = NETLIST_OK;
+	for( uint32_t t=0; t < ports; t++ ) {
+		uint32_t const id = circuit_intern_node(&body, def[t + 2].len, def[t + 2].str);
+		if( id==NODE_NONE ) {
+			st->circuit_err = ERR_OOM;
+			code = NETLIST_ERR_CIRCUIT;
+			goto done;
+		} else if( id != t + 1 ) {
+			code = NETLIST_ERR_SUBCKT; /// ground or a repeated name as a port.
+			goto done;
+		}
+	}
+	struct NetToken f[NETLIST_MAX_FIELDS];
+	uint32_t line = 0;
+	int fields;
+	while( (fields = netlist_next_line(sc, f, &line)) >= 0 ) {
+		st->line = line;
+		if( fields==0 ) {
+			continue;
+		} else if( netlist_token_is(f[0], ".ends") ) {
+			st->circuit_err = circuit_define_subckt(c, &body, ports, name.len, name.str, NULL);
+			code = ( st->circuit_err==ERR_OK )? NETLIST_OK : NETLIST_ERR_CIRCUIT;
+			goto done;
+		} else if( netlist_token_is(f[0], ".end") || netlist_token_is(f[0], ".subckt") ) {
+			break;
+		} else if( f[0].str[0]=='.' ) {
+			continue;
+		}
+		code = _netlist_parse_element(&body, c, f, fields, st, true);
+		if( code != NETLIST_OK ) {
+			goto done;
+		}
+	}
+	code = NETLIST_ERR_SUBCKT; /// no `.ends`.
+done:
+	bistack_rewind_front(s, mark);
+	return code;
+}
+
+/// Builds the circuit from SPICE netlist text.
+/// The first line is the title as in SPICE. Takes R, C, L, V, I and D element lines,
+/// sources as `V n+ n- [DC] [v] [AC mag]` and diodes as `D anode cathode [model|Is]`, stops at `.end`. A `.ac` card goes into `st->ac`,
+/// a `.tran` card into `st->tran`, `.save` cards into `st->save` and a `.sens` card into `st->sens_out`,
+/// other dot-commands are skipped. Only the first source with an `AC` field drives the sweep.
+/// `.subckt name ports..` to `.ends` defines a subcircuit, reduced to its ports right away,
+/// and `Xname nodes.. name` places one. Definitions come before their instances.
+/// Node names are interned as they're met, `0` and `gnd` being ground, a body's other nodes are its own.
+/// On failure `st->line` is the offending line.
+NETLIST_EXPORT EXTANT(1, 2, 4) int circuit_parse_netlist(struct Circuit *const c, char const text[const], size_t const len, struct NetlistStatus *const st) {
+	*st = (struct NetlistStatus){ .code = NETLIST_OK };
+	st->ac = ac_options(AC_DEC, 0, rat_zero(), rat_zero());
+	st->sens_out = NODE_NONE;
+	struct NetScanner sc = netlist_scanner(text, len);
+	netlist_skip_line(&sc);
+
+	struct NetToken f[NETLIST_MAX_FIELDS];
+	uint32_t line = 0;
+	int count;
+	while( (count = netlist_next_line(&sc, f, &line)) >= 0 ) {
+		st->line = line;
+		if( count==0 ) {
+			continue;
+		}
+		if( f[0].str[0]=='.' ) {
+			if( netlist_token_is(f[0], ".end") ) {
+				break;
+			} else if( netlist_token_is(f[0], ".ac") ) {
+				st->code = _netlist_parse_ac(f, count, &st->ac);
+				if( st->code != NETLIST_OK ) {
+					return st->code;
+				}
+				st->has_ac = true;
+			} else if( netlist_token_is(f[0], ".tran") ) {
+				st->code = _netlist_parse_tran(f, count, &st->tran);
+				if( st->code != NETLIST_OK ) {
+					return st->code;
+				}
+				st->has_tran = true;
+			} else if( netlist_token_is(f[0], ".sens") ) {
+				st->code = _netlist_parse_sens(c, f, count, st);
+				if( st->code != NETLIST_OK ) {
+					return st->code;
+				}
+			} else if( netlist_token_is(f[0], ".save") ) {
+				st->code = _netlist_parse_save(c, f, count, st);
+				if( st->code != NETLIST_OK ) {
+					return st->code;
+				}
+			} else if( netlist_token_is(f[0], ".subckt") ) {
+				st->code = _netlist_parse_subckt(c, &sc, f, count, st);
+				if( st->code != NETLIST_OK ) {
+					return st->code;
+				}
+			}
+			continue;
+		}
+		st->code = _netlist_parse_element(c, c, f, count, st, false);
+		if( st->code != NETLIST_OK ) {
+			return st->code;
+		}
+		st->elements++;
+	}
+	st->line = sc.line;
+	return st->code;
+}
+
+/// Loads a netlist file, mapped read-only and parsed straight out of the page cache where there's mmap,
+/// read into the front of the circuit's bistack elsewhere. Nothing points into the text afterwards.
+NETLIST_EXPORT NO_NULLS int circuit_load_netlist(struct Circuit *const c, char const path[const static 1], struct NetlistStatus *const st) {
+	*st = (struct NetlistStatus){ .code = NETLIST_ERR_IO };
+#ifdef NETLIST_MMAP
+	int const fd = open(path, O_RDONLY);
+	if( fd < 0 ) {
+		return st->code;
+	}
+	struct stat info;
+	if( fstat(fd, &info) < 0 ) {
+		close(fd);
+		return st->code;
+	} else if( info.st_size==0 ) {
+		close(fd);
+		return circuit_parse_netlist(c, "", 0, st);
+	}
+	size_t const len = ( size_t )(info.st_size);
+	void *const text = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if( text==MAP_FAILED ) {
+		return st->code;
+	}
+	madvise(text, len, MADV_SEQUENTIAL);
+	int const res = circuit_parse_netlist(c, text, len, st);
+	munmap(text, len);
+	return res;
+#else
+	FILE *const file = fopen(path, "rb");
+	if( file==NULL ) {
+		return st->code;
+	}
+	size_t const avail = bistack_get_margins(&c->bistack);
+	size_t const reserve = avail / 2; /// the circuit still needs room on the back while parsing.
+	char *const text = bistack_alloc_front_raw(&c->bistack, reserve);
+	size_t const len = ( text != NULL )? fread(text, 1, reserve, file) : 0;
+	bool const whole = text != NULL && feof(file) && !ferror(file);
+	fclose(file);
+	int res = st->code;
+	if( whole ) {
+		res = circuit_parse_netlist(c, text, len, st);
+	}
+	bistack_reset_front(&c->bistack);
+	return res;
+#endif
+}
+#endif
@@ -0,0 +1,393 @@
+#ifndef NEWTON_H_INCLUDED
+#	define NEWTON_H_INCLUDED
+
+#include "node.h"
+
+#define NEWTON_EXPORT    static inline
+
+enum {
+	NEWTON_DIRECT = 0, /// Newton from the initial guess converged.
+	NEWTON_GMIN,       /// needed gmin stepping.
+	NEWTON_SOURCE,     /// needed source stepping.
+};
+
+enum {
+	NEWTON_EXP_MAX     = 80,   /// past this many thermal voltages a junction's exponential continues linearly.
+	NEWTON_GMIN_START  = 100,  /// gmin stepping starts at 1/this siemens.
+	NEWTON_SOURCE_MIN  = 1000, /// source stepping gives up once its step drops below 1/this of full scale.
+	NEWTON_DAMP_LEVELS = 4,    /// steps get halved at most this many times while the iteration isn't contracting.
+};
+
+struct NewtonOptions {
+	rat_t    vt;              /// emission coefficient times thermal voltage, `n*k*T/q`.
+	rat_t    gmin;            /// conductance across every junction.
+	rat_t    reltol, vntol, abstol;
+	rat_t    reuse_ratio;     /// modified Newton keeps old factors while each step shrinks to at most this fraction of the last.
+	uint32_t max_iter;        /// per Newton solve, every gmin or source step gets its own.
+	uint32_t reuse_max;       /// iterations one factorization may serve, 1 is plain Newton.
+	bool     gmin_stepping, source_stepping;
+};
+
+struct NewtonResult {
+	uint32_t iterations, factorizations;
+	uint32_t gmin_steps, source_steps;
+	uint8_t  strategy; /// NEWTON_*
+};
+
+NEWTON_EXPORT struct NewtonOptions newton_options(void) {
+	rat_t const milli = rat_recip(rat_from_int(1000));
+	rat_t const micro = rat_mul(milli, milli);
+	return (struct NewtonOptions){
+		.vt              = rat_div(rat_from_int(25852), rat_from_int(1000000)), /// 300 K
+		.gmin            = rat_mul(micro, micro),
+		.reltol          = milli,
+		.vntol           = micro,
+		.abstol          = rat_mul(micro, micro),
+		.reuse_ratio     = rat_recip(rat_from_int(4)),
+		.max_iter        = 100,
+		.reuse_max       = 1,
+		.gmin_stepping   = true,
+		.source_stepping = true,
+	};
+}
+
+/// Everything one operating-point solve works with, all on the front of the circuit's bistack.
+/// The linear part is assembled once into `prog->G.vals` and `rhs`, diodes get stamped over a copy of it in `J`.
+struct _Newton {
+	struct StampProgram const  *prog;
+	struct NewtonOptions const *opt;
+	struct TIBiStack           *s;
+	rat_t                      *rhs, *J, *x, *r, *work;
+	rat_t                      *vd;    /// junction voltage each diode was last evaluated at, after limiting.
+	rat_t                      *gd;    /// its conductance there.
+	uint32_t                   *q;
+	struct SpLU                 lu;
+	size_t                      mark;  /// front offset the factors start at.
+	uint32_t                    iterations, factorizations;
+	bool                        factored;
+};
+
+/// `vcrit`, the junction voltage past which the exponential gets steep enough to need limiting.
+NEWTON_EXPORT rat_t _newton_vcrit(rat_t const vt, rat_t const is) {
+	rat_t const sqrt2 = rat_root(rat_from_int(2), rat_from_int(2));
+	return rat_mul(vt, rat_ln(rat_div(vt, rat_mul(sqrt2, is))));
+}
+
+/// SPICE's `pnjlim`: steps of the junction voltage past `vcrit` move logarithmically.
+NEWTON_EXPORT NO_NULLS rat_t _newton_pnjlim(rat_t const vnew, rat_t const vold, rat_t const vt, rat_t const vcrit, bool *const limited) {
+	if( !rat_lt(vcrit, vnew) || !rat_lt(rat_mul(rat_from_int(2), vt), rat_abs(rat_sub(vnew, vold))) ) {
+		return vnew;
+	}
+	*limited = true;
+	if( rat_lt(rat_zero(), vold) ) {
+		rat_t const arg = rat_add(rat_pos1(), rat_div(rat_sub(vnew, vold), vt));
+		return rat_lt(rat_zero(), arg)? rat_add(vold, rat_mul(vt, rat_ln(arg))) : vcrit;
+	}
+	return rat_mul(vt, rat_ln(rat_div(vnew, vt)));
+}
+
+/// Shockley diode current and conductance at `v`, gmin in parallel.
+NEWTON_EXPORT NO_NULLS void _newton_diode(rat_t const v, rat_t const is, rat_t const vt, rat_t const gmin, rat_t *const id, rat_t *const gd) {
+	rat_t const arg = rat_div(v, vt), cap = rat_from_int(NEWTON_EXP_MAX);
+	rat_t ex, slope;
+	if( rat_lt(cap, arg) ) {
+		slope = rat_exp(cap);
+		ex = rat_mul(slope, rat_add(rat_pos1(), rat_sub(arg, cap)));
+	} else {
+		ex = slope = rat_exp(arg);
+	}
+	*id = rat_add(rat_mul(is, rat_sub(ex, rat_pos1())), rat_mul(gmin, v));
+	*gd = rat_add(rat_div(rat_mul(is, slope), vt), gmin);
+}
+
+/// voltage across diode `d` in the unknown vector `v`, a step or a solution.
+NEWTON_EXPORT NO_NULLS rat_t _newton_junction(struct StampProgram const *const prog, rat_t const v[const], uint32_t const d) {
+	int32_t const a = stamp_row(prog, prog->diode_a[d]), b = stamp_row(prog, prog->diode_b[d]);
+	rat_t const va = ( a >= 0 )? v[a] : rat_zero();
+	rat_t const vb = ( b >= 0 )? v[b] : rat_zero();
+	return rat_sub(va, vb);
+}
+
+/// `(J*x)` of the linear part, `G` in the program's column layout.
+NEWTON_EXPORT NO_NULLS void _newton_spmv(struct SpMat const *const G, rat_t const vals[const restrict], rat_t const x[const restrict], rat_t y[const restrict]) {
+	for( uint32_t i=0; i < G->n; i++ ) {
+		y[i] = rat_zero();
+	}
+	for( uint32_t j=0; j < G->n; j++ ) {
+		rat_t const xj = x[j];
+		for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+			y[G->rowidx[p]] = rat_add(y[G->rowidx[p]], rat_mul(vals[p], xj));
+		}
+	}
+}
+
+/// Linearizes every diode at `x` and leaves the KCL residual of that linearization in `nw->r`.
+/// `init` evaluates every junction at `vcrit` instead, the usual first guess.
+/// Returns whether any junction voltage got limited.
+NEWTON_EXPORT NO_NULLS bool _newton_residual(struct _Newton *const nw, rat_t const gmin, rat_t const scale, bool const init) {
+	struct StampProgram const *const prog = nw->prog;
+	rat_t const vt = nw->opt->vt;
+	_newton_spmv(&prog->G, prog->G.vals, nw->x, nw->r);
+	for( uint32_t i=0; i < prog->n; i++ ) {
+		nw->r[i] = rat_sub(nw->r[i], rat_mul(scale, nw->rhs[i]));
+	}
+	bool limited = init;
+	for( uint32_t d=0; d < prog->diode_count; d++ ) {
+		int32_t const a = stamp_row(prog, prog->diode_a[d]), b = stamp_row(prog, prog->diode_b[d]);
+		rat_t const is = *prog->diode_src[d];
+		rat_t const v = _newton_junction(prog, nw->x, d);
+		rat_t const vcrit = _newton_vcrit(vt, is);
+		rat_t const vl = init? vcrit : _newton_pnjlim(v, nw->vd[d], vt, vcrit, &limited);
+		rat_t id;
+		_newton_diode(vl, is, vt, gmin, &id, &nw->gd[d]);
+		nw->vd[d] = vl;
+		rat_t const i = rat_add(id, rat_mul(nw->gd[d], rat_sub(v, vl)));
+		if( a >= 0 ) {
+			nw->r[a] = rat_add(nw->r[a], i);
+		}
+		if( b >= 0 ) {
+			nw->r[b] = rat_sub(nw->r[b], i);
+		}
+	}
+	return limited;
+}
+
+/// SPICE's junction current check at the new `x`: the current the diode really carries there
+/// against what its linearization at `vd` predicted, `|id(v) - (id(vd) + gd*(v - vd))| <= reltol*max + abstol`.
+/// A step can be tiny next to its nodes and still land where the junction's current is far off.
+NEWTON_EXPORT NO_NULLS bool _newton_currents_agree(struct _Newton const *const nw, rat_t const gmin) {
+	struct StampProgram const *const prog = nw->prog;
+	struct NewtonOptions const *const opt = nw->opt;
+	for( uint32_t d=0; d < prog->diode_count; d++ ) {
+		rat_t const is = *prog->diode_src[d];
+		rat_t const v = _newton_junction(prog, nw->x, d);
+		rat_t id_lin, gd_lin, id, gd;
+		_newton_diode(nw->vd[d], is, opt->vt, gmin, &id_lin, &gd_lin);
+		_newton_diode(v, is, opt->vt, gmin, &id, &gd);
+		rat_t const predicted = rat_add(id_lin, rat_mul(nw->gd[d], rat_sub(v, nw->vd[d])));
+		rat_t const tol = rat_add(rat_mul(opt->reltol, rat_max(rat_abs(id), rat_abs(predicted))), opt->abstol);
+		if( rat_lt(tol, rat_abs(rat_sub(id, predicted))) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Jacobian at the last linearization: the cached linear part with the diode conductances on top.
+/// Refactors through the existing pivots when they hold up, factors afresh otherwise.
+NEWTON_EXPORT NO_NULLS int _newton_factor(struct _Newton *const nw) {
+	struct StampProgram const *const prog = nw->prog;
+	memcpy(nw->J, prog->G.vals, prog->G.nnz * sizeof *nw->J);
+	for( uint32_t d=0; d < prog->diode_count; d++ ) {
+		uint32_t const *const slot = &prog->diode_slots[4*d];
+		rat_t const g = nw->gd[d];
+		for( int k=0; k < 4; k++ ) {
+			if( slot[k] != NODE_NONE ) {
+				nw->J[slot[k]] = ( k < 2 )? rat_add(nw->J[slot[k]], g) : rat_sub(nw->J[slot[k]], g);
+			}
+		}
+	}
+	struct SpMat J = prog->G;
+	J.vals = nw->J;
+	nw->factorizations++;
+	if( nw->factored && splu_refactor(&nw->lu, &J, sparse_pivot_tol(), nw->work)==SPARSE_OK ) {
+		return ERR_OK;
+	}
+	nw->s->front = nw->mark;
+	nw->factored = false;
+	switch( splu_factor(nw->s, &J, nw->q, sparse_pivot_tol(), &nw->lu) ) {
+		case SPARSE_ERR_OOM:      return ERR_OOM;
+		case SPARSE_ERR_SINGULAR: return ERR_SINGULAR;
+	}
+	nw->factored = true;
+	return ERR_OK;
+}
+
+/// Newton iteration from the current `x` and junction voltages, with gmin `gmin` across the
+/// junctions and the sources at `scale` of their value.
+/// Each step is the damped solution of `J*dx = -r`; in modified-Newton mode `J`'s factors
+/// are kept for up to `reuse_max` iterations while the steps keep shrinking fast enough.
+/// Damping halves the step whenever the iteration stops contracting and lets it grow back once it does.
+/// Converging takes what SPICE asks for: a step within tolerance at every node and across every
+/// junction, the latter against the junction's own voltage rather than its nodes' (a 100 V node
+/// says nothing about how settled the diode hanging off it is), and every junction current
+/// agreeing with the linearization that produced the step.
+NEWTON_EXPORT NO_NULLS int _newton_solve(struct _Newton *const nw, rat_t const gmin, rat_t const scale, bool init) {
+	struct StampProgram const *const prog = nw->prog;
+	struct NewtonOptions const *const opt = nw->opt;
+	uint32_t const n = prog->n;
+	rat_t last = rat_zero(), damp = rat_pos1();
+	uint32_t damped = 0, since_factor = 0;
+	bool fresh = false;
+	for( uint32_t iter=0; iter < opt->max_iter; iter++ ) {
+		nw->iterations++;
+		bool const limited = _newton_residual(nw, gmin, scale, init);
+		init = false;
+		bool const keep = nw->factored && fresh && !limited && since_factor < opt->reuse_max;
+		if( !keep ) {
+			int const res = _newton_factor(nw);
+			if( res != ERR_OK ) {
+				return res;
+			}
+			since_factor = 0;
+		}
+		since_factor++;
+		for( uint32_t i=0; i < n; i++ ) {
+			nw->r[i] = rat_neg(nw->r[i]);
+		}
+		splu_solve(&nw->lu, nw->r, nw->work);
+
+		/// weighted infinity norm of the full step, at most 1 once it's within tolerance everywhere.
+		rat_t norm = rat_zero();
+		for( uint32_t i=0; i < n; i++ ) {
+			rat_t const floor = ( i < prog->node_rows )? opt->vntol : opt->abstol;
+			rat_t const tol = rat_add(rat_mul(opt->reltol, rat_abs(nw->x[i])), floor);
+			norm = rat_max(norm, rat_div(rat_abs(nw->r[i]), tol));
+		}
+		/// junction steps only gate convergence, steering the damping by them would stall it.
+		rat_t jnorm = rat_zero();
+		for( uint32_t d=0; d < prog->diode_count; d++ ) {
+			rat_t const dv = _newton_junction(prog, nw->r, d);
+			rat_t const tol = rat_add(rat_mul(opt->reltol, rat_abs(nw->vd[d])), opt->vntol);
+			jnorm = rat_max(jnorm, rat_div(rat_abs(dv), tol));
+		}
+		if( iter > 0 && !rat_lt(norm, last) ) {
+			if( damped < NEWTON_DAMP_LEVELS ) {
+				damped++;
+				damp = rat_div(damp, rat_from_int(2));
+			}
+		} else if( damped > 0 ) {
+			damped--;
+			damp = rat_mul(damp, rat_from_int(2));
+		}
+		/// the old factors only serve the next step if this one contracted well.
+		fresh = iter > 0 && rat_lt(norm, rat_mul(opt->reuse_ratio, last));
+		last = norm;
+		/// a step already within tolerance at the nodes goes in whole, what's left is the junctions settling.
+		bool const small = !limited && !rat_lt(rat_pos1(), norm);
+		for( uint32_t i=0; i < n; i++ ) {
+			nw->x[i] = rat_add(nw->x[i], small? nw->r[i] : rat_mul(damp, nw->r[i]));
+		}
+		if( small && !rat_lt(rat_pos1(), jnorm) && _newton_currents_agree(nw, gmin) ) {
+			return ERR_OK;
+		}
+	}
+	return ERR_NO_CONVERGE;
+}
+
+/// DC operating point of a circuit with diodes, by Newton-Raphson.
+/// The linear part is assembled once and only the diodes are restamped each iteration.
+/// When Newton from the initial guess fails, gmin stepping (a large conductance across every junction,
+/// shrunk a decade at a time) and then source stepping (sources ramped up from 0) are tried,
+/// as enabled in `opt`. Circuits without diodes go straight to `circuit_calc_voltages`.
+/// On ERR_NO_CONVERGE the voltages are left zeroed.
+NEWTON_EXPORT EXTANT(1, 2) int circuit_calc_voltages_newton(struct Circuit *const c, struct NewtonOptions const *const opt, struct NewtonResult *const result) {
+	struct TIBiStack *const s = &c->bistack;
+	struct NewtonResult out = { .strategy = NEWTON_DIRECT };
+	struct StampProgram prog;
+	struct _Newton nw = { .prog = &prog, .opt = opt, .s = s };
+	circuit_reset_voltages(c);
+	int res = circuit_compile(c, &prog);
+	if( res != ERR_OK ) {
+		goto done;
+	} else if( prog.diode_count==0 || prog.n==0 ) {
+		bistack_reset_front(s);
+		res = circuit_calc_voltages(c);
+		out.iterations = out.factorizations = 1;
+		goto done;
+	}
+	res = ERR_OOM;
+	uint32_t const n = prog.n, diodes = prog.diode_count;
+	rat_t *raw   = alloc_vec(s, prog.elem_count);
+	rat_t *vals  = alloc_vec(s, 2 * prog.elem_count);
+	rat_t *x_ok  = alloc_vec(s, n);
+	rat_t *vd_ok = alloc_vec(s, diodes);
+	nw.rhs  = alloc_vec(s, n);
+	nw.J    = alloc_vec(s, prog.G.nnz);
+	nw.x    = alloc_vec(s, n);
+	nw.r    = alloc_vec(s, n);
+	nw.work = alloc_vec(s, n);
+	nw.vd   = alloc_vec(s, diodes);
+	nw.gd   = alloc_vec(s, diodes);
+	nw.q    = sparse_alloc_ids(s, n);
+	if( raw==NULL || vals==NULL || x_ok==NULL || vd_ok==NULL || nw.rhs==NULL || nw.J==NULL
+	 || nw.x==NULL || nw.r==NULL || nw.work==NULL || nw.vd==NULL || nw.gd==NULL || nw.q==NULL ) {
+		goto done;
+	}
+	stamp_program_load(&prog, raw);
+	stamp_program_assemble(&prog, raw, rat_zero(), vals, prog.G.vals, nw.rhs);
+	circuit_order(c, &prog, nw.q);
+	nw.mark = s->front;
+
+	res = _newton_solve(&nw, opt->gmin, rat_pos1(), true);
+	if( res != ERR_NO_CONVERGE && res != ERR_SINGULAR ) {
+		goto done;
+	}
+
+	if( opt->gmin_stepping ) {
+		out.strategy = NEWTON_GMIN;
+		memset(nw.x, 0, n * sizeof *nw.x);
+		bool init = true;
+		rat_t g = rat_recip(rat_from_int(NEWTON_GMIN_START));
+		res = ERR_OK;
+		while( res==ERR_OK && rat_lt(opt->gmin, g) ) {
+			res = _newton_solve(&nw, g, rat_pos1(), init);
+			init = false;
+			out.gmin_steps++;
+			g = rat_div(g, rat_from_int(10));
+		}
+		if( res==ERR_OK ) {
+			res = _newton_solve(&nw, opt->gmin, rat_pos1(), false);
+		}
+		if( res==ERR_OK || res==ERR_OOM ) {
+			goto done;
+		}
+	}
+
+	if( opt->source_stepping ) {
+		out.strategy = NEWTON_SOURCE;
+		memset(nw.x, 0, n * sizeof *nw.x);
+		memset(x_ok, 0, n * sizeof *x_ok);
+		for( uint32_t d=0; d < diodes; d++ ) {
+			vd_ok[d] = nw.vd[d] = rat_zero();
+		}
+		rat_t const min_step = rat_recip(rat_from_int(NEWTON_SOURCE_MIN));
+		rat_t at = rat_zero(), step = rat_recip(rat_from_int(10));
+		res = ERR_NO_CONVERGE;
+		while( !rat_lt(step, min_step) ) {
+			rat_t const scale = rat_min(rat_pos1(), rat_add(at, step));
+			res = _newton_solve(&nw, opt->gmin, scale, false);
+			out.source_steps++;
+			if( res==ERR_OOM ) {
+				goto done;
+			} else if( res==ERR_OK ) {
+				if( !rat_lt(scale, rat_pos1()) ) {
+					goto done;
+				}
+				at = scale;
+				memcpy(x_ok, nw.x, n * sizeof *x_ok);
+				memcpy(vd_ok, nw.vd, diodes * sizeof *vd_ok);
+				step = rat_mul(step, rat_from_int(2));
+			} else {
+				memcpy(nw.x, x_ok, n * sizeof *nw.x);
+				memcpy(nw.vd, vd_ok, diodes * sizeof *nw.vd);
+				step = rat_div(step, rat_from_int(4));
+			}
+		}
+		res = ( res==ERR_OK )? ERR_NO_CONVERGE : res;
+	}
+done:
+	if( res==ERR_OK && nw.x != NULL ) {
+		stamp_program_store(&prog, c, nw.x);
+	}
+	if( nw.iterations > 0 ) {
+		out.iterations     = nw.iterations;
+		out.factorizations = nw.factorizations;
+	}
+	if( result != NULL ) {
+		*result = out;
+	}
+	bistack_reset_front(s);
+	return res;
+}
+#endif
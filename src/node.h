@@ -7,9 +7,21 @@
 #include <stdio.h>
 #include "mem.h"
 #include "realtype.h"
+#include "sparse.h"
+#include "dense.h"
+#ifdef CIRCUIT_STATS
+#	include <time.h>
+#endif
 
 #define CIRCUIT_EXPORT    static inline
 
+/// `CIRCUIT_STATS_ONLY(stmt;)` keeps instrumentation out of the default build.
+#ifdef CIRCUIT_STATS
+#	define CIRCUIT_STATS_ONLY(...)    __VA_ARGS__
+#else
+#	define CIRCUIT_STATS_ONLY(...)
+#endif
+
 
 enum {
 	COMP_WIRE=0, // no real component, just abstract wire.
@@ -19,43 +31,103 @@ enum {
 	COMP_RESISTOR,
 	COMP_CAPACITOR,
 	COMP_INDUCTOR,
-	//COMP_DIODE,
+	COMP_DIODE,
 	MAX_COMP_TYPES,
 };
 
 enum {
-	MAX_NODES = 20,
-	GND_IDX   =  0,
+	GND_IDX        = 0,
+	NODE_TABLE_MIN = 16,  /// first allocation of the per-node tables.
+	NODE_NAMES_MIN = 16,  /// first allocation of the name table, always a power of two.
+	BITS_PER_WORD  = sizeof(size_t) * 8,
+};
+
+/// node ids are 32-bit but stay inside `int32_t` so the solvers can use -1 as "none",
+/// valid ids are below MAX_NODE_ID so a table of `id + 1` entries still fits too.
+#define MAX_NODE_ID    (( uint32_t )(INT32_MAX))
+#define NODE_NONE      UINT32_MAX
+
+enum {
+	SOLVER_AUTO = 0, /// dense for small circuits, banded or sparse past `SPARSE_MIN_ROWS` unknowns.
+	SOLVER_DENSE,
+	SOLVER_SPARSE,
+	SOLVER_MIXED,    /// dense LU in float refined to full precision, plain dense where that can't get there.
+	SOLVER_BANDED,   /// reverse Cuthill-McKee order and a banded LU or Cholesky, AUTO picks it for narrow bands.
+};
+
+enum {
+	SPARSE_MIN_ROWS = 48,
+	BAND_RATIO      = 160, /// AUTO goes banded past `SPARSE_MIN_ROWS` while the squared half-bandwidth stays under this times sqrt(n).
+};
+
+enum {
+	STORE_LINKED = 0, /// per-node adjacency lists of `struct Comp`, one copy per endpoint.
+	STORE_EDGES,      /// one `CompEdges` entry per component.
+};
+
+enum {
+	EDGE_TABLE_MIN = 16,
 };
 
 CIRCUIT_EXPORT size_t idx1D(size_t const i, size_t const j, size_t const n) {
 	return (i*n) + j;
 }
 
-/// _builtin_popcountg()
-CIRCUIT_EXPORT NO_NULLS size_t setup_matrix_ids(size_t const nodes, uint8_t(*const restrict n_to_m)[MAX_NODES], uint8_t(*const restrict m_to_n)[MAX_NODES]) {
+CIRCUIT_EXPORT size_t bitset_words(size_t const bits) {
+	return (bits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
+CIRCUIT_EXPORT NO_NULLS bool bitset_get(size_t const set[const], size_t const i) {
+	return (set[i / BITS_PER_WORD] >> (i % BITS_PER_WORD)) & 1;
+}
+CIRCUIT_EXPORT NO_NULLS void bitset_set(size_t set[const], size_t const i) {
+	set[i / BITS_PER_WORD] |= ( size_t )(1) << (i % BITS_PER_WORD);
+}
+
+/// walks the set bits a word at a time, so empty stretches of the node table cost one test per word.
+CIRCUIT_EXPORT NO_NULLS size_t setup_matrix_ids(
+	size_t   const nodes[const restrict],
+	uint32_t const node_count,
+	uint32_t       n_to_m[const restrict],
+	uint32_t       m_to_n[const restrict]
+) {
 	size_t n = 0;
-	for( size_t i=1; i < MAX_NODES; i++ ) { /// start at 1 because ignoring ground node.
-		if( nodes & (1 << i) ) {
-			(*n_to_m)[i] = n;
-			(*m_to_n)[n] = i;
+	size_t const words = bitset_words(node_count);
+	for( size_t w=0; w < words; w++ ) {
+		size_t bits = nodes[w];
+		if( w==0 ) {
+			bits &= ~( size_t )(1); /// ignoring ground node.
+		}
+		while( bits != 0 ) {
+			uint32_t const i = w*BITS_PER_WORD + __builtin_ctzll(bits);
+			n_to_m[i] = n;
+			m_to_n[n] = i;
 			n++;
+			bits &= bits - 1;
 		}
 	}
 	return n;
 }
 
 CIRCUIT_EXPORT NO_NULLS rat_t *alloc_vec(struct TIBiStack *s, size_t const n) {
-	rat_t *v = bistack_alloc_front_vec(s, n, sizeof *v);
+	rat_t *v = bistack_alloc_front_raw(s, n * sizeof *v);
+	if( v==NULL ) {
+		return NULL;
+	}
 	for( size_t i=0; i < n; i++ ) {
 		v[i] = rat_zero();
 	}
 	return v;
 }
+#ifdef MEM_STATS
+#	define alloc_vec(s, n)    MEM_TRACK_CALL(alloc_vec, s, n)
+#endif
 
-/// for solving the conductance matrix.
+/// Gaussian elimination with partial pivoting on a row-major `A`, `v` is solved in place.
+/// No solver calls it any more: it's the reference `dense_lu_factor` is checked against
+/// (`make check`) and timed against (`bench dense`).
 /// credit to Andrew via https://blamsoft.com/gaussian_rref-elimination-c-code/
 CIRCUIT_EXPORT void gaussian_rref(size_t const n, rat_t A[const restrict], rat_t v[const restrict]) {
+	rat_t const eps = rat_epsilon();
 	for( size_t k = 0; k < n-1; k++ ) {
 		size_t const kk = idx1D(k, k, n);
 		/// Partial pivot
@@ -69,7 +141,7 @@ CIRCUIT_EXPORT void gaussian_rref(size_t const n, rat_t A[const restrict], rat_t
 				m = i;
 			}
 		}
-		if( rat_lt(cur_max, rat_epsilon()) ) {
+		if( rat_lt(cur_max, eps) ) {
 			continue;
 		}
 		if( m != k ) {
@@ -109,20 +181,30 @@ CIRCUIT_EXPORT void gaussian_rref(size_t const n, rat_t A[const restrict], rat_t
 
 
 enum {
-	ERR_NODE_OOB  = -2,
-	ERR_OOM       = -1,
-	ERR_SELF_LOOP =  0,
-	ERR_OK        =  1,
+	ERR_NONLINEAR   = -8,
+	ERR_SOURCE_LOOP = -7,
+	ERR_FLOATING    = -6,
+	ERR_NO_CONVERGE = -5,
+	ERR_TIMESTEP    = -4,
+	ERR_SINGULAR    = -3,
+	ERR_NODE_OOB    = -2,
+	ERR_OOM         = -1,
+	ERR_SELF_LOOP   =  0,
+	ERR_OK          =  1,
 };
 
 /// represents a component that's connected to between two nodes.
+/// every component is stored twice, once per endpoint, `mirrored` marks the copy kept by `n2`.
 struct Comp {
-	struct Comp *next;
+	struct Comp *next, *twin; /// `twin` is the copy stored under the other endpoint.
 	rat_t        val, current;
-	uint8_t      kind, node, owner;
+	uint32_t     node, owner;
+	uint8_t      kind;
+	bool         mirrored;
+	bool         macro; /// generated by `circuit_add_subckt`, part of a macromodel's equivalent network rather than a real part.
 };
 
-CIRCUIT_EXPORT NO_NULLS struct Comp *component_new(struct TIBiStack *const s, rat_t const value, uint8_t const kind, uint8_t const node) {
+CIRCUIT_EXPORT NO_NULLS struct Comp *component_new(struct TIBiStack *const s, rat_t const value, uint8_t const kind, uint32_t const node) {
 	struct Comp *comp = bistack_alloc_back(s, sizeof *comp);
 	if( comp==NULL ) {
 		return NULL;
@@ -134,6 +216,45 @@ CIRCUIT_EXPORT NO_NULLS struct Comp *component_new(struct TIBiStack *const s, ra
 }
 
 
+/// Structure-of-arrays component storage: component `e` runs from `node_a[e]` to `node_b[e]`.
+/// The node -> component index is CSR, built on first use and rebuilt after more components arrive.
+struct CompEdges {
+	uint8_t  *kind;
+	uint32_t *node_a, *node_b;
+	rat_t    *val;
+	bool     *macro;         /// as in `struct Comp`, NULL when no component ever got a flag (attached images).
+	uint32_t *adj_ptr, *adj; /// components touching node `i` are `adj[adj_ptr[i] .. adj_ptr[i+1]]`.
+	uint32_t  len, cap, indexed_nodes;
+	bool      indexed;
+};
+
+/// interned node name, `name` points into the circuit's bistack.
+struct NodeName {
+	char const *name;
+	uint32_t    len, id, hash; /// hash is kept so probes rarely chase `name`.
+};
+
+#ifdef CIRCUIT_STATS
+enum {
+	CIRCUIT_PHASE_COMPILE = 0, /// index setup and stamp program.
+	CIRCUIT_PHASE_ASSEMBLE,
+	CIRCUIT_PHASE_ORDER,
+	CIRCUIT_PHASE_FACTOR,
+	CIRCUIT_PHASE_SOLVE,       /// triangular solves and storing the voltages.
+	MAX_CIRCUIT_PHASES,
+};
+
+/// Solver statistics, compiled in with `-DCIRCUIT_STATS`.
+/// Times and counters add up over every solve, the pivot and fill figures describe the latest factorization.
+struct CircuitStats {
+	uint64_t phase_ns[MAX_CIRCUIT_PHASES];
+	uint32_t solves, dense_solves, band_solves, failures, ooms;
+	uint32_t n, a_nnz, lu_nnz;   /// unknowns, nonzeros of G, nonzeros of L+U (n*n when dense).
+	uint32_t off_diag_pivots;    /// pivots taken off the diagonal, row swaps for the dense path.
+	rat_t    min_pivot, max_pivot;
+};
+#endif
+
 struct Circuit {
 	struct TIBiStack bistack;
 	
@@ -141,42 +262,280 @@ struct Circuit {
 	/// The best way to represent an electrical circuit is a graph.
 	/// Specifically, an adjacency list type graph where vertices/comps contain an
 	/// edge/weight that represents an electrical component.
-	struct Comp     *comps[MAX_NODES];
-	rat_t            voltage[MAX_NODES];
-	size_t           active_nodes; /// bitflagged.
+	/// The per-node tables live on the back of the bistack and double when a bigger node id shows up.
+	/// With STORE_EDGES the components live in `edges` instead and `comps` stays NULL.
+	struct Comp    **comps;
+	struct CompEdges edges;
+	rat_t           *voltage;
+	size_t          *active_nodes; /// bitset over node ids.
+	struct NodeName *names;        /// open-addressed hash table, `name_cap` slots.
+	uint32_t         node_cap, node_count, active_count;
+	uint32_t         name_cap, name_count;
+	uint32_t        *order;        /// saved fill-reducing column order for the compiled G, dropped when components are added.
+	uint32_t         order_len;
+	struct Macromodel *macromodels;   /// reduced `.subckt` definitions, newest first (subckt.h).
+	struct SubcktInstance *instances; /// placed subcircuits, newest first.
+	void            *image;        /// mapped circuit image backing the tables, if any.
+	size_t           image_len;
+	uint8_t          solver;       /// SOLVER_*
+	uint8_t          storage;      /// STORE_*, pick before adding components.
+#ifdef CIRCUIT_STATS
+	struct CircuitStats *stats;    /// NULL when not recording.
+#endif
 };
 
 CIRCUIT_EXPORT struct Circuit circuit_make(uint8_t *const memory, size_t const memory_size) {
 	struct Circuit circ = {0};
-	for( size_t i=0; i < MAX_NODES; i++ ) {
-		circ.comps[i] = NULL;
-	}
 	circ.bistack = bistack_make(memory, memory_size);
-	circ.voltage[GND_IDX] = rat_zero();
+	circ.node_count = GND_IDX + 1;
 	return circ;
 }
 
+#ifdef BISTACK_RESERVE
+/// A circuit on a reserved bistack (see `bistack_reserve`) that grows as it's used instead of
+/// running out at a fixed size, `reserve` of 0 takes the default. Free it with `circuit_release`.
+CIRCUIT_EXPORT NO_NULLS bool circuit_make_reserved(struct Circuit *const c, size_t const reserve) {
+	struct TIBiStack s;
+	if( !bistack_reserve(&s, reserve) ) {
+		return false;
+	}
+	*c = circuit_make(s.mem, s.len);
+	c->bistack = s;
+	return true;
+}
+
+CIRCUIT_EXPORT NO_NULLS void circuit_release(struct Circuit *const c) {
+	bistack_release(&c->bistack);
+	*c = (struct Circuit){0};
+}
+#endif
+
+/// grows the node tables so ids below `count` are valid. old tables stay behind on the bistack.
+/// Fails for more than MAX_NODE_ID nodes.
+CIRCUIT_EXPORT NO_NULLS bool circuit_reserve_nodes(struct Circuit *const c, uint32_t const count) {
+	if( count <= c->node_cap ) {
+		return true;
+	} else if( count > MAX_NODE_ID ) {
+		return false;
+	}
+	uint32_t cap = ( c->node_cap < NODE_TABLE_MIN )? NODE_TABLE_MIN : c->node_cap;
+	while( cap < count ) {
+		cap = ( cap > MAX_NODE_ID / 2 )? MAX_NODE_ID : cap * 2;
+	}
+	bool const linked = c->storage==STORE_LINKED;
+	struct Comp **comps   = linked? bistack_alloc_back_vec(&c->bistack, cap, sizeof *comps) : NULL;
+	rat_t        *voltage = bistack_alloc_back_vec(&c->bistack, cap, sizeof *voltage);
+	size_t       *active  = bistack_alloc_back_vec(&c->bistack, bitset_words(cap), sizeof *active);
+	if( (linked && comps==NULL) || voltage==NULL || active==NULL ) {
+		return false;
+	}
+	for( uint32_t i=0; i < cap; i++ ) {
+		if( linked ) {
+			comps[i] = ( i < c->node_cap )? c->comps[i] : NULL;
+		}
+		voltage[i] = ( i < c->node_cap )? c->voltage[i] : rat_zero();
+	}
+	if( c->node_cap > 0 ) {
+		memcpy(active, c->active_nodes, bitset_words(c->node_cap) * sizeof *active);
+	}
+	c->comps        = comps;
+	c->voltage      = voltage;
+	c->active_nodes = active;
+	c->node_cap     = cap;
+	return true;
+}
+
+CIRCUIT_EXPORT NO_NULLS bool circuit_node_active(struct Circuit const *const c, uint32_t const node) {
+	return node < c->node_cap && bitset_get(c->active_nodes, node);
+}
+
 CIRCUIT_EXPORT NO_NULLS void circuit_reset_voltages(struct Circuit *const c) {
-	for( size_t i=0; i < MAX_NODES; i++ ) {
+	for( uint32_t i=0; i < c->node_cap; i++ ) {
 		c->voltage[i] = rat_zero();
 	}
 }
 
+/// FNV-1a
+CIRCUIT_EXPORT uint32_t node_name_hash(size_t const len, char const name[const static len]) {
+	uint32_t h = 2166136261u;
+	for( size_t i=0; i < len; i++ ) {
+		h = (h ^ ( uint8_t )(name[i])) * 16777619u;
+	}
+	return h;
+}
+
+CIRCUIT_EXPORT bool node_name_is_gnd(size_t const len, char const name[const static len]) {
+	if( len==1 ) {
+		return name[0]=='0';
+	}
+	return len==3 && (name[0] | 0x20)=='g' && (name[1] | 0x20)=='n' && (name[2] | 0x20)=='d';
+}
+
+CIRCUIT_EXPORT NO_NULLS struct NodeName *_circuit_name_slot(struct NodeName names[const], uint32_t const cap, uint32_t const hash, size_t const len, char const name[const static len]) {
+	uint32_t i = hash & (cap - 1);
+	while( names[i].name != NULL && !(names[i].hash==hash && names[i].len==len && memcmp(names[i].name, name, len)==0) ) {
+		i = (i + 1) & (cap - 1);
+	}
+	return &names[i];
+}
+
+/// returns the node id for `name`, handing out a fresh id the first time it's seen.
+/// "0" and "gnd" are ground. returns NODE_NONE when out of memory.
+CIRCUIT_EXPORT NO_NULLS uint32_t circuit_intern_node(struct Circuit *const c, size_t const len, char const name[const static len]) {
+	if( node_name_is_gnd(len, name) ) {
+		return GND_IDX;
+	}
+	/// keep the load factor under 3/4.
+	if( (c->name_count + 1) * 4 > c->name_cap * 3 ) {
+		uint32_t const cap = ( c->name_cap==0 )? NODE_NAMES_MIN : c->name_cap * 2;
+		struct NodeName *names = bistack_alloc_back_vec(&c->bistack, cap, sizeof *names);
+		if( names==NULL ) {
+			return NODE_NONE;
+		}
+		for( uint32_t i=0; i < c->name_cap; i++ ) {
+			if( c->names[i].name != NULL ) {
+				*_circuit_name_slot(names, cap, c->names[i].hash, c->names[i].len, c->names[i].name) = c->names[i];
+			}
+		}
+		c->names    = names;
+		c->name_cap = cap;
+	}
+	uint32_t const hash = node_name_hash(len, name);
+	struct NodeName *const slot = _circuit_name_slot(c->names, c->name_cap, hash, len, name);
+	if( slot->name != NULL ) {
+		return slot->id;
+	}
+	char *copy = bistack_alloc_back(&c->bistack, len + 1);
+	if( copy==NULL || c->node_count >= MAX_NODE_ID ) {
+		return NODE_NONE;
+	}
+	memcpy(copy, name, len);
+	slot->name = copy;
+	slot->len  = len;
+	slot->hash = hash;
+	slot->id   = c->node_count++;
+	c->name_count++;
+	return slot->id;
+}
+
+/// grows the edge arrays to hold `count` components, reserving up front avoids leaving old copies behind.
+CIRCUIT_EXPORT NO_NULLS bool circuit_reserve_components(struct Circuit *const c, uint32_t const count) {
+	struct CompEdges *const edges = &c->edges;
+	if( count <= edges->cap ) {
+		return true;
+	}
+	uint32_t cap = ( edges->cap < EDGE_TABLE_MIN )? EDGE_TABLE_MIN : edges->cap;
+	while( cap < count ) {
+		cap *= 2;
+	}
+	uint8_t  *kind   = bistack_alloc_back_vec(&c->bistack, cap, sizeof *kind);
+	uint32_t *node_a = bistack_alloc_back_vec(&c->bistack, cap, sizeof *node_a);
+	uint32_t *node_b = bistack_alloc_back_vec(&c->bistack, cap, sizeof *node_b);
+	rat_t    *val    = bistack_alloc_back_vec(&c->bistack, cap, sizeof *val);
+	bool     *macro  = bistack_alloc_back_vec(&c->bistack, cap, sizeof *macro);
+	if( kind==NULL || node_a==NULL || node_b==NULL || val==NULL || macro==NULL ) {
+		return false;
+	}
+	if( edges->len > 0 ) {
+		memcpy(kind,   edges->kind,   edges->len * sizeof *kind);
+		memcpy(node_a, edges->node_a, edges->len * sizeof *node_a);
+		memcpy(node_b, edges->node_b, edges->len * sizeof *node_b);
+		memcpy(val,    edges->val,    edges->len * sizeof *val);
+		if( edges->macro != NULL ) {
+			memcpy(macro, edges->macro, edges->len * sizeof *macro);
+		}
+	}
+	edges->kind   = kind;
+	edges->node_a = node_a;
+	edges->node_b = node_b;
+	edges->val    = val;
+	edges->macro  = macro;
+	edges->cap    = cap;
+	return true;
+}
+
+/// builds the CSR node -> component index of the edge storage.
+CIRCUIT_EXPORT NO_NULLS bool circuit_index_edges(struct Circuit *const c) {
+	struct CompEdges *const edges = &c->edges;
+	if( edges->indexed && edges->indexed_nodes==c->node_count ) {
+		return true;
+	}
+	uint32_t const nodes = c->node_count;
+	uint32_t *adj_ptr = bistack_alloc_back_vec(&c->bistack, nodes + 1, sizeof *adj_ptr);
+	uint32_t *adj     = bistack_alloc_back_vec(&c->bistack, 2 * edges->len, sizeof *adj);
+	if( adj_ptr==NULL || adj==NULL ) {
+		return false;
+	}
+	for( uint32_t e=0; e < edges->len; e++ ) {
+		adj_ptr[edges->node_a[e]]++;
+		adj_ptr[edges->node_b[e]]++;
+	}
+	/// inclusive prefix sums, so filling back to front leaves `adj_ptr[i]` at the start of node `i`
+	/// with each node's components in insertion order.
+	for( uint32_t i=1; i < nodes; i++ ) {
+		adj_ptr[i] += adj_ptr[i - 1];
+	}
+	adj_ptr[nodes] = 2 * edges->len;
+	for( uint32_t e = edges->len - 1; e < edges->len; e-- ) {
+		adj[--adj_ptr[edges->node_b[e]]] = e;
+		adj[--adj_ptr[edges->node_a[e]]] = e;
+	}
+	edges->adj_ptr       = adj_ptr;
+	edges->adj           = adj;
+	edges->indexed_nodes = nodes;
+	edges->indexed       = true;
+	return true;
+}
+
+/// Calls `action` for every component touching `node`.
+/// With STORE_EDGES, `comp` is a stand-in built from the arrays, changes to its `val` are written back.
 CIRCUIT_EXPORT NO_NULLS void circuit_loop_components(
 	struct Circuit *const restrict c,
-	uint8_t         const node,
-	void            action(struct Circuit *c, uint8_t node, struct Comp *comp, void *data),
+	uint32_t        const node,
+	void            action(struct Circuit *c, uint32_t node, struct Comp *comp, void *data),
 	void            *const restrict data
 ) {
-	for( struct Comp *comp = c->comps[node]; comp != NULL; comp = comp->next ) {
-		action(c, node, comp, data);
+	if( node >= c->node_cap ) {
+		return;
+	}
+	if( c->storage==STORE_LINKED ) {
+		for( struct Comp *comp = c->comps[node]; comp != NULL; comp = comp->next ) {
+			action(c, node, comp, data);
+		}
+		return;
+	}
+	struct CompEdges *const edges = &c->edges;
+	if( !circuit_index_edges(c) ) {
+		return;
+	}
+	for( uint32_t p = edges->adj_ptr[node]; p < edges->adj_ptr[node + 1]; p++ ) {
+		uint32_t const e = edges->adj[p];
+		bool const mirrored = edges->node_b[e]==node;
+		struct Comp comp = {
+			.val      = edges->val[e],
+			.current  = rat_zero(),
+			.kind     = edges->kind[e],
+			.owner    = node,
+			.node     = mirrored? edges->node_a[e] : edges->node_b[e],
+			.mirrored = mirrored,
+			.macro    = edges->macro != NULL && edges->macro[e],
+		};
+		action(c, node, &comp, data);
+		edges->val[e] = comp.val;
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void _circuit_activate(struct Circuit *const c, uint32_t const node) {
+	if( !bitset_get(c->active_nodes, node) ) {
+		bitset_set(c->active_nodes, node);
+		c->active_count++;
 	}
 }
 
 CIRCUIT_EXPORT NO_NULLS void circuit_connect_component(
 	struct Circuit *const c,
-	uint8_t         const n1,
-	uint8_t         const n2,
+	uint32_t        const n1,
+	uint32_t        const n2,
 	struct Comp    *const comp
 ) {
 	comp->owner  = n1;
@@ -187,113 +546,851 @@ CIRCUIT_EXPORT NO_NULLS void circuit_connect_component(
 	if( comp_copy==NULL ) {
 		return;
 	}
-	comp_copy->owner = n2;
-	comp_copy->next  = c->comps[n2];
+	comp_copy->owner    = n2;
+	comp_copy->mirrored = true;
+	comp_copy->macro    = comp->macro;
+	comp_copy->twin     = comp;
+	comp->twin          = comp_copy;
+	comp_copy->next     = c->comps[n2];
 	c->comps[n2]     = comp_copy;
-	c->active_nodes |= ((1 << n1) | (1 << n2));
+	_circuit_activate(c, n1);
+	_circuit_activate(c, n2);
 }
 
-CIRCUIT_EXPORT NO_NULLS int circuit_add_component(
+/// `circuit_add_component` that also sets the component's `macro` flag.
+CIRCUIT_EXPORT NO_NULLS int _circuit_add_component(
 	struct Circuit *const c,
-	uint8_t         const n1,
-	uint8_t         const n2,
+	uint32_t        const n1,
+	uint32_t        const n2,
 	uint8_t         const comp_type,
-	rat_t           const value
+	rat_t           const value,
+	bool            const macro
 ) {
-	if( n1 >= MAX_NODES || n2 >= MAX_NODES ) {
+	if( n1 >= MAX_NODE_ID || n2 >= MAX_NODE_ID ) {
 		return ERR_NODE_OOB;
 	} else if( n1==n2 ) {
 		return ERR_SELF_LOOP;
 	}
+	uint32_t const top = (( n1 > n2 )? n1 : n2) + 1;
+	if( !circuit_reserve_nodes(c, top) ) {
+		return ERR_OOM;
+	}
+	c->order     = NULL;
+	c->order_len = 0;
+	if( top > c->node_count ) {
+		c->node_count = top;
+	}
+	
+	if( c->storage==STORE_EDGES ) {
+		struct CompEdges *const edges = &c->edges;
+		if( !circuit_reserve_components(c, edges->len + 1) ) {
+			return ERR_OOM;
+		}
+		edges->kind[edges->len]   = comp_type;
+		edges->node_a[edges->len] = n1;
+		edges->node_b[edges->len] = n2;
+		edges->val[edges->len]    = value;
+		edges->macro[edges->len]  = macro;
+		edges->len++;
+		edges->indexed = false;
+		_circuit_activate(c, n1);
+		_circuit_activate(c, n2);
+		return ERR_OK;
+	}
 	
 	struct Comp *comp = component_new(&c->bistack, value, comp_type, n2);
 	if( comp==NULL ) {
 		return ERR_OOM;
 	}
+	comp->macro = macro;
 	circuit_connect_component(c, n1, n2, comp);
 	return ERR_OK;
 }
 
-CIRCUIT_EXPORT NO_NULLS void circuit_calc_voltages(struct Circuit *const c) {
-	circuit_reset_voltages(c);
-	uint8_t node_to_matrix_idx[MAX_NODES] = {0};
-	uint8_t matrix_idx_to_node[MAX_NODES] = {0};
-	size_t const n = setup_matrix_ids(c->active_nodes, &node_to_matrix_idx, &matrix_idx_to_node);
-	rat_t *G = alloc_vec(&c->bistack, n*n);
-	rat_t *I = alloc_vec(&c->bistack, n);
+CIRCUIT_EXPORT NO_NULLS int circuit_add_component(
+	struct Circuit *const c,
+	uint32_t        const n1,
+	uint32_t        const n2,
+	uint8_t         const comp_type,
+	rat_t           const value
+) {
+	return _circuit_add_component(c, n1, n2, comp_type, value, false);
+}
+
+/// index of the edge-stored component running from `n1` to `n2`, NODE_NONE if there's none.
+CIRCUIT_EXPORT NO_NULLS uint32_t circuit_find_edge(struct Circuit *const c, uint32_t const n1, uint32_t const n2, uint8_t const comp_type) {
+	struct CompEdges *const edges = &c->edges;
+	if( n1 >= c->node_count || !circuit_index_edges(c) ) {
+		return NODE_NONE;
+	}
+	for( uint32_t p = edges->adj_ptr[n1]; p < edges->adj_ptr[n1 + 1]; p++ ) {
+		uint32_t const e = edges->adj[p];
+		if( edges->node_a[e]==n1 && edges->node_b[e]==n2 && edges->kind[e]==comp_type ) {
+			return e;
+		}
+	}
+	return NODE_NONE;
+}
+
+/// the stored component running from `n1` to `n2`, NULL if there's none.
+CIRCUIT_EXPORT NO_NULLS struct Comp *circuit_find_component(struct Circuit const *const c, uint32_t const n1, uint32_t const n2, uint8_t const comp_type) {
+	if( n1 >= c->node_cap || c->storage != STORE_LINKED ) {
+		return NULL;
+	}
+	for( struct Comp *comp = c->comps[n1]; comp != NULL; comp = comp->next ) {
+		if( comp->node==n2 && comp->kind==comp_type && !comp->mirrored ) {
+			return comp;
+		}
+	}
+	return NULL;
+}
+
+/// changes a component's value in both of its stored copies, topology stays the same.
+CIRCUIT_EXPORT NO_NULLS void circuit_set_value(struct Comp *const comp, rat_t const value) {
+	comp->val = value;
+	if( comp->twin != NULL ) {
+		comp->twin->val = value;
+	}
+}
+
+
+/// One precomputed stamp: `dst[offs] += vals[val]`.
+/// The sign is folded into `val`, every element publishes both its value and its negation.
+struct StampOp {
+	uint32_t offs, val;
+};
+
+/// A circuit lowered for assembly.
+/// Adding components invalidates it, the value pointers in `src` included.
+/// Every component shows up once whatever the storage (`mirrored` copies are skipped), grouped by how it stamps:
+///   [0, r_end)          resistors, publish their conductance.
+///   [r_end, c_end)      capacitors, publish `alpha*C`, the conductance of their companion model.
+///   [c_end, i_end)      current sources, publish their current.
+///   [i_end, v_end)      voltage sources, publish their voltage.
+///   [v_end, l_end)      inductors, publish `alpha*L`, the resistance of their companion model.
+///   [l_end, elem_count) wires, shorts that publish nothing.
+/// `alpha` is the integration coefficient of the current time step, 0 gives the DC picture
+/// where capacitors are open and inductors short. Keeping them in the pattern either way
+/// lets DC and transient solves share one ordering.
+/// Voltage sources, inductors and shorts get an MNA branch row each, after the `node_rows` node voltages.
+/// The branch unknown is the current the element drives out of its `n2` terminal,
+/// and the branch equation is `V(n2) - V(n1) + alpha*L*i = val` (L and val being 0 where they don't apply).
+/// Diodes (anode `n1`, saturation current as value) aren't elements: they only reserve their four
+/// conductance slots in `G`, so linear assembly leaves them open and a nonlinear solve stamps them itself.
+struct StampProgram {
+	rat_t          **src;    /// where each element's value is stored in the circuit.
+	struct Comp    **comp;   /// the component behind each element under STORE_LINKED, NULL under STORE_EDGES.
+	bool            *macro;  /// elements a subcircuit instance generated, see `struct Comp`.
+	uint32_t        *node_a, *node_b;
+	uint8_t         *kind;
+	struct StampOp  *g_ops, *rhs_ops;
+	rat_t           *base;   /// constant part of G (the MNA +-1 entries), copied in before the ops run.
+	uint32_t        *node_to_matrix, *matrix_to_node;
+	struct SpMat     G;      /// pattern of the full MNA matrix, `G.vals` is the assembly target.
+	uint32_t         r_end, c_end, i_end, v_end, l_end, elem_count;
+	uint32_t         g_count, rhs_count, n, node_rows, node_count;
+	rat_t          **diode_src;
+	uint32_t        *diode_a, *diode_b;
+	uint32_t        *diode_slots; /// `G.vals` offsets of each diode's aa, bb, ab, ba entries, NODE_NONE where one end is ground.
+	uint32_t         diode_count;
+};
+
+enum {
+	STAMP_RESISTOR = 0,
+	STAMP_CAPACITOR,
+	STAMP_CURRENT,
+	STAMP_VOLTAGE,
+	STAMP_INDUCTOR,
+	STAMP_SHORT,
+	STAMP_SKIP,
+	MAX_STAMP_GROUPS = STAMP_SKIP,
+};
+
+CIRCUIT_EXPORT int stamp_group(uint8_t const kind) {
+	switch( kind ) {
+		case COMP_RESISTOR:       return STAMP_RESISTOR;
+		case COMP_CAPACITOR:      return STAMP_CAPACITOR;
+		case COMP_DC_CURRENT_SRC: return STAMP_CURRENT;
+		case COMP_VOLTAGE_SRC:    return STAMP_VOLTAGE;
+		case COMP_INDUCTOR:       return STAMP_INDUCTOR;
+		case COMP_WIRE:           return STAMP_SHORT;
+		default:                  return STAMP_SKIP;
+	}
+}
+
+/// matrix index of a node, -1 for ground.
+CIRCUIT_EXPORT NO_NULLS int32_t stamp_row(struct StampProgram const *const prog, uint32_t const node) {
+	return ( node==GND_IDX )? -1 : ( int32_t )(prog->node_to_matrix[node]);
+}
+
+CIRCUIT_EXPORT EXTANT(1, 2, 7) void _stamp_element(
+	struct StampProgram *const prog,
+	uint32_t                   start[const],
+	bool                 const fill,
+	uint8_t              const kind,
+	uint32_t             const a,
+	uint32_t             const b,
+	rat_t               *const val,
+	struct Comp         *const comp,
+	bool                 const macro
+) {
+	if( kind==COMP_DIODE ) {
+		if( fill ) {
+			uint32_t const d = prog->diode_count;
+			prog->diode_src[d] = val;
+			prog->diode_a[d]   = a;
+			prog->diode_b[d]   = b;
+		}
+		prog->diode_count++;
+		return;
+	}
+	int const group = stamp_group(kind);
+	if( group==STAMP_SKIP ) {
+		return;
+	} else if( !fill ) {
+		start[group + 1]++;
+		return;
+	}
+	uint32_t const e = start[group]++;
+	prog->src[e]    = val;
+	prog->comp[e]   = comp;
+	prog->macro[e]  = macro;
+	prog->node_a[e] = a;
+	prog->node_b[e] = b;
+	prog->kind[e]   = kind;
+}
+
+/// walks every component once, counting per group into `start` or, with `fill`, placing them.
+CIRCUIT_EXPORT NO_NULLS void _circuit_gather_elements(struct Circuit *const c, struct StampProgram *const prog, uint32_t start[const], bool const fill) {
+	if( c->storage==STORE_EDGES ) {
+		struct CompEdges *const edges = &c->edges;
+		for( uint32_t e=0; e < edges->len; e++ ) {
+			bool const macro = edges->macro != NULL && edges->macro[e];
+			_stamp_element(prog, start, fill, edges->kind[e], edges->node_a[e], edges->node_b[e], &edges->val[e], NULL, macro);
+		}
+		return;
+	}
+	for( uint32_t node=0; node < c->node_count && node < c->node_cap; node++ ) {
+		for( struct Comp *comp = c->comps[node]; comp != NULL; comp = comp->next ) {
+			if( !comp->mirrored ) {
+				_stamp_element(prog, start, fill, comp->kind, comp->owner, comp->node, &comp->val, comp, comp->macro);
+			}
+		}
+	}
+}
+
+/// Lowers the circuit's components into a stamp program, all allocated from the front of the bistack.
+CIRCUIT_EXPORT NO_NULLS int circuit_compile(struct Circuit *const c, struct StampProgram *const prog) {
+	struct TIBiStack *const s = &c->bistack;
+	*prog = (struct StampProgram){0};
+	prog->node_count     = c->node_count;
+	prog->node_to_matrix = sparse_alloc_ids(s, c->node_count);
+	prog->matrix_to_node = sparse_alloc_ids(s, c->active_count);
+	if( prog->node_to_matrix==NULL || prog->matrix_to_node==NULL ) {
+		return ERR_OOM;
+	}
+	prog->node_rows = setup_matrix_ids(c->active_nodes, c->node_count, prog->node_to_matrix, prog->matrix_to_node);
 	
-	for( size_t idx_i=0; idx_i < n; idx_i++ ) {
-		uint_fast8_t const node_i = matrix_idx_to_node[idx_i];
-		for( struct Comp *comp = c->comps[node_i]; comp != NULL; comp = comp->next ) {
-			uint_fast8_t const node_j = comp->node;
-			int_fast8_t const idx_j = ( node_j != GND_IDX )? node_to_matrix_idx[node_j] : -1;
-			switch( comp->kind ) {
-				case COMP_RESISTOR: {
-					rat_t const G_ij = rat_recip(comp->val); // Compute conductance G_ij = [1/R]
-					// idx_i and idx_j correspond to node_i and node_j in the matrix
-					if( node_i != GND_IDX ) {
-						// Update diagonal element G[i][i]
-						size_t const ii = idx1D(idx_i, idx_i, n);
-						G[ii] = rat_add(G[ii], G_ij);
-						if( idx_j != -1 ) {
-							// Update off-diagonal elements
-							size_t const ij = idx1D(idx_i, idx_j, n);
-							size_t const ji = idx1D(idx_j, idx_i, n);
-							size_t const jj = idx1D(idx_j, idx_j, n);
-							G[ij] = rat_sub(G[ij], G_ij);
-							G[ji] = rat_sub(G[ji], G_ij);
-							G[jj] = rat_add(G[jj], G_ij); /// Update diagonal element G[j][j]
-						} else {
-							// node_j is ground
-							// No need to update G[j][j] since ground node is not included in matrix
-							// Adjust only G[i][i] and G[i][i] (already done)
-						}
-					} else if( node_j != GND_IDX ) {
-						size_t const jj = idx1D(idx_j, idx_j, n);
-						G[jj] = rat_add(G[jj], G_ij);
-					}
-					break;
-				}
-				case COMP_DC_CURRENT_SRC: {
-					rat_t const I_s = comp->val;
-					if( node_i != GND_IDX ) {
-						size_t const idx_i = node_to_matrix_idx[node_i];
-						I[idx_i] = rat_sub(I[idx_i], I_s);
-					}
-					if( node_j != GND_IDX ) {
-						size_t const idx_j = node_to_matrix_idx[node_j];
-						I[idx_j] = rat_add(I[idx_j], I_s);
-					}
-					break;
-				}
-				/// x = a ^ b ^ x; -> if( x==a ) x=b; else if( x==b ) x=a;
-				/// if( node_i==GND_IDX ) node = node_j; else if( node_j==GND_IDX ) node = node_i;
-				case COMP_VOLTAGE_SRC: {
-					if( node_i==GND_IDX || node_j==GND_IDX ) {
-						size_t const non_gnd_node = node_i ^ node_j ^ GND_IDX;
-						size_t const non_gnd_id = node_to_matrix_idx[non_gnd_node];
-						c->voltage[non_gnd_node] = comp->val;
-						// Modify G and I to set V_node_j = comp->val
-						for (size_t k = 0; k < n; k++) {
-							size_t const non_gnd_k = idx1D(non_gnd_id, k, n);
-							G[non_gnd_k] = rat_zero(); // Zero out the row
-						}
-						size_t const non_gnd_2 = idx1D(non_gnd_id, non_gnd_id, n);
-						G[non_gnd_2] = rat_pos1(); // Set diagonal to 1
-						I[non_gnd_id] = comp->val; // Set the known voltage
-					} else {
-						/// Voltage source between two non-ground nodes
-					}
-					break;
+	uint32_t start[MAX_STAMP_GROUPS + 1] = {0};
+	_circuit_gather_elements(c, prog, start, false);
+	for( int g=0; g < MAX_STAMP_GROUPS; g++ ) {
+		start[g + 1] += start[g];
+	}
+	prog->r_end      = start[STAMP_RESISTOR + 1];
+	prog->c_end      = start[STAMP_CAPACITOR + 1];
+	prog->i_end      = start[STAMP_CURRENT + 1];
+	prog->v_end      = start[STAMP_VOLTAGE + 1];
+	prog->l_end      = start[STAMP_INDUCTOR + 1];
+	prog->elem_count = start[MAX_STAMP_GROUPS];
+	prog->n          = prog->node_rows + (prog->elem_count - prog->i_end);
+	
+	uint32_t const diodes = prog->diode_count;
+	uint32_t const max_entries = 4 * (prog->elem_count + diodes);
+	struct SpCoo coo;
+	prog->src     = bistack_alloc_front_vec(s, prog->elem_count, sizeof *prog->src);
+	prog->comp    = bistack_alloc_front_vec(s, prog->elem_count, sizeof *prog->comp);
+	prog->macro   = bistack_alloc_front_vec(s, prog->elem_count, sizeof *prog->macro);
+	prog->node_a  = sparse_alloc_ids(s, prog->elem_count);
+	prog->node_b  = sparse_alloc_ids(s, prog->elem_count);
+	prog->kind    = bistack_alloc_front_vec(s, prog->elem_count, sizeof *prog->kind);
+	prog->g_ops   = bistack_alloc_front_vec(s, 4 * prog->c_end + (prog->l_end - prog->v_end), sizeof *prog->g_ops);
+	prog->rhs_ops = bistack_alloc_front_vec(s, 2 * (prog->i_end - prog->c_end) + (prog->v_end - prog->i_end), sizeof *prog->rhs_ops);
+	prog->diode_src   = bistack_alloc_front_vec(s, diodes, sizeof *prog->diode_src);
+	prog->diode_a     = sparse_alloc_ids(s, diodes);
+	prog->diode_b     = sparse_alloc_ids(s, diodes);
+	prog->diode_slots = sparse_alloc_ids(s, 4 * diodes);
+	uint32_t *slots = sparse_alloc_ids(s, max_entries);
+	if( prog->src==NULL || prog->comp==NULL || prog->macro==NULL || prog->node_a==NULL || prog->node_b==NULL || prog->kind==NULL
+	 || prog->g_ops==NULL || prog->rhs_ops==NULL || slots==NULL || !spcoo_make(s, max_entries, &coo)
+	 || prog->diode_src==NULL || prog->diode_a==NULL || prog->diode_b==NULL || prog->diode_slots==NULL ) {
+		return ERR_OOM;
+	}
+	prog->diode_count = 0;
+	_circuit_gather_elements(c, prog, start, true);
+	
+	/// entries with a variable value go first so the triplet index doubles as the op index.
+	for( uint32_t e=0; e < prog->c_end; e++ ) {
+		int32_t const a = stamp_row(prog, prog->node_a[e]), b = stamp_row(prog, prog->node_b[e]);
+		uint32_t const pos = 2*e, neg = 2*e + 1;
+		if( a >= 0 ) {
+			prog->g_ops[coo.len].val = pos;
+			spcoo_push(&coo, a, a, rat_zero());
+		}
+		if( b >= 0 ) {
+			prog->g_ops[coo.len].val = pos;
+			spcoo_push(&coo, b, b, rat_zero());
+		}
+		if( a >= 0 && b >= 0 ) {
+			prog->g_ops[coo.len].val = neg;
+			spcoo_push(&coo, a, b, rat_zero());
+			prog->g_ops[coo.len].val = neg;
+			spcoo_push(&coo, b, a, rat_zero());
+		}
+	}
+	for( uint32_t e = prog->v_end; e < prog->l_end; e++ ) {
+		uint32_t const k = prog->node_rows + (e - prog->i_end);
+		prog->g_ops[coo.len].val = 2*e;
+		spcoo_push(&coo, k, k, rat_zero());
+	}
+	prog->g_count = coo.len;
+	for( uint32_t d=0; d < diodes; d++ ) {
+		int32_t const a = stamp_row(prog, prog->diode_a[d]), b = stamp_row(prog, prog->diode_b[d]);
+		uint32_t *const slot = &prog->diode_slots[4*d];
+		slot[0] = slot[1] = slot[2] = slot[3] = NODE_NONE;
+		if( a >= 0 ) {
+			slot[0] = coo.len;
+			spcoo_push(&coo, a, a, rat_zero());
+		}
+		if( b >= 0 ) {
+			slot[1] = coo.len;
+			spcoo_push(&coo, b, b, rat_zero());
+		}
+		if( a >= 0 && b >= 0 ) {
+			slot[2] = coo.len;
+			spcoo_push(&coo, a, b, rat_zero());
+			slot[3] = coo.len;
+			spcoo_push(&coo, b, a, rat_zero());
+		}
+	}
+	for( uint32_t e = prog->c_end; e < prog->i_end; e++ ) {
+		int32_t const a = stamp_row(prog, prog->node_a[e]), b = stamp_row(prog, prog->node_b[e]);
+		if( a >= 0 ) {
+			prog->rhs_ops[prog->rhs_count++] = (struct StampOp){ .offs = a, .val = 2*e + 1 };
+		}
+		if( b >= 0 ) {
+			prog->rhs_ops[prog->rhs_count++] = (struct StampOp){ .offs = b, .val = 2*e };
+		}
+	}
+	for( uint32_t e = prog->i_end; e < prog->elem_count; e++ ) {
+		int32_t const a = stamp_row(prog, prog->node_a[e]), b = stamp_row(prog, prog->node_b[e]);
+		uint32_t const k = prog->node_rows + (e - prog->i_end);
+		if( b >= 0 ) {
+			spcoo_push(&coo, b, k, rat_neg1());
+			spcoo_push(&coo, k, b, rat_pos1());
+		}
+		if( a >= 0 ) {
+			spcoo_push(&coo, a, k, rat_pos1());
+			spcoo_push(&coo, k, a, rat_neg1());
+		}
+		if( e < prog->v_end ) {
+			prog->rhs_ops[prog->rhs_count++] = (struct StampOp){ .offs = k, .val = 2*e };
+		}
+	}
+	
+	if( !spmat_from_coo(s, prog->n, &coo, &prog->G, slots) ) {
+		return ERR_OOM;
+	}
+	for( uint32_t k=0; k < prog->g_count; k++ ) {
+		prog->g_ops[k].offs = slots[k];
+	}
+	for( uint32_t k=0; k < 4 * diodes; k++ ) {
+		if( prog->diode_slots[k] != NODE_NONE ) {
+			prog->diode_slots[k] = slots[prog->diode_slots[k]];
+		}
+	}
+	prog->base = sparse_alloc_vals(s, prog->G.nnz);
+	if( prog->base==NULL ) {
+		return ERR_OOM;
+	}
+	memcpy(prog->base, prog->G.vals, prog->G.nnz * sizeof *prog->base);
+	return ERR_OK;
+}
+
+/// copies a compiled program onto the back of the bistack.
+CIRCUIT_EXPORT NO_NULLS bool stamp_program_persist(struct TIBiStack *const s, struct StampProgram *const prog) {
+	prog->src            = sparse_persist(s, prog->src,            prog->elem_count * sizeof *prog->src);
+	prog->comp           = sparse_persist(s, prog->comp,           prog->elem_count * sizeof *prog->comp);
+	prog->macro          = sparse_persist(s, prog->macro,          prog->elem_count * sizeof *prog->macro);
+	prog->node_a         = sparse_persist(s, prog->node_a,         prog->elem_count * sizeof *prog->node_a);
+	prog->node_b         = sparse_persist(s, prog->node_b,         prog->elem_count * sizeof *prog->node_b);
+	prog->kind           = sparse_persist(s, prog->kind,           prog->elem_count * sizeof *prog->kind);
+	prog->g_ops          = sparse_persist(s, prog->g_ops,          prog->g_count * sizeof *prog->g_ops);
+	prog->rhs_ops        = sparse_persist(s, prog->rhs_ops,        prog->rhs_count * sizeof *prog->rhs_ops);
+	prog->base           = sparse_persist(s, prog->base,           prog->G.nnz * sizeof *prog->base);
+	prog->node_to_matrix = sparse_persist(s, prog->node_to_matrix, prog->node_count * sizeof *prog->node_to_matrix);
+	prog->matrix_to_node = sparse_persist(s, prog->matrix_to_node, prog->node_rows * sizeof *prog->matrix_to_node);
+	prog->diode_src      = sparse_persist(s, prog->diode_src,      prog->diode_count * sizeof *prog->diode_src);
+	prog->diode_a        = sparse_persist(s, prog->diode_a,        prog->diode_count * sizeof *prog->diode_a);
+	prog->diode_b        = sparse_persist(s, prog->diode_b,        prog->diode_count * sizeof *prog->diode_b);
+	prog->diode_slots    = sparse_persist(s, prog->diode_slots,    4 * prog->diode_count * sizeof *prog->diode_slots);
+	return spmat_persist(s, &prog->G) && prog->src != NULL && prog->comp != NULL && prog->macro != NULL && prog->node_a != NULL && prog->node_b != NULL
+	    && prog->kind != NULL && prog->g_ops != NULL && prog->rhs_ops != NULL
+	    && prog->base != NULL && prog->node_to_matrix != NULL && prog->matrix_to_node != NULL
+	    && prog->diode_src != NULL && prog->diode_a != NULL && prog->diode_b != NULL && prog->diode_slots != NULL;
+}
+
+/// reads the current component values, `raw` holds `elem_count` values.
+CIRCUIT_EXPORT NO_NULLS void stamp_program_load(struct StampProgram const *const prog, rat_t raw[const restrict]) {
+	for( uint32_t e=0; e < prog->elem_count; e++ ) {
+		raw[e] = *prog->src[e];
+	}
+}
+
+/// Assembles `G` (laid out like `prog->G.vals`) and `rhs` from the element values in `raw`,
+/// with reactive elements scaled by the integration coefficient `alpha` (0 for DC).
+/// `vals` is scratch for the `2*elem_count` published values.
+CIRCUIT_EXPORT NO_NULLS void stamp_program_assemble(
+	struct StampProgram const *const          prog,
+	rat_t               const                 raw[const restrict],
+	rat_t               const                 alpha,
+	rat_t                                     vals[const restrict],
+	rat_t                                     G[const restrict],
+	rat_t                                     rhs[const restrict]
+) {
+	for( uint32_t e=0; e < prog->r_end; e++ ) {
+		rat_t const g = rat_recip(raw[e]);
+		vals[2*e]     = g;
+		vals[2*e + 1] = rat_neg(g);
+	}
+	for( uint32_t e = prog->r_end; e < prog->c_end; e++ ) {
+		rat_t const g = rat_mul(alpha, raw[e]);
+		vals[2*e]     = g;
+		vals[2*e + 1] = rat_neg(g);
+	}
+	for( uint32_t e = prog->c_end; e < prog->v_end; e++ ) {
+		vals[2*e]     = raw[e];
+		vals[2*e + 1] = rat_neg(raw[e]);
+	}
+	for( uint32_t e = prog->v_end; e < prog->l_end; e++ ) {
+		rat_t const r = rat_mul(alpha, raw[e]);
+		vals[2*e]     = r;
+		vals[2*e + 1] = rat_neg(r);
+	}
+	memcpy(G, prog->base, prog->G.nnz * sizeof *G);
+	for( uint32_t k=0; k < prog->g_count; k++ ) {
+		G[prog->g_ops[k].offs] = rat_add(G[prog->g_ops[k].offs], vals[prog->g_ops[k].val]);
+	}
+	for( uint32_t i=0; i < prog->n; i++ ) {
+		rhs[i] = rat_zero();
+	}
+	for( uint32_t k=0; k < prog->rhs_count; k++ ) {
+		rhs[prog->rhs_ops[k].offs] = rat_add(rhs[prog->rhs_ops[k].offs], vals[prog->rhs_ops[k].val]);
+	}
+}
+
+/// writes solved node voltages back into the circuit.
+CIRCUIT_EXPORT NO_NULLS void stamp_program_store(struct StampProgram const *const prog, struct Circuit *const c, rat_t const x[const]) {
+	circuit_reset_voltages(c);
+	for( uint32_t i=0; i < prog->node_rows; i++ ) {
+		c->voltage[prog->matrix_to_node[i]] = x[i];
+	}
+}
+
+
+#ifdef CIRCUIT_STATS
+/// monotonic nanoseconds, from `clock()` on the calculator.
+CIRCUIT_EXPORT uint64_t circuit_stats_clock(void) {
+#	ifdef TICE_H
+	return ( uint64_t )(clock()) * 1000000000u / CLOCKS_PER_SEC;
+#	else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return ( uint64_t )(t.tv_sec) * 1000000000u + ( uint64_t )(t.tv_nsec);
+#	endif
+}
+
+/// starts recording into `stats`, which is cleared. NULL stops recording.
+CIRCUIT_EXPORT EXTANT(1) void circuit_attach_stats(struct Circuit *const c, struct CircuitStats *const stats) {
+	c->stats = stats;
+	if( stats != NULL ) {
+		*stats = (struct CircuitStats){0};
+	}
+}
+
+/// charges the time since `*tick` to `phase` and restarts the lap.
+CIRCUIT_EXPORT NO_NULLS void _circuit_stats_lap(struct Circuit *const c, int const phase, uint64_t *const tick) {
+	uint64_t const now = circuit_stats_clock();
+	if( c->stats != NULL ) {
+		c->stats->phase_ns[phase] += now - *tick;
+	}
+	*tick = now;
+}
+
+CIRCUIT_EXPORT NO_NULLS void _circuit_stats_pivot(struct CircuitStats *const st, uint32_t const k, rat_t const pivot) {
+	rat_t const mag = rat_abs(pivot);
+	if( k==0 || rat_lt(mag, st->min_pivot) ) {
+		st->min_pivot = mag;
+	}
+	if( k==0 || rat_lt(st->max_pivot, mag) ) {
+		st->max_pivot = mag;
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void _circuit_stats_sparse_lu(struct Circuit *const c, struct SpMat const *const A, struct SpLU const *const lu) {
+	struct CircuitStats *const st = c->stats;
+	if( st==NULL ) {
+		return;
+	}
+	st->n = lu->n;
+	st->a_nnz = A->nnz;
+	st->lu_nnz = lu->L.nnz + lu->U.nnz;
+	st->off_diag_pivots = 0;
+	for( uint32_t k=0; k < lu->n; k++ ) {
+		st->off_diag_pivots += lu->pinv[lu->q[k]] != ( int32_t )(k);
+		_circuit_stats_pivot(st, k, lu->U.vals[lu->U.colptr[k + 1] - 1]);
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void _circuit_stats_dense_lu(struct Circuit *const c, uint32_t const a_nnz, size_t const n, rat_t const A[const], uint32_t const piv[const]) {
+	struct CircuitStats *const st = c->stats;
+	if( st==NULL ) {
+		return;
+	}
+	st->dense_solves++;
+	st->n = n;
+	st->a_nnz = a_nnz;
+	st->lu_nnz = n*n;
+	st->off_diag_pivots = 0;
+	for( size_t k=0; k < n; k++ ) {
+		st->off_diag_pivots += piv[k] != k;
+		_circuit_stats_pivot(st, k, A[k + k*n]);
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void circuit_stats_print(struct CircuitStats const *const st, FILE *const out) {
+	static char const *const phase_names[MAX_CIRCUIT_PHASES] = { "compile", "assemble", "order", "factor", "solve" };
+	fprintf(out, "solves: %" PRIu32 " (%" PRIu32 " dense, %" PRIu32 " banded), failures %" PRIu32 ", oom %" PRIu32 "\n", st->solves, st->dense_solves, st->band_solves, st->failures, st->ooms);
+	for( int p=0; p < MAX_CIRCUIT_PHASES; p++ ) {
+		fprintf(out, "  %-9s %12" PRIu64 " ns\n", phase_names[p], st->phase_ns[p]);
+	}
+	char lo[32], hi[32];
+#	ifdef TICE_H
+	rat_to_str(st->min_pivot, sizeof lo, lo);
+	rat_to_str(st->max_pivot, sizeof hi, hi);
+#	else
+	/// `rat_to_str` is fixed-point on the host, tiny pivots are the interesting ones.
+	snprintf(lo, sizeof lo, "%g", ( double )(st->min_pivot));
+	snprintf(hi, sizeof hi, "%g", ( double )(st->max_pivot));
+#	endif
+	fprintf(out, "last factorization: n %" PRIu32 ", nnz %" PRIu32 " -> %" PRIu32 ", off-diagonal pivots %" PRIu32 ", |pivot| %s .. %s\n",
+		st->n, st->a_nnz, st->lu_nnz, st->off_diag_pivots, lo, hi);
+}
+#endif
+
+CIRCUIT_EXPORT NO_NULLS int circuit_solve_dense(struct Circuit *const c, struct StampProgram const *const prog, rat_t x[const]) {
+	CIRCUIT_STATS_ONLY(uint64_t tick = circuit_stats_clock();)
+	size_t const n = prog->n;
+	rat_t    *G   = alloc_vec(&c->bistack, n*n);
+	uint32_t *piv = sparse_alloc_ids(&c->bistack, n);
+	if( G==NULL || piv==NULL ) {
+		return ERR_OOM;
+	}
+	/// CSC expands straight into the column-major layout the LU wants.
+	for( uint32_t j=0; j < n; j++ ) {
+		for( uint32_t p = prog->G.colptr[j]; p < prog->G.colptr[j + 1]; p++ ) {
+			G[prog->G.rowidx[p] + j*n] = prog->G.vals[p];
+		}
+	}
+	struct DenseKernels const kern = dense_kernels();
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_ORDER, &tick);)
+	if( !dense_lu_factor(&kern, n, G, piv) ) {
+		return ERR_SINGULAR;
+	}
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_FACTOR, &tick);)
+	CIRCUIT_STATS_ONLY(_circuit_stats_dense_lu(c, prog->G.nnz, n, G, piv);)
+	dense_lu_solve(&kern, n, G, piv, x);
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_SOLVE, &tick);)
+	return ERR_OK;
+}
+
+/// Dense solve from float factors: the LU runs in float, then iterative refinement
+/// (the residual `b - G*x` in `rat_t` against the sparse G, each correction from the float factors)
+/// recovers full accuracy as long as G's condition number stays well below `1/FLT_EPSILON`.
+/// Falls back to `circuit_solve_dense` when the float factorization fails or refinement stalls.
+CIRCUIT_EXPORT NO_NULLS int circuit_solve_mixed(struct Circuit *const c, struct StampProgram const *const prog, rat_t x[const]) {
+#ifdef DENSE_MIXED
+	CIRCUIT_STATS_ONLY(uint64_t tick = circuit_stats_clock();)
+	struct TIBiStack *const s = &c->bistack;
+	size_t const mark = s->front, n = prog->n;
+	struct SpMat const *const G = &prog->G;
+	float    *F   = bistack_alloc_front_vec(s, n*n, sizeof *F);
+	float    *d   = bistack_alloc_front_vec(s, n, sizeof *d);
+	uint32_t *piv = sparse_alloc_ids(s, n);
+	rat_t    *b   = alloc_vec(s, n);
+	rat_t    *r   = alloc_vec(s, n);
+	rat_t    *y   = alloc_vec(s, n);
+	if( F==NULL || d==NULL || piv==NULL || b==NULL || r==NULL || y==NULL ) {
+		s->front = mark;
+		return circuit_solve_dense(c, prog, x);
+	}
+	/// infinity norm of G for the stopping test, row sums gathered in `r` for now.
+	rat_t a_norm = rat_zero(), b_norm = rat_zero();
+	for( uint32_t j=0; j < n; j++ ) {
+		for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+			F[G->rowidx[p] + j*n] = ( float )(G->vals[p]);
+			r[G->rowidx[p]] = rat_add(r[G->rowidx[p]], rat_abs(G->vals[p]));
+		}
+	}
+	for( size_t i=0; i < n; i++ ) {
+		a_norm = rat_max(a_norm, r[i]);
+		b_norm = rat_max(b_norm, rat_abs(x[i]));
+	}
+	struct DenseKernelsF32 const kern = dense_kernels_f32();
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_ORDER, &tick);)
+	bool solved = false;
+	if( dense_lu_factor_f32(&kern, n, F, piv) ) {
+		CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_FACTOR, &tick);)
+		memcpy(b, x, n * sizeof *b);
+		memcpy(r, x, n * sizeof *r);
+		rat_t const tol = rat_mul(rat_epsilon(), rat_root(rat_from_int(( int )(n)), rat_from_int(2)));
+		rat_t last = rat_zero();
+		for( uint32_t step=0; step < DENSE_REFINE_MAX && !solved; step++ ) {
+			for( size_t i=0; i < n; i++ ) {
+				d[i] = ( float )(r[i]);
+			}
+			dense_lu_solve_f32(&kern, n, F, piv, d);
+			rat_t y_norm = rat_zero(), r_norm = rat_zero();
+			for( size_t i=0; i < n; i++ ) {
+				y[i] = rat_add(y[i], ( rat_t )(d[i]));
+				y_norm = rat_max(y_norm, rat_abs(y[i]));
+			}
+			memcpy(r, b, n * sizeof *r);
+			for( uint32_t j=0; j < n; j++ ) {
+				for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+					r[G->rowidx[p]] = rat_sub(r[G->rowidx[p]], rat_mul(G->vals[p], y[j]));
 				}
 			}
+			for( size_t i=0; i < n; i++ ) {
+				r_norm = rat_max(r_norm, rat_abs(r[i]));
+			}
+			solved = !rat_lt(rat_mul(tol, rat_add(rat_mul(a_norm, y_norm), b_norm)), r_norm);
+			/// each step should cut the residual by about the float factors' accuracy, stalling means they can't.
+			if( !solved && step > 0 && !rat_lt(r_norm, rat_div(last, rat_from_int(2))) ) {
+				break;
+			}
+			last = r_norm;
 		}
 	}
+	if( !solved ) {
+		s->front = mark;
+		return circuit_solve_dense(c, prog, x);
+	}
+	memcpy(x, y, n * sizeof *x);
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_SOLVE, &tick);)
+	CIRCUIT_STATS_ONLY(if( c->stats != NULL ) { c->stats->dense_solves++; c->stats->n = n; c->stats->a_nnz = G->nnz; c->stats->lu_nnz = n*n; })
+	return ERR_OK;
+#else
+	return circuit_solve_dense(c, prog, x);
+#endif
+}
+
+/// fill-reducing column order of the program's G, the saved one when it still fits.
+CIRCUIT_EXPORT NO_NULLS void circuit_order(struct Circuit *const c, struct StampProgram const *const prog, uint32_t q[const]) {
+	if( c->order != NULL && c->order_len==prog->n ) {
+		memcpy(q, c->order, prog->n * sizeof *q);
+	} else {
+		spmat_min_degree(&c->bistack, &prog->G, q);
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS int circuit_solve_sparse(struct Circuit *const c, struct StampProgram const *const prog, rat_t x[const]) {
+	CIRCUIT_STATS_ONLY(uint64_t tick = circuit_stats_clock();)
+	uint32_t const n = prog->n;
+	uint32_t *q = sparse_alloc_ids(&c->bistack, n);
+	if( q==NULL ) {
+		return ERR_OOM;
+	}
+	circuit_order(c, prog, q);
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_ORDER, &tick);)
 	
-	gaussian_rref(n, G, I);
-	for( size_t i=0; i < n; i++ ) {
-		c->voltage[matrix_idx_to_node[i]] = I[i];
+	struct SpLU lu;
+	switch( splu_factor(&c->bistack, &prog->G, q, sparse_pivot_tol(), &lu) ) {
+		case SPARSE_ERR_OOM:      return ERR_OOM;
+		case SPARSE_ERR_SINGULAR: return ERR_SINGULAR;
+	}
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_FACTOR, &tick);)
+	CIRCUIT_STATS_ONLY(_circuit_stats_sparse_lu(c, &prog->G, &lu);)
+	rat_t *work = alloc_vec(&c->bistack, n);
+	if( work==NULL ) {
+		return ERR_OOM;
+	}
+	splu_solve(&lu, x, work);
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_SOLVE, &tick);)
+	return ERR_OK;
+}
+
+/// A symmetric renumbering of G's unknowns and the band it leaves: `order[k]` is the unknown put at `k`, `pinv` the inverse.
+struct CircuitBand {
+	uint32_t *order, *pinv;
+	uint32_t  lower, upper;
+};
+
+/// Reverse Cuthill-McKee order of the program's G and the bandwidth under it.
+/// The compiled matrix ids follow node numbers, the reordering is applied at solve time
+/// rather than in `setup_matrix_ids` so the stamp program and every other solver keep their layout.
+CIRCUIT_EXPORT NO_NULLS int circuit_band_order(struct Circuit *const c, struct StampProgram const *const prog, struct CircuitBand *const band) {
+	uint32_t const n = prog->n;
+	band->order = sparse_alloc_ids(&c->bistack, n);
+	band->pinv  = sparse_alloc_ids(&c->bistack, n);
+	if( band->order==NULL || band->pinv==NULL || !spmat_rcm(&c->bistack, &prog->G, band->order) ) {
+		return ERR_OOM;
+	}
+	for( uint32_t k=0; k < n; k++ ) {
+		band->pinv[band->order[k]] = k;
+	}
+	spmat_bandwidth(&prog->G, band->pinv, &band->lower, &band->upper);
+	return ERR_OK;
+}
+
+/// whether the banded factorization beats the general sparse one: its `n*kd^2` work against the
+/// roughly n^1.5 of a minimum degree LU on a mesh, squared through so it stays in integers.
+CIRCUIT_EXPORT NO_NULLS bool circuit_band_pays(struct CircuitBand const *const band, uint32_t const n) {
+	uint64_t const kd = ( band->lower > band->upper )? band->lower : band->upper;
+	if( kd > UINT16_MAX ) {
+		return false;
+	}
+	return kd * kd * kd * kd <= ( uint64_t )(BAND_RATIO) * BAND_RATIO * n;
+}
+
+/// Solves in the band order: Cholesky when G has no branch rows (so it's symmetric),
+/// falling back to LU with partial pivoting when that isn't positive definite or there are branch rows.
+CIRCUIT_EXPORT NO_NULLS int circuit_solve_banded(struct Circuit *const c, struct StampProgram const *const prog, struct CircuitBand const *const band, rat_t x[const]) {
+	CIRCUIT_STATS_ONLY(uint64_t tick = circuit_stats_clock();)
+	struct TIBiStack *const s = &c->bistack;
+	struct TIBiMark const mark = bistack_mark(s);
+	struct DenseKernels const kern = dense_kernels();
+	struct SpMat const *const G = &prog->G;
+	size_t const n = prog->n, kl = band->lower, ku = band->upper;
+	rat_t *b = alloc_vec(s, n);
+	if( b==NULL ) {
+		return ERR_OOM;
+	}
+	for( size_t k=0; k < n; k++ ) {
+		b[k] = x[band->order[k]];
+	}
+	bool solved = false;
+	struct TIBiMark const rhs_mark = bistack_mark(s);
+	if( prog->n==prog->node_rows && kl==ku ) {
+		size_t const ld = kl + 1;
+		rat_t *A = alloc_vec(s, n * ld);
+		if( A==NULL ) {
+			bistack_rewind_front(s, mark);
+			return ERR_OOM;
+		}
+		for( uint32_t j=0; j < n; j++ ) {
+			for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+				uint32_t const pi = band->pinv[G->rowidx[p]], pj = band->pinv[j];
+				if( pi >= pj ) {
+					A[pi - pj + pj*ld] = G->vals[p];
+				}
+			}
+		}
+		CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_ORDER, &tick);)
+		solved = dense_band_cholesky(&kern, n, kl, A);
+		CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_FACTOR, &tick);)
+		if( solved ) {
+			dense_band_cholesky_solve(&kern, n, kl, A, b);
+			CIRCUIT_STATS_ONLY(if( c->stats != NULL ) { c->stats->lu_nnz = n * ld; })
+		}
+		bistack_rewind_front(s, rhs_mark);
+	}
+	if( !solved ) {
+		size_t const ld = 2*kl + ku + 1;
+		rat_t    *A   = alloc_vec(s, n * ld);
+		uint32_t *piv = sparse_alloc_ids(s, n);
+		if( A==NULL || piv==NULL ) {
+			bistack_rewind_front(s, mark);
+			return ERR_OOM;
+		}
+		for( uint32_t j=0; j < n; j++ ) {
+			for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+				uint32_t const pi = band->pinv[G->rowidx[p]], pj = band->pinv[j];
+				A[kl + ku + pi - pj + pj*ld] = G->vals[p];
+			}
+		}
+		CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_ORDER, &tick);)
+		if( !dense_band_lu_factor(&kern, n, kl, ku, A, piv) ) {
+			bistack_rewind_front(s, mark);
+			return ERR_SINGULAR;
+		}
+		CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_FACTOR, &tick);)
+		dense_band_lu_solve(&kern, n, kl, ku, A, piv, b);
+		CIRCUIT_STATS_ONLY(if( c->stats != NULL ) { c->stats->lu_nnz = n * ld; })
+	}
+	for( size_t k=0; k < n; k++ ) {
+		x[band->order[k]] = b[k];
+	}
+	CIRCUIT_STATS_ONLY(if( c->stats != NULL ) { c->stats->band_solves++; c->stats->n = n; c->stats->a_nnz = G->nnz; })
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_SOLVE, &tick);)
+	bistack_rewind_front(s, mark);
+	return ERR_OK;
+}
+
+/// DC solve of a linear circuit.
+/// Diodes need `circuit_calc_voltages_newton`, here they fail with ERR_NONLINEAR rather than being left open.
+CIRCUIT_EXPORT NO_NULLS int circuit_calc_voltages(struct Circuit *const c) {
+	circuit_reset_voltages(c);
+	if( c->active_count==0 ) {
+		return ERR_OK;
+	}
+	CIRCUIT_STATS_ONLY(uint64_t tick = circuit_stats_clock();)
+	struct StampProgram prog;
+	int res = circuit_compile(c, &prog);
+	if( res==ERR_OK && prog.diode_count > 0 ) {
+		res = ERR_NONLINEAR;
+	}
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_COMPILE, &tick);)
+	rat_t *raw  = NULL, *vals = NULL, *x = NULL;
+	if( res==ERR_OK ) {
+		raw  = alloc_vec(&c->bistack, prog.elem_count);
+		vals = alloc_vec(&c->bistack, 2 * prog.elem_count);
+		x    = alloc_vec(&c->bistack, prog.n);
+		if( raw==NULL || vals==NULL || x==NULL ) {
+			res = ERR_OOM;
+		}
+	}
+	if( res==ERR_OK && prog.n > 0 ) {
+		stamp_program_load(&prog, raw);
+		stamp_program_assemble(&prog, raw, rat_zero(), vals, prog.G.vals, x);
+		CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_ASSEMBLE, &tick);)
+		bool const sparse = c->solver==SOLVER_SPARSE || (c->solver==SOLVER_AUTO && prog.n >= SPARSE_MIN_ROWS);
+		struct CircuitBand band;
+		if( c->solver==SOLVER_MIXED ) {
+			res = circuit_solve_mixed(c, &prog, x);
+		} else if( c->solver==SOLVER_BANDED || (sparse && c->solver==SOLVER_AUTO) ) {
+			/// RCM is linear in the nonzeros, cheap next to the min-degree order it may save.
+			res = circuit_band_order(c, &prog, &band);
+			if( res==ERR_OK ) {
+				bool const banded = c->solver==SOLVER_BANDED || circuit_band_pays(&band, prog.n);
+				res = banded? circuit_solve_banded(c, &prog, &band, x) : circuit_solve_sparse(c, &prog, x);
+			}
+		} else {
+			res = sparse? circuit_solve_sparse(c, &prog, x) : circuit_solve_dense(c, &prog, x);
+		}
+		CIRCUIT_STATS_ONLY(tick = circuit_stats_clock();)
+		if( res==ERR_OK ) {
+			stamp_program_store(&prog, c, x);
+		}
+		CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_SOLVE, &tick);)
+	}
+#ifdef CIRCUIT_STATS
+	if( c->stats != NULL ) {
+		c->stats->solves++;
+		c->stats->failures += res != ERR_OK;
+		c->stats->ooms     += res==ERR_OOM;
 	}
+#endif
 	bistack_reset_front(&c->bistack);
+	return res;
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,445 @@
+#ifndef PCG_H_INCLUDED
+#	define PCG_H_INCLUDED
+
+#include "node.h"
+
+#define PCG_EXPORT    static inline
+
+/// Preconditioned conjugate gradients for resistor and current source networks.
+/// With only those the nodal matrix is symmetric positive definite once every node
+/// has a resistive path to ground, so CG converges without ever factoring it.
+/// Memory stays at the nonzeros of G plus a few vectors, no fill and no stamp program.
+
+enum {
+	PCG_JACOBI = 0, /// diagonal scaling, nothing beyond G itself.
+	PCG_IC0,        /// zero fill incomplete Cholesky, another copy of G's lower triangle.
+};
+
+struct PcgOptions {
+	rat_t    reltol, abstol; /// stop once `|b - Gx| <= max(reltol*|b|, abstol)`.
+	uint32_t max_iter;       /// 0 means the number of unknowns.
+	uint8_t  precond;        /// PCG_*
+	bool     warm_start;     /// start from the voltages already in the circuit.
+};
+
+struct PcgResult {
+	uint32_t iterations;
+	rat_t    residual;       /// final `|b - Gx| / |b|`.
+	bool     direct;         /// the circuit had elements CG can't take, it went through `circuit_calc_voltages`.
+};
+
+PCG_EXPORT struct PcgOptions pcg_options(void) {
+	rat_t const micro = rat_recip(rat_from_int(1000000));
+	return (struct PcgOptions){
+		.reltol     = rat_mul(micro, rat_recip(rat_from_int(1000))),
+		.abstol     = rat_mul(micro, micro),
+		.max_iter   = 0,
+		.precond    = PCG_IC0,
+		.warm_start = true,
+	};
+}
+
+/// G in CSR with sorted columns, both triangles stored.
+struct PcgSystem {
+	uint32_t *rowptr, *col;
+	rat_t    *val, *rhs;
+	uint32_t *node_to_row, *row_to_node;
+	uint32_t  n, nnz;
+	uint32_t *lptr, *lcol; /// IC(0) factor, rows of the lower triangle with the diagonal last.
+	rat_t    *lval, *inv_diag;
+};
+
+/// whether CG can take an element, the rest need an indefinite MNA system.
+PCG_EXPORT bool pcg_accepts(uint8_t const kind) {
+	return kind==COMP_RESISTOR || kind==COMP_DC_CURRENT_SRC || kind==COMP_CAPACITOR;
+}
+
+PCG_EXPORT NO_NULLS bool circuit_pcg_accepts(struct Circuit const *const c) {
+	if( c->storage==STORE_EDGES ) {
+		for( uint32_t e=0; e < c->edges.len; e++ ) {
+			if( !pcg_accepts(c->edges.kind[e]) ) {
+				return false;
+			}
+		}
+		return true;
+	}
+	for( uint32_t node=0; node < c->node_count && node < c->node_cap; node++ ) {
+		for( struct Comp const *comp = c->comps[node]; comp != NULL; comp = comp->next ) {
+			if( !pcg_accepts(comp->kind) ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/// one pass over the components: counts off-diagonal entries per row, or with `fill` stamps them.
+PCG_EXPORT NO_NULLS void _pcg_stamp(struct PcgSystem *const sys, uint32_t next[const], bool const fill, uint8_t const kind, uint32_t const a, uint32_t const b, rat_t const val) {
+	int32_t const ra = ( a==GND_IDX )? -1 : ( int32_t )(sys->node_to_row[a]);
+	int32_t const rb = ( b==GND_IDX )? -1 : ( int32_t )(sys->node_to_row[b]);
+	switch( kind ) {
+		case COMP_RESISTOR: {
+			if( ra==rb ) {
+				return;
+			} else if( !fill ) {
+				if( ra >= 0 && rb >= 0 ) {
+					next[ra]++;
+					next[rb]++;
+				}
+				return;
+			}
+			rat_t const g = rat_recip(val);
+			if( ra >= 0 ) {
+				sys->val[sys->rowptr[ra]] = rat_add(sys->val[sys->rowptr[ra]], g);
+			}
+			if( rb >= 0 ) {
+				sys->val[sys->rowptr[rb]] = rat_add(sys->val[sys->rowptr[rb]], g);
+			}
+			if( ra >= 0 && rb >= 0 ) {
+				sys->col[next[ra]] = rb;
+				sys->val[next[ra]++] = rat_neg(g);
+				sys->col[next[rb]] = ra;
+				sys->val[next[rb]++] = rat_neg(g);
+			}
+			return;
+		}
+		case COMP_DC_CURRENT_SRC:
+			/// same direction as the MNA stamp, out of `a` and into `b`.
+			if( fill && ra >= 0 ) {
+				sys->rhs[ra] = rat_sub(sys->rhs[ra], val);
+			}
+			if( fill && rb >= 0 ) {
+				sys->rhs[rb] = rat_add(sys->rhs[rb], val);
+			}
+			return;
+		default:
+			return; /// capacitors are open at DC.
+	}
+}
+
+PCG_EXPORT NO_NULLS void _pcg_walk(struct Circuit *const c, struct PcgSystem *const sys, uint32_t next[const], bool const fill) {
+	if( c->storage==STORE_EDGES ) {
+		struct CompEdges const *const edges = &c->edges;
+		for( uint32_t e=0; e < edges->len; e++ ) {
+			_pcg_stamp(sys, next, fill, edges->kind[e], edges->node_a[e], edges->node_b[e], edges->val[e]);
+		}
+		return;
+	}
+	for( uint32_t node=0; node < c->node_count && node < c->node_cap; node++ ) {
+		for( struct Comp const *comp = c->comps[node]; comp != NULL; comp = comp->next ) {
+			if( !comp->mirrored ) {
+				_pcg_stamp(sys, next, fill, comp->kind, comp->owner, comp->node, comp->val);
+			}
+		}
+	}
+}
+
+/// Builds G and the source vector on the front of the bistack.
+/// Entries are stamped unsorted, then one counting-sort transpose orders every row
+/// (G is symmetric, so the transpose is G again) and parallel resistors are merged.
+PCG_EXPORT NO_NULLS int _pcg_assemble(struct Circuit *const c, struct PcgSystem *const sys) {
+	struct TIBiStack *const s = &c->bistack;
+	*sys = (struct PcgSystem){0};
+	sys->node_to_row = sparse_alloc_ids(s, c->node_count);
+	sys->row_to_node = sparse_alloc_ids(s, c->active_count);
+	if( sys->node_to_row==NULL || sys->row_to_node==NULL ) {
+		return ERR_OOM;
+	}
+	uint32_t const n = sys->n = setup_matrix_ids(c->active_nodes, c->node_count, sys->node_to_row, sys->row_to_node);
+	uint32_t *next   = sparse_alloc_ids(s, n + 1);
+	sys->rowptr      = sparse_alloc_ids(s, n + 1);
+	sys->rhs         = alloc_vec(s, n);
+	if( next==NULL || sys->rowptr==NULL || sys->rhs==NULL ) {
+		return ERR_OOM;
+	}
+	_pcg_walk(c, sys, next, false);
+	/// the diagonal goes first in every unsorted row.
+	uint32_t nnz = 0;
+	for( uint32_t r=0; r < n; r++ ) {
+		sys->rowptr[r] = nnz;
+		nnz += next[r] + 1;
+		next[r] = sys->rowptr[r] + 1;
+	}
+	sys->rowptr[n] = nnz;
+	sys->col = sparse_alloc_ids(s, nnz);
+	sys->val = sparse_alloc_vals(s, nnz);
+	if( sys->col==NULL || sys->val==NULL ) {
+		return ERR_OOM;
+	}
+	for( uint32_t r=0; r < n; r++ ) {
+		sys->col[sys->rowptr[r]] = r;
+	}
+	_pcg_walk(c, sys, next, true);
+
+	uint32_t *tptr = sparse_alloc_ids(s, n + 1);
+	uint32_t *tcol = sparse_alloc_ids(s, nnz);
+	rat_t    *tval = sparse_alloc_vals(s, nnz);
+	if( tptr==NULL || tcol==NULL || tval==NULL ) {
+		return ERR_OOM;
+	}
+	for( uint32_t p=0; p < nnz; p++ ) {
+		tptr[sys->col[p] + 1]++;
+	}
+	for( uint32_t r=0; r < n; r++ ) {
+		tptr[r + 1] += tptr[r];
+		next[r] = tptr[r];
+	}
+	for( uint32_t r=0; r < n; r++ ) {
+		for( uint32_t p = sys->rowptr[r]; p < sys->rowptr[r + 1]; p++ ) {
+			uint32_t const q = next[sys->col[p]]++;
+			tcol[q] = r;
+			tval[q] = sys->val[p];
+		}
+	}
+	/// rows are sorted now, duplicates sit next to each other.
+	uint32_t out = 0;
+	for( uint32_t r=0; r < n; r++ ) {
+		sys->rowptr[r] = out;
+		for( uint32_t p = tptr[r]; p < tptr[r + 1]; p++ ) {
+			if( out > sys->rowptr[r] && sys->col[out - 1]==tcol[p] ) {
+				sys->val[out - 1] = rat_add(sys->val[out - 1], tval[p]);
+			} else {
+				sys->col[out] = tcol[p];
+				sys->val[out] = tval[p];
+				out++;
+			}
+		}
+	}
+	sys->rowptr[n] = sys->nnz = out;
+	return ERR_OK;
+}
+
+/// `y = G*x`
+PCG_EXPORT NO_NULLS void _pcg_spmv(struct PcgSystem const *const sys, rat_t const x[const restrict], rat_t y[const restrict]) {
+	for( uint32_t r=0; r < sys->n; r++ ) {
+		rat_t sum = rat_zero();
+		for( uint32_t p = sys->rowptr[r]; p < sys->rowptr[r + 1]; p++ ) {
+			sum = rat_add(sum, rat_mul(sys->val[p], x[sys->col[p]]));
+		}
+		y[r] = sum;
+	}
+}
+
+PCG_EXPORT NO_NULLS rat_t _pcg_dot(uint32_t const n, rat_t const a[const], rat_t const b[const]) {
+	rat_t sum = rat_zero();
+	for( uint32_t i=0; i < n; i++ ) {
+		sum = rat_add(sum, rat_mul(a[i], b[i]));
+	}
+	return sum;
+}
+
+/// Jacobi needs only the inverted diagonal. Fails on a row without a positive diagonal,
+/// a node no resistor touches.
+PCG_EXPORT NO_NULLS int _pcg_jacobi(struct TIBiStack *const s, struct PcgSystem *const sys) {
+	sys->inv_diag = alloc_vec(s, sys->n);
+	if( sys->inv_diag==NULL ) {
+		return ERR_OOM;
+	}
+	for( uint32_t r=0; r < sys->n; r++ ) {
+		uint32_t p = sys->rowptr[r];
+		while( p < sys->rowptr[r + 1] && sys->col[p] < r ) {
+			p++;
+		}
+		if( p==sys->rowptr[r + 1] || sys->col[p] != r || !rat_lt(rat_zero(), sys->val[p]) ) {
+			return ERR_SINGULAR;
+		}
+		sys->inv_diag[r] = rat_recip(sys->val[p]);
+	}
+	return ERR_OK;
+}
+
+/// IC(0): `L*L^T ~ G` with L restricted to G's lower pattern.
+/// Row `i` of L only needs the finished rows above it, `L[i][k] = (G[i][k] - L[i][:k].L[k][:k]) / L[k][k]`.
+/// Resistor networks are M-matrices, so this can't break down on a solvable circuit.
+PCG_EXPORT NO_NULLS int _pcg_ic0(struct TIBiStack *const s, struct PcgSystem *const sys) {
+	uint32_t const n = sys->n;
+	uint32_t lnz = 0;
+	for( uint32_t r=0; r < n; r++ ) {
+		for( uint32_t p = sys->rowptr[r]; p < sys->rowptr[r + 1] && sys->col[p] <= r; p++ ) {
+			lnz++;
+		}
+	}
+	sys->lptr = sparse_alloc_ids(s, n + 1);
+	sys->lcol = sparse_alloc_ids(s, lnz);
+	sys->lval = sparse_alloc_vals(s, lnz);
+	if( sys->lptr==NULL || sys->lcol==NULL || sys->lval==NULL ) {
+		return ERR_OOM;
+	}
+	uint32_t q = 0;
+	for( uint32_t i=0; i < n; i++ ) {
+		sys->lptr[i] = q;
+		for( uint32_t p = sys->rowptr[i]; p < sys->rowptr[i + 1] && sys->col[p] <= i; p++ ) {
+			sys->lcol[q] = sys->col[p];
+			sys->lval[q] = sys->val[p];
+			q++;
+		}
+		uint32_t const diag = q - 1;
+		if( q==sys->lptr[i] || sys->lcol[diag] != i ) {
+			return ERR_SINGULAR;
+		}
+		for( uint32_t p = sys->lptr[i]; p < diag; p++ ) {
+			uint32_t const k = sys->lcol[p];
+			uint32_t const kdiag = sys->lptr[k + 1] - 1;
+			rat_t sum = sys->lval[p];
+			/// sorted merge of row `i` and row `k`, both up to column `k`.
+			for( uint32_t a = sys->lptr[i], b = sys->lptr[k]; a < p && b < kdiag; ) {
+				if( sys->lcol[a] < sys->lcol[b] ) {
+					a++;
+				} else if( sys->lcol[b] < sys->lcol[a] ) {
+					b++;
+				} else {
+					sum = rat_sub(sum, rat_mul(sys->lval[a++], sys->lval[b++]));
+				}
+			}
+			sys->lval[p] = rat_div(sum, sys->lval[kdiag]);
+		}
+		rat_t d = sys->lval[diag];
+		for( uint32_t p = sys->lptr[i]; p < diag; p++ ) {
+			d = rat_sub(d, rat_mul(sys->lval[p], sys->lval[p]));
+		}
+		if( !rat_lt(rat_zero(), d) ) {
+			return ERR_SINGULAR;
+		}
+		sys->lval[diag] = rat_root(d, rat_from_int(2));
+	}
+	sys->lptr[n] = q;
+	return ERR_OK;
+}
+
+/// `z = M^-1 * r`
+PCG_EXPORT NO_NULLS void _pcg_precond(struct PcgSystem const *const sys, rat_t const r[const restrict], rat_t z[const restrict]) {
+	uint32_t const n = sys->n;
+	if( sys->lptr==NULL ) {
+		for( uint32_t i=0; i < n; i++ ) {
+			z[i] = rat_mul(r[i], sys->inv_diag[i]);
+		}
+		return;
+	}
+	for( uint32_t i=0; i < n; i++ ) {
+		uint32_t const diag = sys->lptr[i + 1] - 1;
+		rat_t sum = r[i];
+		for( uint32_t p = sys->lptr[i]; p < diag; p++ ) {
+			sum = rat_sub(sum, rat_mul(sys->lval[p], z[sys->lcol[p]]));
+		}
+		z[i] = rat_div(sum, sys->lval[diag]);
+	}
+	/// L^T by scattering each row of L backwards.
+	for( uint32_t i = n-1; i < n; i-- ) {
+		uint32_t const diag = sys->lptr[i + 1] - 1;
+		z[i] = rat_div(z[i], sys->lval[diag]);
+		for( uint32_t p = sys->lptr[i]; p < diag; p++ ) {
+			z[sys->lcol[p]] = rat_sub(z[sys->lcol[p]], rat_mul(sys->lval[p], z[i]));
+		}
+	}
+}
+
+/// Solves the DC node voltages of a resistor/current-source circuit with preconditioned CG.
+/// Circuits with voltage sources, inductors or wires go through `circuit_calc_voltages` instead.
+/// Fails with ERR_SINGULAR when a node has no resistive path to ground
+/// and ERR_NO_CONVERGE when the residual is still above tolerance after `max_iter` steps,
+/// leaving the last iterate in `voltage[]` so a later call can warm-start from it.
+PCG_EXPORT EXTANT(1, 2) int circuit_calc_voltages_pcg(struct Circuit *const c, struct PcgOptions const *const opt, struct PcgResult *const result) {
+	struct PcgResult info = { .residual = rat_zero() };
+	struct TIBiStack *const s = &c->bistack;
+	int res = ERR_OK;
+	if( !circuit_pcg_accepts(c) ) {
+		info.direct = true;
+		res = circuit_calc_voltages(c);
+		goto done;
+	} else if( c->active_count==0 ) {
+		circuit_reset_voltages(c);
+		goto done;
+	}
+	CIRCUIT_STATS_ONLY(uint64_t tick = circuit_stats_clock();)
+	struct PcgSystem sys;
+	res = _pcg_assemble(c, &sys);
+	if( res != ERR_OK ) {
+		goto done;
+	}
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_ASSEMBLE, &tick);)
+	res = ( opt->precond==PCG_IC0 )? _pcg_ic0(s, &sys) : _pcg_jacobi(s, &sys);
+	if( res != ERR_OK ) {
+		goto done;
+	}
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_FACTOR, &tick);)
+
+	uint32_t const n = sys.n;
+	rat_t *x = alloc_vec(s, n), *r = alloc_vec(s, n), *z = alloc_vec(s, n);
+	rat_t *p = alloc_vec(s, n), *q = alloc_vec(s, n);
+	if( x==NULL || r==NULL || z==NULL || p==NULL || q==NULL ) {
+		res = ERR_OOM;
+		goto done;
+	}
+	if( opt->warm_start ) {
+		for( uint32_t i=0; i < n; i++ ) {
+			x[i] = c->voltage[sys.row_to_node[i]];
+		}
+	}
+	/// everything compares squared norms, no square roots in the loop.
+	rat_t const bb = _pcg_dot(n, sys.rhs, sys.rhs);
+	rat_t const target = rat_max(rat_mul(rat_mul(opt->reltol, opt->reltol), bb), rat_mul(opt->abstol, opt->abstol));
+	uint32_t const max_iter = ( opt->max_iter==0 )? n : opt->max_iter;
+
+	_pcg_spmv(&sys, x, q);
+	for( uint32_t i=0; i < n; i++ ) {
+		r[i] = rat_sub(sys.rhs[i], q[i]);
+	}
+	_pcg_precond(&sys, r, z);
+	memcpy(p, z, n * sizeof *p);
+	rat_t rz = _pcg_dot(n, r, z);
+	rat_t rr = _pcg_dot(n, r, r);
+	res = ERR_NO_CONVERGE;
+	for( ;; info.iterations++ ) {
+		if( !rat_lt(target, rr) ) {
+			res = ERR_OK;
+			break;
+		} else if( info.iterations==max_iter ) {
+			break;
+		}
+		_pcg_spmv(&sys, p, q);
+		rat_t const pq = _pcg_dot(n, p, q);
+		if( !rat_lt(rat_zero(), pq) ) {
+			res = ERR_SINGULAR; /// G isn't positive definite, some part floats.
+			break;
+		}
+		rat_t const alpha = rat_div(rz, pq);
+		for( uint32_t i=0; i < n; i++ ) {
+			x[i] = rat_add(x[i], rat_mul(alpha, p[i]));
+			r[i] = rat_sub(r[i], rat_mul(alpha, q[i]));
+		}
+		_pcg_precond(&sys, r, z);
+		rat_t const rz_next = _pcg_dot(n, r, z);
+		rat_t const beta = rat_div(rz_next, rz);
+		rz = rz_next;
+		for( uint32_t i=0; i < n; i++ ) {
+			p[i] = rat_add(z[i], rat_mul(beta, p[i]));
+		}
+		rr = _pcg_dot(n, r, r);
+	}
+	if( rat_lt(rat_zero(), bb) ) {
+		info.residual = rat_root(rat_div(rr, bb), rat_from_int(2));
+	}
+	if( res != ERR_SINGULAR ) {
+		circuit_reset_voltages(c);
+		for( uint32_t i=0; i < n; i++ ) {
+			c->voltage[sys.row_to_node[i]] = x[i];
+		}
+	}
+	CIRCUIT_STATS_ONLY(_circuit_stats_lap(c, CIRCUIT_PHASE_SOLVE, &tick);)
+#ifdef CIRCUIT_STATS
+	if( c->stats != NULL ) {
+		c->stats->solves++;
+		c->stats->failures += res != ERR_OK;
+		c->stats->n = n;
+		c->stats->a_nnz = sys.nnz;
+		c->stats->lu_nnz = ( sys.lptr != NULL )? sys.lptr[n] : n;
+	}
+#endif
+done:
+	bistack_reset_front(s);
+	if( result != NULL ) {
+		*result = info;
+	}
+	return res;
+}
+#endif
@@ -0,0 +1,323 @@
+#ifndef PLAN_H_INCLUDED
+#	define PLAN_H_INCLUDED
+
+#include "node.h"
+
+#define PLAN_EXPORT    static inline
+
+/// A circuit's symbolic analysis, kept so repeated solves only redo the numbers.
+/// Holds the compiled stamp program (index maps, sparsity pattern of G and where every
+/// stamp lands in it) plus the ordering and pivot sequence from the first factorization.
+/// Everything lives on the back of the circuit's bistack.
+/// Changing component values keeps a plan valid, adding components or nodes does not.
+/// Resistors that changed since the last factorization are folded in with the Woodbury identity,
+/// each one costs a sparse solve rather than a refactorization.
+/// Past `PLAN_MAX_UPDATES` distinct resistors the plan refactors and starts over.
+enum {
+	PLAN_MAX_UPDATES = 8,
+};
+
+struct CircuitPlan {
+	struct StampProgram prog;
+	struct SpLU         lu;
+	rat_t              *raw, *vals; /// element values the factorization was built with, and their published +-copies.
+	rat_t              *upd_w;      /// `G^-1 * u_j` for each changed resistor `j`, `n x PLAN_MAX_UPDATES` column-major.
+	uint32_t            upd_elem[PLAN_MAX_UPDATES];
+	uint32_t            upd_count;
+	uint32_t            lu_cap[2];  /// nonzeros the persisted L and U have room for, refactoring reuses them.
+	bool                factored;   /// `lu` holds valid factors, cleared when a refactor and the fresh factorization both failed.
+};
+
+/// factors afresh on the front and copies the result over the plan's previous factors,
+/// a plan whose pivots keep failing doesn't pile up factorizations on the back.
+/// On failure the kept buffers may hold a half-done refactor, so the plan is marked unfactored.
+PLAN_EXPORT NO_NULLS int _plan_factor(struct Circuit *const c, struct CircuitPlan *const plan) {
+	plan->upd_count = 0;
+	plan->factored  = false;
+	struct SpLU const kept = plan->lu;
+	int res = ERR_OK;
+	switch( splu_factor(&c->bistack, &plan->prog.G, plan->lu.q, sparse_pivot_tol(), &plan->lu) ) {
+		case SPARSE_ERR_OOM:      res = ERR_OOM;      break;
+		case SPARSE_ERR_SINGULAR: res = ERR_SINGULAR; break;
+		default:
+			if( !splu_persist_reuse(&c->bistack, &plan->lu, &kept, plan->lu_cap) ) {
+				res = ERR_OOM;
+			}
+	}
+	if( res != ERR_OK ) {
+		/// keep pointing at the back, the front copies go away with the caller's reset.
+		plan->lu = kept;
+	}
+	plan->factored = res==ERR_OK;
+	return res;
+}
+
+/// analyzes and factors the circuit with its current values, ERR_NONLINEAR when it has diodes.
+PLAN_EXPORT NO_NULLS int circuit_prepare(struct Circuit *const c, struct CircuitPlan *const plan) {
+	*plan = (struct CircuitPlan){0};
+	int res = circuit_compile(c, &plan->prog);
+	if( res != ERR_OK ) {
+		goto done;
+	} else if( plan->prog.diode_count > 0 ) {
+		res = ERR_NONLINEAR;
+		goto done;
+	}
+	res = ERR_OOM;
+	struct StampProgram *const prog = &plan->prog;
+	if( !stamp_program_persist(&c->bistack, prog) ) {
+		goto done;
+	}
+	plan->lu.q = bistack_alloc_back_vec(&c->bistack, prog->n, sizeof *plan->lu.q);
+	plan->raw  = bistack_alloc_back_vec(&c->bistack, prog->elem_count, sizeof *plan->raw);
+	plan->vals = bistack_alloc_back_vec(&c->bistack, 2 * prog->elem_count, sizeof *plan->vals);
+	rat_t *rhs = alloc_vec(&c->bistack, prog->n);
+	if( plan->lu.q==NULL || plan->raw==NULL || plan->vals==NULL || rhs==NULL ) {
+		goto done;
+	}
+	stamp_program_load(prog, plan->raw);
+	stamp_program_assemble(prog, plan->raw, rat_zero(), plan->vals, prog->G.vals, rhs);
+	circuit_order(c, prog, plan->lu.q);
+	res = _plan_factor(c, plan);
+done:
+	bistack_reset_front(&c->bistack);
+	return res;
+}
+
+/// Re-solves with the circuit's current component values.
+/// Runs the stamp program into the cached pattern and refactors numerically,
+/// only choosing new pivots if an old one stopped being acceptable, or if the last factorization failed.
+PLAN_EXPORT NO_NULLS int circuit_plan_solve(struct Circuit *const c, struct CircuitPlan *const plan) {
+	struct StampProgram *const prog = &plan->prog;
+	if( c->node_count != prog->node_count ) {
+		return ERR_NODE_OOB;
+	}
+	int res = ERR_OOM;
+	rat_t *x    = alloc_vec(&c->bistack, prog->n);
+	rat_t *work = alloc_vec(&c->bistack, prog->n);
+	if( x==NULL || work==NULL ) {
+		goto done;
+	}
+	stamp_program_load(prog, plan->raw);
+	stamp_program_assemble(prog, plan->raw, rat_zero(), plan->vals, prog->G.vals, x);
+	plan->upd_count = 0;
+	if( !plan->factored || splu_refactor(&plan->lu, &prog->G, sparse_pivot_tol(), work) != SPARSE_OK ) {
+		res = _plan_factor(c, plan);
+		if( res != ERR_OK ) {
+			goto done;
+		}
+	}
+	splu_solve(&plan->lu, x, work);
+	stamp_program_store(prog, c, x);
+	res = ERR_OK;
+done:
+	bistack_reset_front(&c->bistack);
+	return res;
+}
+
+/// `u^T * v` for the stamp vector `u = e_a - e_b` of element `e`, ground rows dropped.
+PLAN_EXPORT NO_NULLS rat_t _plan_stamp_dot(struct StampProgram const *const prog, uint32_t const e, rat_t const v[const]) {
+	int32_t const a = stamp_row(prog, prog->node_a[e]), b = stamp_row(prog, prog->node_b[e]);
+	rat_t const va = ( a >= 0 )? v[a] : rat_zero();
+	rat_t const vb = ( b >= 0 )? v[b] : rat_zero();
+	return rat_sub(va, vb);
+}
+
+/// Re-solves after a few resistor or source values changed, without refactoring.
+/// A resistor between `a` and `b` going from `g0` to `g` changes G by `(g - g0) * u*u^T`, `u = e_a - e_b`.
+/// With `k` of them, `U = [u_1..u_k]` and `D = diag(g_j - g0_j)`, Woodbury gives
+///   `x = y - W * (I + D*U^T*W)^-1 * D*U^T*y`,  `y = G0^-1*b`, `W = G0^-1*U`
+/// so every call is one solve for `y`, one more per newly changed resistor and a `k x k` dense solve.
+/// Too many changed resistors, a singular `k x k` system or a plan without valid factors falls back to `circuit_plan_solve`.
+/// Capacitor and inductor values don't matter at DC and are ignored.
+PLAN_EXPORT NO_NULLS int circuit_plan_update(struct Circuit *const c, struct CircuitPlan *const plan) {
+	struct StampProgram *const prog = &plan->prog;
+	if( c->node_count != prog->node_count ) {
+		return ERR_NODE_OOB;
+	}
+	if( !plan->factored ) {
+		return circuit_plan_solve(c, plan);
+	}
+	size_t const n = prog->n;
+	int res = ERR_OOM;
+	if( plan->upd_w==NULL ) {
+		plan->upd_w = bistack_alloc_back_vec(&c->bistack, n * PLAN_MAX_UPDATES, sizeof *plan->upd_w);
+		if( plan->upd_w==NULL ) {
+			goto done;
+		}
+	}
+	rat_t *y    = alloc_vec(&c->bistack, n);
+	rat_t *work = alloc_vec(&c->bistack, n);
+	if( y==NULL || work==NULL ) {
+		goto done;
+	}
+	
+	/// pick up resistors that moved away from the factored values.
+	for( uint32_t e=0; e < prog->r_end; e++ ) {
+		if( rat_cmp(*prog->src[e], plan->raw[e])==0 ) {
+			continue;
+		}
+		uint32_t j = 0;
+		while( j < plan->upd_count && plan->upd_elem[j] != e ) {
+			j++;
+		}
+		if( j < plan->upd_count ) {
+			continue;
+		} else if( plan->upd_count==PLAN_MAX_UPDATES ) {
+			bistack_reset_front(&c->bistack);
+			return circuit_plan_solve(c, plan);
+		}
+		rat_t *const w = &plan->upd_w[plan->upd_count * n];
+		for( size_t i=0; i < n; i++ ) {
+			w[i] = rat_zero();
+		}
+		int32_t const a = stamp_row(prog, prog->node_a[e]), b = stamp_row(prog, prog->node_b[e]);
+		if( a >= 0 ) {
+			w[a] = rat_pos1();
+		}
+		if( b >= 0 ) {
+			w[b] = rat_neg(rat_pos1());
+		}
+		splu_solve(&plan->lu, w, work);
+		plan->upd_elem[plan->upd_count++] = e;
+	}
+	
+	/// sources only reach the rhs, publish their current values and scatter.
+	for( uint32_t e = prog->c_end; e < prog->v_end; e++ ) {
+		plan->vals[2*e]     = *prog->src[e];
+		plan->vals[2*e + 1] = rat_neg(*prog->src[e]);
+	}
+	for( uint32_t op=0; op < prog->rhs_count; op++ ) {
+		y[prog->rhs_ops[op].offs] = rat_add(y[prog->rhs_ops[op].offs], plan->vals[prog->rhs_ops[op].val]);
+	}
+	splu_solve(&plan->lu, y, work);
+	
+	size_t const k = plan->upd_count;
+	if( k > 0 ) {
+		rat_t    M[PLAN_MAX_UPDATES * PLAN_MAX_UPDATES];
+		rat_t    z[PLAN_MAX_UPDATES];
+		uint32_t piv[PLAN_MAX_UPDATES];
+		for( size_t i=0; i < k; i++ ) {
+			uint32_t const e = plan->upd_elem[i];
+			rat_t const d = rat_sub(rat_recip(*prog->src[e]), rat_recip(plan->raw[e]));
+			for( size_t j=0; j < k; j++ ) {
+				rat_t const uw = _plan_stamp_dot(prog, e, &plan->upd_w[j * n]);
+				M[i + j*k] = rat_mul(d, uw);
+			}
+			M[i + i*k] = rat_add(M[i + i*k], rat_pos1());
+			z[i] = rat_mul(d, _plan_stamp_dot(prog, e, y));
+		}
+		struct DenseKernels const kern = dense_kernels_for(DENSE_KERNEL_SCALAR);
+		if( !dense_lu_factor(&kern, k, M, piv) ) {
+			bistack_reset_front(&c->bistack);
+			return circuit_plan_solve(c, plan);
+		}
+		dense_lu_solve(&kern, k, M, piv, z);
+		for( size_t j=0; j < k; j++ ) {
+			rat_t const *const w = &plan->upd_w[j * n];
+			for( size_t i=0; i < n; i++ ) {
+				y[i] = rat_sub(y[i], rat_mul(w[i], z[j]));
+			}
+		}
+	}
+	stamp_program_store(prog, c, y);
+	res = ERR_OK;
+done:
+	bistack_reset_front(&c->bistack);
+	return res;
+}
+
+/// Sources are the independent current and voltage sources of the program, in program order.
+PLAN_EXPORT NO_NULLS uint32_t circuit_plan_source_count(struct CircuitPlan const *const plan) {
+	return plan->prog.v_end - plan->prog.c_end;
+}
+
+/// index of the source running from `n1` to `n2` within a sweep's excitation vectors, NODE_NONE if there's none.
+PLAN_EXPORT NO_NULLS uint32_t circuit_plan_find_source(struct CircuitPlan const *const plan, uint32_t const n1, uint32_t const n2, uint8_t const comp_type) {
+	struct StampProgram const *const prog = &plan->prog;
+	for( uint32_t e = prog->c_end; e < prog->v_end; e++ ) {
+		if( prog->node_a[e]==n1 && prog->node_b[e]==n2 && prog->kind[e]==comp_type ) {
+			return e - prog->c_end;
+		}
+	}
+	return NODE_NONE;
+}
+
+/// Solves the circuit for `k` source settings at once.
+/// Sweeping sources only moves the right-hand side, so G is assembled and
+/// (re)factored once and the substitutions run over all `k` systems together.
+/// `excite[idx1D(r, j, circuit_plan_source_count(plan))]` is the value of source `j` in run `r`,
+/// `volts[idx1D(r, node, c->node_count)]` (nullable) receives the node voltages of run `r`.
+/// `probe` (nullable) sees the runs in order with the full unknown vector as `circuit_transient`'s does,
+/// at `scale[r]`, the swept value, or at `r` itself without a `scale`. `wave_probe` writes them out.
+/// The circuit's own source values and voltages are left alone.
+PLAN_EXPORT EXTANT(1, 2, 4) int circuit_plan_sweep(
+	struct Circuit     *const c,
+	struct CircuitPlan *const plan,
+	uint32_t            const k,
+	rat_t               const excite[const restrict],
+	rat_t                     volts[const restrict],
+	rat_t               const scale[const],
+	void                      probe(struct StampProgram const *prog, rat_t at, rat_t const x[], void *data),
+	void                     *const data
+) {
+	struct StampProgram *const prog = &plan->prog;
+	if( c->node_count != prog->node_count ) {
+		return ERR_NODE_OOB;
+	}
+	size_t const n  = prog->n;
+	size_t const ns = circuit_plan_source_count(plan);
+	int res = ERR_OOM;
+	rat_t *rhs  = alloc_vec(&c->bistack, n);
+	rat_t *B    = alloc_vec(&c->bistack, n * k);
+	rat_t *work = alloc_vec(&c->bistack, n * k);
+	if( rhs==NULL || B==NULL || work==NULL ) {
+		goto done;
+	}
+	stamp_program_load(prog, plan->raw);
+	stamp_program_assemble(prog, plan->raw, rat_zero(), plan->vals, prog->G.vals, rhs);
+	plan->upd_count = 0;
+	if( !plan->factored || splu_refactor(&plan->lu, &prog->G, sparse_pivot_tol(), work) != SPARSE_OK ) {
+		res = _plan_factor(c, plan);
+		if( res != ERR_OK ) {
+			goto done;
+		}
+	}
+	
+	/// sources only reach the rhs, publish each run's values and scatter them into column `r`.
+	for( uint32_t r=0; r < k; r++ ) {
+		for( size_t j=0; j < ns; j++ ) {
+			size_t const e = prog->c_end + j;
+			plan->vals[2*e]     = excite[idx1D(r, j, ns)];
+			plan->vals[2*e + 1] = rat_neg(excite[idx1D(r, j, ns)]);
+		}
+		for( uint32_t op=0; op < prog->rhs_count; op++ ) {
+			rat_t *const slot = &B[idx1D(prog->rhs_ops[op].offs, r, k)];
+			*slot = rat_add(*slot, plan->vals[prog->rhs_ops[op].val]);
+		}
+	}
+	splu_solve_batch(&plan->lu, k, B, work);
+	
+	for( uint32_t r=0; r < k; r++ ) {
+		if( volts != NULL ) {
+			rat_t *const v = &volts[idx1D(r, 0, c->node_count)];
+			for( uint32_t i=0; i < c->node_count; i++ ) {
+				v[i] = rat_zero();
+			}
+			for( uint32_t i=0; i < prog->node_rows; i++ ) {
+				v[prog->matrix_to_node[i]] = B[idx1D(i, r, k)];
+			}
+		}
+		if( probe != NULL ) {
+			/// run `r` is a column of B, gathered into `rhs` which the assembly is done with.
+			for( size_t i=0; i < n; i++ ) {
+				rhs[i] = B[idx1D(i, r, k)];
+			}
+			probe(prog, ( scale != NULL )? scale[r] : rat_from_int(( int )(r)), rhs, data);
+		}
+	}
+	res = ERR_OK;
+done:
+	bistack_reset_front(&c->bistack);
+	return res;
+}
+#endif
@@ -117,14 +117,10 @@ RATIONAL_EXPORT int rat_ge(rat_t const a, rat_t const b) {
 	return rat_cmp(a, b) >= 0;
 }
 
+/// one unit in the last place of the 14-digit BCD mantissa at 1.
+#define RAT_EPSILON    1e-13f
 RATIONAL_EXPORT rat_t rat_epsilon(void) {
-	rat_t eps = rat_pos1();
-	rat_t const one = rat_pos1();
-	rat_t const two = rat_from_int(2);
-	while( rat_lt(one, rat_add(eps, one)) ) {
-		eps = rat_div(eps, two);
-	}
-	return rat_mul(eps, two);
+	return os_FloatToReal(RAT_EPSILON);
 }
 
 /** Ternary Operations */
@@ -139,13 +135,32 @@ RATIONAL_EXPORT int rat_to_str(rat_t const a, size_t const len, char buffer[cons
 	return os_RealToStr(buffer, &a, len, 0, -1) > 0;
 }
 
+/// the value as a C float type, the calculator's `double` being a 32-bit float.
+RATIONAL_EXPORT double rat_to_double(rat_t const a) {
+	return os_RealToFloat(&a);
+}
+
 RATIONAL_EXPORT rat_t str_to_rat(char const cstr[const static 1]) {
 	char *end = NULL;
 	return os_StrToReal(cstr, &end);
 }
 #	else
-#include <math.h>
+#include <float.h>
+#include <tgmath.h>
+/// Host scalar, `double` unless built with `-DRAT_FLOAT` or `-DRAT_LONG_DOUBLE`.
+/// The math calls below go through <tgmath.h> so they follow whichever type this is.
+#	if defined(RAT_FLOAT) && defined(RAT_LONG_DOUBLE)
+#		error "pick one of RAT_FLOAT and RAT_LONG_DOUBLE"
+#	elif defined(RAT_FLOAT)
+typedef float rat_t;
+#		define RAT_EPSILON    FLT_EPSILON
+#	elif defined(RAT_LONG_DOUBLE)
+typedef long double rat_t;
+#		define RAT_EPSILON    LDBL_EPSILON
+#	else
 typedef double rat_t;
+#		define RAT_EPSILON    DBL_EPSILON
+#	endif
 /** Unary Operations */
 RATIONAL_EXPORT rat_t rat_pos1(void) {
 	return 1.;
@@ -157,7 +172,7 @@ RATIONAL_EXPORT rat_t rat_zero(void) {
 	return 0;
 }
 RATIONAL_EXPORT rat_t rat_from_int(int const a) {
-	return a + 0.0;
+	return ( rat_t )(a);
 }
 RATIONAL_EXPORT rat_t rat_frac(rat_t const a) {
 	return a - floor(a);
@@ -178,16 +193,16 @@ RATIONAL_EXPORT rat_t rat_exp(rat_t const a) {
 	return exp(a);
 }
 RATIONAL_EXPORT rat_t rat_recip(rat_t const a) {
-	return 1.0 / a;
+	return 1 / a;
 }
 RATIONAL_EXPORT rat_t rat_floor(rat_t const a) {
 	return floor(a);
 }
 RATIONAL_EXPORT rat_t rat_rad_to_deg(rat_t const a) {
-	return a * (180.0 / acos(-1.0));
+	return a * (180 / acos(( rat_t )(-1)));
 }
 RATIONAL_EXPORT rat_t rat_deg_to_rad(rat_t const a) {
-	return a * (acos(-1.0) / 180.0);
+	return a * (acos(( rat_t )(-1)) / 180);
 }
 RATIONAL_EXPORT rat_t rat_sin(rat_t const a) {
 	return sin(a);
@@ -208,7 +223,7 @@ RATIONAL_EXPORT rat_t rat_atan(rat_t const a) {
 	return atan(a);
 }
 RATIONAL_EXPORT rat_t rat_pi(void) {
-	return acos(-1.0);
+	return acos(( rat_t )(-1));
 }
 
 /** Binary Operations */
@@ -250,11 +265,7 @@ RATIONAL_EXPORT int rat_ge(rat_t const a, rat_t const b) {
 	return a >= b;
 }
 RATIONAL_EXPORT rat_t rat_epsilon(void) {
-	rat_t eps = 1.0;
-	while( eps+1.0 > 1.0 ) {
-		eps *= 0.5;
-	}
-	return eps * 2.0;
+	return RAT_EPSILON;
 }
 
 /** Ternary Operations */
@@ -266,20 +277,24 @@ RATIONAL_EXPORT int rat_eq(rat_t const a, rat_t const b, rat_t const eps) {
 }
 
 RATIONAL_EXPORT rat_t rat_root(rat_t const a, rat_t const b) {
-	if( rat_eq(b, 2.0, rat_epsilon()) ) {
+	if( rat_eq(b, 2, rat_epsilon()) ) {
 		return sqrt(a);
-	} else if( rat_eq(b, 3.0, rat_epsilon()) ) {
+	} else if( rat_eq(b, 3, rat_epsilon()) ) {
 		return cbrt(a);
 	}
 	return pow(a, 1/b);
 }
 
 RATIONAL_EXPORT int rat_to_str(rat_t const a, size_t const len, char buffer[const static len]) {
-	return snprintf(buffer, len, "%f", a);
+	return snprintf(buffer, len, "%Lf", ( long double )(a));
+}
+
+RATIONAL_EXPORT double rat_to_double(rat_t const a) {
+	return ( double )(a);
 }
 
 RATIONAL_EXPORT rat_t str_to_rat(char const cstr[const static 1]) {
-	return strtod(cstr, NULL);
+	return ( rat_t )(strtold(cstr, NULL));
 }
 #	endif
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+#ifndef SENSITIVITY_H_INCLUDED
+#	define SENSITIVITY_H_INCLUDED
+
+#include "newton.h"
+
+#define SENS_EXPORT    static inline
+
+/// One element's row of the sensitivity table.
+struct SensEntry {
+	uint32_t n1, n2;   /// terminals, `current` runs from `n1` to `n2` through the element.
+	uint8_t  kind;     /// COMP_RESISTOR, COMP_DC_CURRENT_SRC or COMP_VOLTAGE_SRC.
+	rat_t    val;
+	rat_t    current;  /// at the operating point.
+	rat_t    dv;       /// `dV(out)/dval`.
+	rat_t    rel;      /// `val*dv`, the change of V(out) for the value scaled by 1+x, per unit x. The table's sort key.
+};
+
+struct SensResult {
+	rat_t    vout;
+	uint32_t elements; /// resistors and sources ranked, more than made it into the table when it was short.
+	uint32_t entries;  /// rows written.
+};
+
+/// biggest `|rel|` first, terminals then kind break ties so the order doesn't depend on the sort.
+SENS_EXPORT int _sens_cmp(void const *const a, void const *const b) {
+	struct SensEntry const *const x = a, *const y = b;
+	rat_t const rx = rat_abs(x->rel), ry = rat_abs(y->rel);
+	if( rat_lt(ry, rx) ) {
+		return -1;
+	} else if( rat_lt(rx, ry) ) {
+		return 1;
+	} else if( x->n1 != y->n1 ) {
+		return ( x->n1 < y->n1 )? -1 : 1;
+	} else if( x->n2 != y->n2 ) {
+		return ( x->n2 < y->n2 )? -1 : 1;
+	}
+	return ( int )(x->kind) - ( int )(y->kind);
+}
+
+/// Sensitivity of the DC voltage at `out` to every resistor and independent source, by the adjoint method.
+/// With `G*x = b` factored once, the transposed system `G^T*y = e_out` gives every derivative at once:
+/// `dV(out)/dp = y^T*(db/dp - dG/dp*x)`, which for a resistor R from a to b is `(y_a - y_b)*(v_a - v_b)/R^2`,
+/// for a current source `y_b - y_a` and for a voltage source its branch entry of `y`.
+/// So the cost is one factorization, a solve each way and a pass over the elements, whatever their number.
+/// Circuits with diodes get the Newton operating point first (with `opt`, NULL for the defaults) and are
+/// linearized there, the derivatives being those of the converged solution.
+/// Every element's DC current goes into `current` of its `struct Comp` (negated on the mirrored copy)
+/// where the circuit has them, edge storage has nowhere to keep it.
+/// Elements of subcircuit instances (flagged `macro`) aren't ranked: they're the macromodel's equivalent
+/// network, whose resistors and Norton sources mix every internal part, and those parts were eliminated
+/// when the body was reduced, so there's nothing to map their sensitivities back to.
+/// The largest `cap` rows by `|rel|` go into `table`, sorted.
+SENS_EXPORT EXTANT(1) int circuit_sensitivity(
+	struct Circuit              *const c,
+	struct NewtonOptions const  *const opt,
+	uint32_t                     const out,
+	struct SensEntry                   table[const],
+	uint32_t                     const cap,
+	struct SensResult           *const result
+) {
+	struct TIBiStack *const s = &c->bistack;
+	struct NewtonOptions const defaults = newton_options();
+	struct NewtonOptions const *const nopt = ( opt != NULL )? opt : &defaults;
+	struct SensResult info = {0};
+	int res = ERR_NODE_OOB;
+	if( out >= c->node_count || out==GND_IDX || !circuit_node_active(c, out) ) {
+		goto done;
+	}
+	struct StampProgram prog;
+	res = circuit_compile(c, &prog);
+	if( res==ERR_OK && prog.diode_count > 0 ) {
+		/// the operating point comes first, only its node voltages are needed to linearize the junctions.
+		bistack_reset_front(s);
+		res = circuit_calc_voltages_newton(c, nopt, NULL);
+		if( res==ERR_OK ) {
+			res = circuit_compile(c, &prog);
+		}
+	}
+	if( res != ERR_OK ) {
+		goto done;
+	}
+	res = ERR_OOM;
+	uint32_t const n = prog.n;
+	uint32_t const rankable = prog.r_end + (prog.v_end - prog.c_end);
+	rat_t    *raw  = alloc_vec(s, prog.elem_count);
+	rat_t    *vals = alloc_vec(s, 2 * prog.elem_count);
+	rat_t    *x    = alloc_vec(s, n);
+	rat_t    *y    = alloc_vec(s, n);
+	rat_t    *work = alloc_vec(s, n);
+	uint32_t *q    = sparse_alloc_ids(s, n);
+	struct SensEntry *rows = bistack_alloc_front_vec(s, rankable, sizeof *rows);
+	if( raw==NULL || vals==NULL || x==NULL || y==NULL || work==NULL || q==NULL || (rankable > 0 && rows==NULL) ) {
+		goto done;
+	}
+	stamp_program_load(&prog, raw);
+	stamp_program_assemble(&prog, raw, rat_zero(), vals, prog.G.vals, x);
+	for( uint32_t d=0; d < prog.diode_count; d++ ) {
+		uint32_t const a = prog.diode_a[d], b = prog.diode_b[d];
+		rat_t const v = rat_sub(c->voltage[a], c->voltage[b]);
+		rat_t id, gd;
+		_newton_diode(v, *prog.diode_src[d], nopt->vt, nopt->gmin, &id, &gd);
+		uint32_t const *const slot = &prog.diode_slots[4*d];
+		for( int k=0; k < 4; k++ ) {
+			if( slot[k] != NODE_NONE ) {
+				prog.G.vals[slot[k]] = rat_add(prog.G.vals[slot[k]], ( k < 2 )? gd : rat_neg(gd));
+			}
+		}
+		/// the junction as gd in parallel with the current source that puts it back on its operating point.
+		rat_t const ieq = rat_sub(id, rat_mul(gd, v));
+		int32_t const ra = stamp_row(&prog, a), rb = stamp_row(&prog, b);
+		if( ra >= 0 ) {
+			x[ra] = rat_sub(x[ra], ieq);
+		}
+		if( rb >= 0 ) {
+			x[rb] = rat_add(x[rb], ieq);
+		}
+	}
+	circuit_order(c, &prog, q);
+	struct SpLU lu;
+	switch( splu_factor(s, &prog.G, q, sparse_pivot_tol(), &lu) ) {
+		case SPARSE_ERR_OOM:      res = ERR_OOM;      goto done;
+		case SPARSE_ERR_SINGULAR: res = ERR_SINGULAR; goto done;
+	}
+	splu_solve(&lu, x, work);
+	int32_t const row = stamp_row(&prog, out);
+	y[row] = rat_pos1();
+	splu_solve_transpose(&lu, y, work);
+	stamp_program_store(&prog, c, x);
+	info.vout = x[row];
+
+	uint32_t k = 0;
+	for( uint32_t e=0; e < prog.elem_count; e++ ) {
+		int32_t const a = stamp_row(&prog, prog.node_a[e]), b = stamp_row(&prog, prog.node_b[e]);
+		rat_t const va = ( a >= 0 )? x[a] : rat_zero(), vb = ( b >= 0 )? x[b] : rat_zero();
+		rat_t const ya = ( a >= 0 )? y[a] : rat_zero(), yb = ( b >= 0 )? y[b] : rat_zero();
+		uint32_t const branch = prog.node_rows + (e - prog.i_end);
+		rat_t current = rat_zero(), dv = rat_zero(); /// capacitors are open at DC and stay zero.
+		if( e < prog.r_end ) {
+			current = rat_div(rat_sub(va, vb), raw[e]);
+			dv = rat_div(rat_mul(rat_sub(ya, yb), current), raw[e]);
+		} else if( e >= prog.c_end && e < prog.i_end ) {
+			current = raw[e];
+			dv = rat_sub(yb, ya);
+		} else if( e >= prog.i_end ) {
+			current = x[branch];
+			dv = y[branch];
+		}
+		if( !prog.macro[e] && (e < prog.r_end || (e >= prog.c_end && e < prog.v_end)) ) {
+			rows[k++] = (struct SensEntry){
+				.n1 = prog.node_a[e], .n2 = prog.node_b[e], .kind = prog.kind[e],
+				.val = raw[e], .current = current, .dv = dv, .rel = rat_mul(raw[e], dv),
+			};
+		}
+		struct Comp *const comp = prog.comp[e];
+		if( comp != NULL ) {
+			comp->current = current;
+			if( comp->twin != NULL ) {
+				comp->twin->current = rat_neg(current);
+			}
+		}
+	}
+	if( k > 1 ) {
+		qsort(rows, k, sizeof *rows, _sens_cmp);
+	}
+	info.elements = k;
+	info.entries  = ( k < cap )? k : cap;
+	if( info.entries > 0 ) {
+		memcpy(table, rows, info.entries * sizeof *table);
+	}
+	res = ERR_OK;
+done:
+	bistack_reset_front(s);
+	if( result != NULL ) {
+		*result = info;
+	}
+	return res;
+}
+#endif
@@ -0,0 +1,968 @@
+#ifndef SPARSE_H_INCLUDED
+#	define SPARSE_H_INCLUDED
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include "mem.h"
+#include "realtype.h"
+
+#define SPARSE_EXPORT    static inline
+
+enum {
+	SPARSE_NONE = -1,
+};
+
+enum {
+	SPARSE_ERR_SINGULAR = -2,
+	SPARSE_ERR_OOM      = -1,
+	SPARSE_OK           =  1,
+};
+
+/// Compressed-column matrix.
+/// column `j` owns `rowidx[colptr[j] .. colptr[j+1]]` and the matching `vals`.
+struct SpMat {
+	uint32_t *colptr, *rowidx;
+	rat_t    *vals;
+	uint32_t  n, nnz;
+};
+
+/// Coordinate (triplet) form used while stamping, duplicates get summed on compression.
+struct SpCoo {
+	uint32_t *rows, *cols;
+	rat_t    *vals;
+	uint32_t  len, cap;
+};
+
+/// LU factors of a column-permuted `A`: `P*A*Q = L*U`.
+/// `L` is unit lower triangular with its diagonal stored first in each column,
+/// `U` is upper triangular with its diagonal stored last.
+struct SpLU {
+	struct SpMat L, U;
+	int32_t     *pinv; /// row `i` of `A` became pivot row `pinv[i]`.
+	uint32_t    *q;    /// pivot column `k` is column `q[k]` of `A`.
+	uint32_t     n;
+};
+
+
+/// default threshold for keeping the diagonal as pivot.
+SPARSE_EXPORT rat_t sparse_pivot_tol(void) {
+	return rat_div(rat_pos1(), rat_from_int(10));
+}
+
+SPARSE_EXPORT NO_NULLS uint32_t *sparse_alloc_ids(struct TIBiStack *const s, size_t const n) {
+	return bistack_alloc_front_vec(s, n, sizeof(uint32_t));
+}
+
+SPARSE_EXPORT NO_NULLS rat_t *sparse_alloc_vals(struct TIBiStack *const s, size_t const n) {
+	rat_t *v = bistack_alloc_front_raw(s, n * sizeof *v);
+	if( v==NULL ) {
+		return NULL;
+	}
+	for( size_t i=0; i < n; i++ ) {
+		v[i] = rat_zero();
+	}
+	return v;
+}
+
+/// moves `len` used elements into a fresh, bigger front allocation.
+/// the old block stays behind as garbage until the front is reset.
+SPARSE_EXPORT NO_NULLS void *sparse_grow(struct TIBiStack *const s, void *const old, size_t const len, size_t const new_cap, size_t const elem_size) {
+	void *fresh = bistack_alloc_front_vec(s, new_cap, elem_size);
+	if( fresh==NULL ) {
+		return NULL;
+	}
+	return memcpy(fresh, old, len * elem_size);
+}
+#ifdef MEM_STATS
+#	define sparse_alloc_ids(s, n)                       MEM_TRACK_CALL(sparse_alloc_ids, s, n)
+#	define sparse_alloc_vals(s, n)                      MEM_TRACK_CALL(sparse_alloc_vals, s, n)
+#	define sparse_grow(s, old, len, new_cap, elem_size) MEM_TRACK_CALL(sparse_grow, s, old, len, new_cap, elem_size)
+#endif
+
+
+SPARSE_EXPORT NO_NULLS bool spcoo_make(struct TIBiStack *const s, uint32_t const cap, struct SpCoo *const coo) {
+	coo->rows = sparse_alloc_ids(s, cap);
+	coo->cols = sparse_alloc_ids(s, cap);
+	coo->vals = sparse_alloc_vals(s, cap);
+	coo->len  = 0;
+	coo->cap  = cap;
+	return coo->rows != NULL && coo->cols != NULL && coo->vals != NULL;
+}
+
+SPARSE_EXPORT NO_NULLS bool spcoo_push(struct SpCoo *const coo, uint32_t const row, uint32_t const col, rat_t const val) {
+	if( coo->len >= coo->cap ) {
+		return false;
+	}
+	coo->rows[coo->len] = row;
+	coo->cols[coo->len] = col;
+	coo->vals[coo->len] = val;
+	coo->len++;
+	return true;
+}
+
+/// compresses an `n`x`n` triplet list into `A`, summing duplicate entries.
+/// when `slots` is given, `slots[k]` receives the index in `A->vals` that triplet `k` was summed into.
+SPARSE_EXPORT EXTANT(1, 3, 4) bool spmat_from_coo(struct TIBiStack *const s, uint32_t const n, struct SpCoo const *const coo, struct SpMat *const A, uint32_t slots[const]) {
+	A->n      = n;
+	A->colptr = sparse_alloc_ids(s, n + 1);
+	A->rowidx = sparse_alloc_ids(s, coo->len);
+	A->vals   = sparse_alloc_vals(s, coo->len);
+	uint32_t *next = sparse_alloc_ids(s, n);
+	int32_t  *seen = bistack_alloc_front_vec(s, n, sizeof *seen);
+	if( A->colptr==NULL || A->rowidx==NULL || A->vals==NULL || next==NULL || seen==NULL ) {
+		return false;
+	}
+	for( uint32_t k=0; k < coo->len; k++ ) {
+		A->colptr[coo->cols[k] + 1]++;
+	}
+	for( uint32_t j=0; j < n; j++ ) {
+		A->colptr[j + 1] += A->colptr[j];
+		next[j] = A->colptr[j];
+		seen[j] = SPARSE_NONE;
+	}
+	for( uint32_t k=0; k < coo->len; k++ ) {
+		uint32_t const p = next[coo->cols[k]]++;
+		A->rowidx[p] = coo->rows[k];
+		A->vals[p]   = coo->vals[k];
+		if( slots != NULL ) {
+			slots[k] = p;
+		}
+	}
+	/// `dest[p]` follows where entry `p` ends up after duplicates merge.
+	uint32_t *dest = ( slots != NULL )? sparse_alloc_ids(s, coo->len) : NULL;
+	if( slots != NULL && dest==NULL ) {
+		return false;
+	}
+
+	/// sum duplicates in place, `seen[i]` remembers where row `i` landed in the current column.
+	uint32_t nz = 0;
+	for( uint32_t j=0; j < n; j++ ) {
+		uint32_t const col_start = nz;
+		for( uint32_t p = A->colptr[j]; p < A->colptr[j + 1]; p++ ) {
+			uint32_t const i = A->rowidx[p];
+			if( seen[i] >= ( int32_t )(col_start) ) {
+				A->vals[seen[i]] = rat_add(A->vals[seen[i]], A->vals[p]);
+				if( dest != NULL ) {
+					dest[p] = seen[i];
+				}
+			} else {
+				if( dest != NULL ) {
+					dest[p] = nz;
+				}
+				seen[i] = nz;
+				A->rowidx[nz] = i;
+				A->vals[nz]   = A->vals[p];
+				nz++;
+			}
+		}
+		A->colptr[j] = col_start;
+	}
+	A->colptr[n] = nz;
+	A->nnz = nz;
+	if( slots != NULL ) {
+		for( uint32_t k=0; k < coo->len; k++ ) {
+			slots[k] = dest[slots[k]];
+		}
+	}
+	return true;
+}
+
+/// copies a scratch array onto the back of the bistack so it outlives `bistack_reset_front`.
+SPARSE_EXPORT NO_NULLS void *sparse_persist(struct TIBiStack *const s, void const *const data, size_t const bytes) {
+	void *keep = bistack_alloc_back_raw(s, bytes);
+	if( keep==NULL ) {
+		return NULL;
+	}
+	return memcpy(keep, data, bytes);
+}
+
+SPARSE_EXPORT NO_NULLS bool spmat_persist(struct TIBiStack *const s, struct SpMat *const A) {
+	A->colptr = sparse_persist(s, A->colptr, (A->n + 1) * sizeof *A->colptr);
+	A->rowidx = sparse_persist(s, A->rowidx, A->nnz * sizeof *A->rowidx);
+	A->vals   = sparse_persist(s, A->vals,   A->nnz * sizeof *A->vals);
+	return A->colptr != NULL && A->rowidx != NULL && A->vals != NULL;
+}
+
+
+/// Adjacency lists of the pattern of `A + A^T`, diagonal and duplicates left out.
+struct SpGraph {
+	uint32_t *ptr, *adj;
+	uint32_t  n;
+};
+
+/// builds `g` on the front of `s`.
+SPARSE_EXPORT NO_NULLS bool spmat_graph(struct TIBiStack *const s, struct SpMat const *const A, struct SpGraph *const g) {
+	uint32_t const n = g->n = A->n;
+	g->ptr = sparse_alloc_ids(s, n + 1);
+	uint32_t *fill = sparse_alloc_ids(s, n);
+	if( g->ptr==NULL || fill==NULL ) {
+		return false;
+	}
+	for( uint32_t j=0; j < n; j++ ) {
+		for( uint32_t p = A->colptr[j]; p < A->colptr[j + 1]; p++ ) {
+			if( A->rowidx[p] != j ) {
+				g->ptr[A->rowidx[p] + 1]++;
+				g->ptr[j + 1]++;
+			}
+		}
+	}
+	for( uint32_t i=0; i < n; i++ ) {
+		g->ptr[i + 1] += g->ptr[i];
+		fill[i] = g->ptr[i];
+	}
+	g->adj = sparse_alloc_ids(s, g->ptr[n]);
+	if( g->adj==NULL ) {
+		return false;
+	}
+	for( uint32_t j=0; j < n; j++ ) {
+		for( uint32_t p = A->colptr[j]; p < A->colptr[j + 1]; p++ ) {
+			uint32_t const i = A->rowidx[p];
+			if( i != j ) {
+				g->adj[fill[i]++] = j;
+				g->adj[fill[j]++] = i;
+			}
+		}
+	}
+	/// squeeze the duplicates out, `fill` now marks the vertex last seen as a neighbor.
+	memset(fill, 0, n * sizeof *fill);
+	uint32_t out = 0;
+	for( uint32_t i=0; i < n; i++ ) {
+		uint32_t const start = g->ptr[i], end = g->ptr[i + 1];
+		g->ptr[i] = out;
+		for( uint32_t t = start; t < end; t++ ) {
+			if( fill[g->adj[t]] != i + 1 ) {
+				fill[g->adj[t]] = i + 1;
+				g->adj[out++] = g->adj[t];
+			}
+		}
+	}
+	g->ptr[n] = out;
+	return true;
+}
+
+/// breadth-first search from `root` over the vertices whose `level` is still UINT32_MAX, appended to `queue`.
+/// Returns how many vertices it reached.
+SPARSE_EXPORT NO_NULLS uint32_t _spgraph_bfs(struct SpGraph const *const g, uint32_t const root, uint32_t queue[const restrict], uint32_t level[const restrict]) {
+	uint32_t head = 0, tail = 0;
+	queue[tail++] = root;
+	level[root] = 0;
+	while( head < tail ) {
+		uint32_t const v = queue[head++];
+		for( uint32_t p = g->ptr[v]; p < g->ptr[v + 1]; p++ ) {
+			uint32_t const u = g->adj[p];
+			if( level[u]==UINT32_MAX ) {
+				level[u] = level[v] + 1;
+				queue[tail++] = u;
+			}
+		}
+	}
+	return tail;
+}
+
+/// George-Liu pseudo-peripheral vertex of `start`'s component: restart from the far end of the
+/// last search while that keeps getting farther. `queue` is scratch for the component, `level` is left as it was.
+SPARSE_EXPORT NO_NULLS uint32_t _spgraph_peripheral(struct SpGraph const *const g, uint32_t const start, uint32_t queue[const restrict], uint32_t level[const restrict]) {
+	uint32_t root = start;
+	uint32_t count = _spgraph_bfs(g, root, queue, level);
+	for( ;; ) {
+		uint32_t const far = queue[count - 1], depth = level[far];
+		for( uint32_t k=0; k < count; k++ ) {
+			level[queue[k]] = UINT32_MAX;
+		}
+		if( far==root ) {
+			return root;
+		}
+		count = _spgraph_bfs(g, far, queue, level);
+		if( level[queue[count - 1]] <= depth ) {
+			for( uint32_t k=0; k < count; k++ ) {
+				level[queue[k]] = UINT32_MAX;
+			}
+			return far;
+		}
+		root = far;
+	}
+}
+
+/// Breadth-first order of `g`, one connected component after another.
+/// Each component starts from a pseudo-peripheral vertex, so its levels come out many and thin.
+/// `level` gets every vertex's distance from the start of its component.
+SPARSE_EXPORT NO_NULLS void spgraph_level_order(struct SpGraph const *const g, uint32_t order[const restrict], uint32_t level[const restrict]) {
+	uint32_t const n = g->n;
+	for( uint32_t i=0; i < n; i++ ) {
+		level[i] = UINT32_MAX;
+	}
+	uint32_t done = 0;
+	for( uint32_t start=0; start < n; start++ ) {
+		if( level[start] != UINT32_MAX ) {
+			continue;
+		}
+		uint32_t *const queue = &order[done];
+		done += _spgraph_bfs(g, _spgraph_peripheral(g, start, queue, level), queue, level);
+	}
+}
+
+SPARSE_EXPORT int _spgraph_key_cmp(void const *const a, void const *const b) {
+	uint64_t const x = *( uint64_t const* )(a), y = *( uint64_t const* )(b);
+	return ( x > y ) - ( x < y );
+}
+
+/// Reverse Cuthill-McKee order of `g`: the level order with each vertex's newly reached
+/// neighbours taken by increasing degree, then reversed, which keeps every edge close to
+/// the diagonal and the profile below it small. `keys` is scratch for `n` values.
+SPARSE_EXPORT NO_NULLS void spgraph_rcm(struct SpGraph const *const g, uint32_t order[const restrict], uint32_t level[const restrict], uint64_t keys[const restrict]) {
+	uint32_t const n = g->n;
+	for( uint32_t i=0; i < n; i++ ) {
+		level[i] = UINT32_MAX;
+	}
+	uint32_t done = 0;
+	for( uint32_t start=0; start < n; start++ ) {
+		if( level[start] != UINT32_MAX ) {
+			continue;
+		}
+		uint32_t *const queue = &order[done];
+		uint32_t const root = _spgraph_peripheral(g, start, queue, level);
+		uint32_t head = 0, tail = 0;
+		queue[tail++] = root;
+		level[root] = 0;
+		while( head < tail ) {
+			uint32_t const v = queue[head++];
+			uint32_t fresh = 0;
+			for( uint32_t p = g->ptr[v]; p < g->ptr[v + 1]; p++ ) {
+				uint32_t const u = g->adj[p];
+				if( level[u]==UINT32_MAX ) {
+					level[u] = level[v] + 1;
+					keys[fresh++] = (( uint64_t )(g->ptr[u + 1] - g->ptr[u]) << 32) | u;
+				}
+			}
+			if( fresh > 1 ) {
+				qsort(keys, fresh, sizeof *keys, _spgraph_key_cmp);
+			}
+			for( uint32_t k=0; k < fresh; k++ ) {
+				queue[tail++] = ( uint32_t )(keys[k]);
+			}
+		}
+		done += tail;
+	}
+	for( uint32_t i=0, j = n - 1; i < j && j < n; i++, j-- ) {
+		uint32_t const t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+}
+
+/// RCM order of `A`'s symmetrized pattern into `order`, scratch is released before returning.
+SPARSE_EXPORT NO_NULLS bool spmat_rcm(struct TIBiStack *const s, struct SpMat const *const A, uint32_t order[const]) {
+	struct TIBiMark const scratch = bistack_mark(s);
+	struct SpGraph g;
+	uint32_t *level = sparse_alloc_ids(s, A->n);
+	uint64_t *keys  = bistack_alloc_front_raw(s, A->n * sizeof *keys);
+	bool const ok = level != NULL && keys != NULL && spmat_graph(s, A, &g);
+	if( ok ) {
+		spgraph_rcm(&g, order, level, keys);
+	}
+	bistack_rewind_front(s, scratch);
+	return ok;
+}
+
+/// lower and upper bandwidth of `A` with its rows and columns both renumbered by `pinv`.
+SPARSE_EXPORT NO_NULLS void spmat_bandwidth(struct SpMat const *const A, uint32_t const pinv[const], uint32_t *const lower, uint32_t *const upper) {
+	*lower = *upper = 0;
+	for( uint32_t j=0; j < A->n; j++ ) {
+		uint32_t const pj = pinv[j];
+		for( uint32_t p = A->colptr[j]; p < A->colptr[j + 1]; p++ ) {
+			uint32_t const pi = pinv[A->rowidx[p]];
+			if( pi > pj && pi - pj > *lower ) {
+				*lower = pi - pj;
+			} else if( pj > pi && pj - pi > *upper ) {
+				*upper = pj - pi;
+			}
+		}
+	}
+}
+
+enum {
+	MINDEG_VAR = 0,  /// still uneliminated.
+	MINDEG_ELEM,     /// eliminated, lives on as an element of the quotient graph.
+	MINDEG_ABSORBED, /// element swallowed by a newer element.
+};
+
+SPARSE_EXPORT NO_NULLS void _mindeg_unlink(uint32_t const i, uint32_t const deg[const restrict], int32_t head[const restrict], int32_t next[const restrict], int32_t prev[const restrict]) {
+	if( prev[i] != SPARSE_NONE ) {
+		next[prev[i]] = next[i];
+	} else {
+		head[deg[i]] = next[i];
+	}
+	if( next[i] != SPARSE_NONE ) {
+		prev[next[i]] = prev[i];
+	}
+}
+
+SPARSE_EXPORT NO_NULLS void _mindeg_link(uint32_t const i, uint32_t const deg[const restrict], int32_t head[const restrict], int32_t next[const restrict], int32_t prev[const restrict]) {
+	prev[i] = SPARSE_NONE;
+	next[i] = head[deg[i]];
+	if( head[deg[i]] != SPARSE_NONE ) {
+		prev[head[deg[i]]] = i;
+	}
+	head[deg[i]] = i;
+}
+
+/// Fill-reducing ordering of the pattern of `A + A^T`.
+/// Approximate minimum degree over a quotient graph: eliminated nodes become elements
+/// so the graph never outgrows the pattern of `A`, and degrees are the usual
+/// `|Av| + |Lp| + sum(|Le \ Lp|)` upper bound.
+/// Writes the elimination order into `q`; on OOM `q` is left as the natural order and false is returned.
+/// All scratch is released before returning.
+SPARSE_EXPORT NO_NULLS bool spmat_min_degree(struct TIBiStack *const s, struct SpMat const *const A, uint32_t q[const restrict]) {
+	uint32_t const n = A->n;
+	for( uint32_t i=0; i < n; i++ ) {
+		q[i] = i;
+	}
+	size_t const scratch = s->front;
+	uint32_t *adjptr = sparse_alloc_ids(s, n + 1);
+	uint32_t *ne     = sparse_alloc_ids(s, n);
+	uint32_t *nv     = sparse_alloc_ids(s, n);
+	uint32_t *deg    = sparse_alloc_ids(s, n);
+	uint32_t *mark   = sparse_alloc_ids(s, n);
+	uint32_t *wmark  = sparse_alloc_ids(s, n);
+	uint32_t *estart = sparse_alloc_ids(s, n);
+	uint32_t *esize  = sparse_alloc_ids(s, n);
+	int32_t  *w      = bistack_alloc_front_vec(s, n, sizeof *w);
+	int32_t  *head   = bistack_alloc_front_vec(s, n + 1, sizeof *head);
+	int32_t  *next   = bistack_alloc_front_vec(s, n, sizeof *next);
+	int32_t  *prev   = bistack_alloc_front_vec(s, n, sizeof *prev);
+	uint8_t  *state  = bistack_alloc_front_vec(s, n, sizeof *state);
+	if( adjptr==NULL || ne==NULL || nv==NULL || deg==NULL || mark==NULL || wmark==NULL
+	 || estart==NULL || esize==NULL || w==NULL || head==NULL || next==NULL || prev==NULL || state==NULL ) {
+		s->front = scratch;
+		return false;
+	}
+
+	/// pattern of A + A^T without the diagonal, duplicates squeezed out per node.
+	for( uint32_t j=0; j < n; j++ ) {
+		for( uint32_t p = A->colptr[j]; p < A->colptr[j + 1]; p++ ) {
+			uint32_t const i = A->rowidx[p];
+			if( i != j ) {
+				adjptr[i + 1]++;
+				adjptr[j + 1]++;
+			}
+		}
+	}
+	for( uint32_t i=0; i < n; i++ ) {
+		adjptr[i + 1] += adjptr[i];
+	}
+	uint32_t const total = adjptr[n];
+	uint32_t *adj  = sparse_alloc_ids(s, total);
+	uint32_t const pool_cap = total + n;
+	uint32_t *pool = sparse_alloc_ids(s, pool_cap);
+	if( adj==NULL || pool==NULL ) {
+		s->front = scratch;
+		return false;
+	}
+	for( uint32_t j=0; j < n; j++ ) {
+		for( uint32_t p = A->colptr[j]; p < A->colptr[j + 1]; p++ ) {
+			uint32_t const i = A->rowidx[p];
+			if( i != j ) {
+				adj[adjptr[i] + nv[i]++] = j;
+				adj[adjptr[j] + nv[j]++] = i;
+			}
+		}
+	}
+	for( uint32_t i=0; i <= n; i++ ) {
+		head[i] = SPARSE_NONE;
+	}
+	for( uint32_t i=0; i < n; i++ ) {
+		uint32_t *const list = &adj[adjptr[i]];
+		uint32_t len = 0;
+		for( uint32_t t=0; t < nv[i]; t++ ) {
+			if( mark[list[t]] != i + 1 ) {
+				mark[list[t]] = i + 1;
+				list[len++] = list[t];
+			}
+		}
+		nv[i] = len;
+		deg[i] = len;
+		_mindeg_link(i, deg, head, next, prev);
+	}
+	memset(mark, 0, n * sizeof *mark);
+
+	uint32_t mindeg = 0, pool_len = 0;
+	for( uint32_t k=0; k < n; k++ ) {
+		while( head[mindeg]==SPARSE_NONE ) {
+			mindeg++;
+		}
+		uint32_t const p = head[mindeg];
+		_mindeg_unlink(p, deg, head, next, prev);
+		q[k] = p;
+		state[p] = MINDEG_ELEM;
+
+		/// make room for Lp, compacting the live elements when the pool runs dry.
+		if( pool_len + (n - k) > pool_cap ) {
+			uint32_t len = 0;
+			for( uint32_t t=0; t < k; t++ ) {
+				uint32_t const e = q[t];
+				if( state[e] != MINDEG_ELEM ) {
+					continue;
+				}
+				memmove(&pool[len], &pool[estart[e]], esize[e] * sizeof *pool);
+				estart[e] = len;
+				len += esize[e];
+			}
+			pool_len = len;
+		}
+
+		/// Lp = variables reachable from p, either directly or through the elements it absorbs.
+		uint32_t const tag = k + 1;
+		uint32_t const lp_start = pool_len;
+		uint32_t *const plist = &adj[adjptr[p]];
+		mark[p] = tag;
+		for( uint32_t t=0; t < ne[p]; t++ ) {
+			uint32_t const e = plist[t];
+			if( state[e] != MINDEG_ELEM ) {
+				continue;
+			}
+			for( uint32_t u = estart[e]; u < estart[e] + esize[e]; u++ ) {
+				uint32_t const v = pool[u];
+				if( state[v]==MINDEG_VAR && mark[v] != tag ) {
+					mark[v] = tag;
+					pool[pool_len++] = v;
+				}
+			}
+			state[e] = MINDEG_ABSORBED;
+		}
+		for( uint32_t t = ne[p]; t < ne[p] + nv[p]; t++ ) {
+			uint32_t const v = plist[t];
+			if( state[v]==MINDEG_VAR && mark[v] != tag ) {
+				mark[v] = tag;
+				pool[pool_len++] = v;
+			}
+		}
+		estart[p] = lp_start;
+		esize[p]  = pool_len - lp_start;
+
+		/// w[e] = |Le \ Lp| for every older element touching Lp.
+		for( uint32_t u = lp_start; u < pool_len; u++ ) {
+			uint32_t const *const vlist = &adj[adjptr[pool[u]]];
+			for( uint32_t t=0; t < ne[pool[u]]; t++ ) {
+				uint32_t const e = vlist[t];
+				if( state[e] != MINDEG_ELEM || e==p ) {
+					continue;
+				}
+				if( wmark[e] != tag ) {
+					wmark[e] = tag;
+					w[e] = esize[e];
+				}
+				w[e]--;
+			}
+		}
+
+		/// prune each variable of Lp and recompute its degree.
+		/// p either left its variable list or absorbed one of its elements, so adding p always fits.
+		for( uint32_t u = lp_start; u < pool_len; u++ ) {
+			uint32_t const v = pool[u];
+			uint32_t *const list = &adj[adjptr[v]];
+			_mindeg_unlink(v, deg, head, next, prev);
+			uint32_t d = esize[p] - 1;
+			uint32_t new_ne = 0;
+			for( uint32_t t=0; t < ne[v]; t++ ) {
+				uint32_t const e = list[t];
+				if( state[e]==MINDEG_ELEM ) {
+					list[new_ne++] = e;
+					d += w[e];
+				}
+			}
+			uint32_t new_nv = 0;
+			for( uint32_t t = ne[v]; t < ne[v] + nv[v]; t++ ) {
+				uint32_t const x = list[t];
+				if( state[x]==MINDEG_VAR && mark[x] != tag ) {
+					list[new_ne + new_nv++] = x;
+					d++;
+				}
+			}
+			if( new_nv > 0 ) {
+				list[new_ne + new_nv] = list[new_ne];
+			}
+			list[new_ne] = p;
+			ne[v] = new_ne + 1;
+			nv[v] = new_nv;
+			deg[v] = ( d < n - k - 1 )? d : n - k - 1;
+			_mindeg_link(v, deg, head, next, prev);
+			if( deg[v] < mindeg ) {
+				mindeg = deg[v];
+			}
+		}
+	}
+	s->front = scratch;
+	return true;
+}
+
+
+/// iterative depth-first search from row `j` through the columns of `L` finished so far.
+/// finished nodes are pushed onto `xi[top..n]` in topological order.
+SPARSE_EXPORT NO_NULLS uint32_t _splu_dfs(
+	uint32_t               j,
+	struct SpMat    const *const L,
+	uint32_t               top,
+	uint32_t               xi[const restrict],
+	uint32_t               pstack[const restrict],
+	int32_t         const  pinv[const restrict],
+	uint32_t               mark[const restrict],
+	uint32_t        const  tag
+) {
+	int32_t head = 0;
+	xi[0] = j;
+	while( head >= 0 ) {
+		j = xi[head];
+		int32_t const jnew = pinv[j];
+		if( mark[j] != tag ) {
+			mark[j] = tag;
+			pstack[head] = ( jnew < 0 )? 0 : L->colptr[jnew];
+		}
+		bool done = true;
+		uint32_t const p2 = ( jnew < 0 )? 0 : L->colptr[jnew + 1];
+		for( uint32_t p = pstack[head]; p < p2; p++ ) {
+			uint32_t const i = L->rowidx[p];
+			if( mark[i]==tag ) {
+				continue;
+			}
+			pstack[head] = p;
+			xi[++head] = i;
+			done = false;
+			break;
+		}
+		if( done ) {
+			head--;
+			xi[--top] = j;
+		}
+	}
+	return top;
+}
+
+/// sparse triangular solve `x = L \ A(:,col)`, returns where the nonzero pattern starts in `xi`.
+SPARSE_EXPORT NO_NULLS uint32_t _splu_spsolve(
+	struct SpMat const *const L,
+	struct SpMat const *const A,
+	uint32_t     const        col,
+	uint32_t                  xi[const restrict],
+	rat_t                     x[const restrict],
+	int32_t      const        pinv[const restrict],
+	uint32_t                  mark[const restrict],
+	uint32_t     const        tag
+) {
+	uint32_t const n = A->n;
+	uint32_t top = n;
+	for( uint32_t p = A->colptr[col]; p < A->colptr[col + 1]; p++ ) {
+		if( mark[A->rowidx[p]] != tag ) {
+			top = _splu_dfs(A->rowidx[p], L, top, xi, xi + n, pinv, mark, tag);
+		}
+	}
+	for( uint32_t p = top; p < n; p++ ) {
+		x[xi[p]] = rat_zero();
+	}
+	for( uint32_t p = A->colptr[col]; p < A->colptr[col + 1]; p++ ) {
+		x[A->rowidx[p]] = A->vals[p];
+	}
+	for( uint32_t px = top; px < n; px++ ) {
+		uint32_t const j = xi[px];
+		int32_t  const J = pinv[j];
+		if( J < 0 ) {
+			continue;
+		}
+		rat_t const xj = x[j];
+		/// unit diagonal sits first in the column, skip it.
+		for( uint32_t p = L->colptr[J] + 1; p < L->colptr[J + 1]; p++ ) {
+			x[L->rowidx[p]] = rat_sub(x[L->rowidx[p]], rat_mul(L->vals[p], xj));
+		}
+	}
+	return top;
+}
+
+/// Left-looking (Gilbert-Peierls) LU with threshold partial pivoting.
+/// The diagonal is kept as pivot whenever `|a_kk| >= tol * max|a_ik|`,
+/// so the fill predicted by the column ordering `q` mostly survives pivoting.
+/// `lu->q` aliases `q`, everything else is allocated from the front of `s`.
+SPARSE_EXPORT NO_NULLS int splu_factor(struct TIBiStack *const s, struct SpMat const *const A, uint32_t q[const], rat_t const tol, struct SpLU *const lu) {
+	uint32_t const n = A->n;
+	uint32_t lnz_max = 4*A->nnz + n, unz_max = 4*A->nnz + n;
+	lu->n = n;
+	lu->q = q;
+	lu->L.n = lu->U.n = n;
+	lu->L.colptr = sparse_alloc_ids(s, n + 1);
+	lu->U.colptr = sparse_alloc_ids(s, n + 1);
+	lu->L.rowidx = sparse_alloc_ids(s, lnz_max);
+	lu->L.vals   = sparse_alloc_vals(s, lnz_max);
+	lu->U.rowidx = sparse_alloc_ids(s, unz_max);
+	lu->U.vals   = sparse_alloc_vals(s, unz_max);
+	lu->pinv     = bistack_alloc_front_vec(s, n, sizeof *lu->pinv);
+	rat_t    *x    = sparse_alloc_vals(s, n);
+	uint32_t *xi   = sparse_alloc_ids(s, 2*n);
+	uint32_t *mark = sparse_alloc_ids(s, n);
+	if( lu->L.colptr==NULL || lu->U.colptr==NULL || lu->L.rowidx==NULL || lu->L.vals==NULL
+	 || lu->U.rowidx==NULL || lu->U.vals==NULL || lu->pinv==NULL || x==NULL || xi==NULL || mark==NULL ) {
+		return SPARSE_ERR_OOM;
+	}
+	for( uint32_t i=0; i < n; i++ ) {
+		lu->pinv[i] = SPARSE_NONE;
+	}
+
+	uint32_t lnz = 0, unz = 0;
+	for( uint32_t k=0; k < n; k++ ) {
+		lu->L.colptr[k] = lnz;
+		lu->U.colptr[k] = unz;
+		if( lnz + n > lnz_max ) {
+			uint32_t const cap = 2*lnz_max + n;
+			lu->L.rowidx = sparse_grow(s, lu->L.rowidx, lnz, cap, sizeof *lu->L.rowidx);
+			lu->L.vals   = sparse_grow(s, lu->L.vals,   lnz, cap, sizeof *lu->L.vals);
+			if( lu->L.rowidx==NULL || lu->L.vals==NULL ) {
+				return SPARSE_ERR_OOM;
+			}
+			lnz_max = cap;
+		}
+		if( unz + n > unz_max ) {
+			uint32_t const cap = 2*unz_max + n;
+			lu->U.rowidx = sparse_grow(s, lu->U.rowidx, unz, cap, sizeof *lu->U.rowidx);
+			lu->U.vals   = sparse_grow(s, lu->U.vals,   unz, cap, sizeof *lu->U.vals);
+			if( lu->U.rowidx==NULL || lu->U.vals==NULL ) {
+				return SPARSE_ERR_OOM;
+			}
+			unz_max = cap;
+		}
+
+		uint32_t const col = q[k];
+		uint32_t const top = _splu_spsolve(&lu->L, A, col, xi, x, lu->pinv, mark, k + 1);
+
+		/// split x into U (already pivotal rows) and pivot candidates.
+		int32_t ipiv = SPARSE_NONE;
+		rat_t big = rat_zero();
+		for( uint32_t p = top; p < n; p++ ) {
+			uint32_t const i = xi[p];
+			if( lu->pinv[i] < 0 ) {
+				rat_t const t = rat_abs(x[i]);
+				if( ipiv==SPARSE_NONE || rat_lt(big, t) ) {
+					big = t;
+					ipiv = i;
+				}
+			} else {
+				lu->U.rowidx[unz] = lu->pinv[i];
+				lu->U.vals[unz]   = x[i];
+				unz++;
+			}
+		}
+		if( ipiv==SPARSE_NONE || !rat_lt(rat_zero(), big) ) {
+			return SPARSE_ERR_SINGULAR;
+		}
+		if( lu->pinv[col] < 0 && rat_ge(rat_abs(x[col]), rat_mul(big, tol)) ) {
+			ipiv = col;
+		}
+		rat_t const pivot = x[ipiv];
+		lu->U.rowidx[unz] = k;
+		lu->U.vals[unz]   = pivot;
+		unz++;
+		lu->pinv[ipiv] = k;
+		lu->L.rowidx[lnz] = ipiv;
+		lu->L.vals[lnz]   = rat_pos1();
+		lnz++;
+		for( uint32_t p = top; p < n; p++ ) {
+			uint32_t const i = xi[p];
+			if( lu->pinv[i] < 0 ) {
+				lu->L.rowidx[lnz] = i;
+				lu->L.vals[lnz]   = rat_div(x[i], pivot);
+				lnz++;
+			}
+			x[i] = rat_zero();
+		}
+	}
+	lu->L.colptr[n] = lnz;
+	lu->U.colptr[n] = unz;
+	lu->L.nnz = lnz;
+	lu->U.nnz = unz;
+	/// L was built with original row ids so the DFS could follow them, switch to pivot order now.
+	for( uint32_t p=0; p < lnz; p++ ) {
+		lu->L.rowidx[p] = lu->pinv[lu->L.rowidx[p]];
+	}
+	return SPARSE_OK;
+}
+
+SPARSE_EXPORT NO_NULLS bool splu_persist(struct TIBiStack *const s, struct SpLU *const lu) {
+	lu->pinv = sparse_persist(s, lu->pinv, lu->n * sizeof *lu->pinv);
+	return spmat_persist(s, &lu->L) && spmat_persist(s, &lu->U) && lu->pinv != NULL;
+}
+
+/// `spmat_persist` into `keep`, persisted earlier with room for `*cap` nonzeros, when `A` fits.
+/// Otherwise it persists anew with a quarter extra room and raises `*cap`,
+/// so refactoring over and over stops taking from the back once the fill settles.
+SPARSE_EXPORT NO_NULLS bool spmat_persist_reuse(struct TIBiStack *const s, struct SpMat *const A, struct SpMat const *const keep, uint32_t *const cap) {
+	if( keep->colptr==NULL || A->nnz > *cap ) {
+		uint32_t const room = A->nnz + A->nnz / 4;
+		uint32_t *colptr = ( keep->colptr != NULL )? keep->colptr : bistack_alloc_back_vec(s, A->n + 1, sizeof *colptr);
+		uint32_t *rowidx = bistack_alloc_back_vec(s, room, sizeof *rowidx);
+		rat_t    *vals   = bistack_alloc_back_vec(s, room, sizeof *vals);
+		if( colptr==NULL || rowidx==NULL || vals==NULL ) {
+			return false;
+		}
+		*cap = room;
+		A->colptr = memcpy(colptr, A->colptr, (A->n + 1) * sizeof *colptr);
+		A->rowidx = memcpy(rowidx, A->rowidx, A->nnz * sizeof *rowidx);
+		A->vals   = memcpy(vals,   A->vals,   A->nnz * sizeof *vals);
+		return true;
+	}
+	A->colptr = memcpy(keep->colptr, A->colptr, (A->n + 1) * sizeof *A->colptr);
+	A->rowidx = memcpy(keep->rowidx, A->rowidx, A->nnz * sizeof *A->rowidx);
+	A->vals   = memcpy(keep->vals,   A->vals,   A->nnz * sizeof *A->vals);
+	return true;
+}
+
+/// `splu_persist` reusing the factors `keep` kept before, `cap` holds the nonzeros L and U have room for
+/// (zero and a zeroed `keep` the first time).
+SPARSE_EXPORT NO_NULLS bool splu_persist_reuse(struct TIBiStack *const s, struct SpLU *const lu, struct SpLU const *const keep, uint32_t cap[const static 2]) {
+	int32_t *const pinv = ( keep->pinv != NULL )? keep->pinv : bistack_alloc_back_vec(s, lu->n, sizeof *pinv);
+	if( pinv==NULL ) {
+		return false;
+	}
+	lu->pinv = memcpy(pinv, lu->pinv, lu->n * sizeof *pinv);
+	return spmat_persist_reuse(s, &lu->L, &keep->L, &cap[0]) && spmat_persist_reuse(s, &lu->U, &keep->U, &cap[1]);
+}
+
+/// Numeric-only refactorization: new values of `A` through the pattern, pivot order
+/// and column order already in `lu`. The stored U columns are in topological order,
+/// so the triangular solve needs no DFS.
+/// Fails with SPARSE_ERR_SINGULAR when a kept pivot drops below `tol` times its column,
+/// the caller should then run `splu_factor` again to choose fresh pivots.
+/// `x` must hold `n` values.
+SPARSE_EXPORT NO_NULLS int splu_refactor(struct SpLU *const lu, struct SpMat const *const A, rat_t const tol, rat_t x[const restrict]) {
+	uint32_t const n = lu->n;
+	for( uint32_t k=0; k < n; k++ ) {
+		uint32_t const ustart = lu->U.colptr[k], diag = lu->U.colptr[k + 1] - 1;
+		uint32_t const lstart = lu->L.colptr[k], lend = lu->L.colptr[k + 1];
+		for( uint32_t p = ustart; p <= diag; p++ ) {
+			x[lu->U.rowidx[p]] = rat_zero();
+		}
+		for( uint32_t p = lstart; p < lend; p++ ) {
+			x[lu->L.rowidx[p]] = rat_zero();
+		}
+		uint32_t const col = lu->q[k];
+		for( uint32_t p = A->colptr[col]; p < A->colptr[col + 1]; p++ ) {
+			x[lu->pinv[A->rowidx[p]]] = A->vals[p];
+		}
+		for( uint32_t p = ustart; p < diag; p++ ) {
+			uint32_t const J = lu->U.rowidx[p];
+			rat_t const xj = x[J];
+			lu->U.vals[p] = xj;
+			for( uint32_t pl = lu->L.colptr[J] + 1; pl < lu->L.colptr[J + 1]; pl++ ) {
+				x[lu->L.rowidx[pl]] = rat_sub(x[lu->L.rowidx[pl]], rat_mul(lu->L.vals[pl], xj));
+			}
+		}
+		rat_t const pivot = x[k];
+		rat_t big = rat_abs(pivot);
+		for( uint32_t p = lstart + 1; p < lend; p++ ) {
+			big = rat_max(big, rat_abs(x[lu->L.rowidx[p]]));
+		}
+		if( !rat_lt(rat_zero(), big) || rat_lt(rat_abs(pivot), rat_mul(big, tol)) ) {
+			return SPARSE_ERR_SINGULAR;
+		}
+		lu->U.vals[diag] = pivot;
+		for( uint32_t p = lstart + 1; p < lend; p++ ) {
+			lu->L.vals[p] = rat_div(x[lu->L.rowidx[p]], pivot);
+		}
+	}
+	return SPARSE_OK;
+}
+
+/// solves `A*x = b` in place using the factors, `work` must hold `n` values.
+SPARSE_EXPORT NO_NULLS void splu_solve(struct SpLU const *const lu, rat_t b[const restrict], rat_t work[const restrict]) {
+	uint32_t const n = lu->n;
+	for( uint32_t i=0; i < n; i++ ) {
+		work[lu->pinv[i]] = b[i];
+	}
+	for( uint32_t j=0; j < n; j++ ) {
+		rat_t const xj = work[j];
+		for( uint32_t p = lu->L.colptr[j] + 1; p < lu->L.colptr[j + 1]; p++ ) {
+			work[lu->L.rowidx[p]] = rat_sub(work[lu->L.rowidx[p]], rat_mul(lu->L.vals[p], xj));
+		}
+	}
+	for( uint32_t j = n-1; j < n; j-- ) {
+		uint32_t const diag = lu->U.colptr[j + 1] - 1;
+		work[j] = rat_div(work[j], lu->U.vals[diag]);
+		rat_t const xj = work[j];
+		for( uint32_t p = lu->U.colptr[j]; p < diag; p++ ) {
+			work[lu->U.rowidx[p]] = rat_sub(work[lu->U.rowidx[p]], rat_mul(lu->U.vals[p], xj));
+		}
+	}
+	for( uint32_t k=0; k < n; k++ ) {
+		b[lu->q[k]] = work[k];
+	}
+}
+
+/// Solves `A^T*x = b` in place with the factors of `A`, the adjoint system.
+/// `A = P^T*L*U*Q^T`, so it's `U^T` forward then `L^T` backward, each a dot product down a stored column.
+SPARSE_EXPORT NO_NULLS void splu_solve_transpose(struct SpLU const *const lu, rat_t b[const restrict], rat_t work[const restrict]) {
+	uint32_t const n = lu->n;
+	for( uint32_t k=0; k < n; k++ ) {
+		work[k] = b[lu->q[k]];
+	}
+	for( uint32_t j=0; j < n; j++ ) {
+		uint32_t const diag = lu->U.colptr[j + 1] - 1;
+		rat_t sum = work[j];
+		for( uint32_t p = lu->U.colptr[j]; p < diag; p++ ) {
+			sum = rat_sub(sum, rat_mul(lu->U.vals[p], work[lu->U.rowidx[p]]));
+		}
+		work[j] = rat_div(sum, lu->U.vals[diag]);
+	}
+	for( uint32_t j = n-1; j < n; j-- ) {
+		rat_t sum = work[j];
+		for( uint32_t p = lu->L.colptr[j] + 1; p < lu->L.colptr[j + 1]; p++ ) {
+			sum = rat_sub(sum, rat_mul(lu->L.vals[p], work[lu->L.rowidx[p]]));
+		}
+		work[j] = sum;
+	}
+	for( uint32_t i=0; i < n; i++ ) {
+		b[i] = work[lu->pinv[i]];
+	}
+}
+
+/// `splu_solve_batch` for right-hand sides that are zero on every row pivoted before `first`,
+/// when only the unknowns of pivot columns `last` on are wanted: the forward solve starts
+/// at `first` and the backward solve stops at `last`, so with both near `n` only the trailing
+/// corner of the factors is touched. The other rows of `B` are left as they were.
+SPARSE_EXPORT NO_NULLS void splu_solve_batch_tail(struct SpLU const *const lu, uint32_t const k, uint32_t const first, uint32_t const last, rat_t B[const restrict], rat_t work[const restrict]) {
+	uint32_t const n = lu->n;
+	for( uint32_t i=0; i < n; i++ ) {
+		memcpy(&work[(size_t)(lu->pinv[i]) * k], &B[(size_t)(i) * k], k * sizeof *work);
+	}
+	for( uint32_t j = first; j < n; j++ ) {
+		rat_t const *const xj = &work[(size_t)(j) * k];
+		for( uint32_t p = lu->L.colptr[j] + 1; p < lu->L.colptr[j + 1]; p++ ) {
+			rat_t *const row = &work[(size_t)(lu->L.rowidx[p]) * k];
+			rat_t const l = lu->L.vals[p];
+			for( uint32_t r=0; r < k; r++ ) {
+				row[r] = rat_sub(row[r], rat_mul(l, xj[r]));
+			}
+		}
+	}
+	for( uint32_t j = n-1; j < n && j >= last; j-- ) {
+		uint32_t const diag = lu->U.colptr[j + 1] - 1;
+		rat_t *const xj = &work[(size_t)(j) * k];
+		rat_t const inv = rat_recip(lu->U.vals[diag]);
+		for( uint32_t r=0; r < k; r++ ) {
+			xj[r] = rat_mul(xj[r], inv);
+		}
+		for( uint32_t p = lu->U.colptr[j]; p < diag; p++ ) {
+			rat_t *const row = &work[(size_t)(lu->U.rowidx[p]) * k];
+			rat_t const u = lu->U.vals[p];
+			for( uint32_t r=0; r < k; r++ ) {
+				row[r] = rat_sub(row[r], rat_mul(u, xj[r]));
+			}
+		}
+	}
+	for( uint32_t i = last; i < n; i++ ) {
+		memcpy(&B[(size_t)(lu->q[i]) * k], &work[(size_t)(i) * k], k * sizeof *B);
+	}
+}
+
+/// Solves `A*X = B` for `k` right-hand sides in place, `work` must hold `n*k` values.
+/// `B` is RHS-major: row `i` of system `r` sits at `B[i*k + r]`, so every factor entry
+/// is loaded once and applied across a contiguous run of `k` values.
+SPARSE_EXPORT NO_NULLS void splu_solve_batch(struct SpLU const *const lu, uint32_t const k, rat_t B[const restrict], rat_t work[const restrict]) {
+	splu_solve_batch_tail(lu, k, 0, 0, B, work);
+}
+#endif
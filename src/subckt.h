@@ -0,0 +1,360 @@
+#ifndef SUBCKT_H_INCLUDED
+#	define SUBCKT_H_INCLUDED
+
+#include "node.h"
+
+#define SUBCKT_EXPORT    static inline
+
+enum {
+	SUBCKT_MAX_PORTS = 64,
+};
+
+/// A subcircuit reduced to what its ports see.
+/// The body's MNA system is split into port rows P and everything else I (internal nodes and
+/// branch currents), and I is eliminated once: `Y = A_PP - A_PI A_II^-1 A_IP` is the port conductance
+/// matrix and `J = b_P - A_PI A_II^-1 b_I` the current the body pushes into its ports when they sit at 0 V.
+/// Only DC-linear bodies reduce this way, resistors, DC sources and other reduced subcircuits.
+/// An instance stamps `Y` and `J` as an equivalent network between its port nodes and ground,
+/// precomputed here so instancing is a handful of `circuit_add_component` calls and no solve:
+/// a resistor of `-1/Y_ij` between each coupled pair of ports, `1/sum_j Y_ij` from a port to ground
+/// and a current source of `J_i` into it. Entries within rounding of zero are dropped.
+/// Internal node voltages aren't kept per instance, `recover` turns port voltages into them on request.
+/// Everything lives on the back of the circuit's bistack.
+struct Macromodel {
+	struct Macromodel *next;
+	char const        *name;
+	rat_t             *Y, *J;     /// `ports x ports` row-major, and `ports`.
+	rat_t             *recover;   /// `internals x (ports+1)` row-major: row k is `[x_k, X_k1 .. X_kp]`, node k sits at `x_k - X_k . v_P`.
+	char const       **internal;  /// name of each internal node.
+	uint32_t          *internal_len;
+	uint8_t           *kind;      /// equivalent network, terminals are port numbers with 0 as ground.
+	uint8_t           *term_a, *term_b;
+	rat_t             *val;
+	uint32_t           len, ports, internals, elem_count;
+};
+
+/// One placement of a macromodel, ports wired to `nodes`.
+struct SubcktInstance {
+	struct SubcktInstance   *next;
+	struct Macromodel const *model;
+	char const              *name;
+	uint32_t                *nodes;
+	uint32_t                 len;
+};
+
+SUBCKT_EXPORT NO_NULLS struct Macromodel *circuit_find_macromodel(struct Circuit const *const c, size_t const len, char const name[const static len]) {
+	for( struct Macromodel *m = c->macromodels; m != NULL; m = m->next ) {
+		if( m->len==len && memcmp(m->name, name, len)==0 ) {
+			return m;
+		}
+	}
+	return NULL;
+}
+
+SUBCKT_EXPORT NO_NULLS struct SubcktInstance *circuit_find_instance(struct Circuit const *const c, size_t const len, char const name[const static len]) {
+	for( struct SubcktInstance *inst = c->instances; inst != NULL; inst = inst->next ) {
+		if( inst->len==len && memcmp(inst->name, name, len)==0 ) {
+			return inst;
+		}
+	}
+	return NULL;
+}
+
+/// index of a macromodel's internal node, NODE_NONE if it has none by that name.
+SUBCKT_EXPORT NO_NULLS uint32_t macromodel_find_node(struct Macromodel const *const m, size_t const len, char const name[const static len]) {
+	for( uint32_t k=0; k < m->internals; k++ ) {
+		if( m->internal_len[k]==len && memcmp(m->internal[k], name, len)==0 ) {
+			return k;
+		}
+	}
+	return NODE_NONE;
+}
+
+/// voltage of internal node `k` of an instance, from its port voltages in the last solve.
+SUBCKT_EXPORT NO_NULLS rat_t subckt_internal_voltage(struct Circuit const *const c, struct SubcktInstance const *const inst, uint32_t const k) {
+	struct Macromodel const *const m = inst->model;
+	rat_t const *const row = &m->recover[idx1D(k, 0, m->ports + 1)];
+	rat_t v = row[0];
+	for( uint32_t t=0; t < m->ports; t++ ) {
+		v = rat_sub(v, rat_mul(row[t + 1], c->voltage[inst->nodes[t]]));
+	}
+	return v;
+}
+
+/// rows of the trailing `n - first` unknowns of `G`, shifted down to start at 0.
+SUBCKT_EXPORT NO_NULLS bool _subckt_trailing(struct TIBiStack *const s, struct SpMat const *const G, uint32_t const first, struct SpMat *const A) {
+	uint32_t const m = G->n - first;
+	uint32_t nnz = 0;
+	for( uint32_t p = G->colptr[first]; p < G->colptr[G->n]; p++ ) {
+		nnz += G->rowidx[p] >= first;
+	}
+	A->n      = m;
+	A->nnz    = nnz;
+	A->colptr = sparse_alloc_ids(s, m + 1);
+	A->rowidx = sparse_alloc_ids(s, nnz);
+	A->vals   = sparse_alloc_vals(s, nnz);
+	if( A->colptr==NULL || A->rowidx==NULL || A->vals==NULL ) {
+		return false;
+	}
+	nnz = 0;
+	for( uint32_t j=0; j < m; j++ ) {
+		A->colptr[j] = nnz;
+		for( uint32_t p = G->colptr[first + j]; p < G->colptr[first + j + 1]; p++ ) {
+			if( G->rowidx[p] >= first ) {
+				A->rowidx[nnz] = G->rowidx[p] - first;
+				A->vals[nnz++] = G->vals[p];
+			}
+		}
+	}
+	A->colptr[m] = nnz;
+	return true;
+}
+
+/// Reduces `body` to a macromodel named `name` and adds it to `c`.
+/// The body's nodes 1 to `ports` are its ports, in order, node 0 is the shared ground.
+/// `body` is scratch afterwards, its bistack gets used for the elimination.
+/// Returns ERR_SINGULAR when the internals can't be eliminated: a floating internal node,
+/// or a voltage source or wire directly between ports, which has no conductance to reduce to,
+/// and ERR_NONLINEAR for a body with diodes, which has no fixed conductance at all.
+/// On failure nothing of the model stays on `c`'s bistack.
+SUBCKT_EXPORT EXTANT(1, 2, 5) int circuit_define_subckt(
+	struct Circuit     *const c,
+	struct Circuit     *const body,
+	uint32_t            const ports,
+	size_t              const len,
+	char                const name[const static len],
+	struct Macromodel **const out
+) {
+	struct TIBiStack *const s = &body->bistack;
+	struct TIBiStack *const keep = &c->bistack;
+	struct TIBiMark const mark = bistack_mark(keep);
+	struct StampProgram prog;
+	int res = ERR_NODE_OOB;
+	if( ports==0 || ports > SUBCKT_MAX_PORTS || ports >= body->node_count ) {
+		goto done;
+	}
+	res = circuit_compile(body, &prog);
+	if( res != ERR_OK ) {
+		goto done;
+	} else if( prog.diode_count > 0 ) {
+		res = ERR_NONLINEAR;
+		goto done;
+	}
+	/// rows go out in node order, so the ports that anything touches are the first rows.
+	uint32_t const n = prog.n;
+	uint32_t pa = 0;
+	uint32_t port_row[SUBCKT_MAX_PORTS];
+	for( uint32_t t=0; t < ports; t++ ) {
+		port_row[t] = circuit_node_active(body, t + 1)? pa++ : NODE_NONE;
+	}
+	uint32_t const m = n - pa, k = pa + 1;
+	res = ERR_OOM;
+	rat_t *raw  = alloc_vec(s, prog.elem_count);
+	rat_t *vals = alloc_vec(s, 2 * prog.elem_count);
+	rat_t *rhs  = alloc_vec(s, n);
+	rat_t *B    = alloc_vec(s, ( size_t )(m) * k);
+	rat_t *work = alloc_vec(s, ( size_t )(m) * k);
+	if( raw==NULL || vals==NULL || rhs==NULL || B==NULL || work==NULL ) {
+		goto done;
+	}
+	stamp_program_load(&prog, raw);
+	stamp_program_assemble(&prog, raw, rat_zero(), vals, prog.G.vals, rhs);
+	struct SpMat const *const G = &prog.G;
+
+	/// B = A_II^-1 [b_I, A_IP], one sparse LU of the internals and a batched solve.
+	if( m > 0 ) {
+		struct SpMat A;
+		struct SpLU lu;
+		uint32_t *q = sparse_alloc_ids(s, m);
+		if( q==NULL || !_subckt_trailing(s, G, pa, &A) || !spmat_min_degree(s, &A, q) ) {
+			goto done;
+		}
+		switch( splu_factor(s, &A, q, sparse_pivot_tol(), &lu) ) {
+			case SPARSE_ERR_OOM:      goto done;
+			case SPARSE_ERR_SINGULAR: res = ERR_SINGULAR; goto done;
+		}
+		for( uint32_t i=0; i < m; i++ ) {
+			B[idx1D(i, 0, k)] = rhs[pa + i];
+		}
+		for( uint32_t j=0; j < pa; j++ ) {
+			for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+				if( G->rowidx[p] >= pa ) {
+					B[idx1D(G->rowidx[p] - pa, j + 1, k)] = G->vals[p];
+				}
+			}
+		}
+		splu_solve_batch(&lu, k, B, work);
+	}
+
+	struct Macromodel *model = bistack_alloc_back(keep, sizeof *model);
+	char *copy = bistack_alloc_back(keep, len + 1);
+	if( model==NULL || copy==NULL ) {
+		goto done;
+	}
+	memcpy(copy, name, len);
+	model->name      = copy;
+	model->len       = len;
+	model->ports     = ports;
+	model->internals = prog.node_rows - pa;
+	model->Y         = bistack_alloc_back_vec(keep, ( size_t )(ports) * ports, sizeof *model->Y);
+	model->J         = bistack_alloc_back_vec(keep, ports, sizeof *model->J);
+	model->recover   = bistack_alloc_back_vec(keep, ( size_t )(model->internals) * (ports + 1), sizeof *model->recover);
+	model->internal     = bistack_alloc_back_vec(keep, model->internals, sizeof *model->internal);
+	model->internal_len = bistack_alloc_back_vec(keep, model->internals, sizeof *model->internal_len);
+	if( model->Y==NULL || model->J==NULL || model->recover==NULL || model->internal==NULL || model->internal_len==NULL ) {
+		goto done;
+	}
+
+	/// Y = A_PP - A_PI X and J = b_P - A_PI x, in the active port rows first.
+	rat_t *const Ya = alloc_vec(s, ( size_t )(pa) * pa);
+	rat_t *const Ja = alloc_vec(s, pa);
+	if( Ya==NULL || Ja==NULL ) {
+		goto done;
+	}
+	for( uint32_t a=0; a < pa; a++ ) {
+		Ja[a] = rhs[a];
+	}
+	for( uint32_t j=0; j < n; j++ ) {
+		for( uint32_t p = G->colptr[j]; p < G->colptr[j + 1]; p++ ) {
+			uint32_t const a = G->rowidx[p];
+			if( a >= pa ) {
+				continue;
+			} else if( j < pa ) {
+				Ya[idx1D(a, j, pa)] = rat_add(Ya[idx1D(a, j, pa)], G->vals[p]);
+				continue;
+			}
+			rat_t const *const xj = &B[idx1D(j - pa, 0, k)];
+			Ja[a] = rat_sub(Ja[a], rat_mul(G->vals[p], xj[0]));
+			for( uint32_t b=0; b < pa; b++ ) {
+				Ya[idx1D(a, b, pa)] = rat_sub(Ya[idx1D(a, b, pa)], rat_mul(G->vals[p], xj[b + 1]));
+			}
+		}
+	}
+	for( uint32_t t=0; t < ports; t++ ) {
+		model->J[t] = ( port_row[t]==NODE_NONE )? rat_zero() : Ja[port_row[t]];
+		for( uint32_t u=0; u < ports; u++ ) {
+			bool const both = port_row[t] != NODE_NONE && port_row[u] != NODE_NONE;
+			model->Y[idx1D(t, u, ports)] = both? Ya[idx1D(port_row[t], port_row[u], pa)] : rat_zero();
+		}
+	}
+
+	/// internal node voltages are the leading internal rows, branch currents aren't kept.
+	for( uint32_t i=0; i < model->internals; i++ ) {
+		rat_t *const row = &model->recover[idx1D(i, 0, ports + 1)];
+		row[0] = B[idx1D(i, 0, k)];
+		for( uint32_t t=0; t < ports; t++ ) {
+			row[t + 1] = ( port_row[t]==NODE_NONE )? rat_zero() : B[idx1D(i, port_row[t] + 1, k)];
+		}
+	}
+	for( uint32_t i=0; i < body->name_cap; i++ ) {
+		struct NodeName const *const nn = &body->names[i];
+		if( nn->name==NULL || nn->id <= ports || !circuit_node_active(body, nn->id) ) {
+			continue;
+		}
+		uint32_t const r = prog.node_to_matrix[nn->id] - pa;
+		char *const internal = bistack_alloc_back(keep, nn->len + 1);
+		if( internal==NULL ) {
+			goto done;
+		}
+		memcpy(internal, nn->name, nn->len);
+		model->internal[r]     = internal;
+		model->internal_len[r] = nn->len;
+	}
+
+	/// the equivalent network, with `tol` covering the cancellation of the elimination.
+	rat_t scale = rat_zero();
+	for( size_t i=0; i < ( size_t )(ports) * ports; i++ ) {
+		if( rat_lt(scale, rat_abs(model->Y[i])) ) {
+			scale = rat_abs(model->Y[i]);
+		}
+	}
+	rat_t const tol = rat_mul(rat_mul(rat_from_int(( int )(n)), rat_epsilon()), scale);
+	uint32_t const cap = ports * (ports + 3) / 2;
+	model->kind   = bistack_alloc_back_vec(keep, cap, sizeof *model->kind);
+	model->term_a = bistack_alloc_back_vec(keep, cap, sizeof *model->term_a);
+	model->term_b = bistack_alloc_back_vec(keep, cap, sizeof *model->term_b);
+	model->val    = bistack_alloc_back_vec(keep, cap, sizeof *model->val);
+	if( model->kind==NULL || model->term_a==NULL || model->term_b==NULL || model->val==NULL ) {
+		goto done;
+	}
+	uint32_t e = 0;
+	for( uint32_t t=0; t < ports; t++ ) {
+		rat_t sum = rat_zero();
+		for( uint32_t u=0; u < ports; u++ ) {
+			rat_t const y = model->Y[idx1D(t, u, ports)];
+			sum = rat_add(sum, y);
+			if( u > t && rat_lt(tol, rat_abs(y)) ) {
+				model->kind[e]   = COMP_RESISTOR;
+				model->term_a[e] = t + 1;
+				model->term_b[e] = u + 1;
+				model->val[e++]  = rat_neg(rat_recip(y));
+			}
+		}
+		if( rat_lt(tol, rat_abs(sum)) ) {
+			model->kind[e]   = COMP_RESISTOR;
+			model->term_a[e] = t + 1;
+			model->term_b[e] = GND_IDX;
+			model->val[e++]  = rat_recip(sum);
+		}
+		if( rat_cmp(model->J[t], rat_zero()) != 0 ) {
+			model->kind[e]   = COMP_DC_CURRENT_SRC;
+			model->term_a[e] = GND_IDX;
+			model->term_b[e] = t + 1;
+			model->val[e++]  = model->J[t];
+		}
+	}
+	model->elem_count = e;
+	model->next = c->macromodels;
+	c->macromodels = model;
+	if( out != NULL ) {
+		*out = model;
+	}
+	res = ERR_OK;
+done:
+	if( res != ERR_OK ) {
+		/// a model that never got linked in doesn't keep its half-filled tables.
+		bistack_rewind(keep, mark);
+	}
+	bistack_reset_front(s);
+	return res;
+}
+
+/// Places an instance of `model` with its ports on `nodes`, recorded under `name` for
+/// `subckt_internal_voltage`. Ports may share a node or sit on ground.
+/// The equivalent network's components are flagged `macro`, they aren't parts of the netlist.
+SUBCKT_EXPORT EXTANT(1, 2, 3, 5) int circuit_add_subckt(
+	struct Circuit           *const c,
+	struct Macromodel const  *const model,
+	uint32_t                  const nodes[const],
+	size_t                    const len,
+	char                      const name[const static len],
+	struct SubcktInstance   **const out
+) {
+	struct TIBiStack *const s = &c->bistack;
+	struct SubcktInstance *inst = bistack_alloc_back(s, sizeof *inst);
+	char *copy = bistack_alloc_back(s, len + 1);
+	uint32_t *ports = bistack_alloc_back_vec(s, model->ports, sizeof *ports);
+	if( inst==NULL || copy==NULL || ports==NULL ) {
+		return ERR_OOM;
+	}
+	memcpy(copy, name, len);
+	memcpy(ports, nodes, model->ports * sizeof *ports);
+	for( uint32_t e=0; e < model->elem_count; e++ ) {
+		uint32_t const a = ( model->term_a[e]==GND_IDX )? GND_IDX : nodes[model->term_a[e] - 1];
+		uint32_t const b = ( model->term_b[e]==GND_IDX )? GND_IDX : nodes[model->term_b[e] - 1];
+		if( a==b ) {
+			continue; /// shorted by the wiring, nothing flows through it.
+		}
+		int const res = _circuit_add_component(c, a, b, model->kind[e], model->val[e], true);
+		if( res != ERR_OK ) {
+			return res;
+		}
+	}
+	*inst = (struct SubcktInstance){ .next = c->instances, .model = model, .name = copy, .len = len, .nodes = ports };
+	c->instances = inst;
+	if( out != NULL ) {
+		*out = inst;
+	}
+	return ERR_OK;
+}
+#endif
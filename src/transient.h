@@ -0,0 +1,308 @@
+#ifndef TRANSIENT_H_INCLUDED
+#	define TRANSIENT_H_INCLUDED
+
+#include "node.h"
+
+#define TRAN_EXPORT    static inline
+
+enum {
+	TRAN_BACKWARD_EULER = 0,
+	TRAN_TRAPEZOIDAL,
+};
+
+enum {
+	TRAN_HISTORY = 4, /// accepted points kept for the truncation error estimate.
+	TRAN_TRTOL   = 7, /// SPICE's allowance for how much the LTE estimate overshoots.
+};
+
+struct TranOptions {
+	rat_t   tstop, tstep, tmax; /// `tstep` seeds the first step, `tmax` caps every step (0 means tstop/50).
+	rat_t   reltol, vntol, abstol;
+	uint8_t method;             /// TRAN_*
+	bool    uic;                /// start from an all-zero state instead of the DC operating point.
+};
+
+struct TranStats {
+	uint32_t accepted, rejected;
+	uint32_t factorizations, reuses; /// steps that needed a numeric refactor vs. ones that only re-solved.
+};
+
+TRAN_EXPORT struct TranOptions tran_options(rat_t const tstop, rat_t const tstep) {
+	rat_t const milli = rat_recip(rat_from_int(1000));
+	rat_t const micro = rat_mul(milli, milli);
+	return (struct TranOptions){
+		.tstop  = tstop,
+		.tstep  = tstep,
+		.tmax   = rat_zero(),
+		.reltol = milli,
+		.vntol  = micro,
+		.abstol = rat_mul(micro, micro),
+		.method = TRAN_TRAPEZOIDAL,
+		.uic    = false,
+	};
+}
+
+/// voltage across element `e`, `V(n1) - V(n2)`.
+TRAN_EXPORT NO_NULLS rat_t _tran_vdiff(struct StampProgram const *const prog, rat_t const x[const], uint32_t const e) {
+	int32_t const a = stamp_row(prog, prog->node_a[e]), b = stamp_row(prog, prog->node_b[e]);
+	rat_t const va = ( a >= 0 )? x[a] : rat_zero();
+	rat_t const vb = ( b >= 0 )? x[b] : rat_zero();
+	return rat_sub(va, vb);
+}
+
+/// highest order divided difference over the `m+1` points `(t[i], y[i])`, `m < TRAN_HISTORY`.
+TRAN_EXPORT NO_NULLS rat_t _tran_divided_difference(size_t const m, rat_t const t[const], rat_t const y[const]) {
+	rat_t dd[TRAN_HISTORY + 1];
+	for( size_t i=0; i <= m; i++ ) {
+		dd[i] = y[i];
+	}
+	for( size_t order=1; order <= m; order++ ) {
+		for( size_t i=0; i + order <= m; i++ ) {
+			dd[i] = rat_div(rat_sub(dd[i], dd[i + 1]), rat_sub(t[i], t[i + order]));
+		}
+	}
+	return dd[0];
+}
+
+/// Refreshes the matrix for integration coefficient `alpha` and gets it factored,
+/// numerically reusing the existing pivot sequence whenever that still holds up.
+/// A fresh factorization first rewinds the front to `mark`, dropping the previous factors.
+TRAN_EXPORT NO_NULLS int _tran_factor(
+	struct Circuit      *const c,
+	struct StampProgram *const prog,
+	rat_t         const        raw[const],
+	rat_t         const        alpha,
+	rat_t                      vals[const],
+	rat_t                      rhs[const],
+	rat_t                      work[const],
+	uint32_t                   q[const],
+	struct SpLU         *const lu,
+	bool                *const have_lu,
+	struct TIBiMark      const mark
+) {
+	stamp_program_assemble(prog, raw, alpha, vals, prog->G.vals, rhs);
+	if( *have_lu && splu_refactor(lu, &prog->G, sparse_pivot_tol(), work)==SPARSE_OK ) {
+		return ERR_OK;
+	}
+	bistack_rewind_front(&c->bistack, mark);
+	*have_lu = false;
+	switch( splu_factor(&c->bistack, &prog->G, q, sparse_pivot_tol(), lu) ) {
+		case SPARSE_ERR_OOM:      return ERR_OOM;
+		case SPARSE_ERR_SINGULAR: return ERR_SINGULAR;
+	}
+	*have_lu = true;
+	return ERR_OK;
+}
+
+/// Time-domain analysis from 0 to `opt->tstop`.
+/// Capacitors and inductors become companion models (backward Euler or trapezoidal),
+/// and the step adapts to the local truncation error of their states, estimated from
+/// divided differences over the last accepted points.
+/// Step changes only cost a numeric refactorization of the same pattern, and steps of unchanged
+/// size reuse the factors outright so the work is the history update plus two triangular solves.
+/// To keep that common, a step only grows once the error allows doubling it.
+/// `probe` sees every accepted point with the full unknown vector, the node voltages
+/// of the last point end up in `c->voltage`.
+/// Diodes would need a Newton solve at every step, circuits with them fail with ERR_NONLINEAR.
+TRAN_EXPORT EXTANT(1, 2) int circuit_transient(
+	struct Circuit           *const c,
+	struct TranOptions const *const opt,
+	void                            probe(struct StampProgram const *prog, rat_t t, rat_t const x[], void *data),
+	void                           *const data,
+	struct TranStats               *const stats
+) {
+	struct TranStats local_stats = {0};
+	struct TranStats *const st = ( stats != NULL )? stats : &local_stats;
+	*st = (struct TranStats){0};
+	
+	struct TIBiStack *const s = &c->bistack;
+	struct StampProgram prog;
+	int res = circuit_compile(c, &prog);
+	if( res != ERR_OK ) {
+		goto done;
+	} else if( prog.diode_count > 0 ) {
+		res = ERR_NONLINEAR;
+		goto done;
+	}
+	res = ERR_OOM;
+	uint32_t const n  = prog.n;
+	uint32_t const nc = prog.c_end - prog.r_end;
+	uint32_t const nr = nc + (prog.l_end - prog.v_end);
+	rat_t *raw   = alloc_vec(s, prog.elem_count);
+	rat_t *vals  = alloc_vec(s, 2 * prog.elem_count);
+	rat_t *base  = alloc_vec(s, n);
+	rat_t *x     = alloc_vec(s, n);
+	rat_t *xn    = alloc_vec(s, n);
+	rat_t *work  = alloc_vec(s, n);
+	rat_t *ieq   = alloc_vec(s, nr);  /// companion source of each reactive element this step.
+	rat_t *prev  = alloc_vec(s, nr);  /// cap currents / inductor voltages at the last point, for trapezoidal.
+	rat_t *fresh = alloc_vec(s, nr);
+	uint32_t *q  = sparse_alloc_ids(s, n);
+	rat_t *hist[TRAN_HISTORY];
+	for( size_t i=0; i < TRAN_HISTORY; i++ ) {
+		hist[i] = alloc_vec(s, nr);
+		if( hist[i]==NULL ) {
+			goto done;
+		}
+	}
+	if( raw==NULL || vals==NULL || base==NULL || x==NULL || xn==NULL || work==NULL
+	 || ieq==NULL || prev==NULL || fresh==NULL || q==NULL ) {
+		goto done;
+	}
+	stamp_program_load(&prog, raw);
+	circuit_order(c, &prog, q);
+	
+	struct SpLU lu;
+	bool have_lu = false;
+	struct TIBiMark const lu_mark = bistack_mark(s); /// everything past here is factors.
+	if( !opt->uic ) {
+		res = _tran_factor(c, &prog, raw, rat_zero(), vals, x, work, q, &lu, &have_lu, lu_mark);
+		if( res != ERR_OK ) {
+			goto done;
+		}
+		splu_solve(&lu, x, work);
+	}
+	
+	/// states: capacitor voltages, then inductor currents.
+	rat_t times[TRAN_HISTORY];
+	size_t points = 1;
+	times[0] = rat_zero();
+	for( uint32_t r=0; r < nr; r++ ) {
+		bool const is_cap = r < nc;
+		uint32_t const e = is_cap? prog.r_end + r : prog.v_end + (r - nc);
+		hist[0][r] = is_cap? _tran_vdiff(&prog, x, e) : x[prog.node_rows + (e - prog.i_end)];
+		prev[r] = rat_zero();
+	}
+	if( probe != NULL ) {
+		probe(&prog, rat_zero(), x, data);
+	}
+	
+	bool const trap = opt->method==TRAN_TRAPEZOIDAL;
+	size_t const order = trap? 2 : 1;
+	rat_t const two   = rat_from_int(2);
+	rat_t const tmax  = rat_lt(rat_zero(), opt->tmax)? opt->tmax : rat_div(opt->tstop, rat_from_int(50));
+	rat_t const milli = rat_recip(rat_from_int(1000));
+	rat_t const hmin  = rat_mul(opt->tstop, rat_mul(milli, rat_mul(milli, milli)));
+	rat_t const lte_scale = trap? rat_recip(two) : rat_pos1();
+	rat_t h = rat_div(rat_lt(rat_zero(), opt->tstep)? rat_min(opt->tstep, tmax) : tmax, rat_from_int(10));
+	rat_t h_factored = rat_zero();
+	rat_t t = rat_zero();
+	while( rat_lt(rat_add(t, hmin), opt->tstop) ) {
+		if( rat_ge(rat_add(t, h), rat_sub(opt->tstop, hmin)) ) {
+			h = rat_sub(opt->tstop, t);
+		}
+		rat_t const alpha = rat_div(trap? two : rat_pos1(), h);
+		if( rat_cmp(h, h_factored) != 0 ) {
+			res = _tran_factor(c, &prog, raw, alpha, vals, base, work, q, &lu, &have_lu, lu_mark);
+			if( res != ERR_OK ) {
+				goto done;
+			}
+			h_factored = h;
+			st->factorizations++;
+		} else {
+			st->reuses++;
+		}
+		
+		/// rhs = sources + companion history.
+		memcpy(xn, base, n * sizeof *xn);
+		for( uint32_t r=0; r < nr; r++ ) {
+			bool const is_cap = r < nc;
+			uint32_t const e = is_cap? prog.r_end + r : prog.v_end + (r - nc);
+			rat_t const k = rat_mul(alpha, raw[e]);
+			ieq[r] = rat_mul(k, hist[0][r]);
+			if( trap ) {
+				ieq[r] = rat_add(ieq[r], prev[r]);
+			}
+			if( is_cap ) {
+				int32_t const a = stamp_row(&prog, prog.node_a[e]), b = stamp_row(&prog, prog.node_b[e]);
+				if( a >= 0 ) {
+					xn[a] = rat_add(xn[a], ieq[r]);
+				}
+				if( b >= 0 ) {
+					xn[b] = rat_sub(xn[b], ieq[r]);
+				}
+			} else {
+				uint32_t const row = prog.node_rows + (e - prog.i_end);
+				xn[row] = rat_add(xn[row], ieq[r]);
+			}
+		}
+		splu_solve(&lu, xn, work);
+		
+		/// truncation error: C * h^(k+1) * (k+1)! * DD_(k+1), C being 1/2 for BE and 1/12 for trapezoidal.
+		rat_t ratio = rat_zero();
+		bool const estimate = points > order;
+		for( uint32_t r=0; r < nr && estimate; r++ ) {
+			bool const is_cap = r < nc;
+			uint32_t const e = is_cap? prog.r_end + r : prog.v_end + (r - nc);
+			rat_t ts[TRAN_HISTORY + 1], ys[TRAN_HISTORY + 1];
+			ts[0] = rat_add(t, h);
+			ys[0] = is_cap? _tran_vdiff(&prog, xn, e) : xn[prog.node_rows + (e - prog.i_end)];
+			for( size_t i=0; i < order + 1; i++ ) {
+				ts[i + 1] = times[i];
+				ys[i + 1] = hist[i][r];
+			}
+			rat_t err = rat_abs(_tran_divided_difference(order + 1, ts, ys));
+			for( size_t i=0; i <= order; i++ ) {
+				err = rat_mul(err, h);
+			}
+			err = rat_mul(err, lte_scale);
+			rat_t const mag = rat_max(rat_abs(ys[0]), rat_abs(ys[1]));
+			rat_t const tol = rat_add(rat_mul(opt->reltol, mag), is_cap? opt->vntol : opt->abstol);
+			ratio = rat_max(ratio, rat_div(err, rat_mul(rat_from_int(TRAN_TRTOL), tol)));
+		}
+		/// step factor that would put the error right at tolerance, with a safety margin.
+		rat_t grow = two;
+		if( rat_lt(rat_epsilon(), ratio) ) {
+			rat_t const nine_tenths = rat_div(rat_from_int(9), rat_from_int(10));
+			grow = rat_mul(nine_tenths, rat_pow(ratio, rat_neg(rat_recip(rat_from_int(order + 1)))));
+		}
+		if( rat_lt(rat_pos1(), ratio) ) {
+			st->rejected++;
+			h = rat_mul(h, rat_max(grow, rat_recip(rat_from_int(4))));
+			if( rat_lt(h, hmin) ) {
+				res = ERR_TIMESTEP;
+				goto done;
+			}
+			continue;
+		}
+		
+		/// accept: cap currents / inductor voltages feed the next trapezoidal step.
+		for( uint32_t r=0; r < nr; r++ ) {
+			bool const is_cap = r < nc;
+			uint32_t const e = is_cap? prog.r_end + r : prog.v_end + (r - nc);
+			if( is_cap ) {
+				fresh[r] = _tran_vdiff(&prog, xn, e);
+				prev[r]  = rat_sub(rat_mul(rat_mul(alpha, raw[e]), fresh[r]), ieq[r]);
+			} else {
+				fresh[r] = xn[prog.node_rows + (e - prog.i_end)];
+				prev[r]  = _tran_vdiff(&prog, xn, e);
+			}
+		}
+		rat_t *const oldest = hist[TRAN_HISTORY - 1];
+		for( size_t i = TRAN_HISTORY - 1; i > 0; i-- ) {
+			hist[i]  = hist[i - 1];
+			times[i] = times[i - 1];
+		}
+		hist[0] = oldest;
+		memcpy(hist[0], fresh, nr * sizeof *fresh);
+		t = rat_add(t, h);
+		times[0] = t;
+		if( points < TRAN_HISTORY ) {
+			points++;
+		}
+		memcpy(x, xn, n * sizeof *x);
+		st->accepted++;
+		if( probe != NULL ) {
+			probe(&prog, t, x, data);
+		}
+		if( rat_ge(grow, two) ) {
+			h = rat_min(rat_mul(h, two), tmax);
+		}
+	}
+	stamp_program_store(&prog, c, x);
+	res = ERR_OK;
+done:
+	bistack_reset_front(s);
+	return res;
+}
+#endif
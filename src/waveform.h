@@ -0,0 +1,522 @@
+#ifndef WAVEFORM_H_INCLUDED
+#	define WAVEFORM_H_INCLUDED
+
+#include "transient.h"
+#include "crat.h"
+
+/// the calculator has no threads, blocks are written out on the solver's own thread there.
+#if !defined(TICE_H) && (defined(__unix__) || defined(__APPLE__))
+#	define WAVE_THREADS
+#	include <pthread.h>
+#endif
+
+#define WAVE_EXPORT    static inline
+
+enum {
+	WAVE_RAW = 0, /// SPICE raw: an ASCII header, then each point as native `double`s with the scale first.
+	WAVE_CSV,     /// a row of signal names, then a row of text per point.
+};
+
+enum {
+	WAVE_ERR_IO  = -2,
+	WAVE_ERR_OOM = -1,
+	WAVE_OK      =  1,
+};
+
+enum {
+	WAVE_MAX_BLOCK    = 4096, /// points per block at most, a block is what the writer thread gets at once.
+	WAVE_POINTS_FIELD = 12,   /// width the raw header's point count is padded to, so it can be patched at the end.
+	WAVE_CHUNK        = 256,  /// values converted to `double` at a time on their way into a raw file.
+};
+
+struct WaveOptions {
+	char const     *title;
+	char const     *plot;       /// the raw header's `Plotname:`, names the analysis.
+	char const     *scale;      /// name of the first column: "time", "frequency", the swept source.
+	char const     *unit;       /// the scale's raw variable type: "time", "frequency", "voltage"...
+	uint32_t const *nodes;      /// nodes to save, in this order. NULL saves every active node.
+	uint32_t        node_count;
+	uint8_t         format;     /// WAVE_*
+	bool            currents;   /// also save the branch currents of voltage sources and inductors.
+	bool            phasors;    /// complex values: `Flags: complex`, every value a real and imaginary pair.
+};
+
+/// Streams the points of an analysis to a file from a pair of blocks: the solver fills one while
+/// a writer thread converts and writes out the other, so neither text formatting nor the disk
+/// sits in the solve loop. The solver only waits when it fills a block before the last one is out.
+/// Everything lives in the memory handed to `wave_open`: the signal table, then both blocks
+/// splitting what's left. Signals are picked on the first point, once the unknowns' layout is known.
+struct WaveWriter {
+	FILE                 *file;
+	struct Circuit const *c;
+	struct WaveOptions    opt;
+	struct TIBiStack      arena;
+	int32_t              *rows;         /// unknown each signal reads, -1 for ground and nodes with nothing on them.
+	rat_t                *block[2];
+	uint32_t              signals;      /// saved signals, the scale not counted.
+	uint32_t              width;        /// values per point, the scale's included and doubled for phasors.
+	uint32_t              block_points;
+	uint32_t              fill;         /// points in the block being filled.
+	uint32_t              points;       /// points handed off so far.
+	long                  points_at;    /// file offset of the raw header's point count.
+	int                   err;          /// WAVE_*, the first failure sticks and later points are dropped.
+	uint8_t               active;       /// block the solver is filling.
+	bool                  ready;        /// signals picked and header out.
+#ifdef WAVE_THREADS
+	pthread_t             thread;
+	pthread_mutex_t       lock;
+	pthread_cond_t        cond;
+	uint32_t              pending[2];   /// points of a handed-off block left to write, 0 once it's free again.
+	int                   io_err;       /// the writer thread's failures, picked up at the next handoff.
+	bool                  started, quit;
+#endif
+};
+
+WAVE_EXPORT struct WaveOptions wave_options(uint8_t const format) {
+	return (struct WaveOptions){
+		.title      = "LiteSpiCE",
+		.plot       = "Transient Analysis",
+		.scale      = "time",
+		.unit       = "time",
+		.nodes      = NULL,
+		.node_count = 0,
+		.format     = format,
+		.currents   = true,
+		.phasors    = false,
+	};
+}
+
+#ifndef TICE_H
+/// `v * 10^k`, exact powers of ten where `double` has them.
+WAVE_EXPORT double _wave_scale10(double const v, int const k) {
+	static double const exact[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	int const a = ( k < 0 )? -k : k;
+	double const p = ( ( size_t )(a) < sizeof exact / sizeof *exact )? exact[a] : pow(10.0, a);
+	return ( k < 0 )? v / p : v * p;
+}
+
+/// `v` with 15 significant digits as `d.ddde+XX`, trailing zeros dropped. printf's `%.15g` would be
+/// most of a CSV writer's time, this is a scaling, one integer conversion and the digits.
+WAVE_EXPORT NO_NULLS size_t _wave_format(double v, char out[const static 32]) {
+	enum { DIGITS = 15 };
+	double const top = 1e15;
+	if( v != v || v - v != 0 ) {
+		return ( size_t )(snprintf(out, 32, "%g", v));
+	}
+	char *p = out;
+	if( v < 0 ) {
+		*p++ = '-';
+		v = -v;
+	}
+	if( v==0 ) {
+		*p++ = '0';
+		return ( size_t )(p - out);
+	}
+	/// log10(2) times the binary exponent, at most one short of the decimal one.
+	int bin;
+	frexp(v, &bin);
+	int exp = ( int )(floor((bin - 1) * 0.30102999566398120));
+	if( exp < -290 || exp > 290 ) {
+		return ( size_t )(p - out) + ( size_t )(snprintf(p, 31, "%.14e", v));
+	}
+	double scaled = _wave_scale10(v, DIGITS - 1 - exp);
+	if( scaled + 0.5 >= top ) {
+		exp++;
+		scaled = _wave_scale10(v, DIGITS - 1 - exp);
+	}
+	uint64_t m = ( uint64_t )(scaled + 0.5);
+	if( m >= ( uint64_t )(top) ) {
+		m = (m + 5) / 10;
+		exp++;
+	}
+	char digits[DIGITS];
+	for( int i = DIGITS - 1; i >= 0; i-- ) {
+		digits[i] = ( char )('0' + m % 10);
+		m /= 10;
+	}
+	int last = DIGITS - 1;
+	while( last > 0 && digits[last]=='0' ) {
+		last--;
+	}
+	*p++ = digits[0];
+	if( last > 0 ) {
+		*p++ = '.';
+		memcpy(p, &digits[1], ( size_t )(last));
+		p += last;
+	}
+	*p++ = 'e';
+	*p++ = ( exp < 0 )? '-' : '+';
+	unsigned const e = ( unsigned )(( exp < 0 )? -exp : exp);
+	if( e >= 100 ) {
+		*p++ = ( char )('0' + e / 100);
+	}
+	*p++ = ( char )('0' + e / 10 % 10);
+	*p++ = ( char )('0' + e % 10);
+	return ( size_t )(p - out);
+}
+#endif
+
+WAVE_EXPORT NO_NULLS bool _wave_put_value(FILE *const file, rat_t const v, char const sep) {
+	char buf[40] = {0};
+#ifdef TICE_H
+	rat_to_str(v, sizeof buf, buf);
+	size_t len = strlen(buf);
+#else
+	size_t len = _wave_format(rat_to_double(v), buf);
+#endif
+	buf[len++] = sep;
+	return fwrite(buf, 1, len, file)==len;
+}
+
+/// writes `count` points of a block, each the scale and then every signal.
+/// CSV has no use for a phasor scale's imaginary part, it only goes into raw files.
+WAVE_EXPORT NO_NULLS bool _wave_write_block(struct WaveWriter *const w, rat_t const block[const], uint32_t const count) {
+	size_t const width = w->width, len = width * count;
+	if( w->opt.format==WAVE_RAW ) {
+		double out[WAVE_CHUNK];
+		for( size_t i=0; i < len; i += WAVE_CHUNK ) {
+			size_t const k = ( len - i < WAVE_CHUNK )? len - i : WAVE_CHUNK;
+			for( size_t j=0; j < k; j++ ) {
+				out[j] = rat_to_double(block[i + j]);
+			}
+			if( fwrite(out, sizeof *out, k, w->file) != k ) {
+				return false;
+			}
+		}
+		return true;
+	}
+	for( size_t i=0; i < len; i++ ) {
+		if( w->opt.phasors && i % width==1 ) {
+			continue;
+		} else if( !_wave_put_value(w->file, block[i], ( (i + 1) % width==0 )? '\n' : ',') ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#ifdef WAVE_THREADS
+/// takes the blocks in the order they're handed off until told to quit with nothing left.
+WAVE_EXPORT void *_wave_thread(void *const arg) {
+	struct WaveWriter *const w = arg;
+	uint8_t next = 0;
+	pthread_mutex_lock(&w->lock);
+	for( ;; ) {
+		while( w->pending[next]==0 && !w->quit ) {
+			pthread_cond_wait(&w->cond, &w->lock);
+		}
+		uint32_t const count = w->pending[next];
+		if( count==0 ) {
+			break;
+		}
+		pthread_mutex_unlock(&w->lock);
+		bool const ok = _wave_write_block(w, w->block[next], count);
+		pthread_mutex_lock(&w->lock);
+		if( !ok && w->io_err==WAVE_OK ) {
+			w->io_err = WAVE_ERR_IO;
+		}
+		w->pending[next] = 0;
+		next ^= 1;
+		pthread_cond_broadcast(&w->cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+#endif
+
+/// Opens `path` for the waveform and starts the writer. `mem` holds the writer's tables and
+/// blocks for as long as it's open, a few hundred KiB keeps the blocks long.
+WAVE_EXPORT NO_NULLS int wave_open(struct WaveWriter *const w, struct Circuit const *const c, char const path[const static 1], struct WaveOptions const *const opt, void *const mem, size_t const len) {
+	*w = (struct WaveWriter){
+		.c     = c,
+		.opt   = *opt,
+		.arena = bistack_make(mem, len),
+		.err   = WAVE_OK,
+	};
+	w->file = fopen(path, "wb");
+	if( w->file==NULL ) {
+		return w->err = WAVE_ERR_IO;
+	}
+#ifdef WAVE_THREADS
+	w->io_err = WAVE_OK;
+	if( pthread_mutex_init(&w->lock, NULL) != 0 ) {
+		return WAVE_OK;
+	} else if( pthread_cond_init(&w->cond, NULL) != 0 ) {
+		pthread_mutex_destroy(&w->lock);
+		return WAVE_OK;
+	}
+	/// no thread to be had just means writing inline.
+	w->started = pthread_create(&w->thread, NULL, _wave_thread, w)==0;
+	if( !w->started ) {
+		pthread_cond_destroy(&w->cond);
+		pthread_mutex_destroy(&w->lock);
+	}
+#endif
+	return WAVE_OK;
+}
+
+WAVE_EXPORT EXTANT(1) void _wave_put_node(struct WaveWriter const *const w, uint32_t const names[const], uint32_t const node) {
+	struct Circuit const *const c = w->c;
+	if( names != NULL && node < c->node_count && names[node] != NODE_NONE ) {
+		struct NodeName const *const n = &c->names[names[node]];
+		fprintf(w->file, "%.*s", ( int )(n->len), n->name);
+	} else {
+		fprintf(w->file, "%" PRIu32, node);
+	}
+}
+
+/// node signal `k` reads: the save list's, the program's row `k`, or without a program the node its row is.
+WAVE_EXPORT EXTANT(1) uint32_t _wave_node(struct WaveWriter const *const w, struct StampProgram const *const prog, uint32_t const k) {
+	if( w->opt.nodes != NULL ) {
+		return w->opt.nodes[k];
+	} else if( prog != NULL ) {
+		return prog->matrix_to_node[k];
+	}
+	return ( uint32_t )(w->rows[k]);
+}
+
+/// name of signal `k`: `v(node)`, or `i(a:b)` for the current from `a` to `b` through a branch.
+WAVE_EXPORT EXTANT(1) void _wave_put_signal(struct WaveWriter const *const w, struct StampProgram const *const prog, uint32_t const names[const], uint32_t const k, uint32_t const node_signals) {
+	if( k < node_signals ) {
+		fputs("v(", w->file);
+		_wave_put_node(w, names, _wave_node(w, prog, k));
+	} else {
+		uint32_t const e = prog->i_end + (k - node_signals);
+		fputs("i(", w->file);
+		_wave_put_node(w, names, prog->node_a[e]);
+		fputc(':', w->file);
+		_wave_put_node(w, names, prog->node_b[e]);
+	}
+	fputc(')', w->file);
+}
+
+/// Picks the signals against the program's layout, carves out the blocks and writes the header.
+/// Without a program points come in by node, so a signal's row is its node and there are no currents.
+WAVE_EXPORT EXTANT(1) int _wave_setup(struct WaveWriter *const w, struct StampProgram const *const prog) {
+	struct TIBiStack *const s = &w->arena;
+	struct Circuit const *const c = w->c;
+	uint32_t node_signals = w->opt.node_count;
+	if( w->opt.nodes==NULL && prog != NULL ) {
+		node_signals = prog->node_rows;
+	} else if( w->opt.nodes==NULL ) {
+		node_signals = 0;
+		for( uint32_t node=1; node < c->node_count; node++ ) {
+			node_signals += circuit_node_active(c, node);
+		}
+	}
+	uint32_t const branches = ( w->opt.currents && prog != NULL )? prog->l_end - prog->i_end : 0;
+	w->signals = node_signals + branches;
+	w->width   = (w->signals + 1) * ( w->opt.phasors? 2 : 1 );
+	w->rows = bistack_alloc_front_raw(s, (( size_t )(w->signals) + 1) * sizeof *w->rows);
+	if( w->rows==NULL ) {
+		return WAVE_ERR_OOM;
+	}
+	if( w->opt.nodes==NULL && prog==NULL ) {
+		uint32_t k = 0;
+		for( uint32_t node=1; node < c->node_count; node++ ) {
+			if( circuit_node_active(c, node) ) {
+				w->rows[k++] = ( int32_t )(node);
+			}
+		}
+	} else {
+		for( uint32_t k=0; k < node_signals; k++ ) {
+			uint32_t const node = _wave_node(w, prog, k);
+			bool const active = node < c->node_count && node != GND_IDX && circuit_node_active(c, node);
+			if( prog==NULL ) {
+				w->rows[k] = active? ( int32_t )(node) : -1;
+			} else {
+				w->rows[k] = ( active && node < prog->node_count )? stamp_row(prog, node) : -1;
+			}
+		}
+	}
+	for( uint32_t k=0; k < branches; k++ ) {
+		w->rows[node_signals + k] = ( int32_t )(prog->node_rows + k);
+	}
+
+	/// names by node, dropped again before the blocks take the rest. Without room for it nodes go by number.
+	struct TIBiMark const mark = bistack_mark(s);
+	uint32_t *names = sparse_alloc_ids(s, c->node_count);
+	if( names != NULL ) {
+		for( uint32_t i=0; i < c->node_count; i++ ) {
+			names[i] = NODE_NONE;
+		}
+		for( uint32_t i=0; i < c->name_cap; i++ ) {
+			if( c->names[i].name != NULL && c->names[i].id < c->node_count ) {
+				names[c->names[i].id] = i;
+			}
+		}
+	}
+	FILE *const f = w->file;
+	if( w->opt.format==WAVE_RAW ) {
+		fprintf(f, "Title: %s\nPlotname: %s\nFlags: %s\n", w->opt.title, w->opt.plot, w->opt.phasors? "complex" : "real");
+		fprintf(f, "No. Variables: %" PRIu32 "\nNo. Points: ", w->signals + 1);
+		w->points_at = ftell(f);
+		fprintf(f, "%-*" PRIu32 "\nVariables:\n\t0\t%s\t%s\n", ( int )(WAVE_POINTS_FIELD), ( uint32_t )(0), w->opt.scale, w->opt.unit);
+		for( uint32_t k=0; k < w->signals; k++ ) {
+			fprintf(f, "\t%" PRIu32 "\t", k + 1);
+			_wave_put_signal(w, prog, names, k, node_signals);
+			fputs(( k < node_signals )? "\tvoltage\n" : "\tcurrent\n", f);
+		}
+		fputs("Binary:\n", f);
+	} else {
+		fputs(w->opt.scale, f);
+		for( uint32_t k=0; k < w->signals; k++ ) {
+			if( w->opt.phasors ) {
+				fputs(",re(", f);
+				_wave_put_signal(w, prog, names, k, node_signals);
+				fputs("),im(", f);
+				_wave_put_signal(w, prog, names, k, node_signals);
+				fputc(')', f);
+			} else {
+				fputc(',', f);
+				_wave_put_signal(w, prog, names, k, node_signals);
+			}
+		}
+		fputc('\n', f);
+	}
+	bistack_rewind_front(s, mark);
+	if( ferror(f) ) {
+		return WAVE_ERR_IO;
+	}
+
+	size_t const point_bytes = ( size_t )(w->width) * sizeof(rat_t);
+	size_t points = bistack_get_margins(s) / (2 * point_bytes + 2 * sizeof(rat_t));
+	if( points > WAVE_MAX_BLOCK ) {
+		points = WAVE_MAX_BLOCK;
+	} else if( points==0 ) {
+		return WAVE_ERR_OOM;
+	}
+	w->block_points = ( uint32_t )(points);
+	w->block[0] = bistack_alloc_front_raw(s, points * point_bytes);
+	w->block[1] = bistack_alloc_front_raw(s, points * point_bytes);
+	if( w->block[0]==NULL || w->block[1]==NULL ) {
+		return WAVE_ERR_OOM;
+	}
+	w->ready = true;
+	return WAVE_OK;
+}
+
+/// passes the filled block to the writer and moves to the other one, once that one's written out.
+WAVE_EXPORT NO_NULLS void _wave_handoff(struct WaveWriter *const w) {
+	uint32_t const count = w->fill;
+	w->points += count;
+	w->fill = 0;
+#ifdef WAVE_THREADS
+	if( w->started ) {
+		pthread_mutex_lock(&w->lock);
+		w->pending[w->active] = count;
+		pthread_cond_broadcast(&w->cond);
+		w->active ^= 1;
+		while( w->pending[w->active] != 0 ) {
+			pthread_cond_wait(&w->cond, &w->lock);
+		}
+		if( w->err==WAVE_OK ) {
+			w->err = w->io_err;
+		}
+		pthread_mutex_unlock(&w->lock);
+		return;
+	}
+#endif
+	if( !_wave_write_block(w, w->block[w->active], count) ) {
+		w->err = WAVE_ERR_IO;
+	}
+}
+
+/// slot for the next point in the block being filled, NULL once the writer has failed.
+WAVE_EXPORT EXTANT(1) rat_t *_wave_next_point(struct WaveWriter *const w, struct StampProgram const *const prog) {
+	if( w->err != WAVE_OK || (!w->ready && (w->err = _wave_setup(w, prog)) != WAVE_OK) ) {
+		return NULL;
+	}
+	return &w->block[w->active][( size_t )(w->fill) * w->width];
+}
+
+WAVE_EXPORT NO_NULLS void _wave_point_done(struct WaveWriter *const w) {
+	if( ++w->fill==w->block_points ) {
+		_wave_handoff(w);
+	}
+}
+
+/// Records one point. Fits the probes of `circuit_transient` and `circuit_plan_sweep` with the writer
+/// as their data: the saved unknowns are copied into the block being filled and the rest happens on the writer.
+/// A `phasors` writer gets them with a zero imaginary part.
+WAVE_EXPORT void wave_probe(struct StampProgram const *const prog, rat_t const t, rat_t const x[const], void *const data) {
+	struct WaveWriter *const w = data;
+	rat_t *const point = _wave_next_point(w, prog);
+	if( point==NULL ) {
+		return;
+	}
+	uint32_t const part = w->opt.phasors? 2 : 1;
+	for( uint32_t i=0; i < w->width; i++ ) {
+		point[i] = rat_zero();
+	}
+	point[0] = t;
+	for( uint32_t k=0; k < w->signals; k++ ) {
+		if( w->rows[k] >= 0 ) {
+			point[(k + 1) * part] = x[w->rows[k]];
+		}
+	}
+	_wave_point_done(w);
+}
+
+/// Records one point of phasors by node, `v[node]` as `circuit_ac_sweep` leaves each of its points,
+/// at frequency `f`. Meant for a writer opened with `phasors`, a real one keeps the real parts.
+/// A writer takes its points from this or from `wave_probe`, not both.
+WAVE_EXPORT NO_NULLS void wave_put_phasors(struct WaveWriter *const w, rat_t const f, crat_t const v[const]) {
+	rat_t *const point = _wave_next_point(w, NULL);
+	if( point==NULL ) {
+		return;
+	}
+	uint32_t const part = w->opt.phasors? 2 : 1;
+	point[0] = f;
+	if( w->opt.phasors ) {
+		point[1] = rat_zero();
+	}
+	for( uint32_t k=0; k < w->signals; k++ ) {
+		crat_t const z = ( w->rows[k] >= 0 )? v[w->rows[k]] : crat_zero();
+		point[(k + 1) * part] = z.re;
+		if( w->opt.phasors ) {
+			point[(k + 1) * part + 1] = z.im;
+		}
+	}
+	_wave_point_done(w);
+}
+
+/// Writes out what's left, stops the writer and patches the point count into a raw header.
+/// Returns WAVE_OK or the first failure since `wave_open`.
+WAVE_EXPORT NO_NULLS int wave_close(struct WaveWriter *const w) {
+	if( w->file==NULL ) {
+		return w->err;
+	}
+	if( w->ready && w->fill > 0 && w->err==WAVE_OK ) {
+		_wave_handoff(w);
+	}
+#ifdef WAVE_THREADS
+	if( w->started ) {
+		pthread_mutex_lock(&w->lock);
+		w->quit = true;
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+		pthread_join(w->thread, NULL);
+		pthread_cond_destroy(&w->cond);
+		pthread_mutex_destroy(&w->lock);
+		w->started = false;
+		if( w->err==WAVE_OK ) {
+			w->err = w->io_err;
+		}
+	}
+#endif
+	if( w->ready && w->opt.format==WAVE_RAW && w->err==WAVE_OK ) {
+		if( fseek(w->file, w->points_at, SEEK_SET) != 0 || fprintf(w->file, "%-*" PRIu32, ( int )(WAVE_POINTS_FIELD), w->points) < 0 ) {
+			w->err = WAVE_ERR_IO;
+		}
+	}
+	if( fclose(w->file) != 0 && w->err==WAVE_OK ) {
+		w->err = WAVE_ERR_IO;
+	}
+	w->file = NULL;
+	return w->err;
+}
+#endif
@@ -0,0 +1,598 @@
+/**
+ * Host regression check.
+ * Runs the built-in cases below, then solves each netlist's DC operating point with the default
+ * Newton options and compares node voltages against the expectations written into the netlist
+ * as comment cards:
+ *
+ *   *expect <node> <volts> <tolerance>
+ *
+ * Prints one line per case and netlist and exits nonzero if any of them failed.
+ *
+ *   check netlist.cir...
+ *
+ * Not part of the calculator build: `make check` compiles it with the host compiler and runs every netlist in test/.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "netlist.h"
+#include "newton.h"
+#include "plan.h"
+#include "pcg.h"
+#include "montecarlo.h"
+#include "transient.h"
+#include "image.h"
+#include "subckt.h"
+#include "sensitivity.h"
+
+
+enum {
+	CHECK_ARENA = 16 << 20,
+	CHECK_LINE  = 256,
+};
+
+/// one built-in case, `mem` is a fresh `CHECK_ARENA` bytes. Returns NULL when it passes, the failure otherwise.
+struct CheckCase {
+	char const *name;
+	char const *(*run)(uint8_t mem[]);
+};
+
+
+/// ids at the top of the range are refused instead of growing the tables forever.
+static char const *check_node_ids(uint8_t mem[]) {
+	struct Circuit c = circuit_make(mem, CHECK_ARENA);
+	if( circuit_add_component(&c, GND_IDX, MAX_NODE_ID, COMP_RESISTOR, rat_pos1()) != ERR_NODE_OOB ) {
+		return "MAX_NODE_ID accepted as a node";
+	} else if( circuit_add_component(&c, MAX_NODE_ID, GND_IDX, COMP_RESISTOR, rat_pos1()) != ERR_NODE_OOB ) {
+		return "MAX_NODE_ID accepted as the first node";
+	} else if( circuit_reserve_nodes(&c, MAX_NODE_ID + 1) ) {
+		return "reserved more than MAX_NODE_ID nodes";
+	} else if( circuit_add_component(&c, GND_IDX, MAX_NODE_ID - 1, COMP_RESISTOR, rat_pos1()) != ERR_OOM ) {
+		return "the largest id didn't run out of the arena";
+	} else if( circuit_add_component(&c, GND_IDX, 1, COMP_RESISTOR, rat_pos1()) != ERR_OK || c.node_count != 2 ) {
+		return "the circuit isn't usable after refusing an id";
+	}
+	return NULL;
+}
+
+/// `|got - want| <= tol`, the one comparison every case makes.
+static bool check_near(rat_t const got, double const want, double const tol) {
+	double const d = rat_to_double(got) - want;
+	return d <= tol && -d <= tol;
+}
+
+/// a plan whose factorization failed refactors from scratch once the values are good again.
+static char const *check_plan_recovers(uint8_t mem[]) {
+	struct Circuit c = circuit_make(mem, CHECK_ARENA);
+	struct CircuitPlan plan;
+	circuit_add_component(&c, GND_IDX, 1, COMP_DC_CURRENT_SRC, rat_pos1());
+	circuit_add_component(&c, 1, GND_IDX, COMP_RESISTOR, rat_pos1());
+	circuit_add_component(&c, 1, 2, COMP_RESISTOR, rat_pos1());
+	circuit_add_component(&c, 2, GND_IDX, COMP_RESISTOR, rat_pos1());
+	struct Comp *const r = circuit_find_component(&c, 1, GND_IDX, COMP_RESISTOR);
+	if( circuit_prepare(&c, &plan) != ERR_OK || circuit_plan_solve(&c, &plan) != ERR_OK ) {
+		return "prepare failed";
+	} else if( !check_near(c.voltage[1], 2.0 / 3.0, 1e-9) ) {
+		return "wrong first solve";
+	}
+	/// -2 ohms in parallel with the 2 ohms through node 2 cancel out: singular.
+	circuit_set_value(r, rat_from_int(-2));
+	if( circuit_plan_solve(&c, &plan) != ERR_SINGULAR ) {
+		return "singular matrix not reported";
+	} else if( plan.factored ) {
+		return "plan still claims factors after the failure";
+	}
+	circuit_set_value(r, rat_from_int(2));
+	if( circuit_plan_update(&c, &plan) != ERR_OK || !check_near(c.voltage[1], 1.0, 1e-9) ) {
+		return "update after the failure gave the wrong answer";
+	}
+	circuit_set_value(r, rat_pos1());
+	if( circuit_plan_solve(&c, &plan) != ERR_OK || !check_near(c.voltage[1], 2.0 / 3.0, 1e-9) ) {
+		return "solve after the failure gave the wrong answer";
+	}
+	return NULL;
+}
+
+/// the blocked LU, scalar and dispatched, solves what the reference `gaussian_rref` does,
+/// across sizes on both sides of a `DENSE_BLOCK` panel.
+static char const *check_dense_lu(uint8_t mem[]) {
+	struct TIBiStack s = bistack_make(mem, CHECK_ARENA);
+	struct DenseKernels const kinds[] = { dense_kernels_for(DENSE_KERNEL_SCALAR), dense_kernels() };
+	size_t const sizes[] = { 1, 2, 7, DENSE_BLOCK - 1, DENSE_BLOCK, DENSE_BLOCK + 1, 3 * DENSE_BLOCK + 5 };
+	uint32_t seed = 12345;
+	for( size_t z=0; z < sizeof sizes / sizeof *sizes; z++ ) {
+		size_t const n = sizes[z];
+		bistack_reset_front(&s);
+		rat_t    *ref = bistack_alloc_front_vec(&s, n*n, sizeof *ref);
+		rat_t    *A   = bistack_alloc_front_vec(&s, n*n, sizeof *A);
+		rat_t    *b   = bistack_alloc_front_vec(&s, n, sizeof *b);
+		rat_t    *x   = bistack_alloc_front_vec(&s, n, sizeof *x);
+		rat_t    *v   = bistack_alloc_front_vec(&s, n, sizeof *v);
+		uint32_t *piv = bistack_alloc_front_vec(&s, n, sizeof *piv);
+		if( ref==NULL || A==NULL || b==NULL || x==NULL || v==NULL || piv==NULL ) {
+			return "out of memory";
+		}
+		/// nonsymmetric with off-diagonal entries up to the diagonal's size, so rows do get swapped.
+		for( size_t i=0; i < n*n; i++ ) {
+			seed = seed * 1103515245u + 12345u;
+			ref[i] = rat_div(rat_from_int(( int )(seed >> 16 & 0xff) - 128), rat_from_int(64));
+		}
+		for( size_t i=0; i < n; i++ ) {
+			ref[idx1D(i, i, n)] = rat_add(ref[idx1D(i, i, n)], rat_from_int(( i & 1 )? -4 : 4));
+			b[i] = rat_from_int(( int )(i % 9) - 4);
+		}
+		for( size_t k=0; k < sizeof kinds / sizeof *kinds; k++ ) {
+			for( size_t i=0; i < n; i++ ) {
+				for( size_t j=0; j < n; j++ ) {
+					A[i + j*n] = ref[idx1D(i, j, n)];
+				}
+				x[i] = b[i];
+			}
+			if( !dense_lu_factor(&kinds[k], n, A, piv) ) {
+				return "dense_lu_factor refused a nonsingular matrix";
+			}
+			dense_lu_solve(&kinds[k], n, A, piv, x);
+			memcpy(A, ref, n*n * sizeof *A);
+			memcpy(v, b, n * sizeof *v);
+			gaussian_rref(n, A, v);
+			for( size_t i=0; i < n; i++ ) {
+				double const scale = 1.0 + rat_to_double(rat_abs(v[i]));
+				if( !check_near(x[i], rat_to_double(v[i]), 1e-9 * scale) ) {
+					return "LU and gaussian_rref disagree";
+				}
+			}
+		}
+	}
+	return NULL;
+}
+
+/// SPICE number syntax: scale suffixes, `mil`, and exponents that stop short.
+static char const *check_netlist_values(uint8_t mem[]) {
+	static struct { char const *text; double want; } const good[] = {
+		{ "4.7u", 4.7e-6 }, { "2meg", 2e6 }, { "2MEG", 2e6 }, { "3m", 3e-3 }, { "3mil", 76.2e-6 },
+		{ "1milohm", 25.4e-6 }, { "-1.5e-3", -1.5e-3 }, { "1e3", 1e3 }, { "10kohm", 1e4 }, { "1E+2k", 1e5 },
+	};
+	static char const *const bad[] = { "1e", "1e-", "1E+", "1ek", "k", "1.5x3" };
+	for( size_t i=0; i < sizeof good / sizeof *good; i++ ) {
+		rat_t v;
+		struct NetToken const tok = { good[i].text, ( uint32_t )(strlen(good[i].text)) };
+		if( !netlist_parse_value(tok, &v) || !check_near(v, good[i].want, 1e-12 * (good[i].want < 0? -good[i].want : good[i].want)) ) {
+			return "a valid number parsed wrong";
+		}
+	}
+	for( size_t i=0; i < sizeof bad / sizeof *bad; i++ ) {
+		rat_t v;
+		struct NetToken const tok = { bad[i], ( uint32_t )(strlen(bad[i])) };
+		if( netlist_parse_value(tok, &v) ) {
+			return "a malformed number was accepted";
+		}
+	}
+	struct Circuit c = circuit_make(mem, CHECK_ARENA);
+	struct NetlistStatus st;
+	char const text[] = "title\nV1 a 0 5\nR1 a 0 1e\n";
+	if( circuit_parse_netlist(&c, text, sizeof text - 1, &st) != NETLIST_ERR_VALUE || st.line != 3 ) {
+		return "an incomplete exponent wasn't reported on its line";
+	}
+	return NULL;
+}
+
+/// A `side` x `side` mesh of uneven resistors, every node leaking to ground and every 7th fed by a
+/// current source. Node `1 + i*side + j` sits at row `i`, column `j`. With `vsrc` a voltage source
+/// drives the first node, which CG can't take.
+static bool check_mesh(struct Circuit *const c, uint32_t const side, bool const vsrc) {
+	bool ok = true;
+	for( uint32_t i=0; i < side; i++ ) {
+		for( uint32_t j=0; j < side; j++ ) {
+			uint32_t const node = 1 + i*side + j;
+			rat_t const r = rat_from_int(( int )(1 + (i*7 + j*13) % 10));
+			if( j + 1 < side ) {
+				ok &= circuit_add_component(c, node, node + 1, COMP_RESISTOR, r)==ERR_OK;
+			}
+			if( i + 1 < side ) {
+				ok &= circuit_add_component(c, node, node + side, COMP_RESISTOR, rat_add(r, rat_pos1()))==ERR_OK;
+			}
+			ok &= circuit_add_component(c, node, GND_IDX, COMP_RESISTOR, rat_from_int(( int )(200 + node % 50)))==ERR_OK;
+			if( node % 7==0 ) {
+				ok &= circuit_add_component(c, GND_IDX, node, COMP_DC_CURRENT_SRC, rat_from_int(( int )(node % 5) + 1))==ERR_OK;
+			}
+		}
+	}
+	if( vsrc ) {
+		ok &= circuit_add_component(c, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_from_int(10))==ERR_OK;
+	}
+	return ok;
+}
+
+/// whether the node voltages of `a` and `b` agree to `tol` relative to the larger of 1 V and the voltage.
+static bool check_same_voltages(struct Circuit const *const a, rat_t const b[const], double const tol) {
+	for( uint32_t i=0; i < a->node_count; i++ ) {
+		double const want = rat_to_double(b[i]);
+		if( !check_near(a->voltage[i], want, tol * (1.0 + fabs(want))) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// every DC solver lands on the dense LU's answer, the direct ones with and without a voltage source.
+static char const *check_solvers(uint8_t mem[]) {
+	enum { SMALL = 9, LARGE = 36 };
+	static rat_t ref[LARGE*LARGE + 1];
+	static uint8_t const direct[] = { SOLVER_SPARSE, SOLVER_BANDED, SOLVER_MIXED, SOLVER_AUTO };
+	for( int vsrc=0; vsrc < 2; vsrc++ ) {
+		struct Circuit c = circuit_make(mem, CHECK_ARENA);
+		if( !check_mesh(&c, SMALL, vsrc) ) {
+			return "mesh didn't build";
+		}
+		c.solver = SOLVER_DENSE;
+		if( circuit_calc_voltages(&c) != ERR_OK ) {
+			return "dense solve failed";
+		}
+		memcpy(ref, c.voltage, c.node_count * sizeof *ref);
+		for( size_t k=0; k < sizeof direct / sizeof *direct; k++ ) {
+			c.solver = direct[k];
+			if( circuit_calc_voltages(&c) != ERR_OK || !check_same_voltages(&c, ref, 1e-9) ) {
+				return "a direct solver disagrees with dense";
+			}
+		}
+	}
+
+	/// large enough that the domain solve really splits.
+	struct Circuit c = circuit_make(mem, CHECK_ARENA);
+	if( !check_mesh(&c, LARGE, false) ) {
+		return "mesh didn't build";
+	}
+	c.solver = SOLVER_SPARSE;
+	if( circuit_calc_voltages(&c) != ERR_OK ) {
+		return "sparse solve failed";
+	}
+	memcpy(ref, c.voltage, c.node_count * sizeof *ref);
+	struct PcgOptions popt = pcg_options();
+	popt.reltol = rat_div(popt.reltol, rat_from_int(1000));
+	struct PcgResult pres;
+	for( uint8_t pre = PCG_JACOBI; pre <= PCG_IC0; pre++ ) {
+		popt.precond = pre;
+		if( circuit_calc_voltages_pcg(&c, &popt, &pres) != ERR_OK || pres.direct || !check_same_voltages(&c, ref, 1e-7) ) {
+			return "CG disagrees with sparse";
+		}
+	}
+	struct DomainOptions dopt = domain_options();
+	dopt.workers = 4;
+	struct DomainResult dres;
+	if( circuit_calc_voltages_domain(&c, &dopt, &dres) != ERR_OK || dres.direct || !check_same_voltages(&c, ref, 1e-9) ) {
+		return "the domain solve disagrees with sparse";
+	}
+	return NULL;
+}
+
+struct CheckRc {
+	uint32_t node;
+	double   tau;
+	double   worst;
+	uint32_t points;
+};
+
+/// records how far each accepted point strays from the analytic charge curve.
+static void check_rc_probe(struct StampProgram const *const prog, rat_t const t, rat_t const x[const], void *const data) {
+	struct CheckRc *const rc = data;
+	double const want = 1.0 - exp(-rat_to_double(t) / rc->tau);
+	double const got = rat_to_double(x[stamp_row(prog, rc->node)]);
+	double const err = fabs(got - want);
+	rc->worst = ( err > rc->worst )? err : rc->worst;
+	rc->points++;
+}
+
+/// a 1 V step into 1 kohm and 1 uF follows `1 - exp(-t/RC)` with either integration method.
+static char const *check_transient(uint8_t mem[]) {
+	for( uint8_t method = TRAN_BACKWARD_EULER; method <= TRAN_TRAPEZOIDAL; method++ ) {
+		struct Circuit c = circuit_make(mem, CHECK_ARENA);
+		rat_t const micro = rat_recip(rat_from_int(1000000));
+		circuit_add_component(&c, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_pos1());
+		circuit_add_component(&c, 1, 2, COMP_RESISTOR, rat_from_int(1000));
+		circuit_add_component(&c, 2, GND_IDX, COMP_CAPACITOR, micro);
+		struct TranOptions opt = tran_options(rat_mul(rat_from_int(5000), micro), micro);
+		opt.method = method;
+		opt.uic    = true;
+		struct CheckRc rc = { .node = 2, .tau = 1e-3 };
+		/// backward Euler is first order, at the default tolerances its error piles up to about 1%.
+		double const tol = ( method==TRAN_TRAPEZOIDAL )? 1e-3 : 2e-2;
+		if( circuit_transient(&c, &opt, check_rc_probe, &rc, NULL) != ERR_OK ) {
+			return "transient failed";
+		} else if( rc.points < 20 || rc.worst > tol ) {
+			return "the RC charge curve is off";
+		}
+	}
+	return NULL;
+}
+
+/// an RC low-pass over five decades: `|H| = 1/sqrt(1 + (wRC)^2)` and `arg H = -atan(wRC)`.
+static char const *check_ac(uint8_t mem[]) {
+	enum { POINTS = 5 * 4 + 1 };
+	static crat_t volts[POINTS * 3];
+	static rat_t freqs[POINTS];
+	struct Circuit c = circuit_make(mem, CHECK_ARENA);
+	circuit_add_component(&c, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_pos1());
+	circuit_add_component(&c, 1, 2, COMP_RESISTOR, rat_from_int(1000));
+	circuit_add_component(&c, 2, GND_IDX, COMP_CAPACITOR, rat_recip(rat_from_int(1000000)));
+	struct AcOptions opt = ac_options(AC_DEC, 4, rat_pos1(), rat_from_int(100000));
+	opt.in_n1 = GND_IDX;
+	opt.in_n2 = 1;
+	struct AcResult res;
+	if( ac_point_count(&opt) != POINTS || c.node_count != 3 ) {
+		return "unexpected sweep layout";
+	} else if( circuit_ac_sweep(&c, &opt, volts, freqs, &res) != ERR_OK || res.failed > 0 ) {
+		return "sweep failed";
+	}
+	for( uint32_t p=0; p < POINTS; p++ ) {
+		double const wrc = 2.0 * acos(-1.0) * rat_to_double(freqs[p]) * 1e-3;
+		crat_t const v = volts[idx1D(p, 2, c.node_count)];
+		if( !check_near(crat_abs(v), 1.0 / sqrt(1.0 + wrc*wrc), 1e-9) || !check_near(crat_arg(v), -atan(wrc), 1e-9) ) {
+			return "wrong magnitude or phase";
+		}
+	}
+	return NULL;
+}
+
+/// the same seed gives bit-identical statistics and histograms whatever the number of workers.
+static char const *check_monte_carlo(uint8_t mem[]) {
+	enum { SIDE = 5, NODES = SIDE*SIDE + 1, BINS = 16 };
+	static uint32_t const workers[] = { 1, 2, 3, 8 };
+	static struct McNodeStats stats[2][NODES];
+	static uint32_t hist[2][NODES * BINS];
+	struct McVary const vary[] = {
+		{ .n1 = NODE_NONE, .kind = COMP_RESISTOR,       .dist = MC_GAUSSIAN, .tol = rat_div(rat_pos1(), rat_from_int(10)) },
+		{ .n1 = NODE_NONE, .kind = COMP_DC_CURRENT_SRC, .dist = MC_UNIFORM,  .tol = rat_div(rat_pos1(), rat_from_int(20)) },
+	};
+	for( size_t w=0; w < sizeof workers / sizeof *workers; w++ ) {
+		struct Circuit c = circuit_make(mem, CHECK_ARENA);
+		if( !check_mesh(&c, SIDE, true) || c.node_count != NODES ) {
+			return "mesh didn't build";
+		}
+		struct McOptions const opt = { .seed = 42, .trials = 1000, .workers = workers[w], .bins = BINS, .hist_span = rat_div(rat_pos1(), rat_from_int(2)) };
+		struct McResult res;
+		size_t const slot = ( w==0 )? 0 : 1;
+		memset(hist[slot], 0, sizeof hist[slot]);
+		if( circuit_monte_carlo(&c, &opt, vary, 2, stats[slot], hist[slot], &res) != ERR_OK || res.trials != opt.trials || res.failed > 0 ) {
+			return "run failed";
+		} else if( slot > 0 && (memcmp(stats[0], stats[1], sizeof stats[0]) != 0 || memcmp(hist[0], hist[1], sizeof hist[0]) != 0) ) {
+			return "results depend on the worker count";
+		}
+	}
+	return NULL;
+}
+
+/// resistor changes folded in by Woodbury match factoring the changed circuit from scratch,
+/// past `PLAN_MAX_UPDATES` too, where the plan refactors and starts over.
+static char const *check_woodbury(uint8_t mem[]) {
+	enum { SIDE = PLAN_MAX_UPDATES + 1 };
+	struct Circuit c = circuit_make(mem, CHECK_ARENA / 2);
+	struct Circuit fresh = circuit_make(mem + CHECK_ARENA / 2, CHECK_ARENA / 2);
+	struct CircuitPlan plan;
+	if( !check_mesh(&c, SIDE, true) || !check_mesh(&fresh, SIDE, true) ) {
+		return "mesh didn't build";
+	} else if( circuit_prepare(&c, &plan) != ERR_OK || circuit_plan_solve(&c, &plan) != ERR_OK ) {
+		return "prepare failed";
+	}
+	for( uint32_t round=0; round < 2 * PLAN_MAX_UPDATES; round++ ) {
+		/// walk along the first row and down the last column, retuning one more resistor each round.
+		uint32_t const node = ( round < SIDE - 1 )? 1 + round : SIDE * (round - SIDE + 2);
+		uint32_t const next = ( round < SIDE - 1 )? node + 1 : node + SIDE;
+		rat_t const value = rat_div(rat_from_int(( int )(round % 3) + 2), rat_from_int(( int )(round % 4) + 3));
+		struct Comp *const a = circuit_find_component(&c, node, next, COMP_RESISTOR);
+		struct Comp *const b = circuit_find_component(&fresh, node, next, COMP_RESISTOR);
+		if( a==NULL || b==NULL ) {
+			return "resistor not found";
+		}
+		circuit_set_value(a, value);
+		circuit_set_value(b, value);
+		if( circuit_plan_update(&c, &plan) != ERR_OK || circuit_calc_voltages(&fresh) != ERR_OK ) {
+			return "solve failed";
+		} else if( !check_same_voltages(&c, fresh.voltage, 1e-9) ) {
+			return "the updated solution is off";
+		}
+	}
+	return NULL;
+}
+
+/// a saved image loads back to the same tables, names and operating point.
+static char const *check_image(uint8_t mem[]) {
+	static char const text[] = "image\nV1 in 0 5\nR1 in mid 1k\nR2 mid 0 2k\nR3 mid out 500\nR4 out 0 1.5k\nI1 0 out 1m\n";
+	struct Circuit c = circuit_make(mem, CHECK_ARENA / 2);
+	struct Circuit back = circuit_make(mem + CHECK_ARENA / 2, CHECK_ARENA / 2);
+	struct NetlistStatus st;
+	char path[] = "/tmp/check-image-XXXXXX";
+	int const fd = mkstemp(path);
+	if( fd < 0 ) {
+		return "no temporary file";
+	}
+	close(fd);
+	char const *why = NULL;
+	if( circuit_parse_netlist(&c, text, sizeof text - 1, &st) != NETLIST_OK || circuit_calc_voltages(&c) != ERR_OK ) {
+		why = "netlist didn't solve";
+	} else if( circuit_save_image(&c, path, true) != IMAGE_OK || circuit_load_mapped(&back, path) != IMAGE_OK ) {
+		why = "save or load failed";
+	} else if( back.node_count != c.node_count || back.name_count != c.name_count || circuit_calc_voltages(&back) != ERR_OK ) {
+		why = "the loaded circuit differs";
+	} else if( !check_same_voltages(&back, c.voltage, 1e-12) ) {
+		why = "the loaded circuit solves differently";
+	}
+	for( uint32_t i=0; why==NULL && i < c.name_cap; i++ ) {
+		struct NodeName const *const n = &c.names[i];
+		bool found = n->name==NULL;
+		for( uint32_t j=0; !found && j < back.name_cap; j++ ) {
+			struct NodeName const *const m = &back.names[j];
+			found = m->name != NULL && m->id==n->id && m->len==n->len && memcmp(m->name, n->name, n->len)==0;
+		}
+		why = found? NULL : "a node name went missing";
+	}
+	circuit_unmap(&back);
+	remove(path);
+	return why;
+}
+
+/// a reduced subcircuit drives its ports, and recovers its internal node, as the flat circuit does.
+static char const *check_subckt(uint8_t mem[]) {
+	size_t const part = CHECK_ARENA / 3;
+	struct Circuit flat = circuit_make(mem, part);
+	struct Circuit body = circuit_make(mem + part, part);
+	struct Circuit c = circuit_make(mem + 2*part, part);
+	/// ports 1 and 2, internal node 3 with a source of its own.
+	circuit_add_component(&body, 1, 3, COMP_RESISTOR, rat_from_int(1000));
+	circuit_add_component(&body, 3, 2, COMP_RESISTOR, rat_from_int(2000));
+	circuit_add_component(&body, 3, GND_IDX, COMP_RESISTOR, rat_from_int(3000));
+	circuit_add_component(&body, GND_IDX, 3, COMP_DC_CURRENT_SRC, rat_recip(rat_from_int(1000)));
+	circuit_add_component(&flat, 1, 3, COMP_RESISTOR, rat_from_int(1000));
+	circuit_add_component(&flat, 3, 2, COMP_RESISTOR, rat_from_int(2000));
+	circuit_add_component(&flat, 3, GND_IDX, COMP_RESISTOR, rat_from_int(3000));
+	circuit_add_component(&flat, GND_IDX, 3, COMP_DC_CURRENT_SRC, rat_recip(rat_from_int(1000)));
+	circuit_add_component(&flat, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_from_int(5));
+	circuit_add_component(&flat, 2, GND_IDX, COMP_RESISTOR, rat_from_int(4000));
+	struct Macromodel *model;
+	struct SubcktInstance *inst;
+	uint32_t const ports[] = { 1, 2 };
+	if( circuit_define_subckt(&c, &body, 2, 4, "cell", &model) != ERR_OK || model->internals != 1 ) {
+		return "couldn't reduce the body";
+	}
+	circuit_add_component(&c, GND_IDX, 1, COMP_VOLTAGE_SRC, rat_from_int(5));
+	circuit_add_component(&c, 2, GND_IDX, COMP_RESISTOR, rat_from_int(4000));
+	if( circuit_add_subckt(&c, model, ports, 2, "X1", &inst) != ERR_OK ) {
+		return "couldn't place the instance";
+	} else if( circuit_calc_voltages(&flat) != ERR_OK || circuit_calc_voltages(&c) != ERR_OK ) {
+		return "solve failed";
+	} else if( !check_near(c.voltage[1], rat_to_double(flat.voltage[1]), 1e-9) || !check_near(c.voltage[2], rat_to_double(flat.voltage[2]), 1e-9) ) {
+		return "port voltages differ";
+	} else if( !check_near(subckt_internal_voltage(&c, inst, 0), rat_to_double(flat.voltage[3]), 1e-9) ) {
+		return "the internal node differs";
+	}
+	return NULL;
+}
+
+/// the adjoint sensitivities match central differences of re-solving with each value nudged.
+static char const *check_sensitivity(uint8_t mem[]) {
+	static char const text[] = "sens\nV1 in 0 10\nR1 in mid 1k\nR2 mid 0 2k\nR3 mid out 500\nR4 out 0 1.5k\nI1 0 out 1m\n";
+	enum { ROWS = 8 };
+	struct SensEntry table[ROWS];
+	struct SensResult res;
+	struct NetlistStatus st;
+	struct Circuit c = circuit_make(mem, CHECK_ARENA);
+	if( circuit_parse_netlist(&c, text, sizeof text - 1, &st) != NETLIST_OK ) {
+		return "netlist didn't parse";
+	}
+	uint32_t const out = circuit_intern_node(&c, 3, "out");
+	if( circuit_sensitivity(&c, NULL, out, table, ROWS, &res) != ERR_OK || res.entries != 6 ) {
+		return "sensitivity failed";
+	}
+	for( uint32_t i=0; i < res.entries; i++ ) {
+		struct SensEntry const *const e = &table[i];
+		struct Comp *const comp = circuit_find_component(&c, e->n1, e->n2, e->kind);
+		if( comp==NULL ) {
+			return "a ranked element isn't in the circuit";
+		}
+		rat_t const h = rat_mul(e->val, rat_recip(rat_from_int(10000)));
+		circuit_set_value(comp, rat_add(e->val, h));
+		int const up = circuit_calc_voltages(&c);
+		double const v_up = rat_to_double(c.voltage[out]);
+		circuit_set_value(comp, rat_sub(e->val, h));
+		int const down = circuit_calc_voltages(&c);
+		double const v_down = rat_to_double(c.voltage[out]);
+		circuit_set_value(comp, e->val);
+		if( up != ERR_OK || down != ERR_OK ) {
+			return "a nudged circuit didn't solve";
+		}
+		double const fd = (v_up - v_down) / (2.0 * rat_to_double(h));
+		if( !check_near(e->dv, fd, 1e-6 * (1.0 + fabs(fd))) ) {
+			return "an adjoint derivative misses the finite difference";
+		}
+	}
+	return NULL;
+}
+
+static struct CheckCase const check_cases[] = {
+	{ "node ids",       check_node_ids },
+	{ "plan recovers",  check_plan_recovers },
+	{ "dense lu",       check_dense_lu },
+	{ "netlist values", check_netlist_values },
+	{ "solvers agree",  check_solvers },
+	{ "transient rc",   check_transient },
+	{ "ac low-pass",    check_ac },
+	{ "monte carlo",    check_monte_carlo },
+	{ "woodbury",       check_woodbury },
+	{ "image",          check_image },
+	{ "subcircuit",     check_subckt },
+	{ "sensitivity",    check_sensitivity },
+};
+
+
+/// compares the solved voltages against every `*expect` card of `path`, reporting each miss.
+static bool check_expectations(struct Circuit *const c, char const path[const static 1]) {
+	FILE *const file = fopen(path, "r");
+	if( file==NULL ) {
+		printf("FAIL %s: can't reopen for its expectations\n", path);
+		return false;
+	}
+	bool ok = true;
+	uint32_t expects = 0;
+	char line[CHECK_LINE];
+	while( fgets(line, sizeof line, file) != NULL ) {
+		char name[CHECK_LINE];
+		double volts, tol;
+		if( strncmp(line, "*expect", 7) != 0 ) {
+			continue;
+		} else if( sscanf(line + 7, "%255s %lf %lf", name, &volts, &tol) != 3 ) {
+			printf("FAIL %s: malformed card %s", path, line);
+			ok = false;
+			continue;
+		}
+		expects++;
+		uint32_t const node = ( strcmp(name, "0")==0 )? GND_IDX : circuit_intern_node(c, strlen(name), name);
+		double const got = ( node < c->node_count )? rat_to_double(c->voltage[node]) : 0.0;
+		if( node==NODE_NONE || !(got - volts <= tol && volts - got <= tol) ) {
+			printf("FAIL %s: v(%s) = %g, expected %g +- %g\n", path, name, got, volts, tol);
+			ok = false;
+		}
+	}
+	fclose(file);
+	if( expects==0 ) {
+		printf("FAIL %s: no *expect cards\n", path);
+		ok = false;
+	}
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	uint8_t *const mem = malloc(CHECK_ARENA);
+	if( mem==NULL ) {
+		fputs("can't allocate the arena\n", stderr);
+		return 1;
+	}
+	int failed = 0;
+	for( size_t i=0; i < sizeof check_cases / sizeof *check_cases; i++ ) {
+		memset(mem, 0, CHECK_ARENA);
+		char const *const why = check_cases[i].run(mem);
+		if( why != NULL ) {
+			printf("FAIL %s: %s\n", check_cases[i].name, why);
+			failed++;
+		} else {
+			printf("ok   %s\n", check_cases[i].name);
+		}
+	}
+	for( int i=1; i < argc; i++ ) {
+		struct Circuit c = circuit_make(mem, CHECK_ARENA);
+		struct NetlistStatus status;
+		struct NewtonOptions const opt = newton_options();
+		struct NewtonResult result;
+		int res = ERR_OK;
+		if( circuit_load_netlist(&c, argv[i], &status) != NETLIST_OK ) {
+			printf("FAIL %s:%" PRIu32 ": %s\n", argv[i], status.line, netlist_strerror(status.code));
+		} else if( (res = circuit_calc_voltages_newton(&c, &opt, &result)) != ERR_OK ) {
+			printf("FAIL %s: solve failed (%d)\n", argv[i], res);
+		} else if( check_expectations(&c, argv[i]) ) {
+			printf("ok   %s (%" PRIu32 " iterations)\n", argv[i], result.iterations);
+			continue;
+		}
+		failed++;
+	}
+	free(mem);
+	return failed > 0;
+}